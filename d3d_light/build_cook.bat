@@ -0,0 +1,15 @@
+@echo off
+pushd .build
+
+set output=cook.exe
+set entry=../src/cook.cpp
+set c_defines=/D_DEBUG /DWIN32_LEAN_AND_MEAN
+set c_flags=/I../src/ /I../src/vendor/ /permissive /std:c++17 /O2 /Zi %c_defines%
+set libs=kernel32.lib assimp-vc143-mt.lib
+set link_flags=/nologo /incremental:no /out:%output% /libpath:../src/vendor/ %libs%
+
+:BUILD
+cl.exe %entry% %c_flags% /link %link_flags%
+copy %output% ..
+
+popd
@@ -0,0 +1,11 @@
+#!/bin/sh
+# Linux build of the incremental cook (see src/cook.cpp). Needs the Assimp development package.
+mkdir -p .build
+cd .build
+
+output=cook
+entry=../src/cook.cpp
+c_flags="-I../src/ -I../src/vendor/ -std=c++17 -O2 -g -D_DEBUG"
+libs="-lassimp -lpthread"
+
+g++ $entry $c_flags -o $output $libs && cp $output ..
@@ -0,0 +1,11 @@
+#!/bin/sh
+# Linux build of the offline tools. Needs the Assimp development package.
+mkdir -p .build
+cd .build
+
+output=cooker
+entry=../src/mesh_cooker.cpp
+c_flags="-I../src/ -I../src/vendor/ -std=c++17 -O2 -g -D_DEBUG"
+libs="-lassimp"
+
+g++ $entry $c_flags -o $output $libs && cp $output ..
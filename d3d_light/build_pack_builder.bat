@@ -0,0 +1,15 @@
+@echo off
+pushd .build
+
+set output=pack_builder.exe
+set entry=../src/pack_builder.cpp
+set c_defines=/D_DEBUG /DWIN32_LEAN_AND_MEAN
+set c_flags=/I../src/ /permissive /std:c++17 /O2 /Zi %c_defines%
+set libs=kernel32.lib
+set link_flags=/nologo /incremental:no /out:%output% %libs%
+
+:BUILD
+cl.exe %entry% %c_flags% /link %link_flags%
+copy %output% ..
+
+popd
@@ -0,0 +1,10 @@
+#!/bin/sh
+# Linux build of the pack builder.
+mkdir -p .build
+cd .build
+
+output=pack_builder
+entry=../src/pack_builder.cpp
+c_flags="-I../src/ -std=c++17 -O2 -g -D_DEBUG"
+
+g++ $entry $c_flags -o $output && cp $output ..
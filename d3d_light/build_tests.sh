@@ -0,0 +1,15 @@
+#!/bin/sh
+# Linux build of the tests in tests/, one program per *_test.cpp. Runs every one of them and
+#   fails when any of them doesn't build or doesn't pass.
+mkdir -p .build
+cd .build
+
+c_flags="-I../src/ -I../tests/ -std=c++17 -O2 -g -D_DEBUG"
+libs="-lpthread"
+
+failed=0
+for entry in ../tests/*_test.cpp; do
+    output=$(basename $entry .cpp)
+    g++ $entry $c_flags -o $output $libs && ./$output || failed=1
+done
+exit $failed
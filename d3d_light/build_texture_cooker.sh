@@ -0,0 +1,11 @@
+#!/bin/sh
+# Linux build of the texture cooker.
+mkdir -p .build
+cd .build
+
+output=texture_cooker
+entry=../src/texture_cooker.cpp
+c_flags="-I../src/ -std=c++17 -O2 -g -D_DEBUG"
+libs="-lpthread"
+
+g++ $entry $c_flags -o $output $libs && cp $output ..
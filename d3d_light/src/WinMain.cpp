@@ -3,7 +3,41 @@
 #define HANDMADE_MATH_USE_RADIANS
 #include "HandmadeMath.h"
 
-#include "assimp_import.h"
+#include "scene_import.h"
+#include "mesh_blob.h"
+#include "mesh_bounds.h"
+#include "mesh_optimize.h"
+#include "vertex_quant.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "image_decode.h"
+#include "dds.h"
+#include "mip_chain.h"
+#include "material.h"
+#include "texture_streaming.h"
+#include "pack.h"
+#include "super_texture.h"
+#include "normal_map.h"
+#include "asset_loader.h"
+
+// 1: meshes are drawn from 16 byte Packed_Vertex buffers through static_packed.hlsl.
+#define USE_PACKED_VERTICES 0
+
+// 1: every material's textures are loaded, streamed and counted against the GPU budget. Nothing
+//   binds them until meshes know their material (see normal_map.h), so by default they aren't.
+#define LOAD_MATERIAL_TEXTURES 0
+
+// Video memory the streamed textures may use on top of their mip tails.
+#define TEXTURE_STREAMING_BUDGET (32 * 1024 * 1024)
+
+// Video memory everything may use (see gpu_budget.h). Past the soft limit streamed textures drop
+//   to their mip tails, creates that would cross the hard one fail.
+#define GPU_MEMORY_SOFT_BUDGET (256 * 1024 * 1024)
+#define GPU_MEMORY_HARD_BUDGET (384 * 1024 * 1024)
+
+// Time every frame may spend creating the GPU objects of finished loads (see asset_loader.h).
+#define ASSET_COMPLETE_BUDGET_MS 4.0f
+#define ASSET_MAX_REQUESTS       1024
 
 struct Camera {
     float    fov; // vertical fov
@@ -61,6 +95,17 @@ struct VS_CB0 {
     HMM_Mat4 view_matrix;
     HMM_Mat4 proj_matrix;
 };
+struct VS_PACKED_CB0 {
+    HMM_Mat4 world_matrix;
+    HMM_Mat4 view_matrix;
+    HMM_Mat4 proj_matrix;
+    HMM_Vec3 aabb_min;
+    float    pad0;
+    HMM_Vec3 aabb_extent;
+    float    pad1;
+    HMM_Vec3 base_color;
+    float    pad2;
+};
 struct PS_CB0 {
     HMM_Vec3 view_pos;
     HMM_Vec3 light_pos;
@@ -68,9 +113,535 @@ struct PS_CB0 {
     int      use_lighting;
 };
 
+// Assets come from the pack when there is one (see cook.cpp, pack_builder.cpp) and it has them,
+//   loose files are the fallback while iterating.
+#define ASSET_PACK_PATH "data\\assets.pak"
+
+static bool compile_gpu_shader_asset(Pack_File *pack, Gpu_Shader *it, char *path, int type, const D3D11_INPUT_ELEMENT_DESC *layout = NULL, uint num_layout_elements = 0)
+{
+    size_t size;
+    if (auto source = (const char *)find_pack_asset(pack, path, &size))
+        return compile_gpu_shader_source(it, source, size, path, type, layout, num_layout_elements);
+    return compile_gpu_shader(it, path, type, layout, num_layout_elements);
+}
+
+// Texture_Stream_Sink that recreates the Gpu_Image with just the resident levels. The levels
+//   of a DDS file are back to back, so they're one block starting at first_level.
+struct Streamed_Gpu_Images {
+    Gpu_Image *images;
+    uint *slots;               // streamer index -> images index
+    const char **paths;        // images index -> asset name
+    Texture_Streamer *streamer;
+};
+
+static bool set_streamed_gpu_image_levels(void *user, uint index, const Streamed_Texture *texture, uint first_level)
+{
+    auto target = (Streamed_Gpu_Images *)user;
+    Gpu_Image image;
+    if (!create_gpu_image(&image, (void *)texture->levels[first_level], get_mip_dimension(texture->width, first_level),
+                          get_mip_dimension(texture->height, first_level), texture->format, texture->num_levels - first_level,
+                          target->paths[target->slots[index]], first_level < texture->tail_level))
+        return false;
+
+    auto slot = &target->images[target->slots[index]];
+    if (slot->handle)
+        release_gpu_image(slot);
+    *slot = image;
+    return true;
+}
+
+// Gpu_Budget evictor. Only streamed images above their mip tail are evictable, they go down to it.
+static bool evict_streamed_gpu_image(void *user, const void *handle)
+{
+    auto target = (Streamed_Gpu_Images *)user;
+    for (auto i = 0; i != target->streamer->num_textures; ++i)
+        if (target->images[target->slots[i]].handle == handle)
+            return evict_streamed_texture(target->streamer, i) != 0;
+    return false;
+}
+
+/// ============ SCENE LOADING ============ ///
+// The model comes in over two rounds of asset requests (see asset_loader.h): load_scene maps the
+//   cooked blob (see mesh_cooker.cpp), or imports the source scene (see scene_import.h) when the
+//   blob is missing or was cooked by an older version, and fills everything the draw loop reads
+//   but the buffers.
+//   complete_scene then creates the mesh arena all of them share and issues a request per mesh,
+//   whose load packs its vertices and indices and whose complete uploads them into the arena, so
+//   meshes show up one by one over the next frames.
+
+struct Scene_Load;
+
+struct Mesh_Upload {
+    Scene_Load *scene;
+    uint index;
+    Cpu_Mesh mesh;          // imported with assimp, empty when the mesh is in the blob
+    Vertex *vertices;
+    uint num_vertices;
+    const void *indices;    // index_stride wide, set by prepare_mesh_upload for imported meshes
+    uint num_indices;
+    uint index_stride;
+
+    const void *vertex_data; // what goes into the vertex buffer, Packed_Vertex with USE_PACKED_VERTICES
+    uint vertex_stride;
+    void *packed_vertices;   // allocations behind vertex_data and indices, if any
+    void *packed_indices;
+};
+
+struct Scene_Load {
+    Pack_File *pack;
+    Asset_Loader *loader;
+    Mesh_Blob blob;          // mapped until every mesh is uploaded
+
+    uint num_meshes;
+    Mesh_Upload *uploads;
+    Mesh_Info *infos;
+    Mesh_Part *parts;
+    uint num_parts;
+    Meshlet *meshlets;
+    uint num_meshlets;
+    Mesh_Lod *lods;
+    uint num_lods;
+    Vertex_Quant_Params *quant;
+    Mesh_Part *draw_ranges;  // visible meshlets of the mesh being drawn, merged into DrawIndexed ranges
+    Mesh_Bounds bounds;      // around all meshes, what texture streaming measures the screen size of
+
+    Gpu_Mesh_Arena arena;    // every mesh's vertices and indices
+    Gpu_Mesh_Range *ranges;  // where each mesh is in the arena
+    uint *mesh_requests;
+    uint num_uploads_left;
+};
+
+static bool load_scene(void *user)
+{
+    auto scene = (Scene_Load *)user;
+    uint max_meshlets = 0; // per mesh, sizes the culling output
+
+    size_t blob_size;
+    const void *blob_data = find_pack_asset(scene->pack, "data\\remington\\model.mesh", &blob_size);
+    if (blob_data ? open_mesh_blob_memory(&scene->blob, blob_data, blob_size, "data\\remington\\model.mesh")
+                  : open_mesh_blob(&scene->blob, "data\\remington\\model.mesh"))
+    {
+        auto blob = &scene->blob;
+        scene->num_meshes = blob->header->num_meshes;
+        scene->uploads = (Mesh_Upload *)calloc(scene->num_meshes, sizeof(Mesh_Upload));
+        scene->infos = (Mesh_Info *)malloc(scene->num_meshes * sizeof(Mesh_Info));
+        scene->quant = (Vertex_Quant_Params *)calloc(scene->num_meshes, sizeof(Vertex_Quant_Params));
+
+        for (auto i = 0; i != scene->num_meshes; ++i)
+        {
+            scene->num_parts += blob->entries[i].num_parts;
+            scene->num_meshlets += blob->entries[i].num_meshlets;
+            scene->num_lods += blob->entries[i].num_lods;
+        }
+        scene->parts = (Mesh_Part *)malloc(scene->num_parts * sizeof(Mesh_Part));
+        scene->meshlets = (Meshlet *)malloc(scene->num_meshlets * sizeof(Meshlet));
+        scene->lods = (Mesh_Lod *)malloc(scene->num_lods * sizeof(Mesh_Lod));
+        scene->num_parts = 0;
+        scene->num_meshlets = 0;
+        scene->num_lods = 0;
+
+        for (auto i = 0; i != scene->num_meshes; ++i)
+        {
+            auto entry = &blob->entries[i];
+            auto upload = &scene->uploads[i];
+            upload->vertices = get_blob_vertices(blob, i);
+            upload->num_vertices = entry->vertex_count;
+            upload->indices = get_blob_indices(blob, i);
+            upload->num_indices = entry->index_count;
+            upload->index_stride = entry->index_stride;
+
+            scene->infos[i].first_part = scene->num_parts;
+            scene->infos[i].num_parts = entry->num_parts;
+            memcpy(&scene->parts[scene->num_parts], get_blob_parts(blob, i), entry->num_parts * sizeof(Mesh_Part));
+            scene->num_parts += entry->num_parts;
+
+            scene->infos[i].first_meshlet = scene->num_meshlets;
+            scene->infos[i].num_meshlets = entry->num_meshlets;
+            memcpy(&scene->meshlets[scene->num_meshlets], get_blob_meshlets(blob, i), entry->num_meshlets * sizeof(Meshlet));
+            scene->num_meshlets += entry->num_meshlets;
+            max_meshlets = HMM_MAX(max_meshlets, entry->num_meshlets);
+
+            scene->infos[i].first_lod = scene->num_lods;
+            scene->infos[i].num_lods = entry->num_lods;
+            memcpy(&scene->lods[scene->num_lods], get_blob_lods(blob, i), entry->num_lods * sizeof(Mesh_Lod));
+            scene->num_lods += entry->num_lods;
+
+            scene->infos[i].bounds = entry->bounds;
+        }
+    }
+    else
+    {
+        // A glTF binary source skips Assimp (see scene_import.h), so it goes first.
+        const char *source = "data\\remington\\model.glb";
+        FILE *file = fopen(source, "rb");
+        if (file)
+            fclose(file);
+        else
+            source = "data\\remington\\model.dae";
+
+        Cpu_Mesh *meshes;
+        if (!import_scene_meshes(source, &meshes, &scene->num_meshes))
+            return false;
+
+        scene->uploads = (Mesh_Upload *)calloc(scene->num_meshes, sizeof(Mesh_Upload));
+        scene->infos = (Mesh_Info *)malloc(scene->num_meshes * sizeof(Mesh_Info));
+        scene->quant = (Vertex_Quant_Params *)calloc(scene->num_meshes, sizeof(Vertex_Quant_Params));
+
+        for (auto i = 0; i != scene->num_meshes; ++i)
+        {
+            auto upload = &scene->uploads[i];
+            auto mesh = &upload->mesh;
+            *mesh = meshes[i];
+            optimize_cpu_mesh(mesh, i);
+
+            upload->vertices = mesh->vertices;
+            upload->num_vertices = mesh->num_vertices;
+            upload->num_indices = mesh->num_indices;
+            upload->index_stride = mesh->index_stride;
+
+            scene->infos[i].first_part = scene->num_parts;
+            scene->infos[i].num_parts = mesh->num_parts;
+            scene->parts = (Mesh_Part *)realloc(scene->parts, (scene->num_parts + mesh->num_parts) * sizeof(Mesh_Part));
+            memcpy(&scene->parts[scene->num_parts], mesh->parts, mesh->num_parts * sizeof(Mesh_Part));
+            scene->num_parts += mesh->num_parts;
+
+            scene->infos[i].first_meshlet = scene->num_meshlets;
+            scene->infos[i].num_meshlets = mesh->num_meshlets;
+            scene->meshlets = (Meshlet *)realloc(scene->meshlets, (scene->num_meshlets + mesh->num_meshlets) * sizeof(Meshlet));
+            memcpy(&scene->meshlets[scene->num_meshlets], mesh->meshlets, mesh->num_meshlets * sizeof(Meshlet));
+            scene->num_meshlets += mesh->num_meshlets;
+            max_meshlets = HMM_MAX(max_meshlets, mesh->num_meshlets);
+
+            scene->infos[i].first_lod = scene->num_lods;
+            scene->infos[i].num_lods = mesh->num_lods;
+            scene->lods = (Mesh_Lod *)realloc(scene->lods, (scene->num_lods + mesh->num_lods) * sizeof(Mesh_Lod));
+            memcpy(&scene->lods[scene->num_lods], mesh->lods, mesh->num_lods * sizeof(Mesh_Lod));
+            scene->num_lods += mesh->num_lods;
+
+            scene->infos[i].bounds = mesh->bounds;
+        }
+        free(meshes);
+    }
+
+    init_mesh_bounds(&scene->bounds);
+    for (auto i = 0; i != scene->num_meshes; ++i)
+    {
+        scene->uploads[i].scene = scene;
+        scene->uploads[i].index = i;
+        merge_mesh_bounds(&scene->bounds, &scene->infos[i].bounds);
+    }
+    scene->draw_ranges = (Mesh_Part *)malloc(HMM_MAX(max_meshlets, 1) * sizeof(Mesh_Part));
+    return true;
+}
+
+static bool prepare_mesh_upload(void *user)
+{
+    auto it = (Mesh_Upload *)user;
+
+#if USE_PACKED_VERTICES
+    auto quant = &it->scene->quant[it->index];
+    compute_vertex_quant_params(it->vertices, it->num_vertices, quant);
+
+    Packed_Vertex *packed = (Packed_Vertex *)malloc(it->num_vertices * sizeof(Packed_Vertex));
+    encode_packed_vertices(packed, it->vertices, it->num_vertices, quant);
+
+    auto error = measure_vertex_quant_error(it->vertices, packed, it->num_vertices, quant);
+    LOGF("Packed vertices: %u bytes -> %u bytes, max error: position %f, normal %f deg, texcoord %f\n",
+         (uint)(it->num_vertices * sizeof(Vertex)), (uint)(it->num_vertices * sizeof(Packed_Vertex)),
+         error.max_position_error, error.max_normal_degrees, error.max_texcoord_error);
+
+    it->packed_vertices = packed;
+    it->vertex_data = packed;
+    it->vertex_stride = sizeof(Packed_Vertex);
+#else
+    it->vertex_data = it->vertices;
+    it->vertex_stride = sizeof(Vertex);
+#endif
+
+    if (it->mesh.indices)
+    {
+        it->packed_indices = malloc(it->num_indices * it->index_stride);
+        pack_mesh_indices(&it->mesh, it->packed_indices);
+        it->indices = it->packed_indices;
+    }
+    return true;
+}
+
+// Frees what the upload's load made, and the blob once no upload needs it anymore.
+static void free_mesh_upload(Mesh_Upload *it)
+{
+    free(it->packed_vertices);
+    free(it->packed_indices);
+    it->packed_vertices = it->packed_indices = NULL;
+    free_cpu_mesh(&it->mesh);
+
+    if (!--it->scene->num_uploads_left)
+        close_mesh_blob(&it->scene->blob);
+}
+
+static bool complete_mesh_upload(void *user, bool loaded)
+{
+    auto it = (Mesh_Upload *)user;
+    auto scene = it->scene;
+
+    bool ready = loaded && upload_gpu_mesh(&scene->arena, &scene->ranges[it->index], it->vertex_data, it->num_vertices, it->vertex_stride,
+                                           it->indices, it->num_indices, it->index_stride);
+
+    free_mesh_upload(it);
+    return ready;
+}
+
+static bool complete_scene(void *user, bool loaded)
+{
+    auto scene = (Scene_Load *)user;
+    if (!loaded)
+        return false;
+
+    // Sized for exactly this scene. Every mesh has 16-bit indices (see index_pack.h).
+    uint num_vertices = 0, num_indices = 0;
+    for (auto i = 0; i != scene->num_meshes; ++i)
+    {
+        num_vertices += scene->uploads[i].num_vertices;
+        num_indices += scene->uploads[i].num_indices;
+    }
+#if USE_PACKED_VERTICES
+    uint vertex_stride = sizeof(Packed_Vertex);
+#else
+    uint vertex_stride = sizeof(Vertex);
+#endif
+    if (!create_gpu_mesh_arena(&scene->arena, num_vertices, vertex_stride, num_indices, sizeof(uint16_t), "data\\remington\\model.mesh"))
+        return false;
+
+    scene->ranges = (Gpu_Mesh_Range *)calloc(scene->num_meshes, sizeof(Gpu_Mesh_Range));
+    scene->mesh_requests = (uint *)malloc(scene->num_meshes * sizeof(uint));
+    scene->num_uploads_left = scene->num_meshes + 1;
+
+    for (auto i = 0; i != scene->num_meshes; ++i)
+    {
+        scene->mesh_requests[i] = request_asset_load(scene->loader, prepare_mesh_upload, complete_mesh_upload, &scene->uploads[i]);
+        if (scene->mesh_requests[i] == ASSET_NO_REQUEST)
+        {
+            LOGF("No room to load mesh %d\n", i);
+            free_mesh_upload(&scene->uploads[i]);
+        }
+    }
+
+    // The scene's own reference to the blob, the uploads close it once they're done.
+    if (!--scene->num_uploads_left)
+        close_mesh_blob(&scene->blob);
+    return true;
+}
+
+// After shutdown_asset_loader, whatever state the loads got to.
+static void free_scene(Scene_Load *scene)
+{
+    release_gpu_mesh_arena(&scene->arena);
+
+    for (auto i = 0; i != scene->num_meshes; ++i)
+    {
+        free(scene->uploads[i].packed_vertices);
+        free(scene->uploads[i].packed_indices);
+        free_cpu_mesh(&scene->uploads[i].mesh);
+    }
+    close_mesh_blob(&scene->blob);
+
+    free(scene->uploads);
+    free(scene->infos);
+    free(scene->parts);
+    free(scene->meshlets);
+    free(scene->lods);
+    free(scene->quant);
+    free(scene->draw_ranges);
+    free(scene->ranges);
+    free(scene->mesh_requests);
+    ZeroThat(scene);
+}
+
+/// ============ TEXTURE LOADING ============ ///
+// One request per texture. load_texture takes the block compressed .dds or .stex next to the
+//   source image if the texture cooker has been run, from the pack if it has it, otherwise it
+//   decodes the source image, or for an ORM map the three it's packed from, and builds the mips.
+//   complete_texture hands cooked levels to the streamer and uploads built chains whole.
+
+struct Texture_Load {
+    Pack_File *pack;
+    const char *path;
+    const char *const *orm_sources; // MATERIAL_CHANNEL_COUNT images for an ORM map that only exists cooked
+    const uchar *orm_channels;      // where they go, Material::orm_channels
+    Gpu_Image *image;
+    uint slot;                      // image's index, what stream_slots maps streamer indices to
+    Texture_Streamer *streamer;
+    uint *stream_slots;
+
+    Dds_File dds;                   // streamed from its mapped file, open until shutdown
+    uchar *stex_blocks;             // or the levels a .stex transcoded to, kept until shutdown
+    Texture_Format format;
+    uint width;
+    uint height;
+    uint num_levels;
+    const uchar *levels[STREAM_MAX_LEVELS];
+
+    Mip_Chain chain;                // or a chain built here, freed once it's uploaded
+    Texture_Format chain_format;
+};
+
+static bool load_cooked_texture(Texture_Load *it)
+{
+    char path[MAX_PATH];
+    const char *extension = strrchr(it->path, '.');
+    int length = (int)(extension - it->path);
+
+    snprintf(path, sizeof(path), "%.*s.dds", length, it->path);
+    size_t size;
+    const void *data = find_pack_asset(it->pack, path, &size);
+    if (data ? open_dds_memory(&it->dds, data, size, path) : open_dds(&it->dds, path))
+    {
+        it->format = it->dds.format;
+        it->width = it->dds.width;
+        it->height = it->dds.height;
+        it->num_levels = HMM_MIN(it->dds.num_levels, STREAM_MAX_LEVELS);
+        memcpy(it->levels, it->dds.levels, it->num_levels * sizeof(it->levels[0]));
+        return true;
+    }
+
+    snprintf(path, sizeof(path), "%.*s.stex", length, it->path);
+    Super_Texture stex;
+    data = find_pack_asset(it->pack, path, &size);
+    if (!(data ? open_super_texture_memory(&stex, data, size, path) : open_super_texture(&stex, path)))
+        return false;
+
+    size_t level_offsets[STEX_MAX_LEVELS + 1] = {};
+    for (auto l = 0; l != stex.num_levels; ++l)
+        level_offsets[l + 1] = level_offsets[l] + get_texture_level_size(stex.format, get_mip_dimension(stex.width, l), get_mip_dimension(stex.height, l));
+
+    bool transcoded = true;
+    it->stex_blocks = (uchar *)malloc(level_offsets[stex.num_levels]);
+    for (auto l = 0; l != stex.num_levels && transcoded; ++l)
+    {
+        it->levels[l] = it->stex_blocks + level_offsets[l];
+        transcoded = transcode_super_texture(&stex, l, stex.format, it->stex_blocks + level_offsets[l]);
+    }
+
+    if (transcoded)
+    {
+        it->format = stex.format;
+        it->width = stex.width;
+        it->height = stex.height;
+        it->num_levels = stex.num_levels;
+    }
+    else
+    {
+        LOGF("Failed to transcode %s\n", path);
+        free(it->stex_blocks);
+        it->stex_blocks = NULL;
+    }
+    close_super_texture(&stex);
+    return transcoded;
+}
+
+// One channel each, packed into one RGBA8 texture: 4 bytes a texel instead of three RGBA8 textures' 12.
+static bool load_orm_sources(Texture_Load *it)
+{
+    Decoded_Image maps[MATERIAL_CHANNEL_COUNT];
+    auto stats = load_images((const char **)it->orm_sources, MATERIAL_CHANNEL_COUNT, maps, 1, 1);
+    log_image_decode_stats((const char **)it->orm_sources, maps, MATERIAL_CHANNEL_COUNT, &stats);
+
+    uint width = (uint)maps[0].width, height = (uint)maps[0].height;
+    const uchar *pixels[MATERIAL_CHANNEL_COUNT];
+    bool complete = true;
+    for (auto c = 0; c != MATERIAL_CHANNEL_COUNT; ++c)
+    {
+        pixels[c] = maps[c].pixels;
+        complete = complete && maps[c].pixels && maps[c].width == (int)width && maps[c].height == (int)height;
+    }
+
+    bool result = false;
+    uchar *rgba = complete ? (uchar *)malloc((size_t)width * height * 4) : NULL;
+    if (rgba)
+    {
+        pack_orm_texture(rgba, pixels, (size_t)width * height, it->orm_channels);
+        result = generate_mip_chain(&it->chain, rgba, width, height, TEXTURE_USAGE_ORM);
+        it->chain_format = TEXTURE_FORMAT_RGBA8;
+        free(rgba);
+    }
+    else
+    {
+        LOGF("Can't pack the ORM map %s\n", it->path);
+    }
+
+    for (auto c = 0; c != MATERIAL_CHANNEL_COUNT; ++c)
+        stbi_image_free(maps[c].pixels);
+    return result;
+}
+
+// Decoded straight into level 0 of the mip chain that gets uploaded, no stbi buffer to copy out of.
+static bool load_source_image(Texture_Load *it)
+{
+    int width = 0, height = 0, channels;
+    if (!stbi_info(it->path, &width, &height, &channels) || !init_mip_chain(&it->chain, (uint)width, (uint)height))
+    {
+        LOGF("Failed to open %s\n", it->path);
+        return false;
+    }
+
+    Image_Destination destination;
+    destination.pixels = it->chain.data;
+    destination.row_pitch = (size_t)it->chain.width * 4;
+    destination.width = it->chain.width;
+    destination.height = it->chain.height;
+
+    Decoded_Image image;
+    auto stats = load_images(&it->path, 1, &image, 4, 1, &destination);
+    log_image_decode_stats(&it->path, &image, 1, &stats);
+
+    Texture_Usage usage = guess_texture_usage(it->path);
+    if (!image.pixels || !build_mip_levels(&it->chain, usage))
+    {
+        free_mip_chain(&it->chain);
+        return false;
+    }
+
+    it->chain_format = (usage == TEXTURE_USAGE_COLOR) ? TEXTURE_FORMAT_RGBA8_SRGB : TEXTURE_FORMAT_RGBA8;
+    if (usage == TEXTURE_USAGE_NORMAL)
+    {
+        // X and Y are all the shader reads, half the memory of RGBA8.
+        pack_normal_mip_chain(&it->chain);
+        it->chain_format = TEXTURE_FORMAT_RG8;
+    }
+    return true;
+}
+
+static bool load_texture(void *user)
+{
+    auto it = (Texture_Load *)user;
+    if (load_cooked_texture(it))
+        return true;
+    return it->orm_sources ? load_orm_sources(it) : load_source_image(it);
+}
+
+static bool complete_texture(void *user, bool loaded)
+{
+    auto it = (Texture_Load *)user;
+    bool ready = false;
+
+    if (loaded && it->chain.data)
+    {
+        ready = create_gpu_image(it->image, it->chain.data, it->chain.width, it->chain.height, it->chain_format, it->chain.num_levels, it->path);
+    }
+    else if (loaded)
+    {
+        it->stream_slots[it->streamer->num_textures] = it->slot;
+        ready = add_streamed_texture(it->streamer, it->format, it->width, it->height, it->levels, it->num_levels) != STREAM_NO_LEVEL;
+    }
+
+    free_mip_chain(&it->chain);
+    return ready;
+}
+
 int main() {
     initialize_win32();
     initialize_d3d();
+    set_gpu_budget_limits(&d3d.budget, GPU_MEMORY_SOFT_BUDGET, GPU_MEMORY_HARD_BUDGET);
     
     Gpu_Buffer cube_vbo, cube_ibo;
     {
@@ -112,7 +683,7 @@ int main() {
             { {  0.5f, 0.5f,  0.5f }, { 1, 1, 0 }, { 1, 1 }, { 0, -1, 0 } },
         };
 
-        unsigned int cube_indices[] = {
+        uint16_t cube_indices[] = {
             // +z
             0, 1, 2, 2, 3, 0,
             // -z
@@ -127,86 +698,91 @@ int main() {
             20, 21, 22, 22, 23, 20
         };
 
-        create_gpu_buffer(&cube_vbo, cube_vertices, 24, sizeof(Vertex), D3D11_BIND_VERTEX_BUFFER);
-        create_gpu_buffer(&cube_ibo, cube_indices, 36, sizeof(uint), D3D11_BIND_INDEX_BUFFER);
+        create_gpu_buffer(&cube_vbo, cube_vertices, 24, sizeof(Vertex), D3D11_BIND_VERTEX_BUFFER, "cube");
+        create_gpu_buffer(&cube_ibo, cube_indices, 36, sizeof(uint16_t), D3D11_BIND_INDEX_BUFFER, "cube");
     }
     
-    uint num_meshes;
-    Gpu_Buffer *mesh_buffers;
-    
-    /// MESH LOADING
-    // @TODO: This whole thing needs to be rewritten. Memory allocation is causing some kind of heap corruption, I think.
+    // Stays mapped until shutdown, streamed textures point into it.
+    Pack_File pack;
+    if (open_pack(&pack, ASSET_PACK_PATH))
+        LOGF("Using %s: %u assets\n", ASSET_PACK_PATH, pack.header->num_entries);
+
+    /// ASSET LOADING
+    // The model and its textures load on the loader threads while the main loop runs, which
+    //   completes them a few at a time (see asset_loader.h) and draws whatever is ready.
+    Asset_Loader loader;
+    init_asset_loader(&loader, ASSET_MAX_REQUESTS);
+
+    Scene_Load scene = {};
+    scene.pack = &pack;
+    scene.loader = &loader;
+    uint scene_request = request_asset_load(&loader, load_scene, complete_scene, &scene);
+
+    // Every material's albedo, normal and ORM map. The ORM maps only exist cooked (cook.cpp packs
+    //   them), without the .dds or .stex they're packed from orm_sources.
+    const char *texture_paths[] = {
+        "data\\remington\\gun_body_albedo.jpg",
+        "data\\remington\\gun_body_normal.jpg",
+        "data\\remington\\gun_body_orm.dds",
+        "data\\remington\\Scope_albedo.jpg",
+        "data\\remington\\Scope_normal.jpg",
+        "data\\remington\\Scope_orm.dds",
+    };
+    Material materials[] = {
+        { "gun_body", 0, 1, 2, { 0, 1, 2 } }, // ORM_DEFAULT_CHANNELS, what the cook packs
+        { "Scope",    3, 4, 5, { 0, 1, 2 } },
+    };
+    const char *orm_sources[][MATERIAL_CHANNEL_COUNT] = {
+        { "data\\remington\\gun_body_AO.jpg", "data\\remington\\gun_body_roughness.jpg", "data\\remington\\gun_body_metallic.jpg" },
+        { "data\\remington\\Scope_AO.jpg",    "data\\remington\\Scope_roughness.jpg",    "data\\remington\\Scope_metallic.jpg" },
+    };
+    const uint num_materials = ARRAYSIZE(materials);
+    const uint num_textures = ARRAYSIZE(texture_paths);
+    Gpu_Image textures[num_textures] = {};
+
+    // Cooked textures stream in from their mapped .dds files, which stay open until shutdown, or
+    //   from the blocks their .stex transcodes to, which are kept until then instead.
+    uint stream_slots[num_textures];
+    Texture_Streamer streamer;
+    Streamed_Gpu_Images stream_target = { textures, stream_slots, texture_paths, &streamer };
+    init_texture_streamer(&streamer, { &stream_target, set_streamed_gpu_image_levels }, TEXTURE_STREAMING_BUDGET, num_textures);
+    set_gpu_budget_evictor(&d3d.budget, evict_streamed_gpu_image, &stream_target);
+
+    // Without LOAD_MATERIAL_TEXTURES the streamer stays empty and there's nothing to release.
+    Texture_Load texture_loads[num_textures] = {};
+#if LOAD_MATERIAL_TEXTURES
+    for (auto i = 0; i != num_textures; ++i)
     {
-        Assimp::Importer importer;
-        const aiScene *scene = importer.ReadFile("data\\remington\\model.dae", aiProcess_Triangulate|aiProcess_FlipUVs|aiProcess_GenNormals);
-
-        if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+        auto load = &texture_loads[i];
+        load->pack = &pack;
+        load->path = texture_paths[i];
+        load->image = &textures[i];
+        load->slot = i;
+        load->streamer = &streamer;
+        load->stream_slots = stream_slots;
+        for (auto m = 0; m != num_materials; ++m)
         {
-            LOGF("Assimp error: %s\n", importer.GetErrorString());
-            ASSERT(NULL);
-        }
-
-        num_meshes = scene->mNumMeshes;
-        mesh_buffers = (Gpu_Buffer *)malloc((num_meshes * 2) * sizeof(Gpu_Buffer));
-        
-        for (auto i = 0; i != num_meshes; ++i)
-        {    
-            auto ai_mesh = scene->mMeshes[i];
-
-            int num_uv_channels = ai_mesh->GetNumUVChannels();
-            int num_vertices = ai_mesh->mNumVertices;
-            int num_faces = ai_mesh->mNumFaces;
-
-            // Construct vbo.
-            Gpu_Buffer *current_vbo = &mesh_buffers[i];
-
-            Vertex *vertices = (Vertex *)malloc(num_vertices * sizeof(Vertex));
-            for (auto j = 0; j != num_vertices; ++j)
-            {    
-                memcpy(vertices[j].position, &ai_mesh->mVertices[j], 3 * sizeof(float));
-                memcpy(vertices[j].normal, &ai_mesh->mNormals[j], 3 * sizeof(float));
-
-                //if (ai_mesh->mColors)
-                //    memcpy(vertices[j].color, &ai_mesh->mColors[j], 3 * sizeof(float));
-                //else {
-                //    float color[3] = { 0.5f, 0.5f, 0.5f };
-                //    memcpy(vertices[j].color, color, 3 * sizeof(float));
-                // }
-                
-                float color[3] = { 0.65f, 0.65f, 0.65f };
-                memcpy(vertices[j].color, color, 3 * sizeof(float));
-            }
-
-            create_gpu_buffer(current_vbo, vertices, num_vertices, sizeof(Vertex), D3D11_BIND_VERTEX_BUFFER);
-
-            // Construct ibo.
-            Gpu_Buffer *current_ibo = &mesh_buffers[num_meshes + i];
-            
-            uint *indices = (uint *)malloc((num_faces * 3) * sizeof(uint));
-            auto indices_index = 0;
-            
-            for (auto j = 0; j != num_faces; ++j)
+            if (materials[m].orm == i)
             {
-                ASSERT(ai_mesh->mFaces[j].mNumIndices == 3);
-
-                auto face_indices = ai_mesh->mFaces[j].mIndices;
-
-                memcpy(&indices[indices_index], &face_indices[0], 3 * sizeof(uint));
-                
-                indices_index += 3;
+                load->orm_sources = orm_sources[m];
+                load->orm_channels = materials[m].orm_channels;
             }
-
-            create_gpu_buffer(current_ibo, indices, (num_faces * 3), sizeof(uint), D3D11_BIND_INDEX_BUFFER);
-            
-            free(vertices);
-            free(indices);
         }
+        request_asset_load(&loader, load_texture, complete_texture, load);
     }
+#endif
+    bool assets_loaded = false;
+    int64_t load_start = get_clock();
     ///
     
     Gpu_Shader vs, ps;
-    ASSERT(compile_gpu_shader(&vs, "src\\shaders\\static.hlsl", D3D11_SHVER_VERTEX_SHADER));
-    ASSERT(compile_gpu_shader(&ps, "src\\shaders\\lit.hlsl", D3D11_SHVER_PIXEL_SHADER));
+    ASSERT(compile_gpu_shader_asset(&pack, &vs, "src\\shaders\\static.hlsl", D3D11_SHVER_VERTEX_SHADER));
+    ASSERT(compile_gpu_shader_asset(&pack, &ps, "src\\shaders\\lit.hlsl", D3D11_SHVER_PIXEL_SHADER));
+
+#if USE_PACKED_VERTICES
+    Gpu_Shader vs_packed;
+    ASSERT(compile_gpu_shader_asset(&pack, &vs_packed, "src\\shaders\\static_packed.hlsl", D3D11_SHVER_VERTEX_SHADER, packed_vertex_layout, ARRAYSIZE(packed_vertex_layout)));
+#endif
 
     Transform cube_tf = Transform::zero();
     Transform light_tf = Transform::zero();
@@ -216,6 +792,8 @@ int main() {
 
     int renderer_flags = 0; // 1 << 0: wireframe;
                             // 1 << 1: use_lighting;
+                            // 1 << 2: no mesh or meshlet culling;
+                            // 1 << 3: always LOD 0;
     renderer_flags |= 2;
  
     /// MAIN LOOP
@@ -238,6 +816,15 @@ int main() {
             if (get_key_down('L')) {
                 TOGGLE_BIT(renderer_flags, 2);
             }
+            if (get_key_down('M')) {
+                TOGGLE_BIT(renderer_flags, 4);
+            }
+            if (get_key_down('O')) {
+                TOGGLE_BIT(renderer_flags, 8);
+            }
+            if (get_key_down('B')) {
+                dump_gpu_budget(&d3d.budget);
+            }
             
             camera.tick(timestep);
         }
@@ -245,6 +832,16 @@ int main() {
         if (win32.quit)
             break;
 
+        /// ASSET LOADS
+        {
+            complete_asset_loads(&loader, ASSET_COMPLETE_BUDGET_MS);
+            if (!assets_loaded && are_asset_loads_done(&loader))
+            {
+                assets_loaded = true;
+                LOGF("Assets loaded in %.2fs\n", (float)(get_clock() - load_start) / (float)win32.clock_freq);
+            }
+        }
+
         // RENDERING
         {
             if (win32.resized)
@@ -288,10 +885,80 @@ int main() {
             bind_gpu_shader(&vs);
             bind_gpu_shader(&ps);
 
+#if USE_PACKED_VERTICES
+            VS_PACKED_CB0 *vs_packed_cb = (VS_PACKED_CB0 *)vs_packed.cbuffers.data[0].data;
+            vs_packed_cb->world_matrix = vs_cb->world_matrix;
+            vs_packed_cb->view_matrix = vs_cb->view_matrix;
+            vs_packed_cb->proj_matrix = vs_cb->proj_matrix;
+            vs_packed_cb->base_color = HMM_V3(0.65f, 0.65f, 0.65f);
+#endif
+
+            // The meshes share cube_tf, so one set of model space culling planes does for all of them.
+            Meshlet_Cull_Params cull_params;
+            HMM_Vec3 camera_model;
+            {
+                HMM_Mat4 model_view_proj = HMM_MulM4(vs_cb->proj_matrix, HMM_MulM4(vs_cb->view_matrix, vs_cb->world_matrix));
+                camera_model = HMM_MulM4V4(HMM_InvGeneralM4(vs_cb->world_matrix), HMM_V4V(camera.position, 1)).XYZ;
+                setup_meshlet_culling(&cull_params, &model_view_proj.Elements[0][0], camera_model.Elements);
+            }
+            float world_scale = HMM_MAX(cube_tf.scaling[0], HMM_MAX(cube_tf.scaling[1], cube_tf.scaling[2]));
+
+            // Nothing of the model to draw until the scene is in, then only the meshes whose buffers are.
+            uint num_meshes = (get_asset_state(&loader, scene_request) == ASSET_READY) ? scene.num_meshes : 0;
+
+            // There's no per-mesh material yet, so every texture is as big as the whole model.
+            {
+                Mesh_Bounds world_bounds;
+                transform_mesh_bounds(&world_bounds, &scene.bounds, &vs_cb->world_matrix.Elements[0][0]);
+                float screen_size = compute_screen_size(world_bounds.center, world_bounds.radius, camera.position.Elements,
+                                                        HMM_AngleDeg(camera.fov), d3d_viewport.Height);
+                for (auto i = 0; i != streamer.num_textures; ++i)
+                {
+                    request_texture_screen_size(&streamer, i, screen_size);
+                    mark_gpu_resource_used(&d3d.budget, textures[stream_slots[i]].handle);
+                }
+                // What got evicted stays out until there's room under the soft limit again.
+                if (!d3d.budget.over_soft)
+                    relax_texture_eviction_cap(&streamer, get_gpu_soft_headroom(&d3d.budget));
+                update_texture_streaming(&streamer);
+                update_gpu_budget(&d3d.budget);
+            }
+
+            // One bind for the whole model, meshes only differ by their offsets into the arena.
+            if (num_meshes)
+                bind_gpu_mesh_arena(&scene.arena);
+
             for (auto i = 0; i != num_meshes; ++i) {
-                bind_gpu_buffer(&mesh_buffers[i]);
-                bind_gpu_buffer(&mesh_buffers[num_meshes + i]);
-                d3d.context->DrawIndexed(mesh_buffers[num_meshes + i].element_count, 0, 0);
+                auto info = &scene.infos[i];
+                if (get_asset_state(&loader, scene.mesh_requests[i]) != ASSET_READY)
+                    continue;
+                if (!(renderer_flags & 4) && !is_mesh_visible(&info->bounds, &cull_params))
+                    continue;
+
+#if USE_PACKED_VERTICES
+                vs_packed_cb->aabb_min = HMM_V3(scene.quant[i].aabb_min[0], scene.quant[i].aabb_min[1], scene.quant[i].aabb_min[2]);
+                vs_packed_cb->aabb_extent = HMM_V3(scene.quant[i].aabb_extent[0], scene.quant[i].aabb_extent[1], scene.quant[i].aabb_extent[2]);
+                bind_gpu_shader(&vs_packed);
+#endif
+
+                auto lod = &scene.lods[info->first_lod];
+                if (!(renderer_flags & 8)) {
+                    auto bounds = &info->bounds;
+                    float distance = HMM_LenV3(HMM_SubV3(camera_model, HMM_V3(bounds->center[0], bounds->center[1], bounds->center[2]))) - bounds->radius;
+                    lod += select_mesh_lod(lod, info->num_lods, world_scale, distance * world_scale, camera.view_plane_distance[0],
+                                           HMM_AngleDeg(camera.fov), d3d_viewport.Height);
+                }
+
+                Mesh_Part *ranges = &scene.parts[info->first_part + lod->first_part];
+                uint num_ranges = lod->num_parts;
+                if (!(renderer_flags & 4)) {
+                    ranges = scene.draw_ranges;
+                    num_ranges = cull_meshlets(&scene.meshlets[info->first_meshlet + lod->first_meshlet], lod->num_meshlets, &cull_params, scene.draw_ranges);
+                }
+
+                auto range = &scene.ranges[i];
+                for (auto j = 0; j != num_ranges; ++j)
+                    d3d.context->DrawIndexed(ranges[j].index_count, range->first_index + ranges[j].first_index, range->first_vertex + ranges[j].base_vertex);
             }
             //bind_gpu_buffer(cube_vbo);
             //bind_gpu_buffer(cube_ibo);
@@ -319,8 +986,21 @@ int main() {
         }
     }
 
-    release_gpu_buffers(mesh_buffers, 2 * num_meshes);
+    shutdown_asset_loader(&loader);
+    free_scene(&scene);
+
+    shutdown_texture_streamer(&streamer);
+    for (auto i = 0; i != num_textures; ++i) {
+        if (textures[i].handle)
+            release_gpu_image(&textures[i]);
+        close_dds(&texture_loads[i].dds);
+        free(texture_loads[i].stex_blocks);
+    }
+    close_pack(&pack);
     
+#if USE_PACKED_VERTICES
+    release_gpu_shader(&vs_packed);
+#endif
     release_gpu_shader(&ps);
     release_gpu_shader(&vs);
     release_gpu_buffer(&cube_ibo);
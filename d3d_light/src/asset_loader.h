@@ -0,0 +1,206 @@
+#ifndef _ASSET_LOADER_H_
+#define _ASSET_LOADER_H_
+#include "stdafx.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+/// ============ ASSET LOADING ============ ///
+// Loads are requests that run in two steps, so the main loop keeps going while assets come in:
+//   load      on one of the loader threads: file reads, parsing, decoding, cooking. No GPU.
+//   complete  on the thread calling complete_asset_loads, which for D3D11 is the one owning the
+//             immediate context: creating the GPU objects out of what load left behind.
+// complete_asset_loads runs at a fixed point of every frame and completes loads in the order they
+//   finished until the frame's budget is spent, but always at least one so nothing starves. A
+//   complete step may issue new requests, e.g. one per mesh of a scene, which spreads the uploads
+//   of a big load over several frames.
+// get_asset_state is what the draw loop checks to skip whatever isn't ready yet. States only
+//   change on the completing thread, so they need no locking.
+
+#define ASSET_NO_REQUEST (~0u)
+
+enum Asset_State {
+    ASSET_PENDING, // queued or loading
+    ASSET_LOADED,  // load is done, complete hasn't run yet
+    ASSET_READY,
+    ASSET_FAILED,
+};
+
+// Returns false on failure. user is whatever was passed to request_asset_load.
+typedef bool (*Asset_Load_Func)(void *user);
+// loaded is what load returned, returns whether the asset is usable. Also called with loaded
+//   false for loads that finished but never got completed by shutdown, to free what load made.
+typedef bool (*Asset_Complete_Func)(void *user, bool loaded);
+
+struct Asset_Request
+{
+    Asset_Load_Func load;         // NULL: nothing to do off the main thread
+    Asset_Complete_Func complete; // NULL: ready as soon as it's loaded
+    void *user;
+    Asset_State state;
+    bool loaded;                  // written by the loader thread before the request shows up in done
+};
+
+struct Asset_Worker_Pool
+{
+    std::thread *threads;
+    uint num_threads;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool quit;
+
+    uint num_queued;  // requests [0, num_queued) have been handed to the pool, in order
+    uint next_queued; // next one a thread picks up
+    uint *done;       // requests whose load finished, in the order they did
+    uint num_done;
+};
+
+struct Asset_Loader
+{
+    Asset_Request *requests;
+    uint num_requests;
+    uint max_requests;
+    uint num_completed; // done[0, num_completed) are completed
+
+    Asset_Worker_Pool *pool;
+
+    float last_complete_ms; // spent in complete_asset_loads on its last call
+};
+
+/// -- Loader threads
+static void run_asset_worker(Asset_Loader *loader)
+{
+    auto pool = loader->pool;
+    std::unique_lock<std::mutex> lock(pool->mutex);
+
+    for (;;)
+    {
+        pool->wake.wait(lock, [pool] { return pool->quit || pool->next_queued != pool->num_queued; });
+        if (pool->quit)
+            return;
+
+        uint index = pool->next_queued++;
+        auto request = &loader->requests[index];
+
+        lock.unlock();
+        bool loaded = request->load ? request->load(request->user) : true;
+        lock.lock();
+
+        request->loaded = loaded;
+        pool->done[pool->num_done++] = index;
+    }
+}
+
+/// -- Loader
+// num_threads == 0: one per core but the calling thread's.
+void init_asset_loader(Asset_Loader *it, uint max_requests, uint num_threads = 0)
+{
+    ZeroThat(it);
+    it->max_requests = max_requests;
+    it->requests = (Asset_Request *)calloc(max_requests, sizeof(Asset_Request));
+
+    if (!num_threads)
+    {
+        uint num_cores = std::thread::hardware_concurrency();
+        num_threads = (num_cores > 1) ? num_cores - 1 : 1;
+    }
+
+    it->pool = new Asset_Worker_Pool();
+    it->pool->done = (uint *)calloc(max_requests, sizeof(uint));
+    it->pool->num_threads = num_threads;
+    it->pool->threads = new std::thread[num_threads];
+    for (auto i = 0; i != num_threads; ++i)
+        it->pool->threads[i] = std::thread(run_asset_worker, it);
+}
+
+// Loads that haven't started are dropped, running ones are waited for, and finished ones that
+//   never got completed are completed with loaded == false so they can free what they made.
+void shutdown_asset_loader(Asset_Loader *it)
+{
+    auto pool = it->pool;
+    {
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        pool->quit = true;
+    }
+    pool->wake.notify_all();
+    for (auto i = 0; i != pool->num_threads; ++i)
+        pool->threads[i].join();
+
+    for (auto i = it->num_completed; i != pool->num_done; ++i)
+    {
+        auto request = &it->requests[pool->done[i]];
+        if (request->complete)
+            request->complete(request->user, false);
+    }
+
+    delete[] pool->threads;
+    free(pool->done);
+    delete pool;
+    free(it->requests);
+    ZeroThat(it);
+}
+
+// Queues a load, returns its handle for get_asset_state, or ASSET_NO_REQUEST when full.
+uint request_asset_load(Asset_Loader *it, Asset_Load_Func load, Asset_Complete_Func complete, void *user)
+{
+    if (it->num_requests == it->max_requests)
+        return ASSET_NO_REQUEST;
+
+    uint index = it->num_requests++;
+    auto request = &it->requests[index];
+    request->load = load;
+    request->complete = complete;
+    request->user = user;
+    request->state = ASSET_PENDING;
+    request->loaded = false;
+
+    {
+        std::lock_guard<std::mutex> lock(it->pool->mutex);
+        it->pool->num_queued = it->num_requests;
+    }
+    it->pool->wake.notify_one();
+    return index;
+}
+
+Asset_State get_asset_state(const Asset_Loader *it, uint request)
+{
+    return (request < it->num_requests) ? it->requests[request].state : ASSET_FAILED;
+}
+
+// Every request has been completed, one way or the other.
+bool are_asset_loads_done(const Asset_Loader *it)
+{
+    return it->num_completed == it->num_requests;
+}
+
+// Completes finished loads for up to budget_ms (at least one). Call once a frame.
+void complete_asset_loads(Asset_Loader *it, float budget_ms)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    uint num_done;
+    {
+        std::lock_guard<std::mutex> lock(it->pool->mutex);
+        num_done = it->pool->num_done;
+    }
+
+    // done[] only grows and is only written past num_done, which was read under the lock.
+    for (auto i = it->num_completed; i != num_done; ++i)
+        it->requests[it->pool->done[i]].state = ASSET_LOADED;
+
+    while (it->num_completed != num_done)
+    {
+        auto request = &it->requests[it->pool->done[it->num_completed++]];
+        bool ready = request->complete ? request->complete(request->user, request->loaded) : request->loaded;
+        request->state = ready ? ASSET_READY : ASSET_FAILED;
+
+        if (std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count() >= budget_ms)
+            break;
+    }
+
+    it->last_complete_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+#endif
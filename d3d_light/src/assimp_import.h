@@ -7,4 +7,34 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+#define ASSIMP_IMPORT_FLAGS (aiProcess_Triangulate|aiProcess_FlipUVs|aiProcess_GenNormals)
+
+// Copies an aiMesh into a Cpu_Mesh. Shared between the runtime loader and the offline cooker.
+void import_ai_mesh(Cpu_Mesh *it, const aiMesh *ai_mesh)
+{
+    ZeroThat(it);
+    it->num_vertices = ai_mesh->mNumVertices;
+    it->num_indices = ai_mesh->mNumFaces * 3;
+    it->vertices = (Vertex *)calloc(it->num_vertices, sizeof(Vertex));
+    it->indices = (uint *)malloc(it->num_indices * sizeof(uint));
+
+    for (auto j = 0; j != it->num_vertices; ++j)
+    {
+        memcpy(it->vertices[j].position, &ai_mesh->mVertices[j], 3 * sizeof(float));
+        memcpy(it->vertices[j].normal, &ai_mesh->mNormals[j], 3 * sizeof(float));
+
+        if (ai_mesh->HasTextureCoords(0))
+            memcpy(it->vertices[j].texcoord, &ai_mesh->mTextureCoords[0][j], 2 * sizeof(float));
+
+        float color[3] = { 0.65f, 0.65f, 0.65f };
+        memcpy(it->vertices[j].color, color, 3 * sizeof(float));
+    }
+
+    for (auto j = 0; j != ai_mesh->mNumFaces; ++j)
+    {
+        ASSERT(ai_mesh->mFaces[j].mNumIndices == 3);
+        memcpy(&it->indices[j * 3], &ai_mesh->mFaces[j].mIndices[0], 3 * sizeof(uint));
+    }
+}
+
 #endif
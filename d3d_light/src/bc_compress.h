@@ -0,0 +1,1171 @@
+#ifndef _BC_COMPRESS_H_
+#define _BC_COMPRESS_H_
+#include "stdafx.h"
+
+#include <math.h>
+#include <float.h>
+#include <atomic>
+#include <thread>
+
+#include "texture_format.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BC_USE_SSE 1
+#include <emmintrin.h>
+#endif
+
+/// ============ BLOCK COMPRESSION ============ ///
+// CPU encoders and decoders for the block formats in texture_format.h. Every encoder works
+//   on one 4x4 block of RGBA8 pixels at a time:
+//   - BC1: principal axis fit of the colors, then least squares refinement of the endpoints
+//   - BC4: min/max fit in 8-value mode, then least squares refinement
+//   - BC3: BC4 for alpha + BC1 for color, BC5: BC4 for red + BC4 for green
+//   - BC7: mode 6 only (one subset, 7.7.7.7 endpoints + p-bits, 4-bit indices), which is
+//     the mode most encoders settle on for smooth, opaque albedo anyway
+// The decoders exist so the cooker can report PSNR and the super texture can transcode. The BC7
+//   one decodes every mode, so .dds files from other tools go through it too.
+//
+// Blocks are independent, so compress_texture hands out rows of blocks to one thread per core.
+//
+// With SSE2 the loops that run per pixel go 4 wide: the covariance and projection of the
+//   principal axis fit, the least squares sums, and the index search, which tries every palette
+//   entry for every pixel and is most of the time. The search packs each squared distance with
+//   its palette index into one integer, so a min over those picks the same entry the scalar
+//   loop does, lowest index on ties. Both paths produce the same blocks bit for bit.
+
+#define BC_REFINE_ITERATIONS 2
+
+// Makes the SSE2 builds take the scalar loops too, for texture_cooker -benchmark.
+static bool bc_disable_sse = false;
+
+static inline int bc_clamp(int v, int lo, int hi)
+{
+    return (v < lo) ? lo : (v > hi) ? hi : v;
+}
+
+// Gathers the 4x4 block at (bx, by), replicating the last row/column on partial blocks.
+static void get_texture_block(const uchar *rgba, uint width, uint height, uint bx, uint by, uchar *out)
+{
+    for (auto y = 0; y != 4; ++y)
+    {
+        uint sy = (by * 4 + y < height) ? by * 4 + y : height - 1;
+        for (auto x = 0; x != 4; ++x)
+        {
+            uint sx = (bx * 4 + x < width) ? bx * 4 + x : width - 1;
+            memcpy(&out[(y * 4 + x) * 4], &rgba[((size_t)sy * width + sx) * 4], 4);
+        }
+    }
+}
+
+static void put_texture_block(uchar *rgba, uint width, uint height, uint bx, uint by, const uchar *block)
+{
+    for (auto y = 0; y != 4 && by * 4 + y < height; ++y)
+        for (auto x = 0; x != 4 && bx * 4 + x < width; ++x)
+            memcpy(&rgba[((size_t)(by * 4 + y) * width + (bx * 4 + x)) * 4], &block[(y * 4 + x) * 4], 4);
+}
+
+#if BC_USE_SSE
+// Lanes of b where a < b is false, a elsewhere. Both hold non-negative keys.
+static inline __m128i bc_min_epi32(__m128i a, __m128i b)
+{
+    __m128i a_less = _mm_cmplt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(a_less, a), _mm_andnot_si128(a_less, b));
+}
+
+static inline uint bc_horizontal_min(__m128i keys)
+{
+    keys = bc_min_epi32(keys, _mm_shuffle_epi32(keys, _MM_SHUFFLE(1, 0, 3, 2)));
+    keys = bc_min_epi32(keys, _mm_shuffle_epi32(keys, _MM_SHUFFLE(2, 3, 0, 1)));
+    return (uint)_mm_cvtsi128_si32(keys);
+}
+
+static inline __m128 bc_splat(__m128 v, int lane)
+{
+    switch (lane)
+    {
+        case 0: return _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0));
+        case 1: return _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1));
+        case 2: return _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2));
+        default: return _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3));
+    }
+}
+#endif
+
+// Mean and covariance of 16 points of 4 components. Unused components have to be 0.
+static void get_block_covariance(const float *points, float *mean, float covariance[4][4])
+{
+#if BC_USE_SSE
+    if (!bc_disable_sse)
+    {
+        __m128 sum = _mm_setzero_ps();
+        for (auto i = 0; i != 16; ++i)
+            sum = _mm_add_ps(sum, _mm_loadu_ps(&points[i * 4]));
+        __m128 m = _mm_div_ps(sum, _mm_set1_ps(16.0f));
+        _mm_storeu_ps(mean, m);
+
+        // Row a is d[a] * d, the same products the scalar loop sums, in the same order.
+        __m128 rows[4] = { _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps() };
+        for (auto i = 0; i != 16; ++i)
+        {
+            __m128 d = _mm_sub_ps(_mm_loadu_ps(&points[i * 4]), m);
+            for (auto a = 0; a != 4; ++a)
+                rows[a] = _mm_add_ps(rows[a], _mm_mul_ps(d, bc_splat(d, a)));
+        }
+        for (auto a = 0; a != 4; ++a)
+            _mm_storeu_ps(covariance[a], rows[a]);
+        return;
+    }
+#endif
+
+    for (auto k = 0; k != 4; ++k)
+    {
+        mean[k] = 0.0f;
+        for (auto i = 0; i != 16; ++i)
+            mean[k] += points[i * 4 + k];
+        mean[k] /= 16.0f;
+    }
+
+    memset(covariance, 0, 16 * sizeof(float));
+    for (auto i = 0; i != 16; ++i)
+        for (auto a = 0; a != 4; ++a)
+            for (auto b = 0; b != 4; ++b)
+                covariance[a][b] += (points[i * 4 + b] - mean[b]) * (points[i * 4 + a] - mean[a]);
+}
+
+// Principal axis of 16 points of 4 components, by power iteration. Unused components have to
+//   be 0. Returns false if all points are the same.
+static bool get_principal_axis(const float *points, float *mean, float *axis)
+{
+    float covariance[4][4];
+    get_block_covariance(points, mean, covariance);
+
+    // Start from the row of the most varying component, it can't be orthogonal to the axis.
+    uint start = 0;
+    for (auto k = 1; k != 4; ++k)
+        if (covariance[k][k] > covariance[start][start])
+            start = k;
+
+    if (covariance[start][start] <= 0.0f)
+    {
+        for (auto k = 0; k != 4; ++k)
+            axis[k] = 0.0f;
+        return false;
+    }
+
+    for (auto k = 0; k != 4; ++k)
+        axis[k] = covariance[start][k];
+
+    for (auto iteration = 0; iteration != 8; ++iteration)
+    {
+        float next[4] = {};
+        float length = 0.0f;
+        for (auto a = 0; a != 4; ++a)
+        {
+            for (auto b = 0; b != 4; ++b)
+                next[a] += covariance[a][b] * axis[b];
+            length += next[a] * next[a];
+        }
+
+        length = sqrtf(length);
+        if (length == 0.0f)
+            break;
+        for (auto k = 0; k != 4; ++k)
+            axis[k] = next[k] / length;
+    }
+
+    return true;
+}
+
+// Endpoints e0 and e1 of the points' extent along the axis through mean: e0 at the low end.
+static void get_axis_endpoints(const float *points, const float *mean, const float *axis, float *e0, float *e1)
+{
+    float t_min = FLT_MAX, t_max = -FLT_MAX;
+#if BC_USE_SSE
+    if (!bc_disable_sse)
+    {
+        // 4 points at a time, transposed so each lane sums its own point in component order.
+        __m128 m[4], a[4];
+        for (auto k = 0; k != 4; ++k)
+        {
+            m[k] = _mm_set1_ps(mean[k]);
+            a[k] = _mm_set1_ps(axis[k]);
+        }
+
+        __m128 lo = _mm_set1_ps(FLT_MAX), hi = _mm_set1_ps(-FLT_MAX);
+        for (auto i = 0; i != 16; i += 4)
+        {
+            __m128 x = _mm_loadu_ps(&points[i * 4]);
+            __m128 y = _mm_loadu_ps(&points[i * 4 + 4]);
+            __m128 z = _mm_loadu_ps(&points[i * 4 + 8]);
+            __m128 w = _mm_loadu_ps(&points[i * 4 + 12]);
+            _MM_TRANSPOSE4_PS(x, y, z, w);
+
+            __m128 t = _mm_mul_ps(_mm_sub_ps(x, m[0]), a[0]);
+            t = _mm_add_ps(t, _mm_mul_ps(_mm_sub_ps(y, m[1]), a[1]));
+            t = _mm_add_ps(t, _mm_mul_ps(_mm_sub_ps(z, m[2]), a[2]));
+            t = _mm_add_ps(t, _mm_mul_ps(_mm_sub_ps(w, m[3]), a[3]));
+            lo = _mm_min_ps(lo, t);
+            hi = _mm_max_ps(hi, t);
+        }
+
+        float lanes_lo[4], lanes_hi[4];
+        _mm_storeu_ps(lanes_lo, lo);
+        _mm_storeu_ps(lanes_hi, hi);
+        for (auto k = 0; k != 4; ++k)
+        {
+            t_min = fminf(t_min, lanes_lo[k]);
+            t_max = fmaxf(t_max, lanes_hi[k]);
+        }
+    }
+    else
+#endif
+    {
+        for (auto i = 0; i != 16; ++i)
+        {
+            float t = (points[i * 4] - mean[0]) * axis[0];
+            for (auto k = 1; k != 4; ++k)
+                t += (points[i * 4 + k] - mean[k]) * axis[k];
+            t_min = fminf(t_min, t);
+            t_max = fmaxf(t_max, t);
+        }
+    }
+
+    for (auto k = 0; k != 4; ++k)
+    {
+        e0[k] = mean[k] + axis[k] * t_min;
+        e1[k] = mean[k] + axis[k] * t_max;
+    }
+}
+
+// Least squares endpoints for the current indices: point i ~= a[i] * e0 + (1 - a[i]) * e1.
+//   Returns false when the indices don't pin both endpoints down.
+static bool solve_block_endpoints(const float *points, const float *a, float *e0, float *e1)
+{
+    float aa = 0, ab = 0, bb = 0;
+    for (auto i = 0; i != 16; ++i)
+    {
+        float b = 1.0f - a[i];
+        aa += a[i] * a[i];
+        ab += a[i] * b;
+        bb += b * b;
+    }
+
+    float det = aa * bb - ab * ab;
+    if (fabsf(det) < 1e-6f)
+        return false;
+
+#if BC_USE_SSE
+    if (!bc_disable_sse)
+    {
+        __m128 ax = _mm_setzero_ps(), bx = _mm_setzero_ps();
+        for (auto i = 0; i != 16; ++i)
+        {
+            __m128 p = _mm_loadu_ps(&points[i * 4]);
+            ax = _mm_add_ps(ax, _mm_mul_ps(_mm_set1_ps(a[i]), p));
+            bx = _mm_add_ps(bx, _mm_mul_ps(_mm_set1_ps(1.0f - a[i]), p));
+        }
+
+        __m128 d = _mm_set1_ps(det);
+        _mm_storeu_ps(e0, _mm_div_ps(_mm_sub_ps(_mm_mul_ps(ax, _mm_set1_ps(bb)), _mm_mul_ps(bx, _mm_set1_ps(ab))), d));
+        _mm_storeu_ps(e1, _mm_div_ps(_mm_sub_ps(_mm_mul_ps(bx, _mm_set1_ps(aa)), _mm_mul_ps(ax, _mm_set1_ps(ab))), d));
+        return true;
+    }
+#endif
+
+    float ax[4] = {}, bx[4] = {};
+    for (auto i = 0; i != 16; ++i)
+    {
+        for (auto k = 0; k != 4; ++k)
+        {
+            ax[k] += a[i] * points[i * 4 + k];
+            bx[k] += (1.0f - a[i]) * points[i * 4 + k];
+        }
+    }
+
+    for (auto k = 0; k != 4; ++k)
+    {
+        e0[k] = (ax[k] * bb - bx[k] * ab) / det;
+        e1[k] = (bx[k] * aa - ax[k] * ab) / det;
+    }
+    return true;
+}
+
+/// -- BC4 (and the alpha / channel halves of BC3 and BC5)
+static void get_bc4_palette(int v0, int v1, int *palette)
+{
+    palette[0] = v0;
+    palette[1] = v1;
+
+    if (v0 > v1)
+    {
+        for (auto k = 1; k != 7; ++k)
+            palette[k + 1] = ((7 - k) * v0 + k * v1 + 3) / 7;
+    }
+    else
+    {
+        for (auto k = 1; k != 5; ++k)
+            palette[k + 1] = ((5 - k) * v0 + k * v1 + 2) / 5;
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+}
+
+static uint get_bc4_indices(const uchar *values, const int *palette, uchar *indices)
+{
+    uint error = 0;
+#if BC_USE_SSE
+    if (!bc_disable_sse)
+    {
+        // Entries as (value, 0) int16 pairs, so madd squares each one into its own 32-bit lane.
+        __m128i entries[2], keys[2];
+        for (auto g = 0; g != 2; ++g)
+        {
+            entries[g] = _mm_setr_epi32(palette[g * 4], palette[g * 4 + 1], palette[g * 4 + 2], palette[g * 4 + 3]);
+            keys[g] = _mm_setr_epi32(g * 4, g * 4 + 1, g * 4 + 2, g * 4 + 3);
+        }
+
+        for (auto i = 0; i != 16; ++i)
+        {
+            __m128i value = _mm_set1_epi32(values[i]);
+            __m128i best = _mm_set1_epi32(0x7FFFFFFF);
+            for (auto g = 0; g != 2; ++g)
+            {
+                __m128i d = _mm_sub_epi16(value, entries[g]);
+                best = bc_min_epi32(best, _mm_or_si128(_mm_slli_epi32(_mm_madd_epi16(d, d), 3), keys[g]));
+            }
+
+            uint key = bc_horizontal_min(best);
+            indices[i] = (uchar)(key & 7);
+            error += key >> 3;
+        }
+        return error;
+    }
+#endif
+
+    for (auto i = 0; i != 16; ++i)
+    {
+        uint best = ~0u;
+        for (auto k = 0; k != 8; ++k)
+        {
+            int d = (int)values[i] - palette[k];
+            if ((uint)(d * d) < best)
+            {
+                best = d * d;
+                indices[i] = (uchar)k;
+            }
+        }
+        error += best;
+    }
+    return error;
+}
+
+// values are 16 single channel samples. Writes 8 bytes.
+void encode_bc4_block(const uchar *values, uchar *out)
+{
+    int lo = 255, hi = 0;
+    for (auto i = 0; i != 16; ++i)
+    {
+        lo = (values[i] < lo) ? values[i] : lo;
+        hi = (values[i] > hi) ? values[i] : hi;
+    }
+
+    uchar indices[16] = {};
+    int v0 = hi, v1 = lo;
+
+    if (hi != lo)
+    {
+        int palette[8];
+        get_bc4_palette(v0, v1, palette);
+        uint best_error = get_bc4_indices(values, palette, indices);
+
+        for (auto iteration = 0; iteration != BC_REFINE_ITERATIONS; ++iteration)
+        {
+            // value ~= a * v0 + (1 - a) * v1, with a from the index.
+            float aa = 0, ab = 0, bb = 0, ax = 0, bx = 0;
+            for (auto i = 0; i != 16; ++i)
+            {
+                float a = (indices[i] == 0) ? 1.0f : (indices[i] == 1) ? 0.0f : (float)(8 - indices[i]) / 7.0f;
+                float b = 1.0f - a;
+                aa += a * a;
+                ab += a * b;
+                bb += b * b;
+                ax += a * values[i];
+                bx += b * values[i];
+            }
+
+            float det = aa * bb - ab * ab;
+            if (fabsf(det) < 1e-6f)
+                break;
+
+            int n0 = bc_clamp((int)lrintf((ax * bb - bx * ab) / det), 0, 255);
+            int n1 = bc_clamp((int)lrintf((bx * aa - ax * ab) / det), 0, 255);
+            if (n0 <= n1)
+                break;
+
+            uchar new_indices[16];
+            get_bc4_palette(n0, n1, palette);
+            uint error = get_bc4_indices(values, palette, new_indices);
+            if (error >= best_error)
+                break;
+
+            best_error = error;
+            v0 = n0;
+            v1 = n1;
+            memcpy(indices, new_indices, sizeof(indices));
+        }
+    }
+
+    out[0] = (uchar)v0;
+    out[1] = (uchar)v1;
+
+    uint64_t bits = 0;
+    for (auto i = 0; i != 16; ++i)
+        bits |= (uint64_t)indices[i] << (i * 3);
+    for (auto k = 0; k != 6; ++k)
+        out[2 + k] = (uchar)(bits >> (k * 8));
+}
+
+void decode_bc4_block(const uchar *block, uchar *values)
+{
+    int palette[8];
+    get_bc4_palette(block[0], block[1], palette);
+
+    uint64_t bits = 0;
+    for (auto k = 0; k != 6; ++k)
+        bits |= (uint64_t)block[2 + k] << (k * 8);
+    for (auto i = 0; i != 16; ++i)
+        values[i] = (uchar)palette[(bits >> (i * 3)) & 7];
+}
+
+/// -- BC1 (and the color half of BC3)
+static inline uint16_t pack_bc1_color(const float *color)
+{
+    int r = bc_clamp((int)lrintf(color[0] * (31.0f / 255.0f)), 0, 31);
+    int g = bc_clamp((int)lrintf(color[1] * (63.0f / 255.0f)), 0, 63);
+    int b = bc_clamp((int)lrintf(color[2] * (31.0f / 255.0f)), 0, 31);
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+static inline void unpack_bc1_color(uint16_t packed, int *color)
+{
+    int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+// four_color forces the 4 color palette regardless of endpoint order, which is what BC3 does.
+static void get_bc1_palette(uint16_t c0, uint16_t c1, bool four_color, int palette[4][4])
+{
+    unpack_bc1_color(c0, palette[0]);
+    unpack_bc1_color(c1, palette[1]);
+    palette[0][3] = palette[1][3] = 255;
+
+    if (four_color || c0 > c1)
+    {
+        for (auto k = 0; k != 3; ++k)
+        {
+            palette[2][k] = (2 * palette[0][k] + palette[1][k] + 1) / 3;
+            palette[3][k] = (palette[0][k] + 2 * palette[1][k] + 1) / 3;
+        }
+        palette[2][3] = palette[3][3] = 255;
+    }
+    else
+    {
+        for (auto k = 0; k != 3; ++k)
+        {
+            palette[2][k] = (palette[0][k] + palette[1][k] + 1) / 2;
+            palette[3][k] = 0;
+        }
+        palette[2][3] = 255;
+        palette[3][3] = 0;
+    }
+}
+
+static uint get_bc1_indices(const uchar *pixels, int palette[4][4], uchar *indices)
+{
+    uint error = 0;
+#if BC_USE_SSE
+    if (!bc_disable_sse)
+    {
+        // Entries as (r, g) and (b, 0) int16 pairs, madd sums each pair into one 32-bit lane.
+        __m128i rg = _mm_setr_epi16((short)palette[0][0], (short)palette[0][1], (short)palette[1][0], (short)palette[1][1],
+                                    (short)palette[2][0], (short)palette[2][1], (short)palette[3][0], (short)palette[3][1]);
+        __m128i b0 = _mm_setr_epi32(palette[0][2], palette[1][2], palette[2][2], palette[3][2]);
+        __m128i keys = _mm_setr_epi32(0, 1, 2, 3);
+
+        for (auto i = 0; i != 16; ++i)
+        {
+            __m128i d_rg = _mm_sub_epi16(_mm_set1_epi32(pixels[i * 4] | (pixels[i * 4 + 1] << 16)), rg);
+            __m128i d_b0 = _mm_sub_epi16(_mm_set1_epi32(pixels[i * 4 + 2]), b0);
+            __m128i d = _mm_add_epi32(_mm_madd_epi16(d_rg, d_rg), _mm_madd_epi16(d_b0, d_b0));
+
+            uint key = bc_horizontal_min(_mm_or_si128(_mm_slli_epi32(d, 2), keys));
+            indices[i] = (uchar)(key & 3);
+            error += key >> 2;
+        }
+        return error;
+    }
+#endif
+
+    for (auto i = 0; i != 16; ++i)
+    {
+        uint best = ~0u;
+        for (auto k = 0; k != 4; ++k)
+        {
+            int dr = pixels[i * 4 + 0] - palette[k][0];
+            int dg = pixels[i * 4 + 1] - palette[k][1];
+            int db = pixels[i * 4 + 2] - palette[k][2];
+            uint d = (uint)(dr * dr + dg * dg + db * db);
+            if (d < best)
+            {
+                best = d;
+                indices[i] = (uchar)k;
+            }
+        }
+        error += best;
+    }
+    return error;
+}
+
+// Encodes the RGB of 16 RGBA pixels into 8 bytes, always in 4 color mode (no punch-through alpha).
+void encode_bc1_block(const uchar *pixels, uchar *out)
+{
+    // Alpha stays 0, so the fit only ever sees RGB.
+    float points[16 * 4];
+    for (auto i = 0; i != 16; ++i)
+    {
+        for (auto k = 0; k != 3; ++k)
+            points[i * 4 + k] = pixels[i * 4 + k];
+        points[i * 4 + 3] = 0.0f;
+    }
+
+    float mean[4], axis[4];
+    float e0[4], e1[4];
+    if (get_principal_axis(points, mean, axis))
+        get_axis_endpoints(points, mean, axis, e0, e1);
+    else
+    {
+        memcpy(e0, mean, sizeof(e0));
+        memcpy(e1, mean, sizeof(e1));
+    }
+
+    uint16_t best_c0 = 0, best_c1 = 0;
+    uchar best_indices[16] = {};
+    uint best_error = ~0u;
+
+    for (auto iteration = 0; iteration <= BC_REFINE_ITERATIONS; ++iteration)
+    {
+        uint16_t c0 = pack_bc1_color(e0);
+        uint16_t c1 = pack_bc1_color(e1);
+        if (c0 < c1)
+        {
+            uint16_t t = c0;
+            c0 = c1;
+            c1 = t;
+        }
+
+        uchar indices[16] = {};
+        uint error;
+        int palette[4][4];
+        get_bc1_palette(c0, c1, true, palette);
+        error = get_bc1_indices(pixels, palette, indices);
+
+        // c0 == c1 means 3 color mode, where only index 0 is safe to use.
+        if (c0 == c1)
+            memset(indices, 0, sizeof(indices));
+
+        if (error < best_error)
+        {
+            best_error = error;
+            best_c0 = c0;
+            best_c1 = c1;
+            memcpy(best_indices, indices, sizeof(indices));
+        }
+
+        if (c0 == c1 || iteration == BC_REFINE_ITERATIONS)
+            break;
+
+        // e0 is c0's end of the palette.
+        static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+        float a[16];
+        for (auto i = 0; i != 16; ++i)
+            a[i] = weights[indices[i]];
+        if (!solve_block_endpoints(points, a, e0, e1))
+            break;
+    }
+
+    out[0] = (uchar)best_c0;
+    out[1] = (uchar)(best_c0 >> 8);
+    out[2] = (uchar)best_c1;
+    out[3] = (uchar)(best_c1 >> 8);
+
+    uint bits = 0;
+    for (auto i = 0; i != 16; ++i)
+        bits |= (uint)best_indices[i] << (i * 2);
+    for (auto k = 0; k != 4; ++k)
+        out[4 + k] = (uchar)(bits >> (k * 8));
+}
+
+void decode_bc1_block(const uchar *block, uchar *pixels, bool four_color = false)
+{
+    uint16_t c0 = (uint16_t)(block[0] | (block[1] << 8));
+    uint16_t c1 = (uint16_t)(block[2] | (block[3] << 8));
+    uint bits = block[4] | (block[5] << 8) | (block[6] << 16) | ((uint)block[7] << 24);
+
+    int palette[4][4];
+    get_bc1_palette(c0, c1, four_color, palette);
+
+    for (auto i = 0; i != 16; ++i)
+        for (auto k = 0; k != 4; ++k)
+            pixels[i * 4 + k] = (uchar)palette[(bits >> (i * 2)) & 3][k];
+}
+
+/// -- BC7, encoding mode 6
+static const int bc7_weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+static inline void put_bc7_bits(uchar *block, uint *position, uint value, uint count)
+{
+    for (auto i = 0; i != count; ++i, ++*position)
+        if (value & (1u << i))
+            block[*position >> 3] |= (uchar)(1u << (*position & 7));
+}
+
+static inline uint get_bc7_bits(const uchar *block, uint *position, uint count)
+{
+    uint value = 0;
+    for (auto i = 0; i != count; ++i, ++*position)
+        value |= (uint)((block[*position >> 3] >> (*position & 7)) & 1) << i;
+    return value;
+}
+
+// Picks 7 bit endpoint values plus the shared p-bit closest to the float endpoint.
+static void quantize_bc7_endpoint(const float *endpoint, int *out7, int *out_pbit)
+{
+    float best_error = FLT_MAX;
+    for (auto p = 0; p != 2; ++p)
+    {
+        int q[4];
+        float error = 0.0f;
+        for (auto k = 0; k != 4; ++k)
+        {
+            q[k] = bc_clamp((int)lrintf((endpoint[k] - (float)p) * 0.5f), 0, 127);
+            float d = (float)((q[k] << 1) | p) - endpoint[k];
+            error += d * d;
+        }
+
+        if (error < best_error)
+        {
+            best_error = error;
+            memcpy(out7, q, sizeof(q));
+            *out_pbit = p;
+        }
+    }
+}
+
+static uint get_bc7_mode6_indices(const uchar *pixels, const int *c0, const int *c1, uchar *indices)
+{
+    int palette[16][4];
+    for (auto w = 0; w != 16; ++w)
+        for (auto k = 0; k != 4; ++k)
+            palette[w][k] = ((64 - bc7_weights4[w]) * c0[k] + bc7_weights4[w] * c1[k] + 32) >> 6;
+
+    uint error = 0;
+#if BC_USE_SSE
+    if (!bc_disable_sse)
+    {
+        // Entries as (r, g) and (b, a) int16 pairs, 4 entries per register.
+        __m128i rg[4], ba[4], keys[4];
+        for (auto g = 0; g != 4; ++g)
+        {
+            auto p = &palette[g * 4];
+            rg[g] = _mm_setr_epi16((short)p[0][0], (short)p[0][1], (short)p[1][0], (short)p[1][1],
+                                   (short)p[2][0], (short)p[2][1], (short)p[3][0], (short)p[3][1]);
+            ba[g] = _mm_setr_epi16((short)p[0][2], (short)p[0][3], (short)p[1][2], (short)p[1][3],
+                                   (short)p[2][2], (short)p[2][3], (short)p[3][2], (short)p[3][3]);
+            keys[g] = _mm_setr_epi32(g * 4, g * 4 + 1, g * 4 + 2, g * 4 + 3);
+        }
+
+        for (auto i = 0; i != 16; ++i)
+        {
+            __m128i pixel_rg = _mm_set1_epi32(pixels[i * 4] | (pixels[i * 4 + 1] << 16));
+            __m128i pixel_ba = _mm_set1_epi32(pixels[i * 4 + 2] | (pixels[i * 4 + 3] << 16));
+            __m128i best = _mm_set1_epi32(0x7FFFFFFF);
+            for (auto g = 0; g != 4; ++g)
+            {
+                __m128i d_rg = _mm_sub_epi16(pixel_rg, rg[g]);
+                __m128i d_ba = _mm_sub_epi16(pixel_ba, ba[g]);
+                __m128i d = _mm_add_epi32(_mm_madd_epi16(d_rg, d_rg), _mm_madd_epi16(d_ba, d_ba));
+                best = bc_min_epi32(best, _mm_or_si128(_mm_slli_epi32(d, 4), keys[g]));
+            }
+
+            uint key = bc_horizontal_min(best);
+            indices[i] = (uchar)(key & 15);
+            error += key >> 4;
+        }
+        return error;
+    }
+#endif
+
+    for (auto i = 0; i != 16; ++i)
+    {
+        uint best = ~0u;
+        for (auto w = 0; w != 16; ++w)
+        {
+            uint d = 0;
+            for (auto k = 0; k != 4; ++k)
+            {
+                int diff = pixels[i * 4 + k] - palette[w][k];
+                d += (uint)(diff * diff);
+            }
+            if (d < best)
+            {
+                best = d;
+                indices[i] = (uchar)w;
+            }
+        }
+        error += best;
+    }
+    return error;
+}
+
+// Encodes 16 RGBA pixels into 16 bytes of BC7 mode 6.
+void encode_bc7_block(const uchar *pixels, uchar *out)
+{
+    float points[16 * 4];
+    for (auto i = 0; i != 64; ++i)
+        points[i] = pixels[i];
+
+    float mean[4], axis[4];
+    float e0[4], e1[4];
+    if (get_principal_axis(points, mean, axis))
+        get_axis_endpoints(points, mean, axis, e0, e1);
+    else
+    {
+        memcpy(e0, mean, sizeof(e0));
+        memcpy(e1, mean, sizeof(e1));
+    }
+
+    int best_q[2][4] = {}, best_p[2] = {};
+    uchar best_indices[16] = {};
+    uint best_error = ~0u;
+
+    for (auto iteration = 0; iteration <= BC_REFINE_ITERATIONS; ++iteration)
+    {
+        int q[2][4], p[2], c[2][4];
+        quantize_bc7_endpoint(e0, q[0], &p[0]);
+        quantize_bc7_endpoint(e1, q[1], &p[1]);
+        for (auto e = 0; e != 2; ++e)
+            for (auto k = 0; k != 4; ++k)
+                c[e][k] = (q[e][k] << 1) | p[e];
+
+        uchar indices[16];
+        uint error = get_bc7_mode6_indices(pixels, c[0], c[1], indices);
+        if (error < best_error)
+        {
+            best_error = error;
+            memcpy(best_q, q, sizeof(q));
+            memcpy(best_p, p, sizeof(p));
+            memcpy(best_indices, indices, sizeof(indices));
+        }
+
+        if (!error || iteration == BC_REFINE_ITERATIONS)
+            break;
+
+        float a[16];
+        for (auto i = 0; i != 16; ++i)
+            a[i] = 1.0f - (float)bc7_weights4[indices[i]] / 64.0f;
+        if (!solve_block_endpoints(points, a, e0, e1))
+            break;
+
+        for (auto k = 0; k != 4; ++k)
+        {
+            e0[k] = fminf(fmaxf(e0[k], 0.0f), 255.0f);
+            e1[k] = fminf(fmaxf(e1[k], 0.0f), 255.0f);
+        }
+    }
+
+    // The anchor (pixel 0) index only gets 3 bits, so its top bit has to be 0.
+    if (best_indices[0] & 8)
+    {
+        int t[4];
+        memcpy(t, best_q[0], sizeof(t));
+        memcpy(best_q[0], best_q[1], sizeof(t));
+        memcpy(best_q[1], t, sizeof(t));
+
+        int tp = best_p[0];
+        best_p[0] = best_p[1];
+        best_p[1] = tp;
+
+        for (auto i = 0; i != 16; ++i)
+            best_indices[i] = (uchar)(15 - best_indices[i]);
+    }
+
+    memset(out, 0, 16);
+    uint position = 0;
+    put_bc7_bits(out, &position, 1 << 6, 7); // mode 6
+    for (auto k = 0; k != 4; ++k)
+    {
+        put_bc7_bits(out, &position, best_q[0][k], 7);
+        put_bc7_bits(out, &position, best_q[1][k], 7);
+    }
+    put_bc7_bits(out, &position, best_p[0], 1);
+    put_bc7_bits(out, &position, best_p[1], 1);
+    for (auto i = 0; i != 16; ++i)
+        put_bc7_bits(out, &position, best_indices[i], i ? 4 : 3);
+}
+
+/// -- BC7 decoding, every mode
+// Per mode: subsets, partition bits, rotation bits, index selection bits, color bits, alpha bits,
+//   p-bits per endpoint, p-bits per subset, index bits, secondary index bits.
+struct Bc7_Mode {
+    uchar subsets, partition_bits, rotation_bits, selection_bits;
+    uchar color_bits, alpha_bits, endpoint_pbits, shared_pbits;
+    uchar index_bits, index_bits2;
+};
+
+static const Bc7_Mode bc7_modes[8] = {
+    { 3, 4, 0, 0, 4, 0, 1, 0, 3, 0 },
+    { 2, 6, 0, 0, 6, 0, 0, 1, 3, 0 },
+    { 3, 6, 0, 0, 5, 0, 0, 0, 2, 0 },
+    { 2, 6, 0, 0, 7, 0, 1, 0, 2, 0 },
+    { 1, 0, 2, 1, 5, 6, 0, 0, 2, 3 },
+    { 1, 0, 2, 0, 7, 8, 0, 0, 2, 2 },
+    { 1, 0, 0, 0, 7, 7, 1, 0, 4, 0 },
+    { 2, 6, 0, 0, 5, 5, 1, 0, 2, 0 },
+};
+
+static const int bc7_weights2[4] = { 0, 21, 43, 64 };
+static const int bc7_weights3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+
+// Bit i set: pixel i is in subset 1.
+static const uint16_t bc7_partitions2[64] = {
+    0xCCCC, 0x8888, 0xEEEE, 0xECC8, 0xC880, 0xFEEC, 0xFEC8, 0xEC80, 0xC800, 0xFFEC, 0xFE80, 0xE800, 0xFFE8, 0xFF00, 0xFFF0, 0xF000,
+    0xF710, 0x008E, 0x7100, 0x08CE, 0x008C, 0x7310, 0x3100, 0x8CCE, 0x088C, 0x3110, 0x6666, 0x366C, 0x17E8, 0x0FF0, 0x718E, 0x399C,
+    0xAAAA, 0xF0F0, 0x5A5A, 0x33CC, 0x3C3C, 0x55AA, 0x9696, 0xA55A, 0x73CE, 0x13C8, 0x324C, 0x3BDC, 0x6996, 0xC33C, 0x9966, 0x0660,
+    0x0272, 0x04E4, 0x4E40, 0x2720, 0xC936, 0x936C, 0x39C6, 0x639C, 0x9336, 0x9CC6, 0x817E, 0xE718, 0xCCF0, 0x0FCC, 0x7744, 0xEE22,
+};
+
+// 2 bits per pixel, pixel i at bits 2i: its subset.
+static const uint bc7_partitions3[64] = {
+    0xAA685050, 0x6A5A5040, 0x5A5A4200, 0x5450A0A8, 0xA5A50000, 0xA0A05050, 0x5555A0A0, 0x5A5A5050,
+    0xAA550000, 0xAA555500, 0xAAAA5500, 0x90909090, 0x94949494, 0xA4A4A4A4, 0xA9A59450, 0x2A0A4250,
+    0xA5945040, 0x0A425054, 0xA5A5A500, 0x55A0A0A0, 0xA8A85454, 0x6A6A4040, 0xA4A45000, 0x1A1A0500,
+    0x0050A4A4, 0xAAA59090, 0x14696914, 0x69691400, 0xA08585A0, 0xAA821414, 0x50A4A450, 0x6A5A0200,
+    0xA9A58000, 0x5090A0A8, 0xA8A09050, 0x24242424, 0x00AA5500, 0x24924924, 0x24499224, 0x50A50A50,
+    0x500AA550, 0xAAAA4444, 0x66660000, 0xA5A0A5A0, 0x50A050A0, 0x69286928, 0x44AAAA44, 0x66666600,
+    0xAA444444, 0x54A854A8, 0x95809580, 0x96969600, 0xA85454A8, 0x80959580, 0xAA141414, 0x96960000,
+    0xAAAA1414, 0xA05050A0, 0xA0A5A5A0, 0x96000000, 0x40804080, 0xA9A8A9A8, 0xAAAAAA44, 0x2A4A5254,
+};
+
+// Pixel whose index has one bit less, per subset after the first (whose anchor is always pixel 0).
+static const uchar bc7_anchors2[64] = {
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+    15,  2,  8,  2,  2,  8,  8, 15,  2,  8,  2,  2,  8,  8,  2,  2,
+    15, 15,  6,  8,  2,  8, 15, 15,  2,  8,  2,  2,  2, 15, 15,  6,
+     6,  2,  6,  8, 15, 15,  2,  2, 15, 15, 15, 15, 15,  2,  2, 15,
+};
+
+static const uchar bc7_anchors3[2][64] = {
+    {  3,  3, 15, 15,  8,  3, 15, 15,  8,  8,  6,  6,  6,  5,  3,  3,
+       3,  3,  8, 15,  3,  3,  6, 10,  5,  8,  8,  6,  8,  5, 15, 15,
+       8, 15,  3,  5,  6, 10,  8, 15, 15,  3, 15,  5, 15, 15, 15, 15,
+       3, 15,  5,  5,  5,  8,  5, 10,  5, 10,  8, 13, 15, 12,  3,  3 },
+    { 15,  8,  8,  3, 15, 15,  3,  8, 15, 15, 15, 15, 15, 15, 15,  8,
+      15,  8, 15,  3, 15,  8, 15,  8,  3, 15,  6, 10, 15, 15, 10,  8,
+      15,  3, 15, 10, 10,  8,  9, 10,  6, 15,  8, 15,  3,  6,  6,  8,
+      15,  3, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,  3, 15, 15,  8 },
+};
+
+static inline uint get_bc7_subset(uint subsets, uint partition, uint pixel)
+{
+    if (subsets == 2)
+        return (bc7_partitions2[partition] >> pixel) & 1;
+    if (subsets == 3)
+        return (bc7_partitions3[partition] >> (pixel * 2)) & 3;
+    return 0;
+}
+
+static inline bool is_bc7_anchor(uint subsets, uint partition, uint pixel)
+{
+    if (!pixel)
+        return true;
+    if (subsets == 2)
+        return pixel == bc7_anchors2[partition];
+    if (subsets == 3)
+        return pixel == bc7_anchors3[0][partition] || pixel == bc7_anchors3[1][partition];
+    return false;
+}
+
+static inline int get_bc7_weight(uint bits, uint index)
+{
+    return (bits == 2) ? bc7_weights2[index] : (bits == 3) ? bc7_weights3[index] : bc7_weights4[index];
+}
+
+// Reserved mode (a zero first byte) decodes to magenta and returns false, like the hardware's zeros
+//   but easier to spot.
+bool decode_bc7_block(const uchar *block, uchar *pixels)
+{
+    uint mode = 0;
+    while (mode != 8 && !(block[0] & (1 << mode)))
+        ++mode;
+
+    if (mode == 8)
+    {
+        for (auto i = 0; i != 16; ++i)
+        {
+            pixels[i * 4 + 0] = 255;
+            pixels[i * 4 + 1] = 0;
+            pixels[i * 4 + 2] = 255;
+            pixels[i * 4 + 3] = 255;
+        }
+        return false;
+    }
+
+    auto info = &bc7_modes[mode];
+    uint position = mode + 1;
+    uint partition = get_bc7_bits(block, &position, info->partition_bits);
+    uint rotation = get_bc7_bits(block, &position, info->rotation_bits);
+    uint selection = get_bc7_bits(block, &position, info->selection_bits);
+
+    /// -- Endpoints: channel by channel, subset by subset, then the p-bits.
+    int endpoints[3][2][4];
+    uint num_endpoints = info->subsets * 2;
+    for (auto k = 0; k != 3; ++k)
+        for (auto e = 0; e != num_endpoints; ++e)
+            endpoints[e / 2][e % 2][k] = (int)get_bc7_bits(block, &position, info->color_bits);
+    for (auto e = 0; e != num_endpoints; ++e)
+        endpoints[e / 2][e % 2][3] = info->alpha_bits ? (int)get_bc7_bits(block, &position, info->alpha_bits) : 255;
+
+    uint color_bits = info->color_bits, alpha_bits = info->alpha_bits;
+    if (info->endpoint_pbits || info->shared_pbits)
+    {
+        int pbits[6];
+        for (auto e = 0; e != num_endpoints; ++e)
+            pbits[e] = (info->endpoint_pbits || !(e & 1)) ? (int)get_bc7_bits(block, &position, 1) : pbits[e - 1];
+        for (auto e = 0; e != num_endpoints; ++e)
+            for (auto k = 0; k != (alpha_bits ? 4 : 3); ++k)
+                endpoints[e / 2][e % 2][k] = (endpoints[e / 2][e % 2][k] << 1) | pbits[e];
+        ++color_bits;
+        alpha_bits += alpha_bits ? 1 : 0;
+    }
+
+    // Expanded to 8 bits by repeating the top bits at the bottom.
+    for (auto e = 0; e != num_endpoints; ++e)
+    {
+        for (auto k = 0; k != 4; ++k)
+        {
+            uint bits = (k == 3) ? alpha_bits : color_bits;
+            if (!bits)
+                continue;
+            int &v = endpoints[e / 2][e % 2][k];
+            v = (v << (8 - bits)) | (v >> (2 * bits - 8));
+        }
+    }
+
+    /// -- Indices, the anchors have one bit less.
+    uchar indices[16], indices2[16];
+    for (auto i = 0; i != 16; ++i)
+        indices[i] = (uchar)get_bc7_bits(block, &position, info->index_bits - (is_bc7_anchor(info->subsets, partition, i) ? 1 : 0));
+    if (info->index_bits2)
+        for (auto i = 0; i != 16; ++i)
+            indices2[i] = (uchar)get_bc7_bits(block, &position, info->index_bits2 - (i ? 0 : 1));
+
+    for (auto i = 0; i != 16; ++i)
+    {
+        auto e = endpoints[get_bc7_subset(info->subsets, partition, i)];
+
+        // Color from the first index set and alpha from the second, or the other way around.
+        int color_weight = get_bc7_weight(info->index_bits, indices[i]);
+        int alpha_weight = color_weight;
+        if (info->index_bits2)
+        {
+            int weight2 = get_bc7_weight(info->index_bits2, indices2[i]);
+            color_weight = selection ? weight2 : color_weight;
+            alpha_weight = selection ? get_bc7_weight(info->index_bits, indices[i]) : weight2;
+        }
+
+        uchar *pixel = &pixels[i * 4];
+        for (auto k = 0; k != 4; ++k)
+        {
+            int w = (k == 3) ? alpha_weight : color_weight;
+            pixel[k] = (uchar)(((64 - w) * e[0][k] + w * e[1][k] + 32) >> 6);
+        }
+
+        // Rotation swaps alpha with red, green or blue.
+        if (rotation)
+        {
+            uchar t = pixel[3];
+            pixel[3] = pixel[rotation - 1];
+            pixel[rotation - 1] = t;
+        }
+    }
+    return true;
+}
+
+/// -- Whole textures
+static void encode_texture_block(Texture_Format format, const uchar *pixels, uchar *out)
+{
+    uchar channel[16];
+
+    switch (format)
+    {
+        case TEXTURE_FORMAT_BC1:
+        case TEXTURE_FORMAT_BC1_SRGB:
+            encode_bc1_block(pixels, out);
+            break;
+
+        case TEXTURE_FORMAT_BC3:
+        case TEXTURE_FORMAT_BC3_SRGB:
+            for (auto i = 0; i != 16; ++i)
+                channel[i] = pixels[i * 4 + 3];
+            encode_bc4_block(channel, out);
+            encode_bc1_block(pixels, out + 8);
+            break;
+
+        case TEXTURE_FORMAT_BC4:
+        case TEXTURE_FORMAT_BC5:
+            for (auto c = 0; c != ((format == TEXTURE_FORMAT_BC5) ? 2 : 1); ++c)
+            {
+                for (auto i = 0; i != 16; ++i)
+                    channel[i] = pixels[i * 4 + c];
+                encode_bc4_block(channel, out + c * 8);
+            }
+            break;
+
+        case TEXTURE_FORMAT_BC7:
+        case TEXTURE_FORMAT_BC7_SRGB:
+            encode_bc7_block(pixels, out);
+            break;
+
+        default:
+            ASSERT(!"Not a block compressed format.");
+    }
+}
+
+// Decodes to what sampling the texture would return: BC4 and BC5 come back with the
+//   missing channels as 0 and alpha as 255.
+static bool decode_texture_block(Texture_Format format, const uchar *block, uchar *pixels)
+{
+    uchar channel[16];
+
+    switch (format)
+    {
+        case TEXTURE_FORMAT_BC1:
+        case TEXTURE_FORMAT_BC1_SRGB:
+            decode_bc1_block(block, pixels);
+            return true;
+
+        case TEXTURE_FORMAT_BC3:
+        case TEXTURE_FORMAT_BC3_SRGB:
+            decode_bc1_block(block + 8, pixels, true);
+            decode_bc4_block(block, channel);
+            for (auto i = 0; i != 16; ++i)
+                pixels[i * 4 + 3] = channel[i];
+            return true;
+
+        case TEXTURE_FORMAT_BC4:
+        case TEXTURE_FORMAT_BC5:
+            memset(pixels, 0, 64);
+            for (auto c = 0; c != ((format == TEXTURE_FORMAT_BC5) ? 2 : 1); ++c)
+            {
+                decode_bc4_block(block + c * 8, channel);
+                for (auto i = 0; i != 16; ++i)
+                    pixels[i * 4 + c] = channel[i];
+            }
+            for (auto i = 0; i != 16; ++i)
+                pixels[i * 4 + 3] = 255;
+            return true;
+
+        case TEXTURE_FORMAT_BC7:
+        case TEXTURE_FORMAT_BC7_SRGB:
+            return decode_bc7_block(block, pixels);
+
+        default:
+            return false;
+    }
+}
+
+// Compresses width x height RGBA8 pixels into out, which needs get_texture_level_size bytes.
+// num_threads == 0 uses one thread per core.
+void compress_texture(Texture_Format format, const uchar *rgba, uint width, uint height, uchar *out, uint num_threads = 0)
+{
+    uint blocks_x = (width + 3) / 4;
+    uint blocks_y = (height + 3) / 4;
+    uint block_bytes = get_texture_format_bytes(format);
+
+    if (!num_threads)
+        num_threads = std::thread::hardware_concurrency();
+    if (num_threads > blocks_y)
+        num_threads = blocks_y;
+    if (!num_threads)
+        num_threads = 1;
+
+    std::atomic<uint> next_row(0);
+    auto worker = [&]() {
+        uchar pixels[64];
+        for (uint by; (by = next_row.fetch_add(1)) < blocks_y;)
+        {
+            for (auto bx = 0; bx != blocks_x; ++bx)
+            {
+                get_texture_block(rgba, width, height, bx, by, pixels);
+                encode_texture_block(format, pixels, &out[((size_t)by * blocks_x + bx) * block_bytes]);
+            }
+        }
+    };
+
+    std::thread *threads = new std::thread[num_threads - 1];
+    for (auto i = 0; i != num_threads - 1; ++i)
+        threads[i] = std::thread(worker);
+    worker();
+    for (auto i = 0; i != num_threads - 1; ++i)
+        threads[i].join();
+    delete[] threads;
+}
+
+// Returns false if any block couldn't be decoded.
+bool decompress_texture(Texture_Format format, const uchar *blocks, uint width, uint height, uchar *rgba)
+{
+    uint blocks_x = (width + 3) / 4;
+    uint blocks_y = (height + 3) / 4;
+    uint block_bytes = get_texture_format_bytes(format);
+    bool result = true;
+
+    uchar pixels[64];
+    for (auto by = 0; by != blocks_y; ++by)
+    {
+        for (auto bx = 0; bx != blocks_x; ++bx)
+        {
+            if (!decode_texture_block(format, &blocks[((size_t)by * blocks_x + bx) * block_bytes], pixels))
+                result = false;
+            put_texture_block(rgba, width, height, bx, by, pixels);
+        }
+    }
+
+    return result;
+}
+
+// PSNR in dB over the channels set in channel_mask (bit 0 = R ... bit 3 = A).
+float compute_texture_psnr(const uchar *a, const uchar *b, uint width, uint height, uint channel_mask)
+{
+    double sum = 0.0;
+    size_t count = 0;
+
+    for (size_t i = 0; i != (size_t)width * height; ++i)
+    {
+        for (auto k = 0; k != 4; ++k)
+        {
+            if (!(channel_mask & (1 << k)))
+                continue;
+            double d = (double)a[i * 4 + k] - (double)b[i * 4 + k];
+            sum += d * d;
+            ++count;
+        }
+    }
+
+    if (!count || sum == 0.0)
+        return 99.0f;
+    return (float)(10.0 * log10((255.0 * 255.0) / (sum / (double)count)));
+}
+
+#endif
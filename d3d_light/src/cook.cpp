@@ -0,0 +1,526 @@
+// Incremental asset cook. Reads a manifest of rules and brings every output up to date, cooking
+//   only the outputs whose inputs or settings changed since the last run (see cook_cache.h).
+//
+// Usage: cook [-force] [-cache <directory>] <manifest>
+//
+// The manifest has one rule per line, a trailing \ continues it on the next line and # starts a comment:
+//   mesh    <output .mesh> <scene> [dependency...] [-overdraw=1.05] [-weld=0] [-lods=4]
+//   texture <output .dds|.stex> <image> [dependency...] [-filter=box|kaiser|lanczos]
+//   orm     <output .dds|.stex> <AO> <roughness> <metallic> [dependency...] [-filter=box|kaiser|lanczos]
+//   shader  <output .hlsl> <source .hlsl> [dependency...]
+//   pack    <output .pak> <file | name=file>...
+//
+// The first input (the first three for orm, see material.h) is what gets cooked, the rest are only
+//   dependencies: a change to any of them cooks the output again. That's how a material is tied to
+//   its textures (or a scene to the files the importer pulls in) without the cook having to
+//   understand the format. Shader rules paste
+//   every #include into the output, so the shaders that end up in the pack compile on their own.
+//   A rule whose input is another rule's output runs after it, so the pack always sees fresh outputs.
+//
+// Paths are relative to the working directory, run it from where the runtime runs.
+//   -force cooks everything, -cache moves the index and content store (default .build/cook_cache).
+#include "stdafx.h"
+
+#include <chrono>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "texture_cook.h"
+#include "mesh_cook.h"
+#include "cook_cache.h"
+
+#define COOK_SHADER_VERSION 1 // bump when flatten_hlsl_file changes what it writes
+
+enum Cook_Kind
+{
+    COOK_MESH,
+    COOK_TEXTURE,
+    COOK_ORM,
+    COOK_SHADER,
+    COOK_PACK,
+    COOK_KIND_COUNT
+};
+
+static const char *cook_kind_names[COOK_KIND_COUNT] = { "mesh", "texture", "orm", "shader", "pack" };
+
+struct Cook_Rule
+{
+    Cook_Kind kind;
+    uint line;
+    char output[COOK_MAX_PATH];
+    char inputs[COOK_MAX_INPUTS][COOK_MAX_PATH];
+    char names[COOK_MAX_INPUTS][COOK_MAX_PATH]; // what the pack stores each input as, the input itself elsewhere
+    uint num_inputs;
+
+    Mip_Filter filter;
+    float overdraw_threshold;
+    float weld_epsilon;
+    uint max_lods;
+
+    int producers[COOK_MAX_INPUTS]; // rule writing each input, -1 for source files
+    uint visit;                     // 0 not sorted yet, 1 on the stack, 2 sorted
+    bool failed;
+};
+
+static double get_ms_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+/// ============ MANIFEST ============ ///
+static bool parse_cook_setting(Cook_Rule *rule, const char *token)
+{
+    const char *value = strchr(token, '=') + 1;
+    int length = (int)(value - token - 1);
+
+    if ((rule->kind == COOK_TEXTURE || rule->kind == COOK_ORM) && length == 7 && !memcmp(token, "-filter", 7))
+    {
+        if (!strcmp(value, "box"))
+            rule->filter = MIP_FILTER_BOX;
+        else if (!strcmp(value, "kaiser"))
+            rule->filter = MIP_FILTER_KAISER;
+        else if (!strcmp(value, "lanczos"))
+            rule->filter = MIP_FILTER_LANCZOS;
+        else
+            return false;
+        return true;
+    }
+
+    if (rule->kind == COOK_MESH && length == 9 && !memcmp(token, "-overdraw", 9))
+        return (rule->overdraw_threshold = (float)atof(value)), true;
+    if (rule->kind == COOK_MESH && length == 5 && !memcmp(token, "-weld", 5))
+        return (rule->weld_epsilon = (float)atof(value)), true;
+    if (rule->kind == COOK_MESH && length == 5 && !memcmp(token, "-lods", 5))
+        return (rule->max_lods = (uint)atoi(value)), true;
+
+    return false;
+}
+
+// Rules in manifest order, NULL if the manifest is missing or has a bad line.
+static Cook_Rule *load_cook_manifest(const char *path, uint *out_num_rules)
+{
+    Mapped_File file;
+    if (!map_file(&file, path))
+    {
+        LOGF("Failed to open %s\n", path);
+        return NULL;
+    }
+
+    // Private copy to cut tokens out of in place. Continuations become '\v' so the line numbers
+    //   in errors still count them.
+    char *text = (char *)malloc(file.size + 1);
+    size_t size = 0;
+    auto source = (const char *)file.data;
+    for (size_t i = 0; i != file.size; ++i)
+    {
+        size_t end = i + 1;
+        while (source[i] == '\\' && end != file.size && source[end] == '\r')
+            ++end;
+        if (source[i] == '\\' && end != file.size && source[end] == '\n')
+        {
+            text[size++] = '\v';
+            i = end;
+            continue;
+        }
+        text[size++] = source[i];
+    }
+    text[size] = 0;
+    unmap_file(&file);
+
+    uint max_rules = 16, num_rules = 0;
+    Cook_Rule *rules = (Cook_Rule *)calloc(max_rules, sizeof(Cook_Rule));
+    bool result = true;
+    uint line_number = 0;
+
+    for (char *line = text; line && result;)
+    {
+        char *next = strchr(line, '\n');
+        if (next)
+            *next++ = 0;
+        ++line_number;
+        uint first_line = line_number;
+        for (char *c = line; *c; ++c)
+        {
+            if (*c == '\v')
+            {
+                *c = ' ';
+                ++line_number;
+            }
+        }
+
+        char *comment = strchr(line, '#');
+        if (comment)
+            *comment = 0;
+
+        const char *separators = " \t\r";
+        char *token = strtok(line, separators);
+        if (!token)
+        {
+            line = next;
+            continue;
+        }
+
+        if (num_rules == max_rules)
+        {
+            rules = (Cook_Rule *)realloc(rules, max_rules * 2 * sizeof(Cook_Rule));
+            memset(rules + max_rules, 0, max_rules * sizeof(Cook_Rule));
+            max_rules *= 2;
+        }
+
+        auto rule = &rules[num_rules];
+        rule->line = first_line;
+        rule->kind = COOK_KIND_COUNT;
+        for (auto k = 0; k != COOK_KIND_COUNT; ++k)
+            if (!strcmp(token, cook_kind_names[k]))
+                rule->kind = (Cook_Kind)k;
+
+        rule->filter = MIP_FILTER_KAISER;
+        rule->overdraw_threshold = OVERDRAW_DEFAULT_THRESHOLD;
+        rule->max_lods = MESH_LOD_MAX_COUNT;
+
+        if (rule->kind == COOK_KIND_COUNT)
+        {
+            LOGF("%s(%u): unknown rule '%s'\n", path, first_line, token);
+            result = false;
+            break;
+        }
+
+        token = strtok(NULL, separators);
+        if (!token || strlen(token) >= COOK_MAX_PATH)
+        {
+            LOGF("%s(%u): missing output\n", path, first_line);
+            result = false;
+            break;
+        }
+        snprintf(rule->output, COOK_MAX_PATH, "%s", token);
+
+        while ((token = strtok(NULL, separators)) != NULL)
+        {
+            if (token[0] == '-' && strchr(token, '='))
+            {
+                if (!parse_cook_setting(rule, token))
+                {
+                    LOGF("%s(%u): bad setting '%s' for a %s rule\n", path, first_line, token, cook_kind_names[rule->kind]);
+                    result = false;
+                    break;
+                }
+                continue;
+            }
+
+            if (rule->num_inputs == COOK_MAX_INPUTS || strlen(token) >= COOK_MAX_PATH)
+            {
+                LOGF("%s(%u): more than %d inputs or an input path that's too long\n", path, first_line, COOK_MAX_INPUTS);
+                result = false;
+                break;
+            }
+
+            // name=file only means something to packs, elsewhere '=' is just part of the path.
+            char *split = (rule->kind == COOK_PACK) ? strchr(token, '=') : NULL;
+            uint i = rule->num_inputs++;
+            if (split)
+            {
+                *split = 0;
+                snprintf(rule->names[i], COOK_MAX_PATH, "%s", token);
+                snprintf(rule->inputs[i], COOK_MAX_PATH, "%s", split + 1);
+            }
+            else
+            {
+                snprintf(rule->names[i], COOK_MAX_PATH, "%s", token);
+                snprintf(rule->inputs[i], COOK_MAX_PATH, "%s", token);
+            }
+        }
+
+        uint min_inputs = (rule->kind == COOK_ORM) ? MATERIAL_CHANNEL_COUNT : 1;
+        if (result && rule->num_inputs < min_inputs)
+        {
+            LOGF("%s(%u): %s needs %u inputs\n", path, first_line, rule->output, min_inputs);
+            result = false;
+        }
+
+        ++num_rules;
+        line = next;
+    }
+
+    free(text);
+    if (!result)
+    {
+        free(rules);
+        return NULL;
+    }
+
+    *out_num_rules = num_rules;
+    return rules;
+}
+
+/// ============ ORDERING ============ ///
+// Depth first from every rule, producers before consumers. Cycles and two rules writing the
+//   same output are errors.
+static bool visit_cook_rule(Cook_Rule *rules, uint index, uint *order, uint *num_ordered)
+{
+    auto rule = &rules[index];
+    if (rule->visit == 2)
+        return true;
+    if (rule->visit == 1)
+    {
+        LOGF("Dependency cycle through %s\n", rule->output);
+        return false;
+    }
+
+    rule->visit = 1;
+    for (auto i = 0; i != rule->num_inputs; ++i)
+        if (rule->producers[i] >= 0 && !visit_cook_rule(rules, (uint)rule->producers[i], order, num_ordered))
+            return false;
+    rule->visit = 2;
+
+    order[(*num_ordered)++] = index;
+    return true;
+}
+
+static bool sort_cook_rules(Cook_Rule *rules, uint num_rules, uint *order)
+{
+    char a[PACK_MAX_PATH], b[PACK_MAX_PATH];
+
+    for (auto r = 0; r != num_rules; ++r)
+    {
+        normalize_pack_path(rules[r].output, a);
+        for (auto other = r + 1; other != num_rules; ++other)
+        {
+            normalize_pack_path(rules[other].output, b);
+            if (!strcmp(a, b))
+            {
+                LOGF("%s is written by the rules on line %u and %u\n", rules[r].output, rules[r].line, rules[other].line);
+                return false;
+            }
+        }
+
+        for (auto i = 0; i != rules[r].num_inputs; ++i)
+        {
+            rules[r].producers[i] = -1;
+            normalize_pack_path(rules[r].inputs[i], a);
+            for (auto other = 0; other != num_rules; ++other)
+            {
+                normalize_pack_path(rules[other].output, b);
+                if (!strcmp(a, b))
+                    rules[r].producers[i] = (int)other;
+            }
+        }
+    }
+
+    uint num_ordered = 0;
+    for (auto r = 0; r != num_rules; ++r)
+        if (!visit_cook_rule(rules, r, order, &num_ordered))
+            return false;
+    return true;
+}
+
+/// ============ COOKING ============ ///
+// Everything that decides what the rule writes. False if an input is missing.
+static bool compute_cook_key(const Cook_Rule *rule, uint64_t *out_key, uint64_t *out_bytes_hashed)
+{
+    char settings[256] = "";
+    uint64_t key = mix_cook_key(0, cook_kind_names[rule->kind]);
+
+    switch (rule->kind)
+    {
+        case COOK_MESH:
+            key = mix_cook_key(key, ((uint64_t)MESH_COOK_VERSION << 32) | MESH_BLOB_VERSION);
+            snprintf(settings, sizeof(settings), "flags=%u overdraw=%.9g weld=%.9g lods=%u", (uint)(ASSIMP_IMPORT_FLAGS),
+                     rule->overdraw_threshold, rule->weld_epsilon, rule->max_lods);
+            break;
+        case COOK_TEXTURE:
+            key = mix_cook_key(key, ((uint64_t)TEXTURE_COOK_VERSION << 32) | MIP_MAX_LEVELS);
+            snprintf(settings, sizeof(settings), "filter=%s", get_mip_filter_name(rule->filter));
+            break;
+        case COOK_ORM:
+            key = mix_cook_key(key, ((uint64_t)TEXTURE_COOK_VERSION << 32) | MIP_MAX_LEVELS);
+            snprintf(settings, sizeof(settings), "filter=%s channels=%u,%u,%u", get_mip_filter_name(rule->filter),
+                     ORM_DEFAULT_CHANNELS[0], ORM_DEFAULT_CHANNELS[1], ORM_DEFAULT_CHANNELS[2]);
+            break;
+        case COOK_SHADER:
+            key = mix_cook_key(key, (uint64_t)COOK_SHADER_VERSION);
+            break;
+        case COOK_PACK:
+            key = mix_cook_key(key, ((uint64_t)PACK_VERSION << 32) | PACK_ALIGNMENT);
+            break;
+        default:
+            break;
+    }
+    key = mix_cook_key(key, settings);
+
+    uint64_t hash, size;
+    for (auto i = 0; i != rule->num_inputs; ++i)
+    {
+        if (!hash_cook_file(rule->inputs[i], &hash, &size))
+        {
+            LOGF("Missing input %s for %s\n", rule->inputs[i], rule->output);
+            return false;
+        }
+        key = mix_cook_key(mix_cook_key(key, rule->names[i]), hash);
+        *out_bytes_hashed += size;
+    }
+
+    // Includes are inputs nobody listed.
+    if (rule->kind == COOK_SHADER)
+    {
+        if (!mix_cook_includes(&key, rule->inputs[0], out_bytes_hashed))
+        {
+            LOGF("Failed to read the includes of %s\n", rule->inputs[0]);
+            return false;
+        }
+    }
+
+    *out_key = key;
+    return true;
+}
+
+static bool cook_rule(const Cook_Rule *rule)
+{
+    make_cook_parent_directories(rule->output);
+
+    switch (rule->kind)
+    {
+        case COOK_MESH:
+            return cook_mesh_file(rule->inputs[0], rule->output, rule->overdraw_threshold, rule->weld_epsilon, rule->max_lods);
+
+        case COOK_TEXTURE:
+            return cook_texture_file(rule->inputs[0], rule->output, rule->filter);
+
+        case COOK_ORM:
+        {
+            const char *inputs[MATERIAL_CHANNEL_COUNT] = { rule->inputs[0], rule->inputs[1], rule->inputs[2] };
+            return cook_orm_texture_files(inputs, rule->output, rule->filter);
+        }
+
+        case COOK_SHADER:
+        {
+            FILE *file = fopen(rule->output, "wb");
+            if (!file)
+            {
+                LOGF("Failed to open %s for writing.\n", rule->output);
+                return false;
+            }
+            auto seen = (Cook_Path_List *)calloc(1, sizeof(Cook_Path_List));
+            bool result = flatten_hlsl_file(rule->inputs[0], seen, file);
+            result = (fclose(file) == 0) && result;
+            free(seen);
+            return result;
+        }
+
+        case COOK_PACK:
+        {
+            const char *files[COOK_MAX_INPUTS], *names[COOK_MAX_INPUTS];
+            for (auto i = 0; i != rule->num_inputs; ++i)
+            {
+                files[i] = rule->inputs[i];
+                names[i] = rule->names[i];
+            }
+            return write_pack(rule->output, files, rule->num_inputs, names);
+        }
+
+        default:
+            return false;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    bool force = false;
+    const char *cache_directory = ".build/cook_cache";
+    const char *manifest = NULL;
+
+    for (auto i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "-force"))
+            force = true;
+        else if (!strcmp(argv[i], "-cache") && i + 1 < argc)
+            cache_directory = argv[++i];
+        else if (!manifest)
+            manifest = argv[i];
+        else
+            manifest = NULL, i = argc;
+    }
+
+    if (!manifest)
+    {
+        printf("Usage: %s [-force] [-cache <directory>] <manifest>\n", argv[0]);
+        return 1;
+    }
+
+    uint num_rules;
+    Cook_Rule *rules = load_cook_manifest(manifest, &num_rules);
+    if (!rules)
+        return 1;
+
+    uint *order = (uint *)malloc(num_rules * sizeof(uint));
+    if (!sort_cook_rules(rules, num_rules, order))
+    {
+        free(order);
+        free(rules);
+        return 1;
+    }
+
+    Cook_Cache cache;
+    open_cook_cache(&cache, cache_directory);
+
+    uint num_current = 0, num_restored = 0, num_cooked = 0, num_failed = 0;
+    uint64_t bytes_hashed = 0;
+    double hash_ms = 0.0, cook_ms = 0.0;
+
+    for (auto o = 0; o != num_rules; ++o)
+    {
+        auto rule = &rules[order[o]];
+
+        for (auto i = 0; i != rule->num_inputs && !rule->failed; ++i)
+            rule->failed = rule->producers[i] >= 0 && rules[rule->producers[i]].failed;
+        if (rule->failed)
+        {
+            LOGF("Skipped %s, an input failed to cook\n", rule->output);
+            ++num_failed;
+            continue;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        uint64_t key = 0;
+        rule->failed = !compute_cook_key(rule, &key, &bytes_hashed);
+        hash_ms += get_ms_since(start);
+        if (rule->failed)
+        {
+            ++num_failed;
+            continue;
+        }
+
+        if (!force && is_cook_output_current(&cache, rule->output, key))
+        {
+            ++num_current;
+            continue;
+        }
+
+        start = std::chrono::steady_clock::now();
+        if (!force && restore_cook_output(&cache, rule->output, key))
+        {
+            LOGF("Restored %s\n", rule->output);
+            ++num_restored;
+        }
+        else if (cook_rule(rule))
+        {
+            store_cook_output(&cache, rule->output, key);
+            LOGF("Cooked %s\n", rule->output);
+            ++num_cooked;
+        }
+        else
+        {
+            LOGF("Failed to cook %s (%s, line %u)\n", rule->output, manifest, rule->line);
+            rule->failed = true;
+            ++num_failed;
+        }
+        cook_ms += get_ms_since(start);
+    }
+
+    close_cook_cache(&cache);
+
+    LOGF("%u outputs: %u up to date, %u restored, %u cooked, %u failed\n", num_rules, num_current, num_restored, num_cooked, num_failed);
+    LOGF("hashing %.2f MB took %.2fms, cooking took %.2fms\n", bytes_hashed / (1024.0 * 1024.0), hash_ms, cook_ms);
+
+    free(order);
+    free(rules);
+    return num_failed ? 1 : 0;
+}
@@ -0,0 +1,537 @@
+#ifndef _COOK_CACHE_H_
+#define _COOK_CACHE_H_
+#include "stdafx.h"
+
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+#include "file_map.h"
+#include "pack.h"
+
+/// ============ COOK CACHE ============ ///
+// Incremental cooking keyed on content, not timestamps. Every output gets a 64-bit key hashed from
+//   what produced it: the kind of cook, the format versions it writes, its settings and the name
+//   and contents of every input (including HLSL #includes found by scanning). The index remembers
+//   the key each output was last cooked with, so an output is up to date if its key still matches
+//   and the file is still there with the size it was written with; nothing else is compared.
+//
+// Cooked outputs are also copied into a content store under their key, so switching branches
+//   back and forth or reverting a texture restores the old output instead of cooking it again.
+//   The store never shrinks on its own, delete the directory to reclaim it.
+//
+//   <directory>/index        one line per output: <key hex> <size> <output path>
+//   <directory>/<key hex>    copy of the output cooked with that key
+
+#define COOK_MAX_PATH     512
+#define COOK_MAX_INPUTS   64
+#define COOK_MAX_INCLUDES 64
+
+/// ===== Hashing =====
+// XXH64. Fast enough that hashing every input on every run costs about as much as reading it.
+
+#define COOK_PRIME64_1 0x9E3779B185EBCA87ull
+#define COOK_PRIME64_2 0xC2B2AE3D27D4EB4Full
+#define COOK_PRIME64_3 0x165667B19E3779F9ull
+#define COOK_PRIME64_4 0x85EBCA77C2B2AE63ull
+#define COOK_PRIME64_5 0x27D4EB2F165667C5ull
+
+static inline uint64_t rotl_cook_hash(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t read_cook_u64(const uchar *p)
+{
+    uint64_t x;
+    memcpy(&x, p, 8);
+    return x;
+}
+
+static inline uint read_cook_u32(const uchar *p)
+{
+    uint x;
+    memcpy(&x, p, 4);
+    return x;
+}
+
+static inline uint64_t round_cook_hash(uint64_t acc, uint64_t input)
+{
+    acc += input * COOK_PRIME64_2;
+    acc = rotl_cook_hash(acc, 31);
+    return acc * COOK_PRIME64_1;
+}
+
+static inline uint64_t merge_cook_hash(uint64_t acc, uint64_t value)
+{
+    acc ^= round_cook_hash(0, value);
+    return acc * COOK_PRIME64_1 + COOK_PRIME64_4;
+}
+
+uint64_t hash_cook_data(const void *data, size_t size, uint64_t seed = 0)
+{
+    auto p = (const uchar *)data;
+    auto end = p + size;
+    uint64_t hash;
+
+    if (size >= 32)
+    {
+        uint64_t v1 = seed + COOK_PRIME64_1 + COOK_PRIME64_2;
+        uint64_t v2 = seed + COOK_PRIME64_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - COOK_PRIME64_1;
+
+        for (; p + 32 <= end; p += 32)
+        {
+            v1 = round_cook_hash(v1, read_cook_u64(p));
+            v2 = round_cook_hash(v2, read_cook_u64(p + 8));
+            v3 = round_cook_hash(v3, read_cook_u64(p + 16));
+            v4 = round_cook_hash(v4, read_cook_u64(p + 24));
+        }
+
+        hash = rotl_cook_hash(v1, 1) + rotl_cook_hash(v2, 7) + rotl_cook_hash(v3, 12) + rotl_cook_hash(v4, 18);
+        hash = merge_cook_hash(hash, v1);
+        hash = merge_cook_hash(hash, v2);
+        hash = merge_cook_hash(hash, v3);
+        hash = merge_cook_hash(hash, v4);
+    }
+    else
+    {
+        hash = seed + COOK_PRIME64_5;
+    }
+
+    hash += (uint64_t)size;
+
+    for (; p + 8 <= end; p += 8)
+    {
+        hash ^= round_cook_hash(0, read_cook_u64(p));
+        hash = rotl_cook_hash(hash, 27) * COOK_PRIME64_1 + COOK_PRIME64_4;
+    }
+    if (p + 4 <= end)
+    {
+        hash ^= (uint64_t)read_cook_u32(p) * COOK_PRIME64_1;
+        hash = rotl_cook_hash(hash, 23) * COOK_PRIME64_2 + COOK_PRIME64_3;
+        p += 4;
+    }
+    for (; p < end; ++p)
+    {
+        hash ^= (*p) * COOK_PRIME64_5;
+        hash = rotl_cook_hash(hash, 11) * COOK_PRIME64_1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= COOK_PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= COOK_PRIME64_3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+// Folds a string into a key, NUL included so "ab" + "c" and "a" + "bc" differ.
+static inline uint64_t mix_cook_key(uint64_t key, const char *text)
+{
+    return hash_cook_data(text, strlen(text) + 1, key);
+}
+
+static inline uint64_t mix_cook_key(uint64_t key, uint64_t value)
+{
+    return hash_cook_data(&value, sizeof(value), key);
+}
+
+// False if the file can't be opened. Empty files hash like empty buffers.
+bool hash_cook_file(const char *path, uint64_t *out_hash, uint64_t *out_size = NULL)
+{
+    Mapped_File file;
+    if (map_file(&file, path))
+    {
+        *out_hash = hash_cook_data(file.data, file.size);
+        if (out_size)
+            *out_size = file.size;
+        unmap_file(&file);
+        return true;
+    }
+
+    // map_file refuses empty files.
+    FILE *test = fopen(path, "rb");
+    if (!test)
+        return false;
+    fclose(test);
+
+    *out_hash = hash_cook_data(NULL, 0);
+    if (out_size)
+        *out_size = 0;
+    return true;
+}
+
+/// ===== Files =====
+static bool get_cook_file_size(const char *path, uint64_t *out_size)
+{
+    struct stat st;
+    if (stat(path, &st) != 0 || !(st.st_mode & S_IFREG))
+        return false;
+    *out_size = (uint64_t)st.st_size;
+    return true;
+}
+
+static void make_cook_directory(const char *path)
+{
+#ifdef _WIN32
+    _mkdir(path);
+#else
+    mkdir(path, 0755);
+#endif
+}
+
+// Creates every directory leading up to the file at path.
+void make_cook_parent_directories(const char *path)
+{
+    char partial[COOK_MAX_PATH];
+    uint length = (uint)strlen(path);
+    if (length >= COOK_MAX_PATH)
+        return;
+
+    for (auto i = 1; i < length; ++i)
+    {
+        if (path[i] == '/' || path[i] == '\\')
+        {
+            memcpy(partial, path, i);
+            partial[i] = 0;
+            make_cook_directory(partial);
+        }
+    }
+}
+
+bool copy_cook_file(const char *from, const char *to)
+{
+    Mapped_File source;
+    bool mapped = map_file(&source, from);
+    uint64_t size;
+    if (!mapped && !get_cook_file_size(from, &size))
+        return false;
+
+    make_cook_parent_directories(to);
+    FILE *file = fopen(to, "wb");
+    bool result = file != NULL;
+    if (file)
+    {
+        if (mapped)
+            result = fwrite(source.data, 1, source.size, file) == source.size;
+        result = (fclose(file) == 0) && result;
+    }
+
+    if (mapped)
+        unmap_file(&source);
+    if (!result)
+        LOGF("Failed to copy %s to %s\n", from, to);
+    return result;
+}
+
+/// ===== HLSL includes =====
+// Only #include "file" is followed, resolved relative to the including file like fxc does.
+//   Each file is taken once however often it's included, as if it had #pragma once,
+//   which also keeps include cycles from recursing forever. More than COOK_MAX_INCLUDES files
+//   fails the rule, a key missing an include would leave its output stale when it changes.
+
+struct Cook_Path_List
+{
+    char paths[COOK_MAX_INCLUDES][COOK_MAX_PATH];
+    uint count;
+    bool full; // a path didn't fit
+};
+
+static bool add_cook_path(Cook_Path_List *it, const char *path)
+{
+    char normalized[PACK_MAX_PATH], other[PACK_MAX_PATH];
+    normalize_pack_path(path, normalized);
+    for (auto i = 0; i != it->count; ++i)
+    {
+        normalize_pack_path(it->paths[i], other);
+        if (!strcmp(normalized, other))
+            return false;
+    }
+
+    if (it->count == COOK_MAX_INCLUDES)
+    {
+        LOGF("More than %d includes, %s doesn't fit.\n", COOK_MAX_INCLUDES, path);
+        it->full = true;
+        return false;
+    }
+
+    snprintf(it->paths[it->count++], COOK_MAX_PATH, "%s", path);
+    return true;
+}
+
+// Name of the include on this line, or 0 if the line isn't one.
+static int parse_hlsl_include(const char *line, const char *end, const char **out_name)
+{
+    while (line < end && (*line == ' ' || *line == '\t'))
+        ++line;
+    if (line == end || *line++ != '#')
+        return 0;
+    while (line < end && (*line == ' ' || *line == '\t'))
+        ++line;
+    if (end - line < 7 || memcmp(line, "include", 7))
+        return 0;
+    line += 7;
+    while (line < end && (*line == ' ' || *line == '\t'))
+        ++line;
+    if (line == end || *line++ != '"')
+        return 0;
+
+    auto name = line;
+    while (line < end && *line != '"')
+        ++line;
+    if (line == end)
+        return 0;
+
+    *out_name = name;
+    return (int)(line - name);
+}
+
+static bool flatten_hlsl_source(const char *path, Cook_Path_List *seen, FILE *out)
+{
+    Mapped_File file;
+    if (!map_file(&file, path))
+    {
+        LOGF("Failed to open %s\n", path);
+        return false;
+    }
+
+    // Directory of path, includes are relative to it.
+    int directory = 0;
+    for (auto i = 0; path[i]; ++i)
+        if (path[i] == '/' || path[i] == '\\')
+            directory = i + 1;
+
+    auto text = (const char *)file.data;
+    auto end = text + file.size;
+    bool result = true;
+    uint line_number = 1;
+
+    if (out)
+        fprintf(out, "#line 1 \"%s\"\n", path);
+
+    for (auto line = text; line < end && result; ++line_number)
+    {
+        auto line_end = (const char *)memchr(line, '\n', end - line);
+        line_end = line_end ? line_end + 1 : end;
+
+        const char *name;
+        int name_length = parse_hlsl_include(line, line_end, &name);
+        if (name_length)
+        {
+            char include[COOK_MAX_PATH];
+            snprintf(include, sizeof(include), "%.*s%.*s", directory, path, name_length, name);
+
+            if (add_cook_path(seen, include))
+            {
+                result = flatten_hlsl_source(include, seen, out);
+                if (out)
+                    fprintf(out, "\n#line %u \"%s\"\n", line_number + 1, path);
+            }
+            else if (seen->full)
+                result = false;
+            else if (out)
+                fputc('\n', out);
+        }
+        else if (out)
+        {
+            fwrite(line, 1, line_end - line, out);
+        }
+
+        line = line_end;
+    }
+
+    unmap_file(&file);
+    return result;
+}
+
+// Adds path and everything it includes to seen. With out, also writes path with every include
+//   pasted in place and #line directives so errors still point at the original files.
+// False if a file can't be read or there are more than COOK_MAX_INCLUDES of them.
+bool flatten_hlsl_file(const char *path, Cook_Path_List *seen, FILE *out = NULL)
+{
+    add_cook_path(seen, path);
+    return !seen->full && flatten_hlsl_source(path, seen, out);
+}
+
+// Folds the name and contents of every file path includes into key, path itself excluded since
+//   it's an input already. False if one can't be read or there are too many.
+bool mix_cook_includes(uint64_t *key, const char *path, uint64_t *out_bytes_hashed = NULL)
+{
+    auto seen = (Cook_Path_List *)calloc(1, sizeof(Cook_Path_List));
+    bool result = flatten_hlsl_file(path, seen);
+    uint64_t hash, size;
+    for (auto i = 1; i < seen->count && result; ++i)
+    {
+        result = hash_cook_file(seen->paths[i], &hash, &size);
+        *key = mix_cook_key(mix_cook_key(*key, seen->paths[i]), hash);
+        if (out_bytes_hashed)
+            *out_bytes_hashed += size;
+    }
+    free(seen);
+    return result;
+}
+
+/// ===== Index and store =====
+struct Cook_Record
+{
+    char output[COOK_MAX_PATH];
+    uint64_t key;
+    uint64_t size;
+};
+
+struct Cook_Cache
+{
+    char directory[COOK_MAX_PATH];
+    Cook_Record *records;
+    uint num_records;
+    uint max_records;
+    bool dirty;
+};
+
+static void get_cook_store_path(const Cook_Cache *it, uint64_t key, char *out, size_t size)
+{
+    snprintf(out, size, "%s/%016llx", it->directory, (unsigned long long)key);
+}
+
+// A missing or unreadable index just means everything is cooked again.
+void open_cook_cache(Cook_Cache *it, const char *directory)
+{
+    ZeroThat(it);
+    snprintf(it->directory, sizeof(it->directory), "%s", directory);
+
+    char path[COOK_MAX_PATH + 16];
+    snprintf(path, sizeof(path), "%s/index", directory);
+    make_cook_parent_directories(path);
+
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return;
+
+    char line[COOK_MAX_PATH + 64];
+    while (fgets(line, sizeof(line), file))
+    {
+        unsigned long long key, size;
+        int consumed = 0;
+        if (sscanf(line, "%llx %llu %n", &key, &size, &consumed) != 2 || !consumed)
+            continue;
+
+        char *output = line + consumed;
+        output[strcspn(output, "\r\n")] = 0;
+        if (!*output)
+            continue;
+
+        if (it->num_records == it->max_records)
+        {
+            it->max_records = it->max_records ? it->max_records * 2 : 64;
+            it->records = (Cook_Record *)realloc(it->records, it->max_records * sizeof(Cook_Record));
+        }
+
+        auto record = &it->records[it->num_records++];
+        snprintf(record->output, sizeof(record->output), "%s", output);
+        record->key = key;
+        record->size = size;
+    }
+
+    fclose(file);
+}
+
+// Writes the index back if anything changed.
+void close_cook_cache(Cook_Cache *it)
+{
+    if (it->dirty)
+    {
+        char path[COOK_MAX_PATH + 16], temp[COOK_MAX_PATH + 16];
+        snprintf(path, sizeof(path), "%s/index", it->directory);
+        snprintf(temp, sizeof(temp), "%s/index.tmp", it->directory);
+
+        // Written aside and renamed so a crash halfway can't leave keys for outputs that were never written.
+        FILE *file = fopen(temp, "wb");
+        if (file)
+        {
+            for (auto i = 0; i != it->num_records; ++i)
+                fprintf(file, "%016llx %llu %s\n", (unsigned long long)it->records[i].key,
+                        (unsigned long long)it->records[i].size, it->records[i].output);
+            fclose(file);
+            remove(path);
+            if (rename(temp, path) != 0)
+                LOGF("Failed to write %s\n", path);
+        }
+        else
+        {
+            LOGF("Failed to write %s\n", temp);
+        }
+    }
+
+    free(it->records);
+    ZeroThat(it);
+}
+
+Cook_Record *find_cook_record(Cook_Cache *it, const char *output)
+{
+    for (auto i = 0; i != it->num_records; ++i)
+        if (!strcmp(it->records[i].output, output))
+            return &it->records[i];
+    return NULL;
+}
+
+static void set_cook_record(Cook_Cache *it, const char *output, uint64_t key, uint64_t size)
+{
+    auto record = find_cook_record(it, output);
+    if (!record)
+    {
+        if (it->num_records == it->max_records)
+        {
+            it->max_records = it->max_records ? it->max_records * 2 : 64;
+            it->records = (Cook_Record *)realloc(it->records, it->max_records * sizeof(Cook_Record));
+        }
+        record = &it->records[it->num_records++];
+        snprintf(record->output, sizeof(record->output), "%s", output);
+    }
+
+    record->key = key;
+    record->size = size;
+    it->dirty = true;
+}
+
+// True if output exists as it was last cooked with key.
+bool is_cook_output_current(Cook_Cache *it, const char *output, uint64_t key)
+{
+    auto record = find_cook_record(it, output);
+    uint64_t size;
+    return record && record->key == key && get_cook_file_size(output, &size) && size == record->size;
+}
+
+// Copies the output cooked with key out of the store, if it's there.
+bool restore_cook_output(Cook_Cache *it, const char *output, uint64_t key)
+{
+    char stored[COOK_MAX_PATH + 32];
+    get_cook_store_path(it, key, stored, sizeof(stored));
+
+    uint64_t size;
+    if (!get_cook_file_size(stored, &size) || !copy_cook_file(stored, output))
+        return false;
+
+    set_cook_record(it, output, key, size);
+    return true;
+}
+
+// Records a freshly cooked output under key and copies it into the store.
+bool store_cook_output(Cook_Cache *it, const char *output, uint64_t key)
+{
+    char stored[COOK_MAX_PATH + 32];
+    get_cook_store_path(it, key, stored, sizeof(stored));
+
+    uint64_t size;
+    if (!get_cook_file_size(output, &size))
+        return false;
+
+    // The output is current either way, a failed copy only costs the next restore.
+    set_cook_record(it, output, key, size);
+    return copy_cook_file(output, stored);
+}
+
+#endif
@@ -0,0 +1,235 @@
+#ifndef _DDS_H_
+#define _DDS_H_
+#include "stdafx.h"
+
+#include "texture_format.h"
+#include "file_map.h"
+
+/// ============ DDS FILES ============ ///
+// Just enough of the DDS container for the texture cooker (texture_cooker.cpp) and the
+//   runtime: 2D textures with a mip chain, no arrays, cubes or volumes.
+// write_dds always emits the DX10 extension header so BC7 and the sRGB variants are
+//   unambiguous; open_dds also takes the legacy DXT1/DXT5/ATI1/ATI2 FourCCs other tools write.
+//
+//   "DDS " magic
+//   Dds_Header
+//   Dds_Header_Dx10 (if pixel_format.four_cc == "DX10")
+//   mip levels, largest first, tightly packed
+
+#define DDS_MAGIC             0x20534444 // "DDS "
+#define DDS_MAX_LEVELS        16
+
+#define DDS_FOURCC(a, b, c, d) ((uint)(a) | ((uint)(b) << 8) | ((uint)(c) << 16) | ((uint)(d) << 24))
+
+#define DDSD_CAPS             0x1
+#define DDSD_HEIGHT           0x2
+#define DDSD_WIDTH            0x4
+#define DDSD_PIXELFORMAT      0x1000
+#define DDSD_MIPMAPCOUNT      0x20000
+#define DDSD_LINEARSIZE       0x80000
+#define DDPF_FOURCC           0x4
+#define DDSCAPS_COMPLEX       0x8
+#define DDSCAPS_TEXTURE       0x1000
+#define DDSCAPS_MIPMAP        0x400000
+#define DDS_DIMENSION_TEXTURE2D 3
+
+struct Dds_Pixel_Format
+{
+    uint size;
+    uint flags;
+    uint four_cc;
+    uint rgb_bit_count;
+    uint r_mask;
+    uint g_mask;
+    uint b_mask;
+    uint a_mask;
+};
+
+struct Dds_Header
+{
+    uint size;
+    uint flags;
+    uint height;
+    uint width;
+    uint pitch_or_linear_size;
+    uint depth;
+    uint mip_map_count;
+    uint reserved1[11];
+    Dds_Pixel_Format pixel_format;
+    uint caps;
+    uint caps2;
+    uint caps3;
+    uint caps4;
+    uint reserved2;
+};
+
+struct Dds_Header_Dx10
+{
+    uint dxgi_format;
+    uint resource_dimension;
+    uint misc_flag;
+    uint array_size;
+    uint misc_flags2;
+};
+
+static_assert(sizeof(Dds_Header) == 124, "Dds_Header must match the file layout.");
+static_assert(sizeof(Dds_Header_Dx10) == 20, "Dds_Header_Dx10 must match the file layout.");
+
+/// ============ WRITING ============ ///
+// levels[i] holds mip i in format, get_texture_level_size bytes of it.
+bool write_dds(const char *path, Texture_Format format, uint width, uint height, const void **levels, uint num_levels)
+{
+    Dds_Header header = {};
+    header.size = sizeof(Dds_Header);
+    header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_LINEARSIZE;
+    header.height = height;
+    header.width = width;
+    header.pitch_or_linear_size = (uint)get_texture_level_size(format, width, height);
+    header.mip_map_count = num_levels;
+    header.pixel_format.size = sizeof(Dds_Pixel_Format);
+    header.pixel_format.flags = DDPF_FOURCC;
+    header.pixel_format.four_cc = DDS_FOURCC('D', 'X', '1', '0');
+    header.caps = DDSCAPS_TEXTURE;
+
+    if (num_levels > 1)
+    {
+        header.flags |= DDSD_MIPMAPCOUNT;
+        header.caps |= DDSCAPS_COMPLEX | DDSCAPS_MIPMAP;
+    }
+
+    Dds_Header_Dx10 dx10 = {};
+    dx10.dxgi_format = format;
+    dx10.resource_dimension = DDS_DIMENSION_TEXTURE2D;
+    dx10.array_size = 1;
+
+    FILE *file = fopen(path, "wb");
+    if (!file)
+    {
+        LOGF("Failed to open %s for writing.\n", path);
+        return false;
+    }
+
+    uint magic = DDS_MAGIC;
+    bool result = fwrite(&magic, sizeof(magic), 1, file) == 1 &&
+                  fwrite(&header, sizeof(header), 1, file) == 1 &&
+                  fwrite(&dx10, sizeof(dx10), 1, file) == 1;
+
+    for (auto i = 0; result && i != num_levels; ++i)
+    {
+        size_t size = get_texture_level_size(format, get_mip_dimension(width, i), get_mip_dimension(height, i));
+        result = fwrite(levels[i], 1, size, file) == size;
+    }
+
+    fclose(file);
+
+    if (!result)
+        LOGF("Failed to write %s.\n", path);
+    return result;
+}
+
+/// ============ READING ============ ///
+struct Dds_File
+{
+    Mapped_File file;
+    Texture_Format format;
+    uint width;
+    uint height;
+    uint num_levels;
+    const uchar *levels[DDS_MAX_LEVELS];
+};
+
+static Texture_Format get_legacy_dds_format(uint four_cc)
+{
+    switch (four_cc)
+    {
+        case DDS_FOURCC('D', 'X', 'T', '1'): return TEXTURE_FORMAT_BC1;
+        case DDS_FOURCC('D', 'X', 'T', '5'): return TEXTURE_FORMAT_BC3;
+        case DDS_FOURCC('A', 'T', 'I', '1'):
+        case DDS_FOURCC('B', 'C', '4', 'U'): return TEXTURE_FORMAT_BC4;
+        case DDS_FOURCC('A', 'T', 'I', '2'):
+        case DDS_FOURCC('B', 'C', '5', 'U'): return TEXTURE_FORMAT_BC5;
+        default:                             return TEXTURE_FORMAT_UNKNOWN;
+    }
+}
+
+// Parses a DDS file that's already in memory (e.g. a view into a pack, see pack.h), the level
+//   pointers point into data. name is only for the log.
+bool open_dds_memory(Dds_File *it, const void *data, size_t size, const char *name)
+{
+    ZeroThat(it);
+
+    auto base = (const uchar *)data;
+    size_t offset = sizeof(uint) + sizeof(Dds_Header);
+    auto header = (const Dds_Header *)(base + sizeof(uint));
+
+    if (size < offset || *(const uint *)base != DDS_MAGIC || header->size != sizeof(Dds_Header))
+    {
+        LOGF("Not a DDS file: %s\n", name);
+        return false;
+    }
+
+    if ((header->pixel_format.flags & DDPF_FOURCC) && header->pixel_format.four_cc == DDS_FOURCC('D', 'X', '1', '0'))
+    {
+        auto dx10 = (const Dds_Header_Dx10 *)(base + offset);
+        offset += sizeof(Dds_Header_Dx10);
+
+        if (size >= offset && dx10->resource_dimension == DDS_DIMENSION_TEXTURE2D && dx10->array_size <= 1)
+            it->format = (Texture_Format)dx10->dxgi_format;
+    }
+    else if (header->pixel_format.flags & DDPF_FOURCC)
+    {
+        it->format = get_legacy_dds_format(header->pixel_format.four_cc);
+    }
+
+    if (!get_texture_format_bytes(it->format))
+    {
+        LOGF("Unsupported DDS format in %s\n", name);
+        return false;
+    }
+
+    it->width = header->width;
+    it->height = header->height;
+    it->num_levels = (header->flags & DDSD_MIPMAPCOUNT && header->mip_map_count) ? header->mip_map_count : 1;
+    if (it->num_levels > DDS_MAX_LEVELS)
+        it->num_levels = DDS_MAX_LEVELS;
+
+    for (auto i = 0; i != it->num_levels; ++i)
+    {
+        size_t level_size = get_texture_level_size(it->format, get_mip_dimension(it->width, i), get_mip_dimension(it->height, i));
+        if (offset + level_size > size)
+        {
+            LOGF("Mip %d is out of bounds: %s\n", i, name);
+            return false;
+        }
+
+        it->levels[i] = base + offset;
+        offset += level_size;
+    }
+
+    return true;
+}
+
+// Maps a DDS file, the level pointers point into the mapping and stay valid until close_dds.
+bool open_dds(Dds_File *it, const char *path)
+{
+    Mapped_File file;
+    if (!map_file(&file, path))
+        return false;
+
+    if (!open_dds_memory(it, file.data, file.size, path))
+    {
+        unmap_file(&file);
+        return false;
+    }
+
+    it->file = file;
+    return true;
+}
+
+void close_dds(Dds_File *it)
+{
+    unmap_file(&it->file);
+    ZeroThat(it);
+}
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef _FILE_MAP_H_
+#define _FILE_MAP_H_
+#include "stdafx.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Read-only view of a whole file. The pages are owned by the OS, so nothing gets
+//   copied until something actually touches them.
+struct Mapped_File
+{
+    void *data;
+    size_t size;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+};
+
+bool map_file(Mapped_File *it, const char *path)
+{
+    ZeroThat(it);
+
+#ifdef _WIN32
+    it->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (it->file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER li;
+    GetFileSizeEx(it->file, &li);
+    it->size = (size_t)li.QuadPart;
+
+    if (it->size)
+    {
+        it->mapping = CreateFileMappingA(it->file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (it->mapping)
+            it->data = MapViewOfFile(it->mapping, FILE_MAP_READ, 0, 0, 0);
+    }
+
+    if (!it->data)
+    {
+        if (it->mapping)
+            CloseHandle(it->mapping);
+        CloseHandle(it->file);
+        ZeroThat(it);
+        return false;
+    }
+#else
+    it->fd = open(path, O_RDONLY);
+    if (it->fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(it->fd, &st) != 0 || st.st_size == 0)
+    {
+        close(it->fd);
+        ZeroThat(it);
+        return false;
+    }
+
+    it->size = (size_t)st.st_size;
+    it->data = mmap(NULL, it->size, PROT_READ, MAP_PRIVATE, it->fd, 0);
+    if (it->data == MAP_FAILED)
+    {
+        close(it->fd);
+        ZeroThat(it);
+        return false;
+    }
+#endif
+
+    return true;
+}
+
+void unmap_file(Mapped_File *it)
+{
+    if (!it->data)
+        return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(it->data);
+    CloseHandle(it->mapping);
+    CloseHandle(it->file);
+#else
+    munmap(it->data, it->size);
+    close(it->fd);
+#endif
+
+    ZeroThat(it);
+}
+
+#endif
@@ -0,0 +1,623 @@
+#ifndef _GLTF_H_
+#define _GLTF_H_
+#include "stdafx.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "mesh_common.h"
+#include "file_map.h"
+
+/// ============ GLTF BINARY (.glb) ============ ///
+// Native loader for glTF 2.0 binary files, so .glb sources don't need Assimp:
+//   - the file is mapped (file_map.h) rather than read, the JSON chunk is tokenized in place
+//   - accessors are views straight into the BIN chunk (Gltf_Accessor), read element by element
+//     into the Cpu_Mesh. Nothing goes from the file to the GPU as is: Vertex is laid out unlike
+//     anything a .glb stores, and meshes go through optimize_cpu_mesh and the cook (see
+//     mesh_cook.h) first anyway. Packed UNSIGNED_INT indices are a single memcpy.
+//   - import_gltf_primitive builds the same Cpu_Mesh import_ai_mesh does out of an aiMesh
+//     imported with ASSIMP_IMPORT_FLAGS, one per triangle primitive, in the file's order
+// Only what's in the GLB itself is read: buffers with a uri, sparse accessors and accessors
+//   without a bufferView are refused. Node transforms are ignored, same as the Assimp path.
+
+/// ============ JSON ============ ///
+// A single pass over the text fills a token array the caller provides, the parser itself
+//   allocates nothing and nests at most JSON_MAX_DEPTH deep. Passing no tokens just counts them.
+// Objects are followed by their members as key, value token pairs, arrays by their elements.
+//   skip is the token right after a token's whole subtree, which is how siblings are walked.
+// It's a tokenizer more than a validator: separators aren't checked, and numbers, true, false
+//   and null are all JSON_PRIMITIVE, told apart by whoever reads them.
+
+#define JSON_MAX_DEPTH 64
+#define JSON_NONE      (~0u)
+
+enum Json_Type {
+    JSON_OBJECT,
+    JSON_ARRAY,
+    JSON_STRING,
+    JSON_PRIMITIVE,
+};
+
+struct Json_Token {
+    uint type;
+    uint start;    // in the text, strings without their quotes
+    uint end;
+    uint size;     // members of an object, elements of an array
+    uint skip;
+};
+
+bool parse_json(const char *text, uint length, Json_Token *tokens, uint max_tokens, uint *out_count)
+{
+    uint stack[JSON_MAX_DEPTH]; // open containers
+    uint depth = 0;
+    uint count = 0;
+    *out_count = 0;
+
+    for (uint pos = 0; pos < length; ++pos)
+    {
+        char c = text[pos];
+        switch (c)
+        {
+            case ' ': case '\t': case '\r': case '\n': case ',': case ':':
+                continue;
+
+            case '}': case ']':
+            {
+                if (!depth)
+                    return false;
+                uint open = stack[--depth];
+                if (tokens)
+                {
+                    if (tokens[open].type != ((c == '}') ? JSON_OBJECT : JSON_ARRAY))
+                        return false;
+                    tokens[open].end = pos + 1;
+                    tokens[open].skip = count;
+                    if (c == '}')
+                        tokens[open].size /= 2; // counted keys and values
+                }
+                continue;
+            }
+        }
+
+        if (tokens && count == max_tokens)
+            return false;
+        if (tokens && depth)
+            ++tokens[stack[depth - 1]].size;
+
+        Json_Token token = {};
+        if (c == '{' || c == '[')
+        {
+            if (depth == JSON_MAX_DEPTH)
+                return false;
+            token.type = (c == '{') ? JSON_OBJECT : JSON_ARRAY;
+            token.start = pos;
+            stack[depth++] = count;
+        }
+        else if (c == '"')
+        {
+            token.type = JSON_STRING;
+            token.start = ++pos;
+            for (; pos < length && text[pos] != '"'; ++pos)
+                if (text[pos] == '\\')
+                    ++pos;
+            if (pos >= length)
+                return false;
+            token.end = pos;
+            token.skip = count + 1;
+        }
+        else
+        {
+            token.type = JSON_PRIMITIVE;
+            token.start = pos;
+            for (; pos < length; ++pos)
+            {
+                char p = text[pos];
+                if (p == ' ' || p == '\t' || p == '\r' || p == '\n' || p == ',' || p == ':' || p == ']' || p == '}')
+                    break;
+            }
+            token.end = pos--;
+            token.skip = count + 1;
+        }
+
+        if (tokens)
+            tokens[count] = token;
+        ++count;
+    }
+
+    if (depth)
+        return false;
+    *out_count = count;
+    return true;
+}
+
+static inline bool is_json_string(const char *text, const Json_Token *token, const char *string)
+{
+    uint length = (uint)strlen(string);
+    return token->type == JSON_STRING && token->end - token->start == length && !memcmp(&text[token->start], string, length);
+}
+
+// Value of key in object, or JSON_NONE.
+uint find_json_member(const char *text, const Json_Token *tokens, uint object, const char *key)
+{
+    if (object == JSON_NONE || tokens[object].type != JSON_OBJECT)
+        return JSON_NONE;
+
+    uint member = object + 1;
+    for (auto i = 0; i != tokens[object].size; ++i)
+    {
+        uint value = member + 1;
+        if (is_json_string(text, &tokens[member], key))
+            return value;
+        member = tokens[value].skip;
+    }
+    return JSON_NONE;
+}
+
+// Element index of array, or JSON_NONE.
+uint get_json_element(const Json_Token *tokens, uint array, uint index)
+{
+    if (array == JSON_NONE || tokens[array].type != JSON_ARRAY || index >= tokens[array].size)
+        return JSON_NONE;
+
+    uint element = array + 1;
+    for (auto i = 0; i != index; ++i)
+        element = tokens[element].skip;
+    return element;
+}
+
+// Non-negative integers only, which is all glTF indexes and sizes are.
+static uint64_t get_json_uint(const char *text, const Json_Token *tokens, uint token, uint64_t fallback)
+{
+    if (token == JSON_NONE || tokens[token].type != JSON_PRIMITIVE)
+        return fallback;
+
+    uint64_t value = 0;
+    for (auto i = tokens[token].start; i != tokens[token].end; ++i)
+    {
+        if (text[i] < '0' || text[i] > '9')
+            return fallback;
+        value = value * 10 + (uint64_t)(text[i] - '0');
+    }
+    return value;
+}
+
+static inline bool get_json_bool(const char *text, const Json_Token *tokens, uint token, bool fallback)
+{
+    if (token == JSON_NONE || tokens[token].type != JSON_PRIMITIVE)
+        return fallback;
+    return text[tokens[token].start] == 't';
+}
+
+/// ============ GLB FILE ============ ///
+// Header, then a JSON chunk and an optional BIN chunk, each 4 byte aligned.
+
+#define GLB_MAGIC      0x46546C67 // "glTF"
+#define GLB_VERSION    2
+#define GLB_CHUNK_JSON 0x4E4F534A // "JSON"
+#define GLB_CHUNK_BIN  0x004E4942 // "BIN\0"
+
+#define GLTF_BYTE           5120
+#define GLTF_UNSIGNED_BYTE  5121
+#define GLTF_SHORT          5122
+#define GLTF_UNSIGNED_SHORT 5123
+#define GLTF_UNSIGNED_INT   5125
+#define GLTF_FLOAT          5126
+
+#define GLTF_TRIANGLES      4
+#define GLTF_TRIANGLE_STRIP 5
+#define GLTF_TRIANGLE_FAN   6
+
+struct Gltf_File
+{
+    Mapped_File file;
+    const char *name;   // for the log
+    const char *json;
+    uint json_size;
+    const uchar *bin;
+    uint64_t bin_size;
+
+    Json_Token *tokens;
+    uint num_tokens;
+    uint accessors;     // root members, JSON_NONE when missing
+    uint buffer_views;
+    uint buffers;
+    uint meshes;
+};
+
+// Validates a .glb that's already in memory, which has to outlive the Gltf_File.
+bool open_gltf_memory(Gltf_File *it, const void *data, size_t size, const char *name)
+{
+    ZeroThat(it);
+    it->name = name;
+
+    auto base = (const uchar *)data;
+    uint header[5];
+    if (size < sizeof(header))
+    {
+        LOGF("Not a glTF binary: %s\n", name);
+        return false;
+    }
+    memcpy(header, base, sizeof(header));
+
+    uint json_size = header[3];
+    if (header[0] != GLB_MAGIC || header[1] != GLB_VERSION || header[2] > size || header[4] != GLB_CHUNK_JSON ||
+        (uint64_t)json_size + 20 > header[2])
+    {
+        LOGF("Not a glTF 2.0 binary: %s\n", name);
+        return false;
+    }
+    it->json = (const char *)base + 20;
+    it->json_size = json_size;
+
+    uint64_t bin_chunk = 20 + (((uint64_t)json_size + 3) & ~3ull);
+    if (bin_chunk + 8 <= header[2])
+    {
+        uint chunk[2];
+        memcpy(chunk, base + bin_chunk, sizeof(chunk));
+        if (chunk[1] == GLB_CHUNK_BIN && bin_chunk + 8 + chunk[0] <= header[2])
+        {
+            it->bin = base + bin_chunk + 8;
+            it->bin_size = chunk[0];
+        }
+    }
+
+    uint num_tokens;
+    if (!parse_json(it->json, it->json_size, NULL, 0, &num_tokens) || !num_tokens)
+    {
+        LOGF("Invalid glTF JSON: %s\n", name);
+        return false;
+    }
+    it->tokens = (Json_Token *)malloc(num_tokens * sizeof(Json_Token));
+    if (!parse_json(it->json, it->json_size, it->tokens, num_tokens, &it->num_tokens) || it->tokens[0].type != JSON_OBJECT)
+    {
+        LOGF("Invalid glTF JSON: %s\n", name);
+        free(it->tokens);
+        ZeroThat(it);
+        return false;
+    }
+
+    it->accessors = find_json_member(it->json, it->tokens, 0, "accessors");
+    it->buffer_views = find_json_member(it->json, it->tokens, 0, "bufferViews");
+    it->buffers = find_json_member(it->json, it->tokens, 0, "buffers");
+    it->meshes = find_json_member(it->json, it->tokens, 0, "meshes");
+    return true;
+}
+
+bool open_gltf(Gltf_File *it, const char *path)
+{
+    Mapped_File file;
+    if (!map_file(&file, path))
+    {
+        LOGF("Failed to open %s\n", path);
+        return false;
+    }
+
+    if (!open_gltf_memory(it, file.data, file.size, path))
+    {
+        unmap_file(&file);
+        return false;
+    }
+
+    it->file = file;
+    return true;
+}
+
+void close_gltf(Gltf_File *it)
+{
+    free(it->tokens);
+    unmap_file(&it->file);
+    ZeroThat(it);
+}
+
+/// ============ ACCESSORS ============ ///
+struct Gltf_Accessor
+{
+    const uchar *data;   // first element, inside the BIN chunk
+    uint count;
+    uint stride;         // bytes from one element to the next
+    uint component_type; // GLTF_FLOAT, GLTF_UNSIGNED_SHORT...
+    uint num_components; // 1 for SCALAR up to 16 for MAT4
+    bool normalized;
+};
+
+static uint get_gltf_component_size(uint component_type)
+{
+    switch (component_type)
+    {
+        case GLTF_BYTE: case GLTF_UNSIGNED_BYTE:   return 1;
+        case GLTF_SHORT: case GLTF_UNSIGNED_SHORT: return 2;
+        case GLTF_UNSIGNED_INT: case GLTF_FLOAT:   return 4;
+        default:                                   return 0;
+    }
+}
+
+static uint get_gltf_num_components(const char *text, const Json_Token *token)
+{
+    static const char *types[] = { "SCALAR", "VEC2", "VEC3", "VEC4", "MAT2", "MAT3", "MAT4" };
+    static const uint counts[] = { 1, 2, 3, 4, 4, 9, 16 };
+    for (auto i = 0; i != sizeof(types) / sizeof(types[0]); ++i)
+        if (is_json_string(text, token, types[i]))
+            return counts[i];
+    return 0;
+}
+
+static inline uint get_gltf_element_size(const Gltf_Accessor *it)
+{
+    return get_gltf_component_size(it->component_type) * it->num_components;
+}
+
+// Elements are back to back, so data holds exactly count * get_gltf_element_size bytes.
+static inline bool is_gltf_accessor_packed(const Gltf_Accessor *it)
+{
+    return it->stride == get_gltf_element_size(it);
+}
+
+bool get_gltf_accessor(const Gltf_File *it, uint index, Gltf_Accessor *out)
+{
+    ZeroThat(out);
+    auto text = it->json;
+    auto tokens = it->tokens;
+
+    uint accessor = get_json_element(tokens, it->accessors, index);
+    if (accessor == JSON_NONE)
+    {
+        LOGF("Accessor %u is missing: %s\n", index, it->name);
+        return false;
+    }
+
+    uint view = get_json_element(tokens, it->buffer_views, (uint)get_json_uint(text, tokens, find_json_member(text, tokens, accessor, "bufferView"), JSON_NONE));
+    if (view == JSON_NONE || find_json_member(text, tokens, accessor, "sparse") != JSON_NONE)
+    {
+        LOGF("Accessor %u has no bufferView or is sparse, which isn't supported: %s\n", index, it->name);
+        return false;
+    }
+
+    uint buffer = get_json_element(tokens, it->buffers, (uint)get_json_uint(text, tokens, find_json_member(text, tokens, view, "buffer"), JSON_NONE));
+    if (buffer != get_json_element(tokens, it->buffers, 0) || find_json_member(text, tokens, buffer, "uri") != JSON_NONE || !it->bin)
+    {
+        LOGF("Accessor %u isn't in the GLB's own buffer: %s\n", index, it->name);
+        return false;
+    }
+
+    out->count = (uint)get_json_uint(text, tokens, find_json_member(text, tokens, accessor, "count"), 0);
+    out->component_type = (uint)get_json_uint(text, tokens, find_json_member(text, tokens, accessor, "componentType"), 0);
+    out->normalized = get_json_bool(text, tokens, find_json_member(text, tokens, accessor, "normalized"), false);
+
+    uint type = find_json_member(text, tokens, accessor, "type");
+    out->num_components = (type != JSON_NONE) ? get_gltf_num_components(text, &tokens[type]) : 0;
+
+    uint element_size = get_gltf_element_size(out);
+    out->stride = (uint)get_json_uint(text, tokens, find_json_member(text, tokens, view, "byteStride"), element_size);
+
+    uint64_t view_offset = get_json_uint(text, tokens, find_json_member(text, tokens, view, "byteOffset"), 0);
+    uint64_t view_length = get_json_uint(text, tokens, find_json_member(text, tokens, view, "byteLength"), 0);
+    uint64_t offset = get_json_uint(text, tokens, find_json_member(text, tokens, accessor, "byteOffset"), 0);
+    if (!element_size || out->stride < element_size || view_offset + view_length > it->bin_size ||
+        (out->count && offset + (uint64_t)out->stride * (out->count - 1) + element_size > view_length))
+    {
+        LOGF("Accessor %u is invalid or out of bounds: %s\n", index, it->name);
+        ZeroThat(out);
+        return false;
+    }
+
+    out->data = it->bin + view_offset + offset;
+    return true;
+}
+
+// Element i as floats, normalized integers mapped to [0, 1] or [-1, 1] the way glTF says.
+static void read_gltf_floats(const Gltf_Accessor *it, uint i, float *out, uint num_components)
+{
+    const uchar *element = it->data + (size_t)i * it->stride;
+    for (auto k = 0; k != num_components; ++k)
+    {
+        if (k >= it->num_components)
+        {
+            out[k] = 0.0f;
+            continue;
+        }
+
+        switch (it->component_type)
+        {
+            case GLTF_FLOAT:          { float v;    memcpy(&v, element + k * 4, 4); out[k] = v; break; }
+            case GLTF_UNSIGNED_BYTE:  { uchar v = element[k];                     out[k] = it->normalized ? v / 255.0f : v; break; }
+            case GLTF_BYTE:           { int8_t v;   memcpy(&v, element + k, 1);   out[k] = it->normalized ? fmaxf(v / 127.0f, -1.0f) : v; break; }
+            case GLTF_UNSIGNED_SHORT: { uint16_t v; memcpy(&v, element + k * 2, 2); out[k] = it->normalized ? v / 65535.0f : v; break; }
+            case GLTF_SHORT:          { int16_t v;  memcpy(&v, element + k * 2, 2); out[k] = it->normalized ? fmaxf(v / 32767.0f, -1.0f) : v; break; }
+            case GLTF_UNSIGNED_INT:   { uint v;     memcpy(&v, element + k * 4, 4); out[k] = (float)v; break; }
+        }
+    }
+}
+
+// What glTF allows for indices, anything else would be read as the wrong size.
+static inline bool is_gltf_index_accessor(const Gltf_Accessor *it)
+{
+    return it->num_components == 1 && (it->component_type == GLTF_UNSIGNED_BYTE || it->component_type == GLTF_UNSIGNED_SHORT ||
+                                       it->component_type == GLTF_UNSIGNED_INT);
+}
+
+// Only for accessors is_gltf_index_accessor takes.
+static void read_gltf_indices(const Gltf_Accessor *it, uint *out)
+{
+    if (it->component_type == GLTF_UNSIGNED_INT && is_gltf_accessor_packed(it))
+    {
+        memcpy(out, it->data, (size_t)it->count * sizeof(uint));
+        return;
+    }
+
+    for (auto i = 0; i != it->count; ++i)
+    {
+        const uchar *element = it->data + (size_t)i * it->stride;
+        switch (it->component_type)
+        {
+            case GLTF_UNSIGNED_BYTE:  out[i] = element[0]; break;
+            case GLTF_UNSIGNED_SHORT: { uint16_t v; memcpy(&v, element, 2); out[i] = v; break; }
+            case GLTF_UNSIGNED_INT:   memcpy(&out[i], element, 4); break;
+        }
+    }
+}
+
+/// ============ IMPORT ============ ///
+static inline bool is_gltf_triangle_mode(uint mode)
+{
+    return mode == GLTF_TRIANGLES || mode == GLTF_TRIANGLE_STRIP || mode == GLTF_TRIANGLE_FAN;
+}
+
+// Primitives that import_gltf_primitive takes, points and lines aren't.
+uint count_gltf_primitives(const Gltf_File *it)
+{
+    uint count = 0;
+    for (auto m = 0; it->meshes != JSON_NONE && m != it->tokens[it->meshes].size; ++m)
+    {
+        uint primitives = find_json_member(it->json, it->tokens, get_json_element(it->tokens, it->meshes, m), "primitives");
+        for (auto p = 0; primitives != JSON_NONE && p != it->tokens[primitives].size; ++p)
+        {
+            uint primitive = get_json_element(it->tokens, primitives, p);
+            count += is_gltf_triangle_mode((uint)get_json_uint(it->json, it->tokens, find_json_member(it->json, it->tokens, primitive, "mode"), GLTF_TRIANGLES));
+        }
+    }
+    return count;
+}
+
+static uint find_gltf_primitive(const Gltf_File *it, uint index)
+{
+    for (auto m = 0; it->meshes != JSON_NONE && m != it->tokens[it->meshes].size; ++m)
+    {
+        uint primitives = find_json_member(it->json, it->tokens, get_json_element(it->tokens, it->meshes, m), "primitives");
+        for (auto p = 0; primitives != JSON_NONE && p != it->tokens[primitives].size; ++p)
+        {
+            uint primitive = get_json_element(it->tokens, primitives, p);
+            if (is_gltf_triangle_mode((uint)get_json_uint(it->json, it->tokens, find_json_member(it->json, it->tokens, primitive, "mode"), GLTF_TRIANGLES)) && !index--)
+                return primitive;
+        }
+    }
+    return JSON_NONE;
+}
+
+// Triangle primitive index (see count_gltf_primitives) to a Cpu_Mesh. Strips and fans become
+//   lists, and primitives without normals get flat ones, which needs a vertex per corner.
+// Texcoords stay as they are: glTF's top left origin is what Assimp's importer plus
+//   aiProcess_FlipUVs ends up with too.
+bool import_gltf_primitive(Cpu_Mesh *it, const Gltf_File *file, uint index)
+{
+    ZeroThat(it);
+    auto text = file->json;
+    auto tokens = file->tokens;
+
+    uint primitive = find_gltf_primitive(file, index);
+    uint attributes = find_json_member(text, tokens, primitive, "attributes");
+    uint position_index = (uint)get_json_uint(text, tokens, find_json_member(text, tokens, attributes, "POSITION"), JSON_NONE);
+    uint normal_index = (uint)get_json_uint(text, tokens, find_json_member(text, tokens, attributes, "NORMAL"), JSON_NONE);
+    uint texcoord_index = (uint)get_json_uint(text, tokens, find_json_member(text, tokens, attributes, "TEXCOORD_0"), JSON_NONE);
+    uint indices_index = (uint)get_json_uint(text, tokens, find_json_member(text, tokens, primitive, "indices"), JSON_NONE);
+    uint mode = (uint)get_json_uint(text, tokens, find_json_member(text, tokens, primitive, "mode"), GLTF_TRIANGLES);
+
+    Gltf_Accessor positions, normals, texcoords, indices;
+    if (primitive == JSON_NONE || position_index == JSON_NONE || !get_gltf_accessor(file, position_index, &positions) ||
+        (normal_index != JSON_NONE && !get_gltf_accessor(file, normal_index, &normals)) ||
+        (texcoord_index != JSON_NONE && !get_gltf_accessor(file, texcoord_index, &texcoords)) ||
+        (indices_index != JSON_NONE && !get_gltf_accessor(file, indices_index, &indices)))
+    {
+        LOGF("Primitive %u can't be imported: %s\n", index, file->name);
+        return false;
+    }
+    if (indices_index != JSON_NONE && !is_gltf_index_accessor(&indices))
+    {
+        LOGF("Primitive %u has indices that aren't unsigned scalars: %s\n", index, file->name);
+        return false;
+    }
+
+    uint num_vertices = positions.count;
+    if ((normal_index != JSON_NONE && normals.count < num_vertices) || (texcoord_index != JSON_NONE && texcoords.count < num_vertices))
+    {
+        LOGF("Primitive %u has fewer normals or texcoords than positions: %s\n", index, file->name);
+        return false;
+    }
+
+    /// -- Corners, as they come.
+    uint num_corners = (indices_index != JSON_NONE) ? indices.count : num_vertices;
+    uint *corners = (uint *)malloc(((size_t)num_corners + 1) * sizeof(uint));
+    if (indices_index != JSON_NONE)
+        read_gltf_indices(&indices, corners);
+    else
+        for (auto i = 0; i != num_corners; ++i)
+            corners[i] = i;
+
+    for (auto i = 0; i != num_corners; ++i)
+    {
+        if (corners[i] >= num_vertices)
+        {
+            LOGF("Primitive %u has an index out of bounds: %s\n", index, file->name);
+            free(corners);
+            return false;
+        }
+    }
+
+    /// -- Triangle list.
+    uint num_triangles = (mode == GLTF_TRIANGLES) ? num_corners / 3 : ((num_corners >= 3) ? num_corners - 2 : 0);
+    it->num_indices = num_triangles * 3;
+    it->indices = (uint *)malloc(((size_t)it->num_indices + 1) * sizeof(uint));
+    for (auto t = 0; t != num_triangles; ++t)
+    {
+        uint *triangle = &it->indices[t * 3];
+        if (mode == GLTF_TRIANGLES)
+            memcpy(triangle, &corners[t * 3], 3 * sizeof(uint));
+        else if (mode == GLTF_TRIANGLE_STRIP)
+        {
+            triangle[0] = corners[t];
+            triangle[1] = corners[t + 1 + (t & 1)];
+            triangle[2] = corners[t + 2 - (t & 1)];
+        }
+        else
+        {
+            triangle[0] = corners[t + 1];
+            triangle[1] = corners[t + 2];
+            triangle[2] = corners[0];
+        }
+    }
+    free(corners);
+
+    /// -- Vertices, a copy per corner when they need flat normals.
+    bool flat = (normal_index == JSON_NONE);
+    it->num_vertices = flat ? it->num_indices : num_vertices;
+    it->vertices = (Vertex *)calloc(it->num_vertices ? it->num_vertices : 1, sizeof(Vertex));
+    for (auto v = 0; v != it->num_vertices; ++v)
+    {
+        auto vertex = &it->vertices[v];
+        uint source = flat ? it->indices[v] : v;
+        read_gltf_floats(&positions, source, vertex->position, 3);
+        if (!flat)
+            read_gltf_floats(&normals, source, vertex->normal, 3);
+        if (texcoord_index != JSON_NONE)
+            read_gltf_floats(&texcoords, source, vertex->texcoord, 2);
+
+        float color[3] = { 0.65f, 0.65f, 0.65f };
+        memcpy(vertex->color, color, 3 * sizeof(float));
+    }
+
+    if (flat)
+    {
+        for (auto t = 0; t != num_triangles; ++t)
+        {
+            Vertex *v = &it->vertices[t * 3];
+            float e1[3], e2[3];
+            for (auto k = 0; k != 3; ++k)
+            {
+                e1[k] = v[1].position[k] - v[0].position[k];
+                e2[k] = v[2].position[k] - v[0].position[k];
+            }
+            float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+            float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            for (auto k = 0; k != 3; ++k)
+                n[k] = (length > 0.0f) ? n[k] / length : 0.0f;
+
+            for (auto c = 0; c != 3; ++c)
+            {
+                memcpy(v[c].normal, n, sizeof(n));
+                it->indices[t * 3 + c] = t * 3 + c;
+            }
+        }
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,369 @@
+#ifndef _GPU_BUDGET_H_
+#define _GPU_BUDGET_H_
+// Shared with d3d_orbit_camera, so rather than stdafx.h it expects whichever of stdafx.h or pch.h
+//   the including project uses to come first (uint, ZeroThat, LOGF).
+
+/// ============ GPU MEMORY BUDGET ============ ///
+// A registry every GPU create and release path reports into, so what the GPU holds can be asked
+//   at any time instead of only read off ReportLiveObjects at shutdown. Resources are counted by
+//   kind and by the asset they belong to (its path, or whatever name the caller passes).
+//
+// Two limits, 0 meaning none:
+//   soft  may be crossed. Evictable resources are evicted back under it once a frame by
+//         update_gpu_budget, least recently used first, and every crossing is counted.
+//   hard  may not. reserve_gpu_memory evicts to make room and refuses when that isn't enough,
+//         which makes the create fail.
+// Evicting is the owner's job: the evict callback gets the handle and has to release or shrink
+//   the resource through the usual paths, which untrack it. Only the decisions are made in here.
+//
+// Nothing in here touches the GPU, handles are only compared, so it runs anywhere with a stand-in
+//   device that just reports sizes.
+
+enum Gpu_Resource_Kind {
+    GPU_RESOURCE_VERTEX_BUFFER,
+    GPU_RESOURCE_INDEX_BUFFER,
+    GPU_RESOURCE_CONSTANT_BUFFER,
+    GPU_RESOURCE_TEXTURE,
+    GPU_RESOURCE_RENDER_TARGET,
+    GPU_RESOURCE_DEPTH_STENCIL,
+
+    GPU_RESOURCE_KIND_COUNT
+};
+
+static const char *gpu_resource_kind_names[GPU_RESOURCE_KIND_COUNT] = {
+    "vertex buffers", "index buffers", "constant buffers", "textures", "render targets", "depth stencils",
+};
+
+#define GPU_BUDGET_MAX_EVICTIONS 64 // per reserve_gpu_memory or update_gpu_budget
+#define GPU_ASSET_NAME_SIZE      64
+
+struct Gpu_Resource
+{
+    const void *handle;
+    size_t bytes;
+    Gpu_Resource_Kind kind;
+    uint asset;     // index into Gpu_Budget::assets
+    uint last_used; // frame
+    bool evictable;
+};
+
+struct Gpu_Asset_Usage
+{
+    char name[GPU_ASSET_NAME_SIZE];
+    size_t bytes;
+    uint num_resources;
+};
+
+// Returns whether the resource was released or shrunk, either way through untrack_gpu_resource.
+typedef bool (*Gpu_Evict_Func)(void *user, const void *handle);
+
+struct Gpu_Budget
+{
+    Gpu_Resource *resources;
+    uint num_resources;
+    uint max_resources;
+
+    Gpu_Asset_Usage *assets; // [0] collects whatever was created without a name
+    uint num_assets;
+    uint max_assets;
+
+    size_t kind_bytes[GPU_RESOURCE_KIND_COUNT];
+    uint kind_counts[GPU_RESOURCE_KIND_COUNT];
+    size_t total_bytes;
+    size_t peak_bytes;
+
+    size_t soft_limit;
+    size_t hard_limit;
+    uint frame;
+
+    Gpu_Evict_Func evict;
+    void *evict_user;
+    bool evicting; // creates made by the evict callback don't evict in turn
+
+    bool over_soft;
+    uint num_soft_overruns;
+    uint num_refused;
+    uint num_evicted;
+};
+
+/// -- Helpers
+// Linear, there are a few hundred resources at most.
+static Gpu_Resource *find_gpu_resource(Gpu_Budget *it, const void *handle)
+{
+    for (auto i = 0; i != it->num_resources; ++i)
+        if (it->resources[i].handle == handle)
+            return &it->resources[i];
+    return NULL;
+}
+
+static uint find_gpu_asset(Gpu_Budget *it, const char *name)
+{
+    if (!name || !*name)
+        return 0;
+
+    for (auto i = 1; i < it->num_assets; ++i)
+        if (!strncmp(it->assets[i].name, name, GPU_ASSET_NAME_SIZE - 1))
+            return i;
+
+    if (it->num_assets == it->max_assets)
+    {
+        it->max_assets *= 2;
+        it->assets = (Gpu_Asset_Usage *)realloc(it->assets, it->max_assets * sizeof(Gpu_Asset_Usage));
+    }
+
+    auto asset = &it->assets[it->num_assets];
+    ZeroThat(asset);
+    snprintf(asset->name, sizeof(asset->name), "%s", name);
+    return it->num_assets++;
+}
+
+static bool is_over_gpu_limit(size_t bytes, size_t limit)
+{
+    return limit && bytes > limit;
+}
+
+/// -- Budget
+void init_gpu_budget(Gpu_Budget *it, size_t soft_limit = 0, size_t hard_limit = 0)
+{
+    ZeroThat(it);
+    it->soft_limit = soft_limit;
+    it->hard_limit = hard_limit;
+
+    it->max_resources = 256;
+    it->resources = (Gpu_Resource *)malloc(it->max_resources * sizeof(Gpu_Resource));
+    it->max_assets = 64;
+    it->assets = (Gpu_Asset_Usage *)malloc(it->max_assets * sizeof(Gpu_Asset_Usage));
+    find_gpu_asset(it, "(unnamed)");
+}
+
+void free_gpu_budget(Gpu_Budget *it)
+{
+    free(it->resources);
+    free(it->assets);
+    ZeroThat(it);
+}
+
+void set_gpu_budget_limits(Gpu_Budget *it, size_t soft_limit, size_t hard_limit)
+{
+    it->soft_limit = soft_limit;
+    it->hard_limit = hard_limit;
+}
+
+void set_gpu_budget_evictor(Gpu_Budget *it, Gpu_Evict_Func evict, void *user)
+{
+    it->evict = evict;
+    it->evict_user = user;
+}
+
+// Which evictable resources to evict to free at least bytes: least recently used first, the
+//   biggest of those first. Returns how many handles it wrote, which may free less than asked.
+uint plan_gpu_eviction(const Gpu_Budget *it, size_t bytes, const void **handles, uint max_handles)
+{
+    uint num_handles = 0;
+    size_t planned = 0;
+
+    // Selection, max_handles is small.
+    while (planned < bytes && num_handles != max_handles)
+    {
+        const Gpu_Resource *best = NULL;
+        for (auto i = 0; i != it->num_resources; ++i)
+        {
+            auto resource = &it->resources[i];
+            if (!resource->evictable)
+                continue;
+
+            bool planned_already = false;
+            for (auto j = 0; j != num_handles && !planned_already; ++j)
+                planned_already = (handles[j] == resource->handle);
+            if (planned_already)
+                continue;
+
+            if (!best || resource->last_used < best->last_used ||
+                (resource->last_used == best->last_used && resource->bytes > best->bytes))
+                best = resource;
+        }
+        if (!best)
+            break;
+
+        handles[num_handles++] = best->handle;
+        planned += best->bytes;
+    }
+
+    return num_handles;
+}
+
+// Evicts until bytes are freed or nothing else can go, returns what was freed.
+size_t evict_gpu_resources(Gpu_Budget *it, size_t bytes)
+{
+    if (!it->evict || it->evicting || !bytes)
+        return 0;
+
+    // Handles, not indices: the callback releases and creates, which moves resources around.
+    const void *handles[GPU_BUDGET_MAX_EVICTIONS];
+    uint num_handles = plan_gpu_eviction(it, bytes, handles, GPU_BUDGET_MAX_EVICTIONS);
+
+    size_t start_bytes = it->total_bytes;
+    it->evicting = true;
+    for (auto i = 0; i != num_handles && it->total_bytes + bytes > start_bytes; ++i)
+    {
+        if (it->evict(it->evict_user, handles[i]))
+            ++it->num_evicted;
+    }
+    it->evicting = false;
+
+    return (it->total_bytes < start_bytes) ? start_bytes - it->total_bytes : 0;
+}
+
+// Call before creating a resource of bytes. False: the create would cross the hard limit even
+//   after evicting, so it mustn't happen.
+bool reserve_gpu_memory(Gpu_Budget *it, size_t bytes)
+{
+    if (is_over_gpu_limit(it->total_bytes + bytes, it->hard_limit))
+    {
+        // No point evicting anything when evicting everything wouldn't do.
+        size_t evictable_bytes = 0;
+        for (auto i = 0; i != it->num_resources; ++i)
+            if (it->resources[i].evictable)
+                evictable_bytes += it->resources[i].bytes;
+
+        if (!is_over_gpu_limit(it->total_bytes - evictable_bytes + bytes, it->hard_limit))
+            evict_gpu_resources(it, it->total_bytes + bytes - it->hard_limit);
+    }
+
+    if (is_over_gpu_limit(it->total_bytes + bytes, it->hard_limit))
+    {
+        ++it->num_refused;
+        LOGF("Refused %zu bytes: %zu of %zu in use.\n", bytes, it->total_bytes, it->hard_limit);
+        return false;
+    }
+    return true;
+}
+
+// Call after the create succeeded. asset NULL: counted as "(unnamed)".
+void track_gpu_resource(Gpu_Budget *it, const void *handle, Gpu_Resource_Kind kind, size_t bytes, const char *asset = NULL, bool evictable = false)
+{
+    if (it->num_resources == it->max_resources)
+    {
+        it->max_resources *= 2;
+        it->resources = (Gpu_Resource *)realloc(it->resources, it->max_resources * sizeof(Gpu_Resource));
+    }
+
+    auto resource = &it->resources[it->num_resources++];
+    resource->handle = handle;
+    resource->bytes = bytes;
+    resource->kind = kind;
+    resource->asset = find_gpu_asset(it, asset);
+    resource->last_used = it->frame;
+    resource->evictable = evictable;
+
+    it->assets[resource->asset].bytes += bytes;
+    it->assets[resource->asset].num_resources += 1;
+    it->kind_bytes[kind] += bytes;
+    it->kind_counts[kind] += 1;
+    it->total_bytes += bytes;
+    if (it->total_bytes > it->peak_bytes)
+        it->peak_bytes = it->total_bytes;
+
+    if (!it->over_soft && is_over_gpu_limit(it->total_bytes, it->soft_limit))
+    {
+        it->over_soft = true;
+        ++it->num_soft_overruns;
+        LOGF("Over the soft limit: %zu of %zu.\n", it->total_bytes, it->soft_limit);
+    }
+}
+
+// Call before releasing. Handles that aren't tracked are ignored.
+void untrack_gpu_resource(Gpu_Budget *it, const void *handle)
+{
+    auto resource = find_gpu_resource(it, handle);
+    if (!resource)
+        return;
+
+    it->assets[resource->asset].bytes -= resource->bytes;
+    it->assets[resource->asset].num_resources -= 1;
+    it->kind_bytes[resource->kind] -= resource->bytes;
+    it->kind_counts[resource->kind] -= 1;
+    it->total_bytes -= resource->bytes;
+
+    *resource = it->resources[--it->num_resources];
+
+    if (it->over_soft && !is_over_gpu_limit(it->total_bytes, it->soft_limit))
+        it->over_soft = false;
+}
+
+// Keeps the resource off the front of the eviction order for this frame.
+void mark_gpu_resource_used(Gpu_Budget *it, const void *handle)
+{
+    if (auto resource = find_gpu_resource(it, handle))
+        resource->last_used = it->frame;
+}
+
+// Once a frame: evicts back under the soft limit and starts the next frame.
+void update_gpu_budget(Gpu_Budget *it)
+{
+    if (is_over_gpu_limit(it->total_bytes, it->soft_limit))
+        evict_gpu_resources(it, it->total_bytes - it->soft_limit);
+    ++it->frame;
+}
+
+/// -- Queries
+// How much more fits under the soft limit: 0 when over it, SIZE_MAX without one.
+size_t get_gpu_soft_headroom(const Gpu_Budget *it)
+{
+    if (!it->soft_limit)
+        return SIZE_MAX;
+    return (it->total_bytes < it->soft_limit) ? it->soft_limit - it->total_bytes : 0;
+}
+
+size_t get_gpu_kind_bytes(const Gpu_Budget *it, Gpu_Resource_Kind kind)
+{
+    return it->kind_bytes[kind];
+}
+
+size_t get_gpu_asset_bytes(Gpu_Budget *it, const char *asset)
+{
+    for (auto i = 0; i != it->num_assets; ++i)
+        if (!strncmp(it->assets[i].name, asset, GPU_ASSET_NAME_SIZE - 1))
+            return it->assets[i].bytes;
+    return 0;
+}
+
+static const Gpu_Budget *sort_gpu_budget;
+static int compare_gpu_asset_bytes(const void *a, const void *b)
+{
+    size_t sa = sort_gpu_budget->assets[*(const uint *)a].bytes;
+    size_t sb = sort_gpu_budget->assets[*(const uint *)b].bytes;
+    return (sa < sb) ? 1 : (sa > sb) ? -1 : (int)(*(const uint *)a) - (int)(*(const uint *)b);
+}
+
+// Totals, then every asset still holding memory, biggest first. Whatever shows up here after
+//   everything was released leaked.
+void dump_gpu_budget(const Gpu_Budget *it)
+{
+    const float mb = 1.0f / (1024.0f * 1024.0f);
+    LOGF("%.2f MB in %u resources, peak %.2f MB, soft limit %.2f MB, hard limit %.2f MB\n", it->total_bytes * mb, it->num_resources,
+         it->peak_bytes * mb, it->soft_limit * mb, it->hard_limit * mb);
+    LOGF("%u soft limit overruns, %u refused, %u evicted\n", it->num_soft_overruns, it->num_refused, it->num_evicted);
+
+    for (auto k = 0; k != GPU_RESOURCE_KIND_COUNT; ++k)
+        if (it->kind_counts[k])
+            LOGF("  %-16s %10.2f MB %6u\n", gpu_resource_kind_names[k], it->kind_bytes[k] * mb, it->kind_counts[k]);
+
+    uint *order = (uint *)malloc(it->num_assets * sizeof(uint));
+    uint num_used = 0;
+    for (auto i = 0; i != it->num_assets; ++i)
+        if (it->assets[i].num_resources)
+            order[num_used++] = i;
+
+    sort_gpu_budget = it;
+    qsort(order, num_used, sizeof(uint), compare_gpu_asset_bytes);
+
+    for (auto i = 0; i != num_used; ++i)
+    {
+        auto asset = &it->assets[order[i]];
+        LOGF("  %10.2f MB %6u  %s\n", asset->bytes * mb, asset->num_resources, asset->name);
+    }
+    free(order);
+}
+
+#endif
@@ -0,0 +1,311 @@
+#ifndef _HUFFMAN_H_
+#define _HUFFMAN_H_
+#include "stdafx.h"
+
+/// ============ HUFFMAN CODING ============ ///
+// Order-0 byte coder for the streams of a super texture (see super_texture.h), built for
+//   decoding speed: codes are at most HUFFMAN_MAX_BITS long so one table lookup decodes a
+//   symbol, and a chunk is four bitstreams over the four quarters of the data decoded side by
+//   side, so the four dependency chains (lookup, shift) overlap. Each refill of a stream's 64
+//   bit window is good for HUFFMAN_REFILL_SYMBOLS symbols.
+// Bits go in LSB first, which makes the window a plain little endian load and a shift.
+//
+// Chunk layout: method byte, then
+//   HUFFMAN_RAW:      the bytes as they are (anything tiny or incompressible)
+//   HUFFMAN_CONSTANT: the one byte every symbol is
+//   HUFFMAN_CODED:    code length of every symbol as nibbles (128 bytes), uint32 byte size of
+//                     each of the four streams, the streams, 8 bytes of padding for the window
+
+#define HUFFMAN_MAX_BITS       11
+#define HUFFMAN_TABLE_SIZE     (1 << HUFFMAN_MAX_BITS)
+#define HUFFMAN_STREAMS        4
+#define HUFFMAN_REFILL_SYMBOLS 5 // 5 * 11 bits of the 57 a refill guarantees
+#define HUFFMAN_PADDING        8
+
+enum Huffman_Method {
+    HUFFMAN_RAW,
+    HUFFMAN_CONSTANT,
+    HUFFMAN_CODED,
+};
+
+// Worst case size of an encoded chunk of size bytes.
+static inline size_t get_huffman_bound(size_t size)
+{
+    return 1 + 128 + HUFFMAN_STREAMS * sizeof(uint) + (size * HUFFMAN_MAX_BITS + 7) / 8 + HUFFMAN_STREAMS + HUFFMAN_PADDING;
+}
+
+static inline uint64_t read_huffman_u64(const uchar *bytes)
+{
+    uint64_t value;
+    memcpy(&value, bytes, sizeof(value));
+    return value;
+}
+
+// Where stream s of the four starts, the last one takes the remainder.
+static inline size_t get_huffman_stream_start(size_t size, uint s)
+{
+    size_t start = (size + HUFFMAN_STREAMS - 1) / HUFFMAN_STREAMS * s;
+    return (start < size) ? start : size;
+}
+
+/// ===== Codes =====
+// Huffman code lengths, limited to HUFFMAN_MAX_BITS by flattening the counts until they fit.
+//   Needs at least two symbols with a count.
+static void build_huffman_lengths(const size_t counts[256], uchar lengths[256])
+{
+    size_t weights[511];
+    uint parents[511], depths[511], symbols[256];
+    uint num_symbols = 0;
+
+    size_t scaled[256];
+    memcpy(scaled, counts, sizeof(scaled));
+
+    for (;;)
+    {
+        // Leaves sorted by weight, insertion sort is plenty for 256.
+        num_symbols = 0;
+        for (uint s = 0; s != 256; ++s)
+        {
+            if (!scaled[s])
+                continue;
+            uint i = num_symbols++;
+            for (; i && scaled[symbols[i - 1]] > scaled[s]; --i)
+                symbols[i] = symbols[i - 1];
+            symbols[i] = s;
+        }
+        for (uint i = 0; i != num_symbols; ++i)
+            weights[i] = scaled[symbols[i]];
+
+        // Two queues: the leaves, and the internal nodes, which come out in order of weight.
+        uint leaf = 0, node = num_symbols, next = num_symbols;
+        for (; next != 2 * num_symbols - 1; ++next)
+        {
+            uint pick[2];
+            for (auto k = 0; k != 2; ++k)
+                pick[k] = (leaf < num_symbols && (node == next || weights[leaf] <= weights[node])) ? leaf++ : node++;
+            weights[next] = weights[pick[0]] + weights[pick[1]];
+            parents[pick[0]] = parents[pick[1]] = next;
+        }
+
+        uint max_depth = 0;
+        depths[next - 1] = 0;
+        for (uint i = next - 1; i-- != 0;)
+        {
+            depths[i] = depths[parents[i]] + 1;
+            max_depth = (depths[i] > max_depth) ? depths[i] : max_depth;
+        }
+
+        if (max_depth <= HUFFMAN_MAX_BITS)
+            break;
+        for (auto s = 0; s != 256; ++s)
+            scaled[s] = scaled[s] ? (scaled[s] + 1) / 2 : 0;
+    }
+
+    memset(lengths, 0, 256);
+    for (uint i = 0; i != num_symbols; ++i)
+        lengths[symbols[i]] = (uchar)depths[i];
+}
+
+// Canonical codes for the lengths, bit reversed for the LSB first streams. False if the
+//   lengths don't make a complete prefix code, which a broken chunk would have.
+static bool build_huffman_codes(const uchar lengths[256], uint codes[256])
+{
+    uint counts[HUFFMAN_MAX_BITS + 1] = {}, firsts[HUFFMAN_MAX_BITS + 1];
+    for (auto s = 0; s != 256; ++s)
+        ++counts[lengths[s]];
+
+    uint code = 0, kraft = 0;
+    for (auto length = 1; length <= HUFFMAN_MAX_BITS; ++length)
+    {
+        code = (code + counts[length - 1] * (length > 1)) << 1;
+        firsts[length] = code;
+        kraft += counts[length] << (HUFFMAN_MAX_BITS - length);
+    }
+    if (kraft != HUFFMAN_TABLE_SIZE)
+        return false;
+
+    for (auto s = 0; s != 256; ++s)
+    {
+        uint length = lengths[s];
+        if (!length)
+            continue;
+        uint canonical = firsts[length]++, reversed = 0;
+        for (auto b = 0; b != length; ++b)
+            reversed |= ((canonical >> b) & 1) << (length - 1 - b);
+        codes[s] = reversed;
+    }
+    return true;
+}
+
+/// ===== Encoding =====
+// Writes data into out (get_huffman_bound(size) bytes), returns the chunk size.
+size_t encode_huffman(const uchar *data, size_t size, uchar *out)
+{
+    size_t counts[256] = {};
+    for (size_t i = 0; i != size; ++i)
+        ++counts[data[i]];
+
+    if (size && counts[data[0]] == size)
+    {
+        out[0] = HUFFMAN_CONSTANT;
+        out[1] = data[0];
+        return 2;
+    }
+
+    // The table alone outweighs anything this small.
+    if (size < 1024)
+    {
+        out[0] = HUFFMAN_RAW;
+        memcpy(out + 1, data, size);
+        return 1 + size;
+    }
+
+    uchar lengths[256];
+    uint codes[256];
+    build_huffman_lengths(counts, lengths);
+    build_huffman_codes(lengths, codes);
+
+    out[0] = HUFFMAN_CODED;
+    for (auto s = 0; s != 256; s += 2)
+        out[1 + s / 2] = (uchar)(lengths[s] | (lengths[s + 1] << 4));
+
+    size_t offset = 1 + 128 + HUFFMAN_STREAMS * sizeof(uint);
+    for (uint k = 0; k != HUFFMAN_STREAMS; ++k)
+    {
+        size_t start = offset;
+        uint64_t bits = 0;
+        uint num_bits = 0;
+        for (size_t i = get_huffman_stream_start(size, k); i != get_huffman_stream_start(size, k + 1); ++i)
+        {
+            bits |= (uint64_t)codes[data[i]] << num_bits;
+            num_bits += lengths[data[i]];
+            for (; num_bits >= 8; num_bits -= 8, bits >>= 8)
+                out[offset++] = (uchar)bits;
+        }
+        if (num_bits)
+            out[offset++] = (uchar)bits;
+
+        uint stream_size = (uint)(offset - start);
+        memcpy(out + 1 + 128 + k * sizeof(uint), &stream_size, sizeof(uint));
+    }
+    memset(out + offset, 0, HUFFMAN_PADDING);
+    offset += HUFFMAN_PADDING;
+
+    if (offset >= 1 + size)
+    {
+        out[0] = HUFFMAN_RAW;
+        memcpy(out + 1, data, size);
+        return 1 + size;
+    }
+    return offset;
+}
+
+/// ===== Decoding =====
+// Decodes count symbols from one refill of the window at *position (in bits). One table entry
+//   per HUFFMAN_MAX_BITS bit window: symbol in the low byte, code length above.
+static inline uchar *decode_huffman_symbols(const uchar *data, size_t *position, uchar *out, const uint16_t *table, uint count)
+{
+    size_t bits = *position;
+    uint64_t window = read_huffman_u64(data + (bits >> 3)) >> (bits & 7);
+    for (uint i = 0; i != count; ++i)
+    {
+        uint entry = table[window & (HUFFMAN_TABLE_SIZE - 1)];
+        out[i] = (uchar)entry;
+        window >>= entry >> 8;
+        bits += entry >> 8;
+    }
+    *position = bits;
+    return out + count;
+}
+
+// Decodes a chunk of chunk_size bytes into the size bytes it was encoded from. False if the
+//   chunk is broken, which doesn't catch everything: a corrupt chunk can decode to garbage.
+bool decode_huffman(const uchar *chunk, size_t chunk_size, uchar *out, size_t size)
+{
+    if (!chunk_size)
+        return !size;
+
+    switch (chunk[0])
+    {
+        case HUFFMAN_RAW:
+            if (chunk_size != 1 + size)
+                return false;
+            memcpy(out, chunk + 1, size);
+            return true;
+
+        case HUFFMAN_CONSTANT:
+            if (chunk_size != 2)
+                return false;
+            memset(out, chunk[1], size);
+            return true;
+
+        case HUFFMAN_CODED:
+            break;
+
+        default:
+            return false;
+    }
+
+    size_t header = 1 + 128 + HUFFMAN_STREAMS * sizeof(uint);
+    if (chunk_size < header + HUFFMAN_PADDING)
+        return false;
+
+    uchar lengths[256];
+    uint codes[256];
+    for (auto s = 0; s != 256; s += 2)
+    {
+        lengths[s] = chunk[1 + s / 2] & 0xF;
+        lengths[s + 1] = chunk[1 + s / 2] >> 4;
+    }
+    if (!build_huffman_codes(lengths, codes))
+        return false;
+
+    uint16_t table[HUFFMAN_TABLE_SIZE];
+    for (auto s = 0; s != 256; ++s)
+        for (uint fill = codes[s]; lengths[s] && fill < HUFFMAN_TABLE_SIZE; fill += 1u << lengths[s])
+            table[fill] = (uint16_t)(s | (lengths[s] << 8));
+
+    const uchar *data[HUFFMAN_STREAMS];
+    size_t stream_sizes[HUFFMAN_STREAMS], offset = header;
+    for (uint k = 0; k != HUFFMAN_STREAMS; ++k)
+    {
+        uint stream_size;
+        memcpy(&stream_size, chunk + 1 + 128 + k * sizeof(uint), sizeof(uint));
+        stream_sizes[k] = stream_size;
+        data[k] = chunk + offset;
+        offset += stream_size;
+    }
+    if (offset + HUFFMAN_PADDING != chunk_size)
+        return false;
+
+    // All four in lockstep while the shortest has a refill's worth left, the stragglers after.
+    //   The state lives in locals rather than an array so it stays in registers, the byte stores
+    //   could alias anything else. A window may read into the next stream or the padding, and as
+    //   long as every refill starts inside its stream, never past the chunk.
+    size_t p0 = 0, p1 = 0, p2 = 0, p3 = 0;
+    uchar *o0 = out, *o1 = out + get_huffman_stream_start(size, 1), *o2 = out + get_huffman_stream_start(size, 2), *o3 = out + get_huffman_stream_start(size, 3);
+    size_t rounds = (size - get_huffman_stream_start(size, 3)) / HUFFMAN_REFILL_SYMBOLS;
+    for (size_t round = 0; round != rounds; ++round)
+    {
+        if ((p0 >> 3) > stream_sizes[0] || (p1 >> 3) > stream_sizes[1] || (p2 >> 3) > stream_sizes[2] || (p3 >> 3) > stream_sizes[3])
+            return false;
+        o0 = decode_huffman_symbols(data[0], &p0, o0, table, HUFFMAN_REFILL_SYMBOLS);
+        o1 = decode_huffman_symbols(data[1], &p1, o1, table, HUFFMAN_REFILL_SYMBOLS);
+        o2 = decode_huffman_symbols(data[2], &p2, o2, table, HUFFMAN_REFILL_SYMBOLS);
+        o3 = decode_huffman_symbols(data[3], &p3, o3, table, HUFFMAN_REFILL_SYMBOLS);
+    }
+
+    size_t positions[HUFFMAN_STREAMS] = { p0, p1, p2, p3 };
+    uchar *outs[HUFFMAN_STREAMS] = { o0, o1, o2, o3 };
+    bool result = true;
+    for (uint k = 0; k != HUFFMAN_STREAMS; ++k)
+    {
+        uchar *end = out + get_huffman_stream_start(size, k + 1);
+        while (outs[k] != end && (positions[k] >> 3) <= stream_sizes[k])
+            outs[k] = decode_huffman_symbols(data[k], &positions[k], outs[k], table, 1);
+        result = result && outs[k] == end && (positions[k] + 7) / 8 == stream_sizes[k];
+    }
+    return result;
+}
+
+#endif
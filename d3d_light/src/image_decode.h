@@ -0,0 +1,186 @@
+#ifndef _IMAGE_DECODE_H_
+#define _IMAGE_DECODE_H_
+#include "stdafx.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "stb_image.h" // STB_IMAGE_IMPLEMENTATION lives in whatever .cpp is the unity build root.
+#include "file_map.h"
+#include "jpeg_decode.h"
+
+/// ============ BATCHED IMAGE DECODING ============ ///
+// A material set is a handful of independent JPGs, so decoding is embarrassingly parallel:
+//   workers pull the next job off an atomic counter and write only into that job's slot, which
+//   keeps the results in submission order without any locking. stbi_load_from_memory has no
+//   shared state as long as nobody touches the global stbi_set_* flags meanwhile.
+// With fewer images than cores the leftover cores go to the images themselves, big baseline
+//   JPEGs decode on several threads (see jpeg_decode.h).
+// A job can bring its own destination, e.g. level 0 of a Mip_Chain that's about to be uploaded.
+//   JPEGs decode straight into it, saving a full size allocation and a copy per image, anything
+//   else still goes through stbi's buffer and gets copied over.
+
+struct Image_Destination {
+    uchar *pixels;        // owned by the caller, NULL to have stbi allocate
+    size_t row_pitch;     // bytes from one row to the next
+    uint width;           // has to be the image's, see stbi_info
+    uint height;
+};
+
+struct Image_Decode_Job {
+    const void *data;     // encoded file contents, owned by the caller
+    size_t size;
+    int desired_channels; // 0 keeps what the file has, needs to be set with a destination
+    Image_Destination destination;
+};
+
+struct Decoded_Image {
+    uchar *pixels;        // the job's destination, or free with stbi_image_free; NULL on failure
+    int width;
+    int height;
+    int channels;         // channels in pixels, i.e. desired_channels unless that was 0
+    float decode_ms;
+    const char *error;    // stbi_failure_reason() of the worker, static string
+};
+
+struct Image_Decode_Stats {
+    uint num_threads;
+    float wall_ms;
+    float decode_ms;      // sum of every image's decode time
+};
+
+// Decodes into memory the caller owns instead of a buffer of stbi's.
+bool decode_image_to(const void *data, size_t size, const Image_Destination *destination, int desired_channels, uint num_threads = 1)
+{
+    if (desired_channels < 1 || desired_channels > 4 || destination->row_pitch < (size_t)destination->width * desired_channels)
+        return stbi__err("bad destination", "Destination needs 1-4 channels and room for a row");
+
+    if (decode_jpeg_to(data, size, destination->pixels, destination->row_pitch, destination->width, destination->height, desired_channels, num_threads))
+        return true;
+
+    int width, height, channels;
+    stbi_uc *pixels = stbi_load_from_memory((const stbi_uc *)data, (int)size, &width, &height, &channels, desired_channels);
+    if (!pixels)
+        return false;
+
+    bool fits = (uint)width == destination->width && (uint)height == destination->height;
+    if (fits)
+        for (auto y = 0; y != height; ++y)
+            memcpy(destination->pixels + destination->row_pitch * y, pixels + (size_t)width * desired_channels * y, (size_t)width * desired_channels);
+    stbi_image_free(pixels);
+
+    return fits ? true : stbi__err("wrong size", "Image isn't the size of its destination");
+}
+
+static void decode_image(const Image_Decode_Job *job, Decoded_Image *out, uint num_threads = 1)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    if (!job->data)
+    {
+        ZeroThat(out);
+        out->error = "no data";
+        return;
+    }
+
+    int file_channels = 0;
+    if (job->destination.pixels)
+    {
+        bool decoded = decode_image_to(job->data, job->size, &job->destination, job->desired_channels, num_threads);
+        out->pixels = decoded ? job->destination.pixels : NULL;
+        out->width = (int)job->destination.width;
+        out->height = (int)job->destination.height;
+    }
+    else
+    {
+        out->pixels = decode_jpeg_parallel(job->data, job->size, &out->width, &out->height, &file_channels, job->desired_channels, num_threads);
+    }
+    out->channels = job->desired_channels ? job->desired_channels : file_channels;
+    out->error = out->pixels ? NULL : stbi_failure_reason();
+
+    out->decode_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Decodes every job on up to num_threads threads (0: one per core), out[i] belongs to jobs[i].
+Image_Decode_Stats decode_images(const Image_Decode_Job *jobs, uint num_jobs, Decoded_Image *out, uint num_threads = 0)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    if (!num_threads)
+        num_threads = std::thread::hardware_concurrency();
+    if (!num_threads)
+        num_threads = 1;
+    uint num_cores = num_threads;
+    if (num_threads > num_jobs)
+        num_threads = num_jobs ? num_jobs : 1;
+    uint threads_per_image = num_cores / num_threads;
+
+    std::atomic<uint> next_job(0);
+    auto worker = [&]() {
+        for (uint i; (i = next_job.fetch_add(1)) < num_jobs;)
+            decode_image(&jobs[i], &out[i], threads_per_image);
+    };
+
+    // The calling thread is one of the workers.
+    std::thread *threads = new std::thread[num_threads - 1];
+    for (auto i = 0; i != num_threads - 1; ++i)
+        threads[i] = std::thread(worker);
+    worker();
+    for (auto i = 0; i != num_threads - 1; ++i)
+        threads[i].join();
+    delete[] threads;
+
+    Image_Decode_Stats stats = {};
+    stats.num_threads = num_threads;
+    stats.wall_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    for (auto i = 0; i != num_jobs; ++i)
+        stats.decode_ms += out[i].decode_ms;
+
+    return stats;
+}
+
+// Maps, decodes and unmaps a set of image files. Files that fail to open come back with
+//   pixels == NULL like any other decode failure. With destinations, image i goes into destinations[i].
+Image_Decode_Stats load_images(const char **paths, uint num_paths, Decoded_Image *out, int desired_channels = 4, uint num_threads = 0,
+                               const Image_Destination *destinations = NULL)
+{
+    Mapped_File *files = (Mapped_File *)calloc(num_paths, sizeof(Mapped_File));
+    Image_Decode_Job *jobs = (Image_Decode_Job *)calloc(num_paths, sizeof(Image_Decode_Job));
+
+    for (auto i = 0; i != num_paths; ++i)
+    {
+        if (!map_file(&files[i], paths[i]))
+            LOGF("Failed to open %s\n", paths[i]);
+
+        jobs[i].data = files[i].data;
+        jobs[i].size = files[i].size;
+        jobs[i].desired_channels = desired_channels;
+        if (destinations)
+            jobs[i].destination = destinations[i];
+    }
+
+    Image_Decode_Stats stats = decode_images(jobs, num_paths, out, num_threads);
+
+    for (auto i = 0; i != num_paths; ++i)
+    {
+        if (files[i].data && !out[i].pixels)
+            LOGF("Failed to decode %s: %s\n", paths[i], out[i].error);
+        unmap_file(&files[i]);
+    }
+
+    free(jobs);
+    free(files);
+    return stats;
+}
+
+void log_image_decode_stats(const char **paths, const Decoded_Image *images, uint num_images, const Image_Decode_Stats *stats)
+{
+    for (auto i = 0; i != num_images; ++i)
+        LOGF("%s: %dx%d, %.2fms\n", paths[i], images[i].width, images[i].height, images[i].decode_ms);
+
+    LOGF("Decoded %u images in %.2fms on %u threads (%.2fms summed decode time)\n",
+         num_images, stats->wall_ms, stats->num_threads, stats->decode_ms);
+}
+
+#endif
@@ -0,0 +1,151 @@
+#ifndef _INDEX_PACK_H_
+#define _INDEX_PACK_H_
+#include "stdafx.h"
+
+#include "mesh_common.h"
+
+/// ============ 16-BIT INDEX PACKING ============ ///
+// Every mesh gets 16-bit indices. Meshes with more vertices than a 16-bit index can
+//   address are cut into parts of at most INDEX_PACK_MAX_VERTICES vertices, and the
+//   vertex buffer is rebuilt so each part owns a contiguous range starting at its
+//   base_vertex. Only vertices shared across a part boundary get duplicated.
+// Triangle order is preserved, so this runs after all the reordering passes.
+// Parts never straddle two LODs, each LOD starts a new one.
+
+// 0xFFFF is left alone so it can never be mistaken for a strip cut.
+#define INDEX_PACK_MAX_VERTICES 0xFFFF
+
+static Mesh_Part *append_mesh_part(Cpu_Mesh *it, uint first_index, uint index_count, int base_vertex)
+{
+    it->parts = (Mesh_Part *)realloc(it->parts, (it->num_parts + 1) * sizeof(Mesh_Part));
+
+    auto part = &it->parts[it->num_parts++];
+    part->first_index = first_index;
+    part->index_count = index_count;
+    part->base_vertex = base_vertex;
+    return part;
+}
+
+// Fills in it->parts and it->index_stride for the whole index buffer, and the part
+//   range of every LOD.
+void split_mesh_parts(Cpu_Mesh *it)
+{
+    free(it->parts);
+    it->parts = NULL;
+    it->num_parts = 0;
+    it->index_stride = sizeof(uint16_t);
+
+    if (it->num_vertices <= INDEX_PACK_MAX_VERTICES)
+    {
+        if (!it->num_lods)
+            append_mesh_part(it, 0, it->num_indices, 0);
+
+        for (auto l = 0; l != it->num_lods; ++l)
+        {
+            it->lods[l].first_part = it->num_parts;
+            it->lods[l].num_parts = 1;
+            append_mesh_part(it, it->lods[l].first_index, it->lods[l].index_count, 0);
+        }
+        return;
+    }
+
+    // part_of[v] is the last part vertex v was copied into, remap[v] where it went.
+    uint *part_of = (uint *)malloc(it->num_vertices * sizeof(uint));
+    uint *remap = (uint *)malloc(it->num_vertices * sizeof(uint));
+    memset(part_of, 0xFF, it->num_vertices * sizeof(uint));
+
+    uint capacity = it->num_vertices + (it->num_vertices / 8);
+    Vertex *vertices = (Vertex *)malloc(capacity * sizeof(Vertex));
+    uint num_vertices = 0;
+
+    uint part_first_index = 0;
+    uint part_base = 0;
+    uint lod = 0;
+    if (it->num_lods)
+        it->lods[0].first_part = 0;
+
+    for (auto i = 0; i < it->num_indices; i += 3)
+    {
+        auto tri = &it->indices[i];
+
+        uint new_vertices = 0;
+        for (auto k = 0; k != 3; ++k)
+            if (part_of[tri[k]] != it->num_parts)
+                ++new_vertices;
+
+        bool next_lod = (lod + 1 < it->num_lods && i == it->lods[lod + 1].first_index);
+        if (next_lod || (num_vertices - part_base) + new_vertices > INDEX_PACK_MAX_VERTICES)
+        {
+            if (next_lod)
+                it->lods[++lod].first_part = it->num_parts + 1;
+
+            append_mesh_part(it, part_first_index, i - part_first_index, (int)part_base);
+            part_first_index = i;
+            part_base = num_vertices;
+        }
+
+        for (auto k = 0; k != 3; ++k)
+        {
+            auto index = tri[k];
+            if (part_of[index] != it->num_parts)
+            {
+                if (num_vertices == capacity)
+                {
+                    capacity += capacity / 2;
+                    vertices = (Vertex *)realloc(vertices, capacity * sizeof(Vertex));
+                }
+
+                part_of[index] = it->num_parts;
+                remap[index] = num_vertices;
+                vertices[num_vertices++] = it->vertices[index];
+            }
+
+            tri[k] = remap[index];
+        }
+    }
+
+    append_mesh_part(it, part_first_index, it->num_indices - part_first_index, (int)part_base);
+
+    for (auto l = 0; l != it->num_lods; ++l)
+    {
+        uint end = (l + 1 < it->num_lods) ? it->lods[l + 1].first_part : it->num_parts;
+        it->lods[l].num_parts = end - it->lods[l].first_part;
+    }
+
+    free(it->vertices);
+    it->vertices = vertices;
+    it->num_vertices = num_vertices;
+
+    free(remap);
+    free(part_of);
+}
+
+// Writes the index buffer in it->index_stride sized elements, relative to each part's base vertex.
+// dst must hold num_indices * index_stride bytes.
+void pack_mesh_indices(const Cpu_Mesh *it, void *dst)
+{
+    if (it->index_stride == sizeof(uint))
+    {
+        for (auto p = 0; p != it->num_parts; ++p)
+        {
+            auto part = &it->parts[p];
+            for (auto i = part->first_index; i != part->first_index + part->index_count; ++i)
+                ((uint *)dst)[i] = it->indices[i] - part->base_vertex;
+        }
+        return;
+    }
+
+    ASSERT(it->index_stride == sizeof(uint16_t));
+    for (auto p = 0; p != it->num_parts; ++p)
+    {
+        auto part = &it->parts[p];
+        for (auto i = part->first_index; i != part->first_index + part->index_count; ++i)
+        {
+            uint index = it->indices[i] - part->base_vertex;
+            ASSERT(index < INDEX_PACK_MAX_VERTICES);
+            ((uint16_t *)dst)[i] = (uint16_t)index;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,643 @@
+#ifndef _JPEG_DECODE_H_
+#define _JPEG_DECODE_H_
+#include "stdafx.h"
+
+#include <atomic>
+#include <thread>
+
+// Include after stb_image.h, with STB_IMAGE_IMPLEMENTATION in the same unity build: this uses its internals.
+
+/// ============ PARALLEL JPEG DECODING ============ ///
+// stbi_load_from_memory for one big baseline JPEG on several threads, with the same output byte
+//   for byte. It's stb_image's own decoder cut into pieces that can run side by side:
+//
+//   entropy decoding  Huffman decoding is serial unless the file has restart intervals. Without
+//                     them one thread decodes every MCU row into dequantized coefficient blocks,
+//                     with them every thread takes whole intervals, each with its own bit reader.
+//   IDCT              per MCU row as soon as the entropy decoder is past it (stbi's SSE2 kernel).
+//   upsampling and    per band of output rows as soon as the MCU rows under the band (and one on
+//   color conversion  either side, for the upsampling filter) are through the IDCT, with stbi's
+//                     SSE2 kernels and its resampler state fast forwarded to the band's first row.
+//
+// Reusing stbi's kernels is what keeps the output identical, anything else would round differently.
+//   Progressive JPEGs, multi-scan baselines, other formats and vertically flipped loads go to
+//   stbi_load_from_memory unchanged, and so do files that fail along the way, so errors and
+//   failure reasons come from stbi too.
+// decode_jpeg_to writes into memory the caller already has (a mip chain, an upload buffer) at any
+//   row pitch instead, even on one thread, where entropy decoding and IDCT are done in one go
+//   like stbi does them.
+
+#define JPEG_BAND_ROWS 16
+
+struct Jpeg_Parallel_Decode
+{
+    stbi__jpeg *z;
+    uint units_x;             // MCUs per row, or blocks for a single component scan
+    uint units_y;
+    uint unit_rows;           // output rows per MCU row
+    short *coeff[4];          // without restart intervals on several threads: blocks waiting for the IDCT, w2/8 x h2/8 each
+
+    const stbi_uc **intervals; // with restart intervals: where each one's entropy coded data starts
+    uint num_intervals;
+    const stbi_uc *scan_end;
+
+    stbi_uc *output;          // the caller's or allocated here if NULL
+    size_t row_pitch;
+    uint width, height;       // the caller's output has to be this size
+    bool owns_output;
+    int channels_in_file;
+    int n, decode_n, is_rgb;
+    uint num_bands;
+
+    std::atomic<uint> decoded_rows;
+    std::atomic<uint> next_idct_row;
+    std::atomic<uint> next_interval;
+    std::atomic<uint> next_band;
+    std::atomic<uint> *row_units; // units of each MCU row through the IDCT
+    std::atomic<bool> failed;
+};
+
+static uint min_jpeg(uint a, uint b)
+{
+    return (a < b) ? a : b;
+}
+
+/// ===== Entropy decoding and IDCT =====
+static short *get_jpeg_coeff_block(Jpeg_Parallel_Decode *it, int n, uint block_x, uint block_y)
+{
+    return it->coeff[n] + ((size_t)block_y * (it->z->img_comp[n].w2 >> 3) + block_x) * 64;
+}
+
+// Decodes the unit (MCU, or block of a single component scan) at i, j. Into the coefficient
+//   buffers if there are any, straight through the IDCT otherwise. Same order as stbi__parse_entropy_coded_data.
+static int decode_jpeg_unit(Jpeg_Parallel_Decode *it, stbi__jpeg *z, uint i, uint j)
+{
+    STBI_SIMD_ALIGN(short, data[64]);
+
+    for (auto k = 0; k != z->scan_n; ++k)
+    {
+        int n = z->order[k];
+        auto comp = &z->img_comp[n];
+        int h = (z->scan_n == 1) ? 1 : comp->h;
+        int v = (z->scan_n == 1) ? 1 : comp->v;
+
+        for (auto y = 0; y != v; ++y)
+        {
+            for (auto x = 0; x != h; ++x)
+            {
+                uint block_x = i * h + x, block_y = j * v + y;
+                short *block = it->coeff[n] ? get_jpeg_coeff_block(it, n, block_x, block_y) : data;
+                if (!stbi__jpeg_decode_block(z, block, z->huff_dc + comp->hd, z->huff_ac + comp->ha, z->fast_ac[comp->ha], n, z->dequant[comp->tq]))
+                    return 0;
+                if (!it->coeff[n])
+                    z->idct_block_kernel(comp->data + comp->w2 * block_y * 8 + block_x * 8, comp->w2, data);
+            }
+        }
+    }
+    return 1;
+}
+
+static void idct_jpeg_row(Jpeg_Parallel_Decode *it, uint j)
+{
+    auto z = it->z;
+    for (auto k = 0; k != z->scan_n; ++k)
+    {
+        int n = z->order[k];
+        auto comp = &z->img_comp[n];
+        int h = (z->scan_n == 1) ? 1 : comp->h;
+        int v = (z->scan_n == 1) ? 1 : comp->v;
+
+        for (auto y = 0; y != v; ++y)
+        {
+            uint block_y = j * v + y;
+            for (uint block_x = 0; block_x != it->units_x * h; ++block_x)
+                z->idct_block_kernel(comp->data + comp->w2 * block_y * 8 + block_x * 8, comp->w2, get_jpeg_coeff_block(it, n, block_x, block_y));
+        }
+    }
+    it->row_units[j].fetch_add(it->units_x, std::memory_order_release);
+}
+
+// One restart interval on its own bit reader, every interval starts from a reset decoder anyway.
+static void decode_jpeg_interval(Jpeg_Parallel_Decode *it, uint interval)
+{
+    auto z = it->z;
+    auto local = (stbi__jpeg *)malloc(sizeof(stbi__jpeg));
+    memcpy(local, z, sizeof(stbi__jpeg));
+
+    const stbi_uc *end = (interval + 1 < it->num_intervals) ? it->intervals[interval + 1] : it->scan_end;
+    stbi__context context;
+    stbi__start_mem(&context, it->intervals[interval], (int)(end - it->intervals[interval]));
+    local->s = &context;
+    stbi__jpeg_reset(local);
+
+    uint first = interval * (uint)z->restart_interval;
+    uint last = min_jpeg(first + (uint)z->restart_interval, it->units_x * it->units_y);
+    for (uint unit = first; unit != last; ++unit)
+    {
+        uint i = unit % it->units_x, j = unit / it->units_x;
+        if (!decode_jpeg_unit(it, local, i, j))
+        {
+            it->failed = true;
+            break;
+        }
+        // Published per unit, bands only look at whole rows.
+        it->row_units[j].fetch_add(1, std::memory_order_release);
+    }
+
+    free(local);
+}
+
+/// ===== Upsampling and color conversion =====
+static bool is_jpeg_band_ready(Jpeg_Parallel_Decode *it, uint band)
+{
+    uint y0 = band * JPEG_BAND_ROWS;
+    uint y1 = min_jpeg(y0 + JPEG_BAND_ROWS, it->z->s->img_y);
+    uint first = y0 / it->unit_rows;
+    uint last = min_jpeg((y1 - 1) / it->unit_rows + 1, it->units_y - 1);
+    first = first ? first - 1 : 0;
+
+    for (auto j = first; j <= last; ++j)
+        if (it->row_units[j].load(std::memory_order_acquire) != it->units_x)
+            return false;
+    return true;
+}
+
+// The body of stbi's load_jpeg_image from row y0 to y1, with the resamplers wound forward to y0.
+//   Its 3 channel conversions write a fourth byte past every pixel, which is fine in order but
+//   would land in the next band's first pixel here, or in the caller's padding between rows, so
+//   those rows go through spare_row.
+static void convert_jpeg_rows(Jpeg_Parallel_Decode *it, uint y0, uint y1, stbi_uc *const linebufs[4], stbi_uc *spare_row)
+{
+    auto z = it->z;
+    int n = it->n, is_rgb = it->is_rgb;
+    stbi__resample res_comp[4];
+    stbi_uc *coutput[4] = { NULL, NULL, NULL, NULL };
+    unsigned int i, j;
+
+    for (auto k = 0; k != it->decode_n; ++k)
+    {
+        stbi__resample *r = &res_comp[k];
+        r->hs      = z->img_h_max / z->img_comp[k].h;
+        r->vs      = z->img_v_max / z->img_comp[k].v;
+        r->ystep   = r->vs >> 1;
+        r->w_lores = (z->s->img_x + r->hs - 1) / r->hs;
+        r->ypos    = 0;
+        r->line0   = r->line1 = z->img_comp[k].data;
+
+        if      (r->hs == 1 && r->vs == 1) r->resample = resample_row_1;
+        else if (r->hs == 1 && r->vs == 2) r->resample = stbi__resample_row_v_2;
+        else if (r->hs == 2 && r->vs == 1) r->resample = stbi__resample_row_h_2;
+        else if (r->hs == 2 && r->vs == 2) r->resample = z->resample_row_hv_2_kernel;
+        else                               r->resample = stbi__resample_row_generic;
+
+        for (j = 0; j != y0; ++j)
+        {
+            if (++r->ystep >= r->vs)
+            {
+                r->ystep = 0;
+                r->line0 = r->line1;
+                if (++r->ypos < z->img_comp[k].y)
+                    r->line1 += z->img_comp[k].w2;
+            }
+        }
+    }
+
+    for (j = y0; j != y1; ++j)
+    {
+        stbi_uc *row = it->output + it->row_pitch * j;
+        bool spare = n == 3 && (j == y1 - 1 || it->row_pitch != (size_t)n * z->s->img_x);
+        stbi_uc *out = spare ? spare_row : row;
+        for (auto k = 0; k != it->decode_n; ++k)
+        {
+            stbi__resample *r = &res_comp[k];
+            int y_bot = r->ystep >= (r->vs >> 1);
+            coutput[k] = r->resample(linebufs[k], y_bot ? r->line1 : r->line0, y_bot ? r->line0 : r->line1, r->w_lores, r->hs);
+            if (++r->ystep >= r->vs)
+            {
+                r->ystep = 0;
+                r->line0 = r->line1;
+                if (++r->ypos < z->img_comp[k].y)
+                    r->line1 += z->img_comp[k].w2;
+            }
+        }
+
+        if (n >= 3)
+        {
+            stbi_uc *y = coutput[0];
+            if (z->s->img_n == 3)
+            {
+                if (is_rgb)
+                {
+                    for (i = 0; i < z->s->img_x; ++i)
+                    {
+                        out[0] = y[i];
+                        out[1] = coutput[1][i];
+                        out[2] = coutput[2][i];
+                        out[3] = 255;
+                        out += n;
+                    }
+                }
+                else
+                {
+                    z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+                }
+            }
+            else if (z->s->img_n == 4)
+            {
+                if (z->app14_color_transform == 0) // CMYK
+                {
+                    for (i = 0; i < z->s->img_x; ++i)
+                    {
+                        stbi_uc m = coutput[3][i];
+                        out[0] = stbi__blinn_8x8(coutput[0][i], m);
+                        out[1] = stbi__blinn_8x8(coutput[1][i], m);
+                        out[2] = stbi__blinn_8x8(coutput[2][i], m);
+                        out[3] = 255;
+                        out += n;
+                    }
+                }
+                else if (z->app14_color_transform == 2) // YCCK
+                {
+                    z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+                    for (i = 0; i < z->s->img_x; ++i)
+                    {
+                        stbi_uc m = coutput[3][i];
+                        out[0] = stbi__blinn_8x8(255 - out[0], m);
+                        out[1] = stbi__blinn_8x8(255 - out[1], m);
+                        out[2] = stbi__blinn_8x8(255 - out[2], m);
+                        out += n;
+                    }
+                }
+                else // YCbCr + alpha, the fourth channel is ignored
+                {
+                    z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+                }
+            }
+            else
+            {
+                for (i = 0; i < z->s->img_x; ++i)
+                {
+                    out[0] = out[1] = out[2] = y[i];
+                    out[3] = 255; // not used if n == 3
+                    out += n;
+                }
+            }
+        }
+        else
+        {
+            if (is_rgb)
+            {
+                if (n == 1)
+                    for (i = 0; i < z->s->img_x; ++i)
+                        *out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+                else
+                    for (i = 0; i < z->s->img_x; ++i, out += 2)
+                    {
+                        out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+                        out[1] = 255;
+                    }
+            }
+            else if (z->s->img_n == 4 && z->app14_color_transform == 0)
+            {
+                for (i = 0; i < z->s->img_x; ++i)
+                {
+                    stbi_uc m = coutput[3][i];
+                    stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
+                    stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
+                    stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
+                    out[0] = stbi__compute_y(r, g, b);
+                    out[1] = 255;
+                    out += n;
+                }
+            }
+            else if (z->s->img_n == 4 && z->app14_color_transform == 2)
+            {
+                for (i = 0; i < z->s->img_x; ++i)
+                {
+                    out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
+                    out[1] = 255;
+                    out += n;
+                }
+            }
+            else
+            {
+                stbi_uc *y = coutput[0];
+                if (n == 1)
+                    for (i = 0; i < z->s->img_x; ++i) out[i] = y[i];
+                else
+                    for (i = 0; i < z->s->img_x; ++i) { *out++ = y[i]; *out++ = 255; }
+            }
+        }
+        if (spare)
+            memcpy(row, spare_row, n * z->s->img_x);
+    }
+}
+
+/// ===== Scheduling =====
+// Every thread runs this: take whatever is ready, IDCT rows and intervals before bands so the
+//   bands have something to wait for. The entropy decoding thread joins in once it's done.
+static void run_jpeg_worker(Jpeg_Parallel_Decode *it)
+{
+    stbi_uc *linebufs[4] = {};
+    for (auto k = 0; k != it->decode_n; ++k)
+        linebufs[k] = (stbi_uc *)malloc(it->z->s->img_x + 3);
+    stbi_uc *spare_row = (stbi_uc *)malloc(it->n * it->z->s->img_x + 1);
+
+    while (!it->failed)
+    {
+        if (it->num_intervals)
+        {
+            uint interval = it->next_interval.fetch_add(1);
+            if (interval < it->num_intervals)
+            {
+                decode_jpeg_interval(it, interval);
+                continue;
+            }
+        }
+        else
+        {
+            uint row = it->next_idct_row.load();
+            if (row < it->units_y && row < it->decoded_rows.load(std::memory_order_acquire) &&
+                it->next_idct_row.compare_exchange_strong(row, row + 1))
+            {
+                idct_jpeg_row(it, row);
+                continue;
+            }
+        }
+
+        uint band = it->next_band.load();
+        if (band >= it->num_bands)
+            break;
+        if (is_jpeg_band_ready(it, band) && it->next_band.compare_exchange_strong(band, band + 1))
+        {
+            uint y0 = band * JPEG_BAND_ROWS;
+            convert_jpeg_rows(it, y0, min_jpeg(y0 + JPEG_BAND_ROWS, it->z->s->img_y), linebufs, spare_row);
+            continue;
+        }
+
+        std::this_thread::yield();
+    }
+
+    for (auto k = 0; k != it->decode_n; ++k)
+        free(linebufs[k]);
+    free(spare_row);
+}
+
+// Finds where each restart interval of the scan starts. False if the count doesn't match the
+//   restart interval, stbi copes with broken files its own way.
+static bool find_jpeg_intervals(Jpeg_Parallel_Decode *it)
+{
+    auto z = it->z;
+    const stbi_uc *p = z->s->img_buffer, *end = z->s->img_buffer_end;
+    uint total = it->units_x * it->units_y;
+    uint expected = (total + z->restart_interval - 1) / z->restart_interval;
+
+    it->intervals = (const stbi_uc **)malloc(expected * sizeof(stbi_uc *));
+    it->intervals[0] = p;
+    it->num_intervals = 1;
+
+    while (p + 1 < end)
+    {
+        if (p[0] != 0xFF || p[1] == 0x00)
+        {
+            p += (p[0] == 0xFF) ? 2 : 1;
+            continue;
+        }
+        if (p[1] == 0xFF)
+        {
+            ++p;
+            continue;
+        }
+        if (!STBI__RESTART(p[1]))
+            break;
+
+        p += 2;
+        if (it->num_intervals == expected)
+            return false;
+        it->intervals[it->num_intervals++] = p;
+    }
+
+    it->scan_end = p;
+    return it->num_intervals == expected;
+}
+
+// Header up to the first scan, then the scan in parallel. 1 on success, 0 if stbi should do it.
+static int decode_jpeg_parallel_image(Jpeg_Parallel_Decode *it, int req_comp, uint num_threads)
+{
+    auto z = it->z;
+    for (auto m = 0; m < 4; ++m)
+    {
+        z->img_comp[m].raw_data = NULL;
+        z->img_comp[m].raw_coeff = NULL;
+    }
+    z->restart_interval = 0;
+    if (!stbi__decode_jpeg_header(z, STBI__SCAN_load) || z->progressive)
+        return 0;
+
+    int m = stbi__get_marker(z);
+    while (!stbi__SOS(m))
+    {
+        if (stbi__EOI(m) || stbi__DNL(m) || !stbi__process_marker(z, m))
+            return 0;
+        m = stbi__get_marker(z);
+    }
+    if (!stbi__process_scan_header(z) || (z->scan_n != z->s->img_n && !(z->scan_n == 1 && z->s->img_n == 1)))
+        return 0;
+    if (it->output && (z->s->img_x != it->width || z->s->img_y != it->height))
+        return 0;
+
+    it->n = req_comp ? req_comp : z->s->img_n >= 3 ? 3 : 1;
+    it->is_rgb = z->s->img_n == 3 && (z->rgb == 3 || (z->app14_color_transform == 0 && !z->jfif));
+    it->decode_n = (z->s->img_n == 3 && it->n < 3 && !it->is_rgb) ? 1 : z->s->img_n;
+
+    if (z->scan_n == 1)
+    {
+        auto comp = &z->img_comp[z->order[0]];
+        it->units_x = (comp->x + 7) >> 3;
+        it->units_y = (comp->y + 7) >> 3;
+        it->unit_rows = 8;
+    }
+    else
+    {
+        it->units_x = z->img_mcu_x;
+        it->units_y = z->img_mcu_y;
+        it->unit_rows = 8 * z->img_v_max;
+    }
+
+    if (z->restart_interval)
+    {
+        if (!find_jpeg_intervals(it))
+            return 0;
+    }
+    else if (num_threads > 1)
+    {
+        // 16 byte aligned for the SSE2 IDCT.
+        for (auto k = 0; k != z->s->img_n; ++k)
+        {
+            size_t size = (size_t)(z->img_comp[k].w2 >> 3) * (z->img_comp[k].h2 >> 3) * 64 * sizeof(short);
+            z->img_comp[k].raw_coeff = malloc(size + 15);
+            z->img_comp[k].coeff = (short *)(((size_t)z->img_comp[k].raw_coeff + 15) & ~(size_t)15);
+            it->coeff[k] = z->img_comp[k].coeff;
+        }
+    }
+
+    if (!it->output)
+    {
+        it->output = (stbi_uc *)stbi__malloc_mad3(it->n, z->s->img_x, z->s->img_y, 1);
+        it->row_pitch = (size_t)it->n * z->s->img_x;
+        it->owns_output = true;
+    }
+    it->row_units = new std::atomic<uint>[it->units_y];
+    for (auto j = 0; j != it->units_y; ++j)
+        it->row_units[j] = 0;
+    it->num_bands = (z->s->img_y + JPEG_BAND_ROWS - 1) / JPEG_BAND_ROWS;
+    it->decoded_rows = 0;
+    it->next_idct_row = 0;
+    it->next_interval = 0;
+    it->next_band = 0;
+    it->failed = !it->output;
+
+    // The calling thread is one of the workers, and the entropy decoder first if there's no
+    //   restart interval to split on.
+    std::thread *threads = new std::thread[num_threads - 1];
+    for (auto i = 0; i != num_threads - 1; ++i)
+        threads[i] = std::thread(run_jpeg_worker, it);
+
+    if (!z->restart_interval)
+    {
+        stbi__jpeg_reset(z);
+        for (uint j = 0; j != it->units_y && !it->failed; ++j)
+        {
+            for (uint i = 0; i != it->units_x && !it->failed; ++i)
+                if (!decode_jpeg_unit(it, z, i, j))
+                    it->failed = true;
+            if (it->coeff[0])
+                it->decoded_rows.store(j + 1, std::memory_order_release);
+            else
+                it->row_units[j].store(it->units_x, std::memory_order_release);
+        }
+    }
+    run_jpeg_worker(it);
+
+    for (auto i = 0; i != num_threads - 1; ++i)
+        threads[i].join();
+    delete[] threads;
+
+    if (it->failed)
+        return 0;
+
+    // The rest of stbi__decode_jpeg_image after the scan.
+    if (z->restart_interval)
+    {
+        z->s->img_buffer = (stbi_uc *)it->scan_end;
+        z->marker = STBI__MARKER_none;
+    }
+    else if (z->marker == STBI__MARKER_none)
+    {
+        z->marker = stbi__skip_jpeg_junk_at_end(z);
+    }
+
+    m = stbi__get_marker(z);
+    if (STBI__RESTART(m))
+        m = stbi__get_marker(z);
+    while (!stbi__EOI(m))
+    {
+        if (stbi__SOS(m))
+            return 0;
+        if (stbi__DNL(m))
+        {
+            int Ld = stbi__get16be(z->s);
+            stbi__uint32 NL = stbi__get16be(z->s);
+            if (Ld != 4 || NL != z->s->img_y)
+                return 0;
+        }
+        else if (!stbi__process_marker(z, m))
+        {
+            break;
+        }
+        m = stbi__get_marker(z);
+    }
+
+    // A marker after the scan can't have changed how the colors were converted.
+    int is_rgb = z->s->img_n == 3 && (z->rgb == 3 || (z->app14_color_transform == 0 && !z->jfif));
+    return is_rgb == it->is_rgb;
+}
+
+// Runs the whole thing with it->output and friends set up by the caller. False if stbi has to do it.
+static bool run_jpeg_decode(Jpeg_Parallel_Decode *it, const void *data, size_t size, int desired_channels, uint num_threads)
+{
+    if (desired_channels < 0 || desired_channels > 4 || size > 0x7FFFFFFF || stbi__vertically_flip_on_load)
+        return false;
+
+    stbi__context context;
+    stbi__start_mem(&context, (const stbi_uc *)data, (int)size);
+
+    it->z = (stbi__jpeg *)malloc(sizeof(stbi__jpeg));
+    memset(it->z, 0, sizeof(stbi__jpeg));
+    it->z->s = &context;
+    stbi__setup_jpeg(it->z);
+    context.img_n = 0; // makes stbi__cleanup_jpeg safe
+
+    bool result = decode_jpeg_parallel_image(it, desired_channels, num_threads) != 0;
+    it->width = context.img_x;
+    it->height = context.img_y;
+    it->channels_in_file = context.img_n >= 3 ? 3 : 1;
+
+    stbi__cleanup_jpeg(it->z);
+    free(it->z);
+    delete[] it->row_units;
+    free(it->intervals);
+    if (!result && it->owns_output)
+        STBI_FREE(it->output);
+    return result;
+}
+
+// stbi_load_from_memory on up to num_threads threads (0: one per core), same output and errors.
+stbi_uc *decode_jpeg_parallel(const void *data, size_t size, int *x, int *y, int *channels_in_file, int desired_channels, uint num_threads = 0)
+{
+    if (!num_threads)
+        num_threads = std::thread::hardware_concurrency();
+    if (num_threads <= 1)
+        return stbi_load_from_memory((const stbi_uc *)data, (int)size, x, y, channels_in_file, desired_channels);
+
+    auto it = new Jpeg_Parallel_Decode();
+    stbi_uc *result = NULL;
+    if (run_jpeg_decode(it, data, size, desired_channels, num_threads))
+    {
+        result = it->output;
+        *x = (int)it->width;
+        *y = (int)it->height;
+        if (channels_in_file)
+            *channels_in_file = it->channels_in_file;
+    }
+    delete it;
+
+    if (!result)
+        return stbi_load_from_memory((const stbi_uc *)data, (int)size, x, y, channels_in_file, desired_channels);
+    return result;
+}
+
+// Decodes a width x height JPEG into destination, row_pitch bytes from one row to the next, with
+//   desired_channels (1-4) per pixel. False if it's some other size, not a JPEG this can do
+//   (see above) or broken, stbi_load_from_memory and a copy is the way then.
+bool decode_jpeg_to(const void *data, size_t size, stbi_uc *destination, size_t row_pitch, uint width, uint height,
+                    int desired_channels, uint num_threads = 0)
+{
+    if (!num_threads)
+        num_threads = std::thread::hardware_concurrency();
+    if (!num_threads)
+        num_threads = 1;
+    if (!desired_channels || row_pitch < (size_t)width * desired_channels)
+        return false;
+
+    auto it = new Jpeg_Parallel_Decode();
+    it->output = destination;
+    it->row_pitch = row_pitch;
+    it->width = width;
+    it->height = height;
+    bool result = run_jpeg_decode(it, data, size, desired_channels, num_threads);
+    delete it;
+    return result;
+}
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef _MATERIAL_H_
+#define _MATERIAL_H_
+#include "stdafx.h"
+
+/// ============ MATERIALS ============ ///
+// A PBR material is an albedo map, a normal map and three single channel maps: ambient occlusion,
+//   roughness and metallic. The single channel maps are packed into the channels of one ORM texture
+//   (by the cook, see cook.cpp, or at load time when only the source images are there), so they
+//   cost one decode, one texture and one sampler binding instead of three. orm_channels records
+//   which channel ended up holding which map, the shader reads them back through it.
+
+enum Material_Channel {
+    MATERIAL_CHANNEL_AO,
+    MATERIAL_CHANNEL_ROUGHNESS,
+    MATERIAL_CHANNEL_METALLIC,
+    MATERIAL_CHANNEL_COUNT
+};
+
+struct Material {
+    const char *name;
+    uint albedo;                                // indices into the texture table
+    uint normal;
+    uint orm;
+    uchar orm_channels[MATERIAL_CHANNEL_COUNT]; // 0..3: R..A of the orm texture
+};
+
+// glTF's layout: R occlusion, G roughness, B metallic. Alpha is left opaque.
+static const uchar ORM_DEFAULT_CHANNELS[MATERIAL_CHANNEL_COUNT] = { 0, 1, 2 };
+
+static inline const char *get_material_channel_name(Material_Channel channel)
+{
+    switch (channel)
+    {
+        case MATERIAL_CHANNEL_AO:        return "AO";
+        case MATERIAL_CHANNEL_ROUGHNESS: return "roughness";
+        case MATERIAL_CHANNEL_METALLIC:  return "metallic";
+        default:                         return "?";
+    }
+}
+
+// Interleaves count single channel pixels of each map into rgba, maps[c] goes to channel channels[c].
+//   Channels no map lands in are 255.
+void pack_orm_texture(uchar *rgba, const uchar *const maps[MATERIAL_CHANNEL_COUNT], size_t count,
+                      const uchar channels[MATERIAL_CHANNEL_COUNT] = ORM_DEFAULT_CHANNELS)
+{
+    memset(rgba, 0xFF, count * 4);
+    for (auto c = 0; c != MATERIAL_CHANNEL_COUNT; ++c)
+    {
+        auto src = maps[c];
+        auto dst = rgba + channels[c];
+        for (size_t i = 0; i != count; ++i)
+            dst[i * 4] = src[i];
+    }
+}
+
+#endif
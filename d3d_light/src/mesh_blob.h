@@ -0,0 +1,247 @@
+#ifndef _MESH_BLOB_H_
+#define _MESH_BLOB_H_
+#include "stdafx.h"
+
+#include "mesh_common.h"
+#include "index_pack.h"
+#include "meshlet.h"
+#include "file_map.h"
+
+/// ============ COOKED MESH BLOB ============ ///
+// Layout of a .mesh file written by the cooker (mesh_cooker.cpp):
+//
+//   Mesh_Blob_Header
+//   Mesh_Blob_Entry[num_meshes]
+//   payloads, each aligned to MESH_BLOB_ALIGNMENT:
+//     Vertex[vertex_count]   (exactly the Vertex struct in mesh_common.h)
+//     indices[index_count]   (index_stride bytes each, relative to their part's base vertex)
+//     Mesh_Part[num_parts]
+//     Meshlet[num_meshlets]
+//     Mesh_Lod[num_lods]
+//
+// Meshes must have gone through optimize_cpu_mesh (mesh_optimize.h) before they are written.
+// Everything is little-endian and offsets are from the start of the file, so the
+//   runtime maps the file and hands the payload pointers straight to create_gpu_buffer.
+
+#define MESH_BLOB_MAGIC     0x48534D43 // "CMSH"
+#define MESH_BLOB_VERSION   6
+#define MESH_BLOB_ALIGNMENT 16
+
+struct Mesh_Blob_Header
+{
+    uint magic;
+    uint version;
+    uint vertex_stride;
+    uint part_stride;
+    uint num_meshes;
+    uint meshlet_stride;
+    uint64_t total_size;
+    uint lod_stride;
+    uint reserved;
+};
+
+struct Mesh_Blob_Entry
+{
+    uint64_t vertex_offset;
+    uint64_t index_offset;
+    uint64_t part_offset;
+    uint64_t meshlet_offset;
+    uint64_t lod_offset;
+    uint vertex_count;
+    uint index_count;
+    uint index_stride;
+    uint num_parts;
+    uint num_meshlets;
+    uint num_lods;
+    Mesh_Bounds bounds;   // see mesh_bounds.h
+};
+
+static_assert(sizeof(Mesh_Blob_Header) == 40, "Mesh_Blob_Header layout changed, bump MESH_BLOB_VERSION.");
+static_assert(sizeof(Mesh_Blob_Entry) == 104, "Mesh_Blob_Entry layout changed, bump MESH_BLOB_VERSION.");
+
+static inline uint64_t align_blob_offset(uint64_t offset)
+{
+    return (offset + (MESH_BLOB_ALIGNMENT - 1)) & ~(uint64_t)(MESH_BLOB_ALIGNMENT - 1);
+}
+
+/// ============ WRITING ============ ///
+bool write_mesh_blob(const char *path, Cpu_Mesh *meshes, uint num_meshes)
+{
+    uint64_t offset = sizeof(Mesh_Blob_Header) + (num_meshes * sizeof(Mesh_Blob_Entry));
+    for (auto i = 0; i != num_meshes; ++i)
+    {
+        offset = align_blob_offset(offset) + (meshes[i].num_vertices * sizeof(Vertex));
+        offset = align_blob_offset(offset) + (meshes[i].num_indices * meshes[i].index_stride);
+        offset = align_blob_offset(offset) + (meshes[i].num_parts * sizeof(Mesh_Part));
+        offset = align_blob_offset(offset) + (meshes[i].num_meshlets * sizeof(Meshlet));
+        offset = align_blob_offset(offset) + (meshes[i].num_lods * sizeof(Mesh_Lod));
+    }
+    uint64_t total_size = align_blob_offset(offset);
+
+    uchar *blob = (uchar *)calloc(1, total_size);
+    if (!blob)
+    {
+        LOGF("Failed to allocate %llu bytes.\n", (unsigned long long)total_size);
+        return false;
+    }
+
+    auto header = (Mesh_Blob_Header *)blob;
+    header->magic = MESH_BLOB_MAGIC;
+    header->version = MESH_BLOB_VERSION;
+    header->vertex_stride = sizeof(Vertex);
+    header->part_stride = sizeof(Mesh_Part);
+    header->meshlet_stride = sizeof(Meshlet);
+    header->lod_stride = sizeof(Mesh_Lod);
+    header->num_meshes = num_meshes;
+    header->total_size = total_size;
+
+    auto entries = (Mesh_Blob_Entry *)(blob + sizeof(Mesh_Blob_Header));
+    offset = sizeof(Mesh_Blob_Header) + (num_meshes * sizeof(Mesh_Blob_Entry));
+
+    for (auto i = 0; i != num_meshes; ++i)
+    {
+        entries[i].vertex_count = meshes[i].num_vertices;
+        entries[i].vertex_offset = align_blob_offset(offset);
+        memcpy(blob + entries[i].vertex_offset, meshes[i].vertices, meshes[i].num_vertices * sizeof(Vertex));
+        offset = entries[i].vertex_offset + (meshes[i].num_vertices * sizeof(Vertex));
+
+        entries[i].index_count = meshes[i].num_indices;
+        entries[i].index_stride = meshes[i].index_stride;
+        entries[i].index_offset = align_blob_offset(offset);
+        pack_mesh_indices(&meshes[i], blob + entries[i].index_offset);
+        offset = entries[i].index_offset + (meshes[i].num_indices * meshes[i].index_stride);
+
+        entries[i].num_parts = meshes[i].num_parts;
+        entries[i].part_offset = align_blob_offset(offset);
+        memcpy(blob + entries[i].part_offset, meshes[i].parts, meshes[i].num_parts * sizeof(Mesh_Part));
+        offset = entries[i].part_offset + (meshes[i].num_parts * sizeof(Mesh_Part));
+
+        entries[i].num_meshlets = meshes[i].num_meshlets;
+        entries[i].meshlet_offset = align_blob_offset(offset);
+        memcpy(blob + entries[i].meshlet_offset, meshes[i].meshlets, meshes[i].num_meshlets * sizeof(Meshlet));
+        offset = entries[i].meshlet_offset + (meshes[i].num_meshlets * sizeof(Meshlet));
+
+        entries[i].num_lods = meshes[i].num_lods;
+        entries[i].lod_offset = align_blob_offset(offset);
+        memcpy(blob + entries[i].lod_offset, meshes[i].lods, meshes[i].num_lods * sizeof(Mesh_Lod));
+        offset = entries[i].lod_offset + (meshes[i].num_lods * sizeof(Mesh_Lod));
+
+        entries[i].bounds = meshes[i].bounds;
+    }
+
+    FILE *file = fopen(path, "wb");
+    if (!file)
+    {
+        LOGF("Failed to open %s for writing.\n", path);
+        free(blob);
+        return false;
+    }
+
+    bool result = (fwrite(blob, 1, total_size, file) == total_size);
+    fclose(file);
+    free(blob);
+
+    if (!result)
+        LOGF("Failed to write %s.\n", path);
+    return result;
+}
+
+/// ============ READING ============ ///
+struct Mesh_Blob
+{
+    Mapped_File file;
+    Mesh_Blob_Header *header;
+    Mesh_Blob_Entry *entries;
+};
+
+// Validates a blob that's already in memory (e.g. a view into a pack, see pack.h), which
+//   has to outlive the Mesh_Blob. name is only for the log.
+bool open_mesh_blob_memory(Mesh_Blob *it, const void *data, size_t size, const char *name)
+{
+    ZeroThat(it);
+
+    auto base = (uchar *)data;
+    auto header = (Mesh_Blob_Header *)base;
+
+    if (size < sizeof(Mesh_Blob_Header) ||
+        header->magic != MESH_BLOB_MAGIC ||
+        header->version != MESH_BLOB_VERSION ||
+        header->vertex_stride != sizeof(Vertex) ||
+        header->part_stride != sizeof(Mesh_Part) ||
+        header->meshlet_stride != sizeof(Meshlet) ||
+        header->lod_stride != sizeof(Mesh_Lod) ||
+        header->total_size != size ||
+        sizeof(Mesh_Blob_Header) + ((uint64_t)header->num_meshes * sizeof(Mesh_Blob_Entry)) > size)
+    {
+        LOGF("Stale or invalid mesh blob: %s\n", name);
+        return false;
+    }
+
+    auto entries = (Mesh_Blob_Entry *)(base + sizeof(Mesh_Blob_Header));
+    for (auto i = 0; i != header->num_meshes; ++i)
+    {
+        if ((entries[i].index_stride != sizeof(uint16_t) && entries[i].index_stride != sizeof(uint)) ||
+            entries[i].vertex_offset + ((uint64_t)entries[i].vertex_count * sizeof(Vertex)) > size ||
+            entries[i].index_offset + ((uint64_t)entries[i].index_count * entries[i].index_stride) > size ||
+            entries[i].part_offset + ((uint64_t)entries[i].num_parts * sizeof(Mesh_Part)) > size ||
+            entries[i].meshlet_offset + ((uint64_t)entries[i].num_meshlets * sizeof(Meshlet)) > size ||
+            entries[i].lod_offset + ((uint64_t)entries[i].num_lods * sizeof(Mesh_Lod)) > size)
+        {
+            LOGF("Mesh %d is out of bounds: %s\n", i, name);
+            return false;
+        }
+    }
+
+    it->header = header;
+    it->entries = entries;
+    return true;
+}
+
+bool open_mesh_blob(Mesh_Blob *it, const char *path)
+{
+    Mapped_File file;
+    if (!map_file(&file, path))
+        return false;
+
+    if (!open_mesh_blob_memory(it, file.data, file.size, path))
+    {
+        unmap_file(&file);
+        return false;
+    }
+
+    it->file = file;
+    return true;
+}
+
+void close_mesh_blob(Mesh_Blob *it)
+{
+    unmap_file(&it->file);
+    ZeroThat(it);
+}
+
+static inline Vertex *get_blob_vertices(Mesh_Blob *it, uint mesh)
+{
+    return (Vertex *)((uchar *)it->header + it->entries[mesh].vertex_offset);
+}
+
+static inline void *get_blob_indices(Mesh_Blob *it, uint mesh)
+{
+    return (uchar *)it->header + it->entries[mesh].index_offset;
+}
+
+static inline Mesh_Part *get_blob_parts(Mesh_Blob *it, uint mesh)
+{
+    return (Mesh_Part *)((uchar *)it->header + it->entries[mesh].part_offset);
+}
+
+static inline Meshlet *get_blob_meshlets(Mesh_Blob *it, uint mesh)
+{
+    return (Meshlet *)((uchar *)it->header + it->entries[mesh].meshlet_offset);
+}
+
+static inline Mesh_Lod *get_blob_lods(Mesh_Blob *it, uint mesh)
+{
+    return (Mesh_Lod *)((uchar *)it->header + it->entries[mesh].lod_offset);
+}
+
+#endif
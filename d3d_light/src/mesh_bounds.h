@@ -0,0 +1,243 @@
+#ifndef _MESH_BOUNDS_H_
+#define _MESH_BOUNDS_H_
+#include "stdafx.h"
+
+#include <math.h>
+#include <float.h>
+
+#include "mesh_common.h"
+#include "meshlet.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BOUNDS_USE_SSE 1
+#include <emmintrin.h>
+#endif
+
+/// ============ MESH BOUNDS ============ ///
+// Mesh_Bounds (mesh_common.h) is an AABB plus a sphere, both around every vertex of the mesh:
+//   the AABB is exact, the sphere is centered on it and reaches out to the farthest vertex,
+//   same as meshlet spheres. Meshes get theirs in optimize_cpu_mesh, the blob stores them.
+// Computing them is two passes over the vertices, one for the AABB and one for the radius.
+//   Both are bound by memory, Vertex being 60 bytes of which 12 are the position, so the SSE
+//   versions mostly just keep up with it: the AABB pass does a whole position per register
+//   (the 4th lane reads the color and is ignored), the radius pass transposes 4 positions at
+//   a time into x, y and z registers.
+// Node or world bounds come from transform_mesh_bounds, and merge_mesh_bounds adds meshes up.
+
+// Empty bounds, which is what a mesh without vertices gets and what merging starts from.
+void init_mesh_bounds(Mesh_Bounds *it)
+{
+    ZeroThat(it);
+    for (auto k = 0; k != 3; ++k)
+    {
+        it->aabb_min[k] = FLT_MAX;
+        it->aabb_max[k] = -FLT_MAX;
+    }
+}
+
+static inline bool is_mesh_bounds_empty(const Mesh_Bounds *it)
+{
+    return it->aabb_min[0] > it->aabb_max[0];
+}
+
+static void compute_mesh_aabb(const Vertex *vertices, uint num_vertices, float *out_min, float *out_max)
+{
+    uint i = 0;
+#if BOUNDS_USE_SSE
+    // Two pairs of accumulators so consecutive vertices don't wait on each other.
+    __m128 min0 = _mm_set1_ps(FLT_MAX), min1 = min0;
+    __m128 max0 = _mm_set1_ps(-FLT_MAX), max1 = max0;
+    for (; i + 2 <= num_vertices; i += 2)
+    {
+        __m128 p0 = _mm_loadu_ps(vertices[i].position);
+        __m128 p1 = _mm_loadu_ps(vertices[i + 1].position);
+        min0 = _mm_min_ps(min0, p0);
+        max0 = _mm_max_ps(max0, p0);
+        min1 = _mm_min_ps(min1, p1);
+        max1 = _mm_max_ps(max1, p1);
+    }
+
+    float lanes_min[4], lanes_max[4];
+    _mm_storeu_ps(lanes_min, _mm_min_ps(min0, min1));
+    _mm_storeu_ps(lanes_max, _mm_max_ps(max0, max1));
+    memcpy(out_min, lanes_min, 3 * sizeof(float));
+    memcpy(out_max, lanes_max, 3 * sizeof(float));
+#else
+    for (auto k = 0; k != 3; ++k)
+    {
+        out_min[k] = FLT_MAX;
+        out_max[k] = -FLT_MAX;
+    }
+#endif
+
+    for (; i != num_vertices; ++i)
+    {
+        for (auto k = 0; k != 3; ++k)
+        {
+            out_min[k] = fminf(out_min[k], vertices[i].position[k]);
+            out_max[k] = fmaxf(out_max[k], vertices[i].position[k]);
+        }
+    }
+}
+
+// Largest squared distance from center to any vertex.
+static float compute_mesh_radius_squared(const Vertex *vertices, uint num_vertices, const float *center)
+{
+    float radius_squared = 0.0f;
+    uint i = 0;
+#if BOUNDS_USE_SSE
+    __m128 cx = _mm_set1_ps(center[0]);
+    __m128 cy = _mm_set1_ps(center[1]);
+    __m128 cz = _mm_set1_ps(center[2]);
+    __m128 max_d2 = _mm_setzero_ps();
+    for (; i + 4 <= num_vertices; i += 4)
+    {
+        // Rows are x y z color.r of 4 vertices, columns end up being x, y, z and color.r.
+        __m128 x = _mm_loadu_ps(vertices[i].position);
+        __m128 y = _mm_loadu_ps(vertices[i + 1].position);
+        __m128 z = _mm_loadu_ps(vertices[i + 2].position);
+        __m128 w = _mm_loadu_ps(vertices[i + 3].position);
+        _MM_TRANSPOSE4_PS(x, y, z, w);
+
+        __m128 dx = _mm_sub_ps(x, cx);
+        __m128 dy = _mm_sub_ps(y, cy);
+        __m128 dz = _mm_sub_ps(z, cz);
+        __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+        max_d2 = _mm_max_ps(max_d2, d2);
+    }
+
+    float lanes[4];
+    _mm_storeu_ps(lanes, max_d2);
+    radius_squared = fmaxf(fmaxf(lanes[0], lanes[1]), fmaxf(lanes[2], lanes[3]));
+#endif
+
+    for (; i != num_vertices; ++i)
+    {
+        float d[3] = { vertices[i].position[0] - center[0], vertices[i].position[1] - center[1], vertices[i].position[2] - center[2] };
+        radius_squared = fmaxf(radius_squared, d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+    }
+    return radius_squared;
+}
+
+void compute_mesh_bounds(Mesh_Bounds *it, const Vertex *vertices, uint num_vertices)
+{
+    init_mesh_bounds(it);
+    if (!num_vertices)
+        return;
+
+    compute_mesh_aabb(vertices, num_vertices, it->aabb_min, it->aabb_max);
+    for (auto k = 0; k != 3; ++k)
+        it->center[k] = (it->aabb_min[k] + it->aabb_max[k]) * 0.5f;
+    it->radius = sqrtf(compute_mesh_radius_squared(vertices, num_vertices, it->center));
+}
+
+// Grows it to hold other as well. The sphere is the smallest one around both spheres, or the
+//   one around the merged AABB when that's smaller.
+void merge_mesh_bounds(Mesh_Bounds *it, const Mesh_Bounds *other)
+{
+    if (is_mesh_bounds_empty(other))
+        return;
+    if (is_mesh_bounds_empty(it))
+    {
+        *it = *other;
+        return;
+    }
+
+    /// -- Sphere around both spheres.
+    float d[3] = { other->center[0] - it->center[0], other->center[1] - it->center[1], other->center[2] - it->center[2] };
+    float distance = sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+    float center[3];
+    float radius;
+    if (distance + other->radius <= it->radius)
+    {
+        memcpy(center, it->center, sizeof(center));
+        radius = it->radius;
+    }
+    else if (distance + it->radius <= other->radius)
+    {
+        memcpy(center, other->center, sizeof(center));
+        radius = other->radius;
+    }
+    else
+    {
+        radius = (distance + it->radius + other->radius) * 0.5f;
+        float t = (radius - it->radius) / distance;
+        for (auto k = 0; k != 3; ++k)
+            center[k] = it->center[k] + d[k] * t;
+    }
+
+    /// -- AABB, and its own sphere.
+    float half_diagonal = 0.0f;
+    for (auto k = 0; k != 3; ++k)
+    {
+        it->aabb_min[k] = fminf(it->aabb_min[k], other->aabb_min[k]);
+        it->aabb_max[k] = fmaxf(it->aabb_max[k], other->aabb_max[k]);
+        float half = (it->aabb_max[k] - it->aabb_min[k]) * 0.5f;
+        half_diagonal += half * half;
+    }
+    half_diagonal = sqrtf(half_diagonal);
+
+    if (half_diagonal < radius)
+    {
+        for (auto k = 0; k != 3; ++k)
+            center[k] = (it->aabb_min[k] + it->aabb_max[k]) * 0.5f;
+        radius = half_diagonal;
+    }
+    memcpy(it->center, center, sizeof(center));
+    it->radius = radius;
+}
+
+// Bounds of the mesh under a column-major matrix (HMM_Mat4::Elements[column][row]). The AABB
+//   is the one around the transformed box (Arvo), the sphere scales by the longest axis.
+void transform_mesh_bounds(Mesh_Bounds *it, const Mesh_Bounds *bounds, const float *matrix)
+{
+    if (is_mesh_bounds_empty(bounds))
+    {
+        init_mesh_bounds(it);
+        return;
+    }
+
+    Mesh_Bounds result;
+    float max_scale_squared = 0.0f;
+    for (auto r = 0; r != 3; ++r)
+    {
+        result.aabb_min[r] = result.aabb_max[r] = matrix[12 + r];
+        result.center[r] = matrix[12 + r];
+        for (auto c = 0; c != 3; ++c)
+        {
+            float m = matrix[c * 4 + r];
+            float a = m * bounds->aabb_min[c];
+            float b = m * bounds->aabb_max[c];
+            result.aabb_min[r] += fminf(a, b);
+            result.aabb_max[r] += fmaxf(a, b);
+            result.center[r] += m * bounds->center[c];
+        }
+
+        float scale_squared = matrix[r * 4] * matrix[r * 4] + matrix[r * 4 + 1] * matrix[r * 4 + 1] + matrix[r * 4 + 2] * matrix[r * 4 + 2];
+        max_scale_squared = fmaxf(max_scale_squared, scale_squared);
+    }
+    result.radius = bounds->radius * sqrtf(max_scale_squared);
+    *it = result;
+}
+
+// Whole-mesh frustum test against the planes of setup_meshlet_culling, which have to be in
+//   the same space as the bounds. The sphere goes first, the AABB catches what it can't.
+bool is_mesh_visible(const Mesh_Bounds *bounds, const Meshlet_Cull_Params *params)
+{
+    for (auto p = 0; p != 6; ++p)
+    {
+        auto plane = params->planes[p];
+        if (meshlet_dot(plane, bounds->center) + plane[3] < -bounds->radius)
+            return false;
+
+        // The corner farthest along the plane normal.
+        float corner[3];
+        for (auto k = 0; k != 3; ++k)
+            corner[k] = (plane[k] >= 0.0f) ? bounds->aabb_max[k] : bounds->aabb_min[k];
+        if (meshlet_dot(plane, corner) + plane[3] < 0.0f)
+            return false;
+    }
+    return true;
+}
+
+#endif
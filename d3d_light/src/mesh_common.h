@@ -10,6 +10,7 @@ struct Vertex {
     float color[3];
     float texcoord[2];
     float normal[3];
+    float tangent[4]; // w: sign of the bitangent, cross(normal, tangent) * w (see tangent_space.h)
 };
 
 union Face {
@@ -19,4 +20,80 @@ union Face {
     uint elements[3];
 };
 
+// One DrawIndexed worth of a mesh. Indices inside a part are relative to base_vertex,
+//   which is what lets meshes with more than 65536 vertices still use 16-bit indices.
+struct Mesh_Part {
+    uint first_index;
+    uint index_count;
+    int  base_vertex;
+};
+
+struct Meshlet; // meshlet.h
+
+// AABB and sphere around every vertex of a mesh, in mesh space (see mesh_bounds.h).
+struct Mesh_Bounds {
+    float aabb_min[3];
+    float aabb_max[3];
+    float center[3];
+    float radius;
+};
+
+// One level of detail. LODs are consecutive index ranges over the same vertex buffer,
+//   LOD 0 first. Parts and meshlets are relative to the mesh's own arrays.
+struct Mesh_Lod {
+    uint first_index;
+    uint index_count;
+    uint first_part;
+    uint num_parts;
+    uint first_meshlet;
+    uint num_meshlets;
+    float error; // geometric error against LOD 0, in mesh units
+};
+
+// CPU-side mesh, i.e. what the importers produce and what gets handed to create_gpu_buffer.
+// indices are always absolute 32-bit while processing; parts and index_stride describe
+//   how they get packed for the GPU (see index_pack.h).
+struct Cpu_Mesh {
+    Vertex *vertices;
+    uint *indices;
+    uint num_vertices;
+    uint num_indices;
+
+    Mesh_Part *parts;
+    uint num_parts;
+    uint index_stride;
+
+    Meshlet *meshlets;
+    uint num_meshlets;
+
+    Mesh_Lod *lods;
+    uint num_lods;
+
+    Mesh_Bounds bounds;
+};
+
+void free_cpu_mesh(Cpu_Mesh *it)
+{
+    free(it->vertices);
+    free(it->indices);
+    free(it->parts);
+    free(it->meshlets);
+    free(it->lods);
+    ZeroThat(it);
+}
+
+// What the draw loop needs to know about a mesh besides its buffers.
+// Parts, meshlets and LODs of all meshes live in shared arrays, the first_* members index into them.
+struct Mesh_Info {
+    uint first_part;
+    uint num_parts;
+    uint first_meshlet;
+    uint num_meshlets;
+    uint first_lod;
+    uint num_lods;
+
+    // For culling the whole mesh and picking its LOD.
+    Mesh_Bounds bounds;
+};
+
 #endif 
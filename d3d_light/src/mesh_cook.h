@@ -0,0 +1,44 @@
+#ifndef _MESH_COOK_H_
+#define _MESH_COOK_H_
+#include "stdafx.h"
+
+#include <time.h>
+
+#include "scene_import.h"
+#include "mesh_blob.h"
+#include "mesh_optimize.h"
+
+/// ============ MESH COOKING ============ ///
+// Anything Assimp or the native glTF loader can read to a .mesh blob: import (scene_import.h),
+//   optimize every mesh (mesh_optimize.h) and write the blob. Shared by mesh_cooker.cpp and cook.cpp.
+
+#define MESH_COOK_VERSION 3 // bump when optimize_cpu_mesh changes its output for the same input
+
+bool cook_mesh_file(const char *input, const char *output, float overdraw_threshold = OVERDRAW_DEFAULT_THRESHOLD,
+                    float weld_epsilon = 0.0f, uint max_lods = MESH_LOD_MAX_COUNT)
+{
+    clock_t clock1 = clock();
+
+    Cpu_Mesh *meshes;
+    uint num_meshes;
+    if (!import_scene_meshes(input, &meshes, &num_meshes))
+        return false;
+
+    for (auto i = 0; i != num_meshes; ++i)
+    {
+        optimize_cpu_mesh(&meshes[i], i, overdraw_threshold, weld_epsilon, max_lods);
+        LOGF("Mesh %d: %u vertices, %u indices\n", i, meshes[i].num_vertices, meshes[i].num_indices);
+    }
+
+    bool result = write_mesh_blob(output, meshes, num_meshes);
+
+    for (auto i = 0; i != num_meshes; ++i)
+        free_cpu_mesh(&meshes[i]);
+    free(meshes);
+
+    if (result)
+        LOGF("Cooked %s -> %s in %.2fs\n", input, output, (float)(clock() - clock1) / (float)CLOCKS_PER_SEC);
+    return result;
+}
+
+#endif
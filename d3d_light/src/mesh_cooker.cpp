@@ -0,0 +1,314 @@
+// Offline mesh cooker. Turns anything Assimp can read into a .mesh blob (see mesh_blob.h)
+//   that the runtime maps without any parsing.
+//
+// Usage: cooker <input scene> <output .mesh> [overdraw threshold] [weld epsilon] [max LODs]
+//        cooker -benchmark <input scene>
+//
+// -benchmark first measures the triangle orders of every mesh, welded the way the cook welds it:
+//   ACMR, ATVR and overdraw as imported, after optimize_vertex_cache (see vertex_cache.h) and
+//   after optimize_overdraw (see overdraw.h) at a few thresholds, with how long each took.
+// It then times generate_tangents (see tangent_space.h) over every mesh of the scene on 1, 2,
+//   4... threads and Assimp's aiProcess_CalcTangentSpace on the same scene, then
+//   compute_mesh_bounds (see mesh_bounds.h) over the scene's vertices repeated up to at least
+//   BENCHMARK_BOUNDS_VERTICES, against a plain loop. For a .glb it starts with the native loader
+//   (see gltf.h) against Assimp reading the same file.
+#include "stdafx.h"
+
+#include <chrono>
+
+#include "mesh_cook.h"
+
+#define BENCHMARK_RUNS            5
+#define BENCHMARK_BOUNDS_VERTICES (1u << 20)
+
+static const float benchmark_overdraw_thresholds[] = { 1.0f, OVERDRAW_DEFAULT_THRESHOLD, 1.5f, 3.0f };
+
+static void copy_cpu_mesh(Cpu_Mesh *it, const Cpu_Mesh *source)
+{
+    ZeroThat(it);
+    it->num_vertices = source->num_vertices;
+    it->num_indices = source->num_indices;
+    it->vertices = (Vertex *)malloc(it->num_vertices * sizeof(Vertex));
+    it->indices = (uint *)malloc(it->num_indices * sizeof(uint));
+    memcpy(it->vertices, source->vertices, it->num_vertices * sizeof(Vertex));
+    memcpy(it->indices, source->indices, it->num_indices * sizeof(uint));
+}
+
+static void log_mesh_order(uint mesh_index, const char *stage, const Cpu_Mesh *it, double ms)
+{
+    auto cache = analyze_vertex_cache(it->indices, it->num_indices, it->num_vertices);
+    auto overdraw = estimate_overdraw(it->indices, it->num_indices, it->vertices, it->num_vertices);
+    LOGF("Mesh %u: %-24s ACMR %.3f, ATVR %.3f, overdraw %.3f, %8.2fms\n", mesh_index, stage, cache.acmr, cache.atvr,
+         overdraw.overdraw, ms);
+}
+
+// Each stage starts from the previous one's output, same as in optimize_cpu_mesh. The overdraw
+//   thresholds all start from the same vertex cache order.
+static void benchmark_mesh_order(const Cpu_Mesh *sources, uint num_meshes)
+{
+    for (auto i = 0; i != num_meshes; ++i)
+    {
+        Cpu_Mesh mesh;
+        copy_cpu_mesh(&mesh, &sources[i]);
+        weld_vertices(&mesh);
+        log_mesh_order(i, "imported", &mesh, 0.0);
+
+        auto start = std::chrono::steady_clock::now();
+        optimize_vertex_cache(mesh.indices, mesh.indices, mesh.num_indices, mesh.num_vertices);
+        log_mesh_order(i, "optimize_vertex_cache", &mesh, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+
+        uint *cache_order = (uint *)malloc(mesh.num_indices * sizeof(uint));
+        memcpy(cache_order, mesh.indices, mesh.num_indices * sizeof(uint));
+        for (auto t = 0; t != sizeof(benchmark_overdraw_thresholds) / sizeof(benchmark_overdraw_thresholds[0]); ++t)
+        {
+            char stage[32];
+            snprintf(stage, sizeof(stage), "optimize_overdraw %.2f", benchmark_overdraw_thresholds[t]);
+            start = std::chrono::steady_clock::now();
+            optimize_overdraw(mesh.indices, cache_order, mesh.num_indices, mesh.vertices, mesh.num_vertices, benchmark_overdraw_thresholds[t]);
+            log_mesh_order(i, stage, &mesh, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+
+        free(cache_order);
+        free_cpu_mesh(&mesh);
+    }
+}
+
+// Best of a few runs each. Any output that differs from the single threaded one is an error.
+static void benchmark_tangents(const Cpu_Mesh *sources, uint num_meshes)
+{
+    uint num_cores = std::thread::hardware_concurrency();
+    num_cores = num_cores ? num_cores : 1;
+
+    uint num_triangles = 0;
+    Cpu_Mesh *references = (Cpu_Mesh *)calloc(num_meshes, sizeof(Cpu_Mesh));
+    for (auto i = 0; i != num_meshes; ++i)
+        num_triangles += sources[i].num_indices / 3;
+
+    double single_ms = 0.0;
+    for (uint num_threads = 1;; num_threads = (num_threads * 2 > num_cores && num_threads < num_cores) ? num_cores : num_threads * 2)
+    {
+        double best_ms = 1e30;
+        bool identical = true;
+        for (auto run = 0; run != BENCHMARK_RUNS; ++run)
+        {
+            Cpu_Mesh *meshes = (Cpu_Mesh *)calloc(num_meshes, sizeof(Cpu_Mesh));
+            for (auto i = 0; i != num_meshes; ++i)
+                copy_cpu_mesh(&meshes[i], &sources[i]);
+
+            auto start = std::chrono::steady_clock::now();
+            for (auto i = 0; i != num_meshes; ++i)
+                generate_tangents(&meshes[i], num_threads);
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            best_ms = (ms < best_ms) ? ms : best_ms;
+
+            for (auto i = 0; i != num_meshes; ++i)
+            {
+                if (num_threads == 1 && run == 0)
+                {
+                    references[i] = meshes[i];
+                    continue;
+                }
+
+                identical = identical && meshes[i].num_vertices == references[i].num_vertices &&
+                            !memcmp(meshes[i].vertices, references[i].vertices, meshes[i].num_vertices * sizeof(Vertex)) &&
+                            !memcmp(meshes[i].indices, references[i].indices, meshes[i].num_indices * sizeof(uint));
+                free_cpu_mesh(&meshes[i]);
+            }
+            free(meshes);
+        }
+        single_ms = (num_threads == 1) ? best_ms : single_ms;
+
+        LOGF("generate_tangents %2u threads %8.2fms %5.2fx, %u triangles%s\n", num_threads, best_ms, single_ms / best_ms,
+             num_triangles, identical ? "" : " DIFFERS FROM 1 THREAD");
+        if (num_threads >= num_cores)
+            break;
+    }
+
+    for (auto i = 0; i != num_meshes; ++i)
+        free_cpu_mesh(&references[i]);
+    free(references);
+}
+
+// Same bounds as compute_mesh_bounds, one vertex and component at a time.
+static void compute_mesh_bounds_reference(Mesh_Bounds *it, const Vertex *vertices, uint num_vertices)
+{
+    init_mesh_bounds(it);
+    for (auto i = 0; i != num_vertices; ++i)
+    {
+        for (auto k = 0; k != 3; ++k)
+        {
+            it->aabb_min[k] = fminf(it->aabb_min[k], vertices[i].position[k]);
+            it->aabb_max[k] = fmaxf(it->aabb_max[k], vertices[i].position[k]);
+        }
+    }
+
+    for (auto k = 0; k != 3; ++k)
+        it->center[k] = (it->aabb_min[k] + it->aabb_max[k]) * 0.5f;
+
+    float radius_squared = 0.0f;
+    for (auto i = 0; i != num_vertices; ++i)
+    {
+        float d[3] = { vertices[i].position[0] - it->center[0], vertices[i].position[1] - it->center[1], vertices[i].position[2] - it->center[2] };
+        radius_squared = fmaxf(radius_squared, d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+    }
+    it->radius = sqrtf(radius_squared);
+}
+
+// The scene's vertices back to back, repeated until there are enough to be worth timing.
+static void benchmark_bounds(const Cpu_Mesh *sources, uint num_meshes)
+{
+    uint num_scene_vertices = 0;
+    for (auto i = 0; i != num_meshes; ++i)
+        num_scene_vertices += sources[i].num_vertices;
+    if (!num_scene_vertices)
+        return;
+
+    uint num_vertices = ((BENCHMARK_BOUNDS_VERTICES + num_scene_vertices - 1) / num_scene_vertices) * num_scene_vertices;
+    Vertex *vertices = (Vertex *)malloc((size_t)num_vertices * sizeof(Vertex));
+    for (uint filled = 0; filled != num_vertices;)
+    {
+        for (auto i = 0; i != num_meshes; ++i)
+        {
+            memcpy(&vertices[filled], sources[i].vertices, sources[i].num_vertices * sizeof(Vertex));
+            filled += sources[i].num_vertices;
+        }
+    }
+
+    Mesh_Bounds bounds, reference;
+    double best_ms = 1e30, best_reference_ms = 1e30;
+    for (auto run = 0; run != BENCHMARK_RUNS; ++run)
+    {
+        auto start = std::chrono::steady_clock::now();
+        compute_mesh_bounds(&bounds, vertices, num_vertices);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        best_ms = (ms < best_ms) ? ms : best_ms;
+
+        start = std::chrono::steady_clock::now();
+        compute_mesh_bounds_reference(&reference, vertices, num_vertices);
+        ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        best_reference_ms = (ms < best_reference_ms) ? ms : best_reference_ms;
+    }
+
+    bool identical = !memcmp(&bounds, &reference, sizeof(bounds));
+    double gigabytes = (double)num_vertices * sizeof(Vertex) * 2.0 / 1e9; // two passes
+    LOGF("compute_mesh_bounds          %8.2fms %6.2fGB/s, %u vertices%s\n", best_ms, gigabytes / (best_ms / 1000.0), num_vertices,
+         identical ? "" : " DIFFERS FROM REFERENCE");
+    LOGF("plain loop                   %8.2fms %6.2fGB/s\n", best_reference_ms, gigabytes / (best_reference_ms / 1000.0));
+    free(vertices);
+}
+
+// Both import the whole file into Cpu_Meshes, counts have to agree for the timings to mean anything.
+static void benchmark_gltf_import(const char *input)
+{
+    double best_ms = 1e30;
+    uint num_meshes = 0, num_vertices = 0, num_indices = 0;
+    for (auto run = 0; run != BENCHMARK_RUNS; ++run)
+    {
+        auto start = std::chrono::steady_clock::now();
+        Cpu_Mesh *meshes;
+        if (!import_scene_meshes(input, &meshes, &num_meshes))
+            return;
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        best_ms = (ms < best_ms) ? ms : best_ms;
+
+        num_vertices = num_indices = 0;
+        for (auto i = 0; i != num_meshes; ++i)
+        {
+            num_vertices += meshes[i].num_vertices;
+            num_indices += meshes[i].num_indices;
+            free_cpu_mesh(&meshes[i]);
+        }
+        free(meshes);
+    }
+    LOGF("glTF loader                  %8.2fms, %u meshes, %u vertices, %u indices\n", best_ms, num_meshes, num_vertices, num_indices);
+
+    double best_assimp_ms = 1e30;
+    for (auto run = 0; run != BENCHMARK_RUNS; ++run)
+    {
+        auto start = std::chrono::steady_clock::now();
+        Assimp::Importer importer;
+        const aiScene *scene = importer.ReadFile(input, ASSIMP_IMPORT_FLAGS);
+        if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+        {
+            LOGF("Assimp error: %s\n", importer.GetErrorString());
+            return;
+        }
+
+        num_meshes = scene->mNumMeshes;
+        Cpu_Mesh *meshes = (Cpu_Mesh *)calloc(num_meshes ? num_meshes : 1, sizeof(Cpu_Mesh));
+        for (auto i = 0; i != num_meshes; ++i)
+            import_ai_mesh(&meshes[i], scene->mMeshes[i]);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        best_assimp_ms = (ms < best_assimp_ms) ? ms : best_assimp_ms;
+
+        num_vertices = num_indices = 0;
+        for (auto i = 0; i != num_meshes; ++i)
+        {
+            num_vertices += meshes[i].num_vertices;
+            num_indices += meshes[i].num_indices;
+            free_cpu_mesh(&meshes[i]);
+        }
+        free(meshes);
+    }
+    LOGF("Assimp                       %8.2fms, %u meshes, %u vertices, %u indices, %.2fx the glTF loader\n", best_assimp_ms,
+         num_meshes, num_vertices, num_indices, best_assimp_ms / best_ms);
+}
+
+static bool run_benchmarks(const char *input)
+{
+    if (is_gltf_binary_path(input))
+        benchmark_gltf_import(input);
+
+    Cpu_Mesh *sources;
+    uint num_meshes;
+    if (!import_scene_meshes(input, &sources, &num_meshes))
+        return false;
+
+    benchmark_mesh_order(sources, num_meshes);
+    benchmark_tangents(sources, num_meshes);
+
+    Assimp::Importer importer;
+    const aiScene *scene = importer.ReadFile(input, ASSIMP_IMPORT_FLAGS);
+    if (scene && !(scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE) && scene->mRootNode)
+    {
+        auto start = std::chrono::steady_clock::now();
+        importer.ApplyPostProcessing(aiProcess_CalcTangentSpace);
+        LOGF("aiProcess_CalcTangentSpace   %8.2fms\n", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    else
+        LOGF("Assimp error: %s\n", importer.GetErrorString());
+
+    benchmark_bounds(sources, num_meshes);
+
+    for (auto i = 0; i != num_meshes; ++i)
+        free_cpu_mesh(&sources[i]);
+    free(sources);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc == 3 && !strcmp(argv[1], "-benchmark"))
+        return run_benchmarks(argv[2]) ? 0 : 1;
+
+    if (argc < 3 || argc > 6)
+    {
+        printf("Usage: %s <input scene> <output .mesh> [overdraw threshold] [weld epsilon] [max LODs]\n", argv[0]);
+        printf("       %s -benchmark <input scene>\n", argv[0]);
+        return 1;
+    }
+
+    float overdraw_threshold = OVERDRAW_DEFAULT_THRESHOLD;
+    if (argc > 3)
+        overdraw_threshold = (float)atof(argv[3]);
+
+    float weld_epsilon = 0.0f;
+    if (argc > 4)
+        weld_epsilon = (float)atof(argv[4]);
+
+    uint max_lods = MESH_LOD_MAX_COUNT;
+    if (argc > 5)
+        max_lods = (uint)atoi(argv[5]);
+
+    return cook_mesh_file(argv[1], argv[2], overdraw_threshold, weld_epsilon, max_lods) ? 0 : 1;
+}
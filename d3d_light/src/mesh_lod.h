@@ -0,0 +1,86 @@
+#ifndef _MESH_LOD_H_
+#define _MESH_LOD_H_
+#include "stdafx.h"
+
+#include <math.h>
+#include <float.h>
+
+#include "mesh_common.h"
+#include "mesh_simplify.h"
+#include "vertex_cache.h"
+#include "meshlet.h"
+
+/// ============ LOD CHAINS ============ ///
+// Every level is simplified straight from LOD 0, so the stored error is the real distance
+//   to the full resolution mesh rather than a sum of per-level errors. The levels are
+//   appended to the index buffer behind LOD 0 and share its vertices.
+// The chain stops early once the simplifier stalls, which happens on meshes that are
+//   mostly UV seams since those are locked.
+
+#define MESH_LOD_MAX_COUNT     4
+#define MESH_LOD_REDUCTION     0.5f  // each level aims for this fraction of the previous level's triangles
+#define MESH_LOD_MIN_TRIANGLES 64
+#define MESH_LOD_PIXEL_ERROR   1.0f  // how far a LOD may be off on screen before the next finer one is used
+
+// Runs after the reordering passes on LOD 0 and before optimize_vertex_fetch, so the
+//   vertex buffer ends up in LOD 0 first-use order.
+void build_mesh_lods(Cpu_Mesh *it, uint max_lods = MESH_LOD_MAX_COUNT)
+{
+    free(it->lods);
+    it->lods = (Mesh_Lod *)calloc(max_lods ? max_lods : 1, sizeof(Mesh_Lod));
+    it->num_lods = 1;
+    it->lods[0].first_index = 0;
+    it->lods[0].index_count = it->num_indices;
+
+    uint lod0_count = it->num_indices;
+    uint *scratch = (uint *)malloc(lod0_count * sizeof(uint));
+    float target = (float)lod0_count;
+
+    for (auto l = 1; l < max_lods; ++l)
+    {
+        target *= MESH_LOD_REDUCTION;
+        uint target_count = (uint)target - ((uint)target % 3);
+        if (target_count / 3 < MESH_LOD_MIN_TRIANGLES)
+            break;
+
+        float error;
+        uint count = simplify_mesh(scratch, it->indices, lod0_count, it->vertices, it->num_vertices, target_count, FLT_MAX, &error);
+
+        // Less than 10% off the previous level isn't worth the memory.
+        if (!count || count > it->lods[it->num_lods - 1].index_count - it->lods[it->num_lods - 1].index_count / 10)
+            break;
+
+        optimize_vertex_cache(scratch, scratch, count, it->num_vertices);
+
+        it->indices = (uint *)realloc(it->indices, (it->num_indices + count) * sizeof(uint));
+        memcpy(&it->indices[it->num_indices], scratch, count * sizeof(uint));
+
+        auto lod = &it->lods[it->num_lods++];
+        lod->first_index = it->num_indices;
+        lod->index_count = count;
+        lod->error = error;
+        it->num_indices += count;
+    }
+
+    free(scratch);
+}
+
+// Picks the coarsest LOD whose error, projected at distance, stays under pixel_error pixels.
+// error_scale converts mesh units into the units of distance (i.e. the world scale).
+// distance should be to the closest point of the mesh and is clamped to near_plane.
+uint select_mesh_lod(const Mesh_Lod *lods, uint num_lods, float error_scale, float distance, float near_plane,
+                     float fov_y, float viewport_height, float pixel_error = MESH_LOD_PIXEL_ERROR)
+{
+    // Pixels covered by one unit at distance 1.
+    float projection = viewport_height / (2.0f * tanf(fov_y * 0.5f));
+    distance = fmaxf(distance, near_plane);
+
+    uint result = 0;
+    for (auto l = 1; l < num_lods; ++l)
+        if (lods[l].error * error_scale * projection / distance <= pixel_error)
+            result = l;
+
+    return result;
+}
+
+#endif
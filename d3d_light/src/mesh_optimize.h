@@ -0,0 +1,56 @@
+#ifndef _MESH_OPTIMIZE_H_
+#define _MESH_OPTIMIZE_H_
+#include "stdafx.h"
+
+#include "mesh_common.h"
+#include "mesh_bounds.h"
+#include "tangent_space.h"
+#include "vertex_cache.h"
+#include "overdraw.h"
+#include "vertex_weld.h"
+#include "index_pack.h"
+#include "meshlet.h"
+#include "mesh_lod.h"
+
+// Runs every CPU optimization pass over a freshly imported mesh. Both the Assimp path in
+//   WinMain and the offline cooker go through here, so they produce identical buffers.
+void optimize_cpu_mesh(Cpu_Mesh *it, uint mesh_index, float overdraw_threshold = OVERDRAW_DEFAULT_THRESHOLD, float weld_epsilon = 0.0f,
+                       uint max_lods = MESH_LOD_MAX_COUNT)
+{
+    // Before welding: tangents merge corners that only differ by index, welding then drops them.
+    generate_tangents(it);
+    uint vertices_before = it->num_vertices;
+    weld_vertices(it, weld_epsilon);
+
+    auto cache_before = analyze_vertex_cache(it->indices, it->num_indices, it->num_vertices);
+    auto overdraw_before = estimate_overdraw(it->indices, it->num_indices, it->vertices, it->num_vertices);
+
+    optimize_vertex_cache(it->indices, it->indices, it->num_indices, it->num_vertices);
+    optimize_overdraw(it->indices, it->indices, it->num_indices, it->vertices, it->num_vertices, overdraw_threshold);
+    build_mesh_lods(it, max_lods);
+    optimize_vertex_fetch(it);
+    uint vertices_after = it->num_vertices;
+    uint lod0_indices = it->lods[0].index_count;
+    split_mesh_parts(it);
+    build_meshlets(it);
+    compute_mesh_bounds(&it->bounds, it->vertices, it->num_vertices);
+
+    // Stats are about LOD 0, same as before.
+    auto cache_after = analyze_vertex_cache(it->indices, it->lods[0].index_count, it->num_vertices);
+    auto overdraw_after = estimate_overdraw(it->indices, it->lods[0].index_count, it->vertices, it->num_vertices);
+
+    LOGF("Mesh %u: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, overdraw %.3f -> %.3f\n", mesh_index,
+         cache_before.acmr, cache_after.acmr, cache_before.atvr, cache_after.atvr,
+         overdraw_before.overdraw, overdraw_after.overdraw);
+    LOGF("Mesh %u: %u -> %u vertices, %u bytes saved\n", mesh_index,
+         vertices_before, vertices_after, (vertices_before - vertices_after) * (uint)sizeof(Vertex));
+    LOGF("Mesh %u: %u-bit indices in %u part(s), %u bytes saved, %u vertices duplicated across parts\n", mesh_index,
+         it->index_stride * 8, it->num_parts, lod0_indices * ((uint)sizeof(uint) - it->index_stride),
+         it->num_vertices - vertices_after);
+    LOGF("Mesh %u: %u meshlets, %.1f triangles each on average\n", mesh_index,
+         it->num_meshlets, it->num_meshlets ? (float)(it->num_indices / 3) / (float)it->num_meshlets : 0.0f);
+    for (auto l = 0; l != it->num_lods; ++l)
+        LOGF("Mesh %u: LOD %d: %u triangles, error %f\n", mesh_index, l, it->lods[l].index_count / 3, it->lods[l].error);
+}
+
+#endif
@@ -0,0 +1,477 @@
+#ifndef _MESH_SIMPLIFY_H_
+#define _MESH_SIMPLIFY_H_
+#include "stdafx.h"
+
+#include <math.h>
+#include <float.h>
+
+#include "mesh_common.h"
+
+/// ============ MESH SIMPLIFICATION ============ ///
+// Edge collapse after Garland & Heckbert's "Surface Simplification Using Quadric Error Metrics".
+// Collapses only ever move a vertex onto one of its neighbours, so the output is a new index
+//   buffer over the untouched vertex buffer, and every LOD can share the vertices of LOD 0.
+//
+// Vertices are classified by what is around their position:
+//   - manifold: may collapse onto any neighbour
+//   - border:   on an open edge, may only slide along it onto the next vertex of the border
+//   - locked:   never moves. That is every vertex whose position is shared by several vertices
+//               (UV seams, hard normals) and everything around non-manifold edges.
+// Locking the seams is what keeps the UV layout and the normal splits intact. Smooth normals
+//   are protected by refusing collapses that turn any triangle by more than ~75 degrees.
+
+#define SIMPLIFY_BORDER_WEIGHT 10.0f   // how much stronger borders hold than faces
+#define SIMPLIFY_MAX_FLIP_COS  0.25f   // smallest allowed cos between a face normal before and after a collapse
+
+enum {
+    SIMPLIFY_MANIFOLD,
+    SIMPLIFY_BORDER,
+    SIMPLIFY_LOCKED,
+};
+
+// Symmetric 4x4 plane quadric plus the accumulated weight, so errors come out as a
+//   weighted mean of squared distances instead of growing with the triangle count.
+struct Quadric {
+    float a00, a11, a22, a01, a02, a12;
+    float b0, b1, b2;
+    float c;
+    float w;
+};
+
+static inline void quadric_from_plane(Quadric *it, float a, float b, float c, float d, float weight)
+{
+    it->a00 = a * a * weight;
+    it->a11 = b * b * weight;
+    it->a22 = c * c * weight;
+    it->a01 = a * b * weight;
+    it->a02 = a * c * weight;
+    it->a12 = b * c * weight;
+    it->b0 = a * d * weight;
+    it->b1 = b * d * weight;
+    it->b2 = c * d * weight;
+    it->c = d * d * weight;
+    it->w = weight;
+}
+
+static inline void quadric_add(Quadric *it, const Quadric *other)
+{
+    auto dst = (float *)it;
+    auto src = (const float *)other;
+    for (auto k = 0; k != sizeof(Quadric) / sizeof(float); ++k)
+        dst[k] += src[k];
+}
+
+static inline float quadric_error(const Quadric *it, const float *p)
+{
+    float x = p[0], y = p[1], z = p[2];
+    float error = it->a00 * x * x + it->a11 * y * y + it->a22 * z * z +
+                  2.0f * (it->a01 * x * y + it->a02 * x * z + it->a12 * y * z) +
+                  2.0f * (it->b0 * x + it->b1 * y + it->b2 * z) +
+                  it->c;
+
+    return (it->w > 0.0f) ? fabsf(error) / it->w : 0.0f;
+}
+
+static inline void simplify_triangle_normal(const float *p0, const float *p1, const float *p2, float *out)
+{
+    float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+    float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+    out[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    out[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    out[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+/// -- Directed edge set over position ids, open addressing with ~0 as the empty key.
+struct Simplify_Edges {
+    uint64_t *keys;
+    uint *counts;
+    uint size;
+};
+
+static inline uint hash_simplify_edge(uint64_t key)
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdull;
+    key ^= key >> 33;
+    return (uint)key;
+}
+
+static uint *find_simplify_edge(Simplify_Edges *it, uint a, uint b, bool insert)
+{
+    uint64_t key = ((uint64_t)a << 32) | b;
+    uint bucket = hash_simplify_edge(key) & (it->size - 1);
+
+    for (;;)
+    {
+        if (it->keys[bucket] == key)
+            return &it->counts[bucket];
+
+        if (it->keys[bucket] == ~0ull)
+        {
+            if (!insert)
+                return NULL;
+            it->keys[bucket] = key;
+            return &it->counts[bucket];
+        }
+
+        bucket = (bucket + 1) & (it->size - 1);
+    }
+}
+
+struct Simplify_Collapse {
+    float error;
+    uint source;
+    uint target;
+};
+
+static int compare_simplify_collapses(const void *a, const void *b)
+{
+    float ea = ((const Simplify_Collapse *)a)->error;
+    float eb = ((const Simplify_Collapse *)b)->error;
+    return (ea < eb) ? -1 : (ea > eb) ? 1 : 0;
+}
+
+// Simplifies the triangle list in indices down to target_index_count indices or until the
+//   next collapse would exceed target_error (in mesh units), whichever comes first.
+// Writes the result to dst, which needs room for num_indices and may not alias indices.
+// Returns the new index count; out_error receives the error of the result in mesh units.
+uint simplify_mesh(uint *dst, const uint *indices, uint num_indices, const Vertex *vertices, uint num_vertices,
+                   uint target_index_count, float target_error = FLT_MAX, float *out_error = NULL)
+{
+    memcpy(dst, indices, num_indices * sizeof(uint));
+    if (out_error)
+        *out_error = 0.0f;
+    if (!num_indices || num_indices <= target_index_count)
+        return num_indices;
+
+    /// -- Positions, rescaled to the unit cube so the float quadrics stay well conditioned.
+    float aabb_min[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float extent = 0.0f;
+    for (auto i = 0; i != num_vertices; ++i)
+        for (auto k = 0; k != 3; ++k)
+            aabb_min[k] = fminf(aabb_min[k], vertices[i].position[k]);
+    for (auto i = 0; i != num_vertices; ++i)
+        for (auto k = 0; k != 3; ++k)
+            extent = fmaxf(extent, vertices[i].position[k] - aabb_min[k]);
+    float scale = (extent > 0.0f) ? 1.0f / extent : 1.0f;
+
+    float *positions = (float *)malloc(num_vertices * 3 * sizeof(float));
+    for (auto i = 0; i != num_vertices; ++i)
+        for (auto k = 0; k != 3; ++k)
+            positions[i * 3 + k] = (vertices[i].position[k] - aabb_min[k]) * scale;
+
+    /// -- Position ids: every vertex maps to the first vertex sharing its position.
+    uint *position_id = (uint *)malloc(num_vertices * sizeof(uint));
+    uint *wedges = (uint *)calloc(num_vertices, sizeof(uint));
+    {
+        uint table_size = 1;
+        while (table_size < num_vertices * 2)
+            table_size *= 2;
+
+        uint *table = (uint *)calloc(table_size, sizeof(uint));
+        for (auto i = 0; i != num_vertices; ++i)
+        {
+            uint key[3];
+            memcpy(key, vertices[i].position, sizeof(key));
+            uint bucket = ((key[0] * 73856093u) ^ (key[1] * 19349663u) ^ (key[2] * 83492791u)) & (table_size - 1);
+
+            for (;;)
+            {
+                if (!table[bucket])
+                {
+                    table[bucket] = i + 1;
+                    position_id[i] = i;
+                    break;
+                }
+
+                uint other = table[bucket] - 1;
+                if (!memcmp(vertices[other].position, key, sizeof(key)))
+                {
+                    position_id[i] = other;
+                    break;
+                }
+
+                bucket = (bucket + 1) & (table_size - 1);
+            }
+        }
+        free(table);
+
+        // Only vertices the mesh uses count as wedges, stray duplicates shouldn't lock anything.
+        bool *used = (bool *)calloc(num_vertices, sizeof(bool));
+        for (auto i = 0; i != num_indices; ++i)
+            used[indices[i]] = true;
+        for (auto i = 0; i != num_vertices; ++i)
+            if (used[i])
+                wedges[position_id[i]]++;
+        free(used);
+    }
+
+    /// -- Quadrics, one per position id.
+    Quadric *quadrics = (Quadric *)calloc(num_vertices, sizeof(Quadric));
+    for (auto i = 0; i < num_indices; i += 3)
+    {
+        auto p0 = &positions[indices[i + 0] * 3];
+        auto p1 = &positions[indices[i + 1] * 3];
+        auto p2 = &positions[indices[i + 2] * 3];
+
+        float n[3];
+        simplify_triangle_normal(p0, p1, p2, n);
+        float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (length == 0.0f)
+            continue;
+
+        n[0] /= length;
+        n[1] /= length;
+        n[2] /= length;
+
+        Quadric q;
+        quadric_from_plane(&q, n[0], n[1], n[2], -(n[0] * p0[0] + n[1] * p0[1] + n[2] * p0[2]), length * 0.5f);
+        for (auto k = 0; k != 3; ++k)
+            quadric_add(&quadrics[position_id[indices[i + k]]], &q);
+    }
+
+    /// -- Working state, reused every pass.
+    Simplify_Edges edges;
+    edges.size = 1;
+    while (edges.size < num_indices * 2)
+        edges.size *= 2;
+    edges.keys = (uint64_t *)malloc(edges.size * sizeof(uint64_t));
+    edges.counts = (uint *)malloc(edges.size * sizeof(uint));
+
+    uchar *kinds = (uchar *)malloc(num_vertices);
+    bool *locked = (bool *)malloc(num_vertices * sizeof(bool));
+    uint *collapse_target = (uint *)malloc(num_vertices * sizeof(uint));
+    uint *adjacency_offsets = (uint *)malloc((num_vertices + 1) * sizeof(uint));
+    uint *adjacency = (uint *)malloc(num_indices * sizeof(uint));
+    Simplify_Collapse *collapses = (Simplify_Collapse *)malloc(num_indices * 2 * sizeof(Simplify_Collapse));
+
+    float limit = (target_error == FLT_MAX) ? FLT_MAX : target_error * scale;
+    float result_error = 0.0f;
+    uint count = num_indices;
+    target_index_count -= target_index_count % 3;
+
+    while (count > target_index_count)
+    {
+        /// -- Classify against the current topology, borders move as they get collapsed.
+        memset(edges.keys, 0xFF, edges.size * sizeof(uint64_t));
+        memset(edges.counts, 0, edges.size * sizeof(uint));
+        for (auto i = 0; i < count; i += 3)
+        {
+            for (auto k = 0; k != 3; ++k)
+            {
+                uint a = position_id[dst[i + k]];
+                uint b = position_id[dst[i + (k + 1) % 3]];
+                (*find_simplify_edge(&edges, a, b, true))++;
+            }
+        }
+
+        for (auto i = 0; i != num_vertices; ++i)
+            kinds[i] = (wedges[i] > 1) ? SIMPLIFY_LOCKED : SIMPLIFY_MANIFOLD;
+
+        for (auto i = 0; i < count; i += 3)
+        {
+            for (auto k = 0; k != 3; ++k)
+            {
+                uint a = position_id[dst[i + k]];
+                uint b = position_id[dst[i + (k + 1) % 3]];
+
+                if (*find_simplify_edge(&edges, a, b, false) > 1)
+                {
+                    kinds[a] = kinds[b] = SIMPLIFY_LOCKED;
+                }
+                else if (!find_simplify_edge(&edges, b, a, false))
+                {
+                    if (kinds[a] == SIMPLIFY_MANIFOLD)
+                        kinds[a] = SIMPLIFY_BORDER;
+                    if (kinds[b] == SIMPLIFY_MANIFOLD)
+                        kinds[b] = SIMPLIFY_BORDER;
+                }
+            }
+        }
+
+        /// -- Border quadrics on the first pass, planes through the open edges perpendicular to their face.
+        if (count == num_indices)
+        {
+            for (auto i = 0; i < count; i += 3)
+            {
+                for (auto k = 0; k != 3; ++k)
+                {
+                    uint va = dst[i + k], vb = dst[i + (k + 1) % 3];
+                    if (find_simplify_edge(&edges, position_id[vb], position_id[va], false))
+                        continue;
+
+                    auto pa = &positions[va * 3];
+                    auto pb = &positions[vb * 3];
+                    float n[3], e[3] = { pb[0] - pa[0], pb[1] - pa[1], pb[2] - pa[2] };
+                    simplify_triangle_normal(&positions[dst[i] * 3], &positions[dst[i + 1] * 3], &positions[dst[i + 2] * 3], n);
+
+                    float p[3] = { e[1] * n[2] - e[2] * n[1], e[2] * n[0] - e[0] * n[2], e[0] * n[1] - e[1] * n[0] };
+                    float length = sqrtf(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+                    if (length == 0.0f)
+                        continue;
+
+                    p[0] /= length;
+                    p[1] /= length;
+                    p[2] /= length;
+
+                    Quadric q;
+                    float edge_length_squared = e[0] * e[0] + e[1] * e[1] + e[2] * e[2];
+                    quadric_from_plane(&q, p[0], p[1], p[2], -(p[0] * pa[0] + p[1] * pa[1] + p[2] * pa[2]), edge_length_squared * SIMPLIFY_BORDER_WEIGHT);
+                    quadric_add(&quadrics[position_id[va]], &q);
+                    quadric_add(&quadrics[position_id[vb]], &q);
+                }
+            }
+        }
+
+        /// -- Vertex -> triangle adjacency.
+        memset(adjacency_offsets, 0, (num_vertices + 1) * sizeof(uint));
+        for (auto i = 0; i != count; ++i)
+            adjacency_offsets[dst[i] + 1]++;
+        for (auto i = 0; i != num_vertices; ++i)
+            adjacency_offsets[i + 1] += adjacency_offsets[i];
+        for (auto i = 0; i != count; ++i)
+            adjacency[adjacency_offsets[dst[i]]++] = i / 3;
+        for (auto i = num_vertices; i != 0; --i)
+            adjacency_offsets[i] = adjacency_offsets[i - 1];
+        adjacency_offsets[0] = 0;
+
+        /// -- Candidate collapses, cheapest first.
+        uint num_collapses = 0;
+        for (auto i = 0; i < count; i += 3)
+        {
+            for (auto k = 0; k != 3; ++k)
+            {
+                uint va = dst[i + k], vb = dst[i + (k + 1) % 3];
+
+                for (auto direction = 0; direction != 2; ++direction)
+                {
+                    uint source = direction ? vb : va;
+                    uint target = direction ? va : vb;
+                    uint ps = position_id[source], pt = position_id[target];
+
+                    if (kinds[ps] == SIMPLIFY_LOCKED)
+                        continue;
+                    // Borders only slide along their own open edges.
+                    if (kinds[ps] == SIMPLIFY_BORDER &&
+                        (find_simplify_edge(&edges, ps, pt, false) != NULL) == (find_simplify_edge(&edges, pt, ps, false) != NULL))
+                        continue;
+
+                    Quadric q = quadrics[ps];
+                    quadric_add(&q, &quadrics[pt]);
+
+                    auto collapse = &collapses[num_collapses++];
+                    collapse->error = sqrtf(quadric_error(&q, &positions[target * 3]));
+                    collapse->source = source;
+                    collapse->target = target;
+                }
+            }
+        }
+
+        qsort(collapses, num_collapses, sizeof(Simplify_Collapse), compare_simplify_collapses);
+
+        /// -- Apply as many independent collapses as the budget allows.
+        memset(locked, 0, num_vertices * sizeof(bool));
+        for (auto i = 0; i != num_vertices; ++i)
+            collapse_target[i] = i;
+
+        uint triangles_to_remove = (count - target_index_count) / 3;
+        uint triangles_removed = 0;
+        uint applied = 0;
+
+        for (auto c = 0; c != num_collapses && triangles_removed < triangles_to_remove; ++c)
+        {
+            auto collapse = &collapses[c];
+            if (collapse->error > limit)
+                break;
+
+            uint source = collapse->source, target = collapse->target;
+            if (locked[source] || locked[target])
+                continue;
+
+            // Reject collapses that flip or badly turn any surviving triangle.
+            bool valid = true;
+            uint shared = 0;
+            for (auto j = adjacency_offsets[source]; j != adjacency_offsets[source + 1] && valid; ++j)
+            {
+                auto tri = &dst[adjacency[j] * 3];
+                if (tri[0] == target || tri[1] == target || tri[2] == target)
+                {
+                    ++shared;
+                    continue;
+                }
+
+                const float *p[3], *q[3];
+                for (auto k = 0; k != 3; ++k)
+                {
+                    p[k] = &positions[tri[k] * 3];
+                    q[k] = (tri[k] == source) ? &positions[target * 3] : p[k];
+                }
+
+                float n0[3], n1[3];
+                simplify_triangle_normal(p[0], p[1], p[2], n0);
+                simplify_triangle_normal(q[0], q[1], q[2], n1);
+
+                float d = n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2];
+                float l = sqrtf((n0[0] * n0[0] + n0[1] * n0[1] + n0[2] * n0[2]) * (n1[0] * n1[0] + n1[1] * n1[1] + n1[2] * n1[2]));
+                if (d < SIMPLIFY_MAX_FLIP_COS * l)
+                    valid = false;
+            }
+
+            if (!valid)
+                continue;
+
+            collapse_target[source] = target;
+            quadric_add(&quadrics[position_id[target]], &quadrics[position_id[source]]);
+            result_error = fmaxf(result_error, collapse->error);
+            triangles_removed += shared;
+            ++applied;
+
+            // Everything around the source changes shape, none of it may move again this pass.
+            for (auto j = adjacency_offsets[source]; j != adjacency_offsets[source + 1]; ++j)
+            {
+                auto tri = &dst[adjacency[j] * 3];
+                locked[tri[0]] = locked[tri[1]] = locked[tri[2]] = true;
+            }
+        }
+
+        if (!applied)
+            break;
+
+        /// -- Remap and drop the triangles that collapsed.
+        uint new_count = 0;
+        for (auto i = 0; i < count; i += 3)
+        {
+            uint a = collapse_target[dst[i + 0]];
+            uint b = collapse_target[dst[i + 1]];
+            uint c = collapse_target[dst[i + 2]];
+
+            uint pa = position_id[a], pb = position_id[b], pc = position_id[c];
+            if (pa == pb || pb == pc || pc == pa)
+                continue;
+
+            dst[new_count++] = a;
+            dst[new_count++] = b;
+            dst[new_count++] = c;
+        }
+        count = new_count;
+    }
+
+    if (out_error)
+        *out_error = result_error / scale;
+
+    free(collapses);
+    free(adjacency);
+    free(adjacency_offsets);
+    free(collapse_target);
+    free(locked);
+    free(kinds);
+    free(edges.counts);
+    free(edges.keys);
+    free(quadrics);
+    free(wedges);
+    free(position_id);
+    free(positions);
+    return count;
+}
+
+#endif
@@ -0,0 +1,337 @@
+#ifndef _MESHLET_H_
+#define _MESHLET_H_
+#include "stdafx.h"
+
+#include <math.h>
+#include <float.h>
+
+#include "mesh_common.h"
+
+/// ============ MESHLETS ============ ///
+// Each part is cut into runs of consecutive triangles touching at most MESHLET_MAX_VERTICES
+//   vertices and MESHLET_MAX_TRIANGLES triangles. Since the earlier passes already sorted
+//   triangles for locality, consecutive runs are spatially tight, and a meshlet stays a
+//   plain index range that DrawIndexed can submit without touching the index buffer.
+//
+// Every meshlet carries a bounding sphere for frustum culling and a normal cone for
+//   backface culling. The renderer doesn't cull backfaces (CULL_NONE), so "front" is the
+//   side the vertex normals point to, not the winding; for closed meshes the clusters
+//   the cone rejects are hidden behind the rest of the mesh anyway.
+
+#define MESHLET_MAX_VERTICES  64
+#define MESHLET_MAX_TRIANGLES 124
+
+// cone_cutoff is set to this when the normals spread too far for the cone to ever cull.
+#define MESHLET_CONE_NONE 2.0f
+
+struct Meshlet {
+    uint first_index;
+    uint index_count;
+    int  base_vertex;
+
+    float center[3];
+    float radius;
+
+    // Backfacing from everywhere with dot(normalize(cone_apex - camera), cone_axis) >= cone_cutoff.
+    float cone_apex[3];
+    float cone_axis[3];
+    float cone_cutoff;
+};
+
+static inline float meshlet_dot(const float *a, const float *b)
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static inline float meshlet_normalize(float *v)
+{
+    float length = sqrtf(meshlet_dot(v, v));
+    if (length > 0.0f)
+    {
+        v[0] /= length;
+        v[1] /= length;
+        v[2] /= length;
+    }
+    return length;
+}
+
+// Fills in the sphere and cone of it from the triangles in its index range.
+void compute_meshlet_bounds(Meshlet *it, const uint *indices, const Vertex *vertices)
+{
+    auto tris = &indices[it->first_index];
+    uint num_triangles = it->index_count / 3;
+
+    /// -- Sphere: AABB center, radius out to the farthest vertex.
+    float aabb_min[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float aabb_max[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for (auto i = 0; i != it->index_count; ++i)
+    {
+        auto position = vertices[tris[i]].position;
+        for (auto k = 0; k != 3; ++k)
+        {
+            aabb_min[k] = fminf(aabb_min[k], position[k]);
+            aabb_max[k] = fmaxf(aabb_max[k], position[k]);
+        }
+    }
+
+    float radius_squared = 0.0f;
+    for (auto k = 0; k != 3; ++k)
+        it->center[k] = (aabb_min[k] + aabb_max[k]) * 0.5f;
+    for (auto i = 0; i != it->index_count; ++i)
+    {
+        auto position = vertices[tris[i]].position;
+        float d[3] = { position[0] - it->center[0], position[1] - it->center[1], position[2] - it->center[2] };
+        radius_squared = fmaxf(radius_squared, meshlet_dot(d, d));
+    }
+    it->radius = sqrtf(radius_squared);
+
+    /// -- Cone.
+    // Face normals from the geometry, flipped to agree with the vertex normals.
+    float *normals = (float *)malloc(num_triangles * 3 * sizeof(float));
+    bool *degenerate = (bool *)calloc(num_triangles, sizeof(bool));
+    float axis[3] = { 0, 0, 0 };
+
+    for (auto t = 0; t != num_triangles; ++t)
+    {
+        auto p0 = vertices[tris[t * 3 + 0]].position;
+        auto p1 = vertices[tris[t * 3 + 1]].position;
+        auto p2 = vertices[tris[t * 3 + 2]].position;
+
+        float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+        float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+        float *n = &normals[t * 3];
+        n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+        n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+        n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+
+        if (meshlet_normalize(n) == 0.0f)
+        {
+            degenerate[t] = true;
+            continue;
+        }
+
+        float vertex_normal[3] = { 0, 0, 0 };
+        for (auto k = 0; k != 3; ++k)
+            for (auto c = 0; c != 3; ++c)
+                vertex_normal[c] += vertices[tris[t * 3 + k]].normal[c];
+
+        if (meshlet_dot(n, vertex_normal) < 0.0f)
+        {
+            n[0] = -n[0];
+            n[1] = -n[1];
+            n[2] = -n[2];
+        }
+
+        for (auto c = 0; c != 3; ++c)
+            axis[c] += n[c];
+    }
+
+    memcpy(it->cone_apex, it->center, sizeof(it->cone_apex));
+    memset(it->cone_axis, 0, sizeof(it->cone_axis));
+    it->cone_cutoff = MESHLET_CONE_NONE;
+
+    if (meshlet_normalize(axis) > 0.0f)
+    {
+        float min_dot = 1.0f;
+        for (auto t = 0; t != num_triangles; ++t)
+            if (!degenerate[t])
+                min_dot = fminf(min_dot, meshlet_dot(&normals[t * 3], axis));
+
+        // Past ~85 degrees of spread the cone culls next to nothing, and the apex below
+        //   would run off towards infinity.
+        if (min_dot > 0.1f)
+        {
+            // Move the apex back along the axis until every triangle plane is in front of it,
+            //   so anything that sees the apex from behind sees all the triangles from behind.
+            float max_t = 0.0f;
+            for (auto t = 0; t != num_triangles; ++t)
+            {
+                if (degenerate[t])
+                    continue;
+
+                auto n = &normals[t * 3];
+                auto p0 = vertices[tris[t * 3]].position;
+                float d[3] = { it->center[0] - p0[0], it->center[1] - p0[1], it->center[2] - p0[2] };
+                max_t = fmaxf(max_t, meshlet_dot(d, n) / meshlet_dot(axis, n));
+            }
+
+            for (auto c = 0; c != 3; ++c)
+                it->cone_apex[c] = it->center[c] - axis[c] * max_t;
+            memcpy(it->cone_axis, axis, sizeof(it->cone_axis));
+            it->cone_cutoff = sqrtf(1.0f - min_dot * min_dot);
+        }
+    }
+
+    free(degenerate);
+    free(normals);
+}
+
+// Rebuilds it->meshlets from it->parts, and the meshlet range of every LOD. Triangle order is
+//   left alone, so this runs after split_mesh_parts and no meshlet ever straddles two parts.
+void build_meshlets(Cpu_Mesh *it)
+{
+    free(it->meshlets);
+    it->meshlets = NULL;
+    it->num_meshlets = 0;
+
+    uint capacity = 0;
+
+    // stamp[v] == current meshlet + 1 means v is already counted in it.
+    uint *stamp = (uint *)calloc(it->num_vertices, sizeof(uint));
+
+    for (auto p = 0; p != it->num_parts; ++p)
+    {
+        for (auto l = 0; l != it->num_lods; ++l)
+            if (it->lods[l].first_part == p)
+                it->lods[l].first_meshlet = it->num_meshlets;
+
+        auto part = &it->parts[p];
+        uint part_end = part->first_index + part->index_count;
+        uint first_index = part->first_index;
+
+        while (first_index < part_end)
+        {
+            uint meshlet_id = it->num_meshlets + 1;
+            uint num_vertices = 0;
+            uint end = first_index;
+
+            while (end < part_end && (end - first_index) / 3 < MESHLET_MAX_TRIANGLES)
+            {
+                auto tri = &it->indices[end];
+
+                uint new_vertices = 0;
+                for (auto k = 0; k != 3; ++k)
+                    if (stamp[tri[k]] != meshlet_id)
+                        ++new_vertices;
+
+                if (num_vertices + new_vertices > MESHLET_MAX_VERTICES)
+                    break;
+
+                for (auto k = 0; k != 3; ++k)
+                    stamp[tri[k]] = meshlet_id;
+                num_vertices += new_vertices;
+                end += 3;
+            }
+
+            if (it->num_meshlets == capacity)
+            {
+                capacity = capacity ? capacity * 2 : 64;
+                it->meshlets = (Meshlet *)realloc(it->meshlets, capacity * sizeof(Meshlet));
+            }
+
+            auto meshlet = &it->meshlets[it->num_meshlets++];
+            meshlet->first_index = first_index;
+            meshlet->index_count = end - first_index;
+            meshlet->base_vertex = part->base_vertex;
+            compute_meshlet_bounds(meshlet, it->indices, it->vertices);
+
+            first_index = end;
+        }
+    }
+
+    for (auto l = 0; l != it->num_lods; ++l)
+    {
+        uint end = (l + 1 < it->num_lods) ? it->lods[l + 1].first_meshlet : it->num_meshlets;
+        it->lods[l].num_meshlets = end - it->lods[l].first_meshlet;
+    }
+
+    free(stamp);
+}
+
+/// ============ CULLING ============ ///
+// Everything is in the mesh's model space: the planes come from the full
+//   proj * view * world matrix, and the camera position has to be brought into model space
+//   by the caller. The cone test assumes world has no non-uniform scale.
+struct Meshlet_Cull_Params {
+    float planes[6][4]; // normalized, inside is dot(plane.xyz, p) + plane.w >= 0
+    float camera_position[3];
+    bool  cull_backfaces;
+};
+
+// model_view_proj is column-major (HMM_Mat4 layout) for column vectors, with D3D's 0..1 clip depth.
+void setup_meshlet_culling(Meshlet_Cull_Params *it, const float *model_view_proj, const float *camera_position, bool cull_backfaces = true)
+{
+    // Gribb & Hartmann: the planes are sums and differences of the matrix rows.
+    float rows[4][4];
+    for (auto r = 0; r != 4; ++r)
+        for (auto c = 0; c != 4; ++c)
+            rows[r][c] = model_view_proj[c * 4 + r];
+
+    for (auto c = 0; c != 4; ++c)
+    {
+        it->planes[0][c] = rows[3][c] + rows[0][c]; // left
+        it->planes[1][c] = rows[3][c] - rows[0][c]; // right
+        it->planes[2][c] = rows[3][c] + rows[1][c]; // bottom
+        it->planes[3][c] = rows[3][c] - rows[1][c]; // top
+        it->planes[4][c] = rows[2][c];              // near
+        it->planes[5][c] = rows[3][c] - rows[2][c]; // far
+    }
+
+    for (auto p = 0; p != 6; ++p)
+    {
+        float length = sqrtf(meshlet_dot(it->planes[p], it->planes[p]));
+        if (length > 0.0f)
+            for (auto c = 0; c != 4; ++c)
+                it->planes[p][c] /= length;
+    }
+
+    memcpy(it->camera_position, camera_position, sizeof(it->camera_position));
+    it->cull_backfaces = cull_backfaces;
+}
+
+bool is_meshlet_visible(const Meshlet *meshlet, const Meshlet_Cull_Params *params)
+{
+    for (auto p = 0; p != 6; ++p)
+    {
+        auto plane = params->planes[p];
+        if (meshlet_dot(plane, meshlet->center) + plane[3] < -meshlet->radius)
+            return false;
+    }
+
+    if (params->cull_backfaces && meshlet->cone_cutoff <= 1.0f)
+    {
+        float view[3] = { meshlet->cone_apex[0] - params->camera_position[0],
+                          meshlet->cone_apex[1] - params->camera_position[1],
+                          meshlet->cone_apex[2] - params->camera_position[2] };
+
+        // Camera sitting on the apex: can't tell, keep it.
+        if (meshlet_normalize(view) > 0.0f && meshlet_dot(view, meshlet->cone_axis) >= meshlet->cone_cutoff)
+            return false;
+    }
+
+    return true;
+}
+
+// Writes the visible meshlets to out_ranges as DrawIndexed ranges, merging neighbours that
+//   are contiguous in the index buffer. out_ranges needs room for num_meshlets entries.
+// Returns the number of ranges written.
+uint cull_meshlets(const Meshlet *meshlets, uint num_meshlets, const Meshlet_Cull_Params *params, Mesh_Part *out_ranges)
+{
+    uint num_ranges = 0;
+
+    for (auto i = 0; i != num_meshlets; ++i)
+    {
+        auto meshlet = &meshlets[i];
+        if (!is_meshlet_visible(meshlet, params))
+            continue;
+
+        if (num_ranges)
+        {
+            auto last = &out_ranges[num_ranges - 1];
+            if (last->base_vertex == meshlet->base_vertex && last->first_index + last->index_count == meshlet->first_index)
+            {
+                last->index_count += meshlet->index_count;
+                continue;
+            }
+        }
+
+        auto range = &out_ranges[num_ranges++];
+        range->first_index = meshlet->first_index;
+        range->index_count = meshlet->index_count;
+        range->base_vertex = meshlet->base_vertex;
+    }
+
+    return num_ranges;
+}
+
+#endif
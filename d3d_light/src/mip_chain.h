@@ -0,0 +1,449 @@
+#ifndef _MIP_CHAIN_H_
+#define _MIP_CHAIN_H_
+#include "stdafx.h"
+
+#include <math.h>
+
+#include "texture_format.h"
+
+#if defined(__AVX__)
+#define MIP_USE_AVX 1
+#include <immintrin.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MIP_USE_SSE 1
+#include <emmintrin.h>
+#endif
+
+/// ============ MIP CHAINS ============ ///
+// Builds every mip of an RGBA8 image, each level filtered from the previous one in float:
+//   - color: RGB goes through linear space so dark/bright edges don't get darker with
+//     distance, alpha stays as is
+//   - normal: filtered as [-1, 1] vectors and renormalized on every level, level 0 included,
+//     otherwise distant surfaces turn flat and dark under lighting
+//   - mask: filtered as is
+// Filtering is separable, rows first. Every destination pixel gets a fixed number of taps
+//   (zero weights pad the short ones), which keeps the inner loops branchless: the row pass
+//   does one pixel (4 channels) per SSE register, the column pass runs AVX, SSE or scalar
+//   straight down the rows.
+// The levels end up back to back in one allocation, largest first, the layout
+//   create_gpu_image and write_dds take.
+
+enum Mip_Filter {
+    MIP_FILTER_BOX,     // 2x2 average, fastest and blurriest
+    MIP_FILTER_KAISER,  // Kaiser windowed sinc, width 3, alpha 4
+    MIP_FILTER_LANCZOS, // Lanczos 3, sharpest, can ring on hard edges
+};
+
+#define MIP_MAX_LEVELS 16
+
+struct Mip_Chain
+{
+    uchar *data;
+    uint width;
+    uint height;
+    uint num_levels;
+    size_t offsets[MIP_MAX_LEVELS];
+};
+
+static inline const char *get_mip_filter_name(Mip_Filter filter)
+{
+    switch (filter)
+    {
+        case MIP_FILTER_BOX:     return "box";
+        case MIP_FILTER_KAISER:  return "kaiser";
+        case MIP_FILTER_LANCZOS: return "lanczos";
+        default:                 return "unknown";
+    }
+}
+
+static inline uint get_mip_count(uint width, uint height)
+{
+    uint count = 1;
+    while ((width > 1 || height > 1) && count < MIP_MAX_LEVELS)
+    {
+        width = (width > 1) ? width / 2 : 1;
+        height = (height > 1) ? height / 2 : 1;
+        ++count;
+    }
+    return count;
+}
+
+static inline const uchar *get_mip_level(const Mip_Chain *it, uint level)
+{
+    return it->data + it->offsets[level];
+}
+
+/// -- Filters
+static inline float mip_sinc(float x)
+{
+    if (fabsf(x) < 1e-5f)
+        return 1.0f;
+    x *= 3.14159265f;
+    return sinf(x) / x;
+}
+
+// Modified Bessel function of the first kind, order 0, for the Kaiser window.
+static float mip_bessel_i0(float x)
+{
+    float sum = 1.0f, term = 1.0f;
+    for (auto k = 1; k != 20; ++k)
+    {
+        term *= (x * 0.5f / (float)k) * (x * 0.5f / (float)k);
+        sum += term;
+    }
+    return sum;
+}
+
+static inline float get_mip_filter_width(Mip_Filter filter)
+{
+    return (filter == MIP_FILTER_BOX) ? 0.5f : 3.0f;
+}
+
+static float evaluate_mip_filter(Mip_Filter filter, float x)
+{
+    float width = get_mip_filter_width(filter);
+    if (fabsf(x) > width)
+        return 0.0f;
+
+    switch (filter)
+    {
+        case MIP_FILTER_BOX:
+            return 1.0f;
+
+        case MIP_FILTER_KAISER: {
+            const float alpha = 4.0f;
+            float t = x / width;
+            return mip_sinc(x) * mip_bessel_i0(alpha * sqrtf(fmaxf(1.0f - t * t, 0.0f))) / mip_bessel_i0(alpha);
+        }
+
+        case MIP_FILTER_LANCZOS:
+            return mip_sinc(x) * mip_sinc(x / width);
+
+        default:
+            return 0.0f;
+    }
+}
+
+// num_taps source indices and weights per destination pixel, edges clamped.
+struct Mip_Taps
+{
+    uint num_taps;
+    uint *indices;
+    float *weights;
+};
+
+static void build_mip_taps(Mip_Taps *it, Mip_Filter filter, uint src_size, uint dst_size)
+{
+    float scale = (float)src_size / (float)dst_size;
+    float radius = get_mip_filter_width(filter) * scale;
+
+    it->num_taps = (uint)ceilf(radius * 2.0f) + 1;
+    it->indices = (uint *)calloc((size_t)dst_size * it->num_taps, sizeof(uint));
+    it->weights = (float *)calloc((size_t)dst_size * it->num_taps, sizeof(float));
+
+    for (auto i = 0; i != dst_size; ++i)
+    {
+        float center = ((float)i + 0.5f) * scale;
+        int first = (int)floorf(center - radius);
+
+        auto indices = &it->indices[i * it->num_taps];
+        auto weights = &it->weights[i * it->num_taps];
+        float sum = 0.0f;
+
+        for (auto k = 0; k != it->num_taps; ++k)
+        {
+            int j = first + k;
+            indices[k] = (uint)((j < 0) ? 0 : (j >= (int)src_size) ? (int)src_size - 1 : j);
+            weights[k] = evaluate_mip_filter(filter, ((float)j + 0.5f - center) / scale);
+            sum += weights[k];
+        }
+
+        for (auto k = 0; k != it->num_taps; ++k)
+            weights[k] /= sum;
+    }
+}
+
+static void free_mip_taps(Mip_Taps *it)
+{
+    free(it->indices);
+    free(it->weights);
+    ZeroThat(it);
+}
+
+/// -- Passes
+// src is src_width x height RGBA floats, dst is dst_width x height.
+static void filter_mip_rows(float *dst, const float *src, uint src_width, uint dst_width, uint height, const Mip_Taps *taps)
+{
+    for (auto y = 0; y != height; ++y)
+    {
+        const float *src_row = &src[(size_t)y * src_width * 4];
+        float *dst_row = &dst[(size_t)y * dst_width * 4];
+
+        for (auto x = 0; x != dst_width; ++x)
+        {
+            auto indices = &taps->indices[x * taps->num_taps];
+            auto weights = &taps->weights[x * taps->num_taps];
+
+#if MIP_USE_SSE
+            __m128 sum = _mm_setzero_ps();
+            for (auto k = 0; k != taps->num_taps; ++k)
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(&src_row[indices[k] * 4])));
+            _mm_storeu_ps(&dst_row[x * 4], sum);
+#else
+            float sum[4] = {};
+            for (auto k = 0; k != taps->num_taps; ++k)
+                for (auto c = 0; c != 4; ++c)
+                    sum[c] += weights[k] * src_row[indices[k] * 4 + c];
+            memcpy(&dst_row[x * 4], sum, sizeof(sum));
+#endif
+        }
+    }
+}
+
+// src is width x src_height RGBA floats, dst is width x dst_height.
+static void filter_mip_columns(float *dst, const float *src, uint width, uint dst_height, const Mip_Taps *taps)
+{
+    size_t row_floats = (size_t)width * 4;
+
+    for (auto y = 0; y != dst_height; ++y)
+    {
+        auto indices = &taps->indices[y * taps->num_taps];
+        auto weights = &taps->weights[y * taps->num_taps];
+        float *dst_row = &dst[y * row_floats];
+        size_t i = 0;
+
+#if MIP_USE_AVX
+        for (; i + 8 <= row_floats; i += 8)
+        {
+            __m256 sum = _mm256_setzero_ps();
+            for (auto k = 0; k != taps->num_taps; ++k)
+                sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(weights[k]), _mm256_loadu_ps(&src[indices[k] * row_floats + i])));
+            _mm256_storeu_ps(&dst_row[i], sum);
+        }
+#endif
+#if MIP_USE_SSE
+        for (; i + 4 <= row_floats; i += 4)
+        {
+            __m128 sum = _mm_setzero_ps();
+            for (auto k = 0; k != taps->num_taps; ++k)
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(&src[indices[k] * row_floats + i])));
+            _mm_storeu_ps(&dst_row[i], sum);
+        }
+#endif
+        for (; i != row_floats; ++i)
+        {
+            float sum = 0.0f;
+            for (auto k = 0; k != taps->num_taps; ++k)
+                sum += weights[k] * src[indices[k] * row_floats + i];
+            dst_row[i] = sum;
+        }
+    }
+}
+
+/// -- Conversions
+static float mip_srgb_to_linear[256];
+static float mip_linear_thresholds[255]; // linear value halfway between sRGB i and i + 1
+
+// Called from every thread that builds mips. The tables are filled by a local static's
+//   initializer, which C++11 runs exactly once while any other caller waits for it.
+static void init_mip_tables()
+{
+    static bool initialized = []() {
+        for (auto i = 0; i != 256; ++i)
+        {
+            float c = (float)i / 255.0f;
+            mip_srgb_to_linear[i] = (c <= 0.04045f) ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+        }
+        for (auto i = 0; i != 255; ++i)
+        {
+            float c = ((float)i + 0.5f) / 255.0f;
+            mip_linear_thresholds[i] = (c <= 0.04045f) ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+        }
+        return true;
+    }();
+    (void)initialized;
+}
+
+// Exact round-to-nearest in sRGB space: binary search over the thresholds.
+static inline uchar linear_to_srgb8(float value)
+{
+    uint lo = 0, hi = 255;
+    while (lo < hi)
+    {
+        uint mid = (lo + hi) / 2;
+        if (value < mip_linear_thresholds[mid])
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return (uchar)lo;
+}
+
+static inline uchar unorm_to_8(float value)
+{
+    value = (value < 0.0f) ? 0.0f : (value > 1.0f) ? 1.0f : value;
+    return (uchar)(value * 255.0f + 0.5f);
+}
+
+static void mip_decode_pixels(float *dst, const uchar *src, size_t count, Texture_Usage usage)
+{
+    for (size_t i = 0; i != count; ++i)
+    {
+        for (auto c = 0; c != 3; ++c)
+        {
+            uchar v = src[i * 4 + c];
+            if (usage == TEXTURE_USAGE_COLOR)
+                dst[i * 4 + c] = mip_srgb_to_linear[v];
+            else if (usage == TEXTURE_USAGE_NORMAL)
+                dst[i * 4 + c] = (float)v * (2.0f / 255.0f) - 1.0f;
+            else
+                dst[i * 4 + c] = (float)v / 255.0f;
+        }
+        dst[i * 4 + 3] = (float)src[i * 4 + 3] / 255.0f;
+    }
+}
+
+// Normal maps get renormalized in place, so the next level is filtered from unit vectors too.
+static void mip_encode_pixels(uchar *dst, float *src, size_t count, Texture_Usage usage)
+{
+    for (size_t i = 0; i != count; ++i)
+    {
+        float *p = &src[i * 4];
+
+        if (usage == TEXTURE_USAGE_NORMAL)
+        {
+            float length = sqrtf(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+            if (length > 1e-6f)
+            {
+                p[0] /= length;
+                p[1] /= length;
+                p[2] /= length;
+            }
+            else
+            {
+                p[0] = p[1] = 0.0f;
+                p[2] = 1.0f;
+            }
+        }
+
+        for (auto c = 0; c != 3; ++c)
+        {
+            if (usage == TEXTURE_USAGE_COLOR)
+                dst[i * 4 + c] = linear_to_srgb8(p[c]);
+            else if (usage == TEXTURE_USAGE_NORMAL)
+                dst[i * 4 + c] = unorm_to_8(p[c] * 0.5f + 0.5f);
+            else
+                dst[i * 4 + c] = unorm_to_8(p[c]);
+        }
+        dst[i * 4 + 3] = unorm_to_8(p[3]);
+    }
+}
+
+/// -- Chain
+// Allocates every level, max_levels == 0 is the full chain down to 1x1. Level 0 is width * 4
+//   bytes a row at it->data, fill it (e.g. decode_image_to) and build_mip_levels does the rest.
+bool init_mip_chain(Mip_Chain *it, uint width, uint height, uint max_levels = 0)
+{
+    ZeroThat(it);
+
+    it->width = width;
+    it->height = height;
+    it->num_levels = get_mip_count(width, height);
+    if (max_levels && it->num_levels > max_levels)
+        it->num_levels = max_levels;
+
+    size_t total = 0;
+    for (auto l = 0; l != it->num_levels; ++l)
+    {
+        it->offsets[l] = total;
+        total += get_texture_level_size(TEXTURE_FORMAT_RGBA8, get_mip_dimension(width, l), get_mip_dimension(height, l));
+    }
+
+    it->data = (uchar *)malloc(total);
+    if (!it->data)
+    {
+        ZeroThat(it);
+        return false;
+    }
+    return true;
+}
+
+// Filters levels 1 and up from level 0 (renormalizing it first, for normal maps).
+bool build_mip_levels(Mip_Chain *it, Texture_Usage usage, Mip_Filter filter = MIP_FILTER_KAISER)
+{
+    init_mip_tables();
+
+    uint width = it->width, height = it->height;
+    float *level = (float *)malloc((size_t)width * height * 4 * sizeof(float));
+    float *rows = (float *)malloc((size_t)get_mip_dimension(width, 1) * height * 4 * sizeof(float));
+    float *next = (float *)malloc((size_t)get_mip_dimension(width, 1) * get_mip_dimension(height, 1) * 4 * sizeof(float));
+
+    if (!level || !rows || !next)
+    {
+        free(level);
+        free(rows);
+        free(next);
+        return false;
+    }
+
+    mip_decode_pixels(level, it->data, (size_t)width * height, usage);
+
+    // Normal maps out of a JPEG aren't unit length even on level 0.
+    if (usage == TEXTURE_USAGE_NORMAL)
+        mip_encode_pixels(it->data, level, (size_t)width * height, usage);
+
+    uint src_width = width, src_height = height;
+    for (auto l = 1; l < it->num_levels; ++l)
+    {
+        uint dst_width = get_mip_dimension(src_width, 1);
+        uint dst_height = get_mip_dimension(src_height, 1);
+
+        Mip_Taps row_taps, column_taps;
+        build_mip_taps(&row_taps, filter, src_width, dst_width);
+        build_mip_taps(&column_taps, filter, src_height, dst_height);
+
+        filter_mip_rows(rows, level, src_width, dst_width, src_height, &row_taps);
+        filter_mip_columns(next, rows, dst_width, dst_height, &column_taps);
+
+        free_mip_taps(&row_taps);
+        free_mip_taps(&column_taps);
+
+        mip_encode_pixels(it->data + it->offsets[l], next, (size_t)dst_width * dst_height, usage);
+
+        float *t = level;
+        level = next;
+        next = t;
+        src_width = dst_width;
+        src_height = dst_height;
+    }
+
+    free(level);
+    free(rows);
+    free(next);
+    return true;
+}
+
+void free_mip_chain(Mip_Chain *it)
+{
+    free(it->data);
+    ZeroThat(it);
+}
+
+// Level 0 is a copy of rgba.
+bool generate_mip_chain(Mip_Chain *it, const uchar *rgba, uint width, uint height, Texture_Usage usage,
+                        Mip_Filter filter = MIP_FILTER_KAISER, uint max_levels = 0)
+{
+    if (!init_mip_chain(it, width, height, max_levels))
+        return false;
+
+    memcpy(it->data, rgba, (size_t)width * height * 4);
+    if (!build_mip_levels(it, usage, filter))
+    {
+        free_mip_chain(it);
+        return false;
+    }
+    return true;
+}
+
+#endif
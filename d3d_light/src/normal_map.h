@@ -0,0 +1,85 @@
+#ifndef _NORMAL_MAP_H_
+#define _NORMAL_MAP_H_
+#include "stdafx.h"
+
+#include <math.h>
+
+#include "mip_chain.h"
+
+/// ============ NORMAL MAPS ============ ///
+// Tangent space normals point away from the surface, so Z is always positive and follows from
+//   X and Y: only those two get stored (BC5 when cooked, RG8 when loaded loose), half of what
+//   RGBA8 takes, and Z is rebuilt on sampling (unpack_normal_xy, here and in lit.hlsl). That
+//   only works for unit vectors, which build_mip_levels makes every level of a normal map.
+// Nothing samples them yet: meshes don't know their material, so lit.hlsl lights with the
+//   vertex normals, binds no textures and never calls its unpack_normal_xy.
+// The error of a stored normal map is the angle between its normals and the source's, which
+//   unlike PSNR says what lighting will get wrong.
+
+#define NORMAL_MAP_PI 3.14159265358979f
+
+// [0, 255] -> [-1, 1] X and Y, Z from the unit length.
+static inline void unpack_normal_xy(uchar x, uchar y, float *normal)
+{
+    normal[0] = (float)x * (2.0f / 255.0f) - 1.0f;
+    normal[1] = (float)y * (2.0f / 255.0f) - 1.0f;
+    float z = 1.0f - normal[0] * normal[0] - normal[1] * normal[1];
+    normal[2] = (z > 0.0f) ? sqrtf(z) : 0.0f;
+}
+
+// Moves every level of a normal map's chain from RGBA8 to RG8 in place, the levels stay back to
+//   back from it->data like create_gpu_image takes them in TEXTURE_FORMAT_RG8. it->offsets
+//   still describe the RGBA8 layout afterwards, only the data changes.
+void pack_normal_mip_chain(Mip_Chain *it)
+{
+    // Every RG8 byte lands at or before the RGBA8 byte it comes from, so front to back is safe.
+    const uchar *src = it->data;
+    uchar *dst = it->data;
+    for (auto l = 0; l != it->num_levels; ++l)
+    {
+        size_t count = (size_t)get_mip_dimension(it->width, l) * get_mip_dimension(it->height, l);
+        for (size_t i = 0; i != count; ++i, src += 4, dst += 2)
+        {
+            dst[0] = src[0];
+            dst[1] = src[1];
+        }
+    }
+}
+
+struct Normal_Error {
+    float mean_degrees;
+    float max_degrees;
+};
+
+// Angles between reference (RGBA8, all three components, renormalized here) and decoded (RGBA8
+//   or anything decompress_texture returns, only X and Y count). count pixels each.
+Normal_Error measure_normal_error(const uchar *reference, const uchar *decoded, size_t count)
+{
+    Normal_Error error = {};
+    double sum = 0.0;
+
+    for (size_t i = 0; i != count; ++i)
+    {
+        const uchar *r = reference + i * 4;
+        float a[3] = { (float)r[0] * (2.0f / 255.0f) - 1.0f, (float)r[1] * (2.0f / 255.0f) - 1.0f, (float)r[2] * (2.0f / 255.0f) - 1.0f };
+        float length = sqrtf(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+        if (length < 1e-6f)
+            continue;
+
+        float b[3];
+        unpack_normal_xy(decoded[i * 4], decoded[i * 4 + 1], b);
+        float length_b = sqrtf(b[0] * b[0] + b[1] * b[1] + b[2] * b[2]);
+
+        float cosine = (a[0] * b[0] + a[1] * b[1] + a[2] * b[2]) / (length * length_b);
+        cosine = (cosine > 1.0f) ? 1.0f : (cosine < -1.0f) ? -1.0f : cosine;
+        float degrees = acosf(cosine) * (180.0f / NORMAL_MAP_PI);
+
+        sum += degrees;
+        error.max_degrees = (degrees > error.max_degrees) ? degrees : error.max_degrees;
+    }
+
+    error.mean_degrees = count ? (float)(sum / (double)count) : 0.0f;
+    return error;
+}
+
+#endif
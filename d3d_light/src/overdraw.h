@@ -0,0 +1,355 @@
+#ifndef _OVERDRAW_H_
+#define _OVERDRAW_H_
+#include "stdafx.h"
+
+#include <math.h>
+#include <float.h>
+
+#include "mesh_common.h"
+#include "vertex_cache.h"
+
+/// ============ OVERDRAW OPTIMIZATION ============ ///
+// Cluster sorting after Sander et al., "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw".
+// The cache-optimized triangle order is cut into clusters, and clusters facing away from
+//   the mesh center are drawn first, since they are the ones most likely to occlude the rest.
+//
+// threshold is how much worse than the whole mesh a cluster's ACMR may be when we cut it:
+//   around 1.0 clusters stay large and the cache order mostly survives, larger values
+//   cut smaller clusters and trade vertex shader work for less overdraw.
+
+#define OVERDRAW_DEFAULT_THRESHOLD 1.05f
+
+struct Overdraw_Cluster
+{
+    uint first_triangle;
+    uint num_triangles;
+    float sort_key;
+};
+
+static void get_triangle_area_normal(const Vertex *vertices, const uint *tri, float *out_normal, float *out_centroid)
+{
+    auto p0 = vertices[tri[0]].position;
+    auto p1 = vertices[tri[1]].position;
+    auto p2 = vertices[tri[2]].position;
+
+    float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+    float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+
+    // Not normalized, the length is twice the triangle area which is exactly the weight we want.
+    out_normal[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    out_normal[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    out_normal[2] = e1[0] * e2[1] - e1[1] * e2[0];
+
+    for (auto k = 0; k != 3; ++k)
+        out_centroid[k] = (p0[k] + p1[k] + p2[k]) / 3.0f;
+}
+
+// dst and indices may be the same buffer. Expects the input to be vertex cache optimized already.
+void optimize_overdraw(uint *dst, const uint *indices, uint num_indices, const Vertex *vertices, uint num_vertices, float threshold = OVERDRAW_DEFAULT_THRESHOLD)
+{
+    uint num_triangles = num_indices / 3;
+    if (!num_triangles)
+        return;
+
+    float mesh_acmr = analyze_vertex_cache(indices, num_indices, num_vertices).acmr;
+
+    /// -- Cut clusters.
+    // Every cluster starts with a cold cache, since after sorting we can't know what was drawn before it.
+    // A cluster ends as soon as its own ACMR is within threshold of the whole mesh, or when the
+    //   next triangle shares no vertex with it (the cache would be cold there anyway).
+    Overdraw_Cluster *clusters = (Overdraw_Cluster *)malloc(num_triangles * sizeof(Overdraw_Cluster));
+    uint num_clusters = 0;
+
+    uint *timestamps = (uint *)calloc(num_vertices, sizeof(uint));
+    uint timestamp = VERTEX_CACHE_FIFO_SIZE + 1;
+    uint cluster_misses = 0;
+    bool cut = true;
+
+    for (auto i = 0; i != num_triangles; ++i)
+    {
+        auto tri = &indices[i * 3];
+
+        if (!cut)
+        {
+            cut = true;
+            for (auto k = 0; k != 3; ++k)
+                if (timestamp - timestamps[tri[k]] <= VERTEX_CACHE_FIFO_SIZE)
+                    cut = false;
+        }
+
+        if (cut)
+        {
+            // Bumping the clock past the cache size flushes every entry at once.
+            timestamp += VERTEX_CACHE_FIFO_SIZE + 1;
+            clusters[num_clusters].first_triangle = i;
+            clusters[num_clusters].num_triangles = 0;
+            ++num_clusters;
+            cluster_misses = 0;
+            cut = false;
+        }
+
+        for (auto k = 0; k != 3; ++k)
+        {
+            if (timestamp - timestamps[tri[k]] > VERTEX_CACHE_FIFO_SIZE)
+            {
+                timestamps[tri[k]] = timestamp++;
+                ++cluster_misses;
+            }
+        }
+
+        auto current = &clusters[num_clusters - 1];
+        current->num_triangles++;
+
+        if (((float)cluster_misses / (float)current->num_triangles) <= (mesh_acmr * threshold))
+            cut = true;
+    }
+
+    free(timestamps);
+
+    /// -- Sort key: how much the cluster faces away from the mesh center.
+    float mesh_centroid[3] = {};
+    float mesh_area = 0.0f;
+
+    for (auto i = 0; i != num_triangles; ++i)
+    {
+        float normal[3], centroid[3];
+        get_triangle_area_normal(vertices, &indices[i * 3], normal, centroid);
+
+        float area = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        for (auto k = 0; k != 3; ++k)
+            mesh_centroid[k] += centroid[k] * area;
+        mesh_area += area;
+    }
+
+    if (mesh_area > 0.0f)
+        for (auto k = 0; k != 3; ++k)
+            mesh_centroid[k] /= mesh_area;
+
+    for (auto c = 0; c != num_clusters; ++c)
+    {
+        float cluster_normal[3] = {};
+        float cluster_centroid[3] = {};
+        float cluster_area = 0.0f;
+
+        for (auto i = clusters[c].first_triangle; i != clusters[c].first_triangle + clusters[c].num_triangles; ++i)
+        {
+            float normal[3], centroid[3];
+            get_triangle_area_normal(vertices, &indices[i * 3], normal, centroid);
+
+            float area = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+            for (auto k = 0; k != 3; ++k)
+            {
+                cluster_normal[k] += normal[k];
+                cluster_centroid[k] += centroid[k] * area;
+            }
+            cluster_area += area;
+        }
+
+        float length = sqrtf(cluster_normal[0] * cluster_normal[0] + cluster_normal[1] * cluster_normal[1] + cluster_normal[2] * cluster_normal[2]);
+        float sort_key = 0.0f;
+
+        if (cluster_area > 0.0f && length > 0.0f)
+            for (auto k = 0; k != 3; ++k)
+                sort_key += ((cluster_centroid[k] / cluster_area) - mesh_centroid[k]) * (cluster_normal[k] / length);
+
+        clusters[c].sort_key = sort_key;
+    }
+
+    /// -- Stable bottom-up merge sort, descending. Equal keys keep their cache order.
+    Overdraw_Cluster *sorted = (Overdraw_Cluster *)malloc(num_clusters * sizeof(Overdraw_Cluster));
+    for (auto width = 1; width < num_clusters; width *= 2)
+    {
+        for (auto lo = 0; lo < num_clusters; lo += 2 * width)
+        {
+            uint mid = (lo + width < num_clusters) ? lo + width : num_clusters;
+            uint hi = (lo + 2 * width < num_clusters) ? lo + 2 * width : num_clusters;
+            uint a = lo, b = mid, out = lo;
+
+            while (a < mid && b < hi)
+                sorted[out++] = (clusters[b].sort_key > clusters[a].sort_key) ? clusters[b++] : clusters[a++];
+            while (a < mid)
+                sorted[out++] = clusters[a++];
+            while (b < hi)
+                sorted[out++] = clusters[b++];
+        }
+
+        auto temp = clusters;
+        clusters = sorted;
+        sorted = temp;
+    }
+
+    /// -- Emit.
+    uint *source = (uint *)malloc(num_indices * sizeof(uint));
+    memcpy(source, indices, num_indices * sizeof(uint));
+
+    uint offset = 0;
+    for (auto c = 0; c != num_clusters; ++c)
+    {
+        auto count = clusters[c].num_triangles * 3;
+        memcpy(&dst[offset], &source[clusters[c].first_triangle * 3], count * sizeof(uint));
+        offset += count;
+    }
+
+    free(source);
+    free(sorted);
+    free(clusters);
+}
+
+/// ============ OVERDRAW ESTIMATION ============ ///
+// A tiny orthographic depth-tested rasterizer, so overdraw can be measured without a GPU.
+// Triangles are rasterized in index buffer order with no culling (the renderer uses
+//   D3D11_CULL_NONE), from directions spread evenly over the sphere.
+
+#define OVERDRAW_ESTIMATE_RESOLUTION 256
+#define OVERDRAW_ESTIMATE_DIRECTIONS 16
+
+struct Overdraw_Stats
+{
+    uint64_t pixels_covered; // pixels with at least one fragment
+    uint64_t pixels_shaded;  // fragments that passed the depth test, i.e. pixel shader invocations
+    float overdraw;          // shaded / covered, 1 is optimal
+};
+
+static void rasterize_overdraw_triangle(float *depth, const float *v0, const float *v1, const float *v2, uint64_t *shaded)
+{
+    const int size = OVERDRAW_ESTIMATE_RESOLUTION;
+
+    float area = (v1[0] - v0[0]) * (v2[1] - v0[1]) - (v1[1] - v0[1]) * (v2[0] - v0[0]);
+    if (fabsf(area) < 1e-12f)
+        return;
+
+    // Fold both windings into one so the edge tests below work for front and back faces.
+    if (area < 0.0f)
+    {
+        auto temp = v1;
+        v1 = v2;
+        v2 = temp;
+        area = -area;
+    }
+
+    int min_x = (int)floorf(fminf(v0[0], fminf(v1[0], v2[0])));
+    int max_x = (int)ceilf(fmaxf(v0[0], fmaxf(v1[0], v2[0])));
+    int min_y = (int)floorf(fminf(v0[1], fminf(v1[1], v2[1])));
+    int max_y = (int)ceilf(fmaxf(v0[1], fmaxf(v1[1], v2[1])));
+
+    if (min_x < 0) min_x = 0;
+    if (min_y < 0) min_y = 0;
+    if (max_x > size - 1) max_x = size - 1;
+    if (max_y > size - 1) max_y = size - 1;
+
+    for (auto y = min_y; y <= max_y; ++y)
+    {
+        for (auto x = min_x; x <= max_x; ++x)
+        {
+            float px = (float)x + 0.5f;
+            float py = (float)y + 0.5f;
+
+            float w0 = (v2[0] - v1[0]) * (py - v1[1]) - (v2[1] - v1[1]) * (px - v1[0]);
+            float w1 = (v0[0] - v2[0]) * (py - v2[1]) - (v0[1] - v2[1]) * (px - v2[0]);
+            float w2 = (v1[0] - v0[0]) * (py - v0[1]) - (v1[1] - v0[1]) * (px - v0[0]);
+
+            if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+                continue;
+
+            float z = (w0 * v0[2] + w1 * v1[2] + w2 * v2[2]) / area;
+            if (z < depth[y * size + x])
+            {
+                depth[y * size + x] = z;
+                (*shaded)++;
+            }
+        }
+    }
+}
+
+Overdraw_Stats estimate_overdraw(const uint *indices, uint num_indices, const Vertex *vertices, uint num_vertices, uint num_directions = OVERDRAW_ESTIMATE_DIRECTIONS)
+{
+    Overdraw_Stats stats = {};
+    if (!num_indices || !num_vertices)
+        return stats;
+
+    const int size = OVERDRAW_ESTIMATE_RESOLUTION;
+
+    float mesh_min[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float mesh_max[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for (auto i = 0; i != num_vertices; ++i)
+    {
+        for (auto k = 0; k != 3; ++k)
+        {
+            mesh_min[k] = fminf(mesh_min[k], vertices[i].position[k]);
+            mesh_max[k] = fmaxf(mesh_max[k], vertices[i].position[k]);
+        }
+    }
+
+    float center[3], radius = 0.0f;
+    for (auto k = 0; k != 3; ++k)
+    {
+        center[k] = (mesh_min[k] + mesh_max[k]) * 0.5f;
+        radius += (mesh_max[k] - center[k]) * (mesh_max[k] - center[k]);
+    }
+    radius = sqrtf(radius);
+    if (radius <= 0.0f)
+        return stats;
+
+    float *depth = (float *)malloc(size * size * sizeof(float));
+    float *projected = (float *)malloc(num_vertices * 3 * sizeof(float));
+
+    for (auto d = 0; d != num_directions; ++d)
+    {
+        // Fibonacci sphere.
+        float z = 1.0f - (2.0f * ((float)d + 0.5f) / (float)num_directions);
+        float r = sqrtf(fmaxf(0.0f, 1.0f - z * z));
+        float phi = (float)d * 2.39996323f;
+        float forward[3] = { r * cosf(phi), r * sinf(phi), z };
+
+        float up[3] = { 0, 1, 0 };
+        if (fabsf(forward[1]) > 0.99f)
+        {
+            up[1] = 0;
+            up[2] = 1;
+        }
+
+        float right[3] = { up[1] * forward[2] - up[2] * forward[1], up[2] * forward[0] - up[0] * forward[2], up[0] * forward[1] - up[1] * forward[0] };
+        float right_length = sqrtf(right[0] * right[0] + right[1] * right[1] + right[2] * right[2]);
+        for (auto k = 0; k != 3; ++k)
+            right[k] /= right_length;
+
+        float view_up[3] = { forward[1] * right[2] - forward[2] * right[1], forward[2] * right[0] - forward[0] * right[2], forward[0] * right[1] - forward[1] * right[0] };
+
+        for (auto i = 0; i != num_vertices; ++i)
+        {
+            float p[3];
+            for (auto k = 0; k != 3; ++k)
+                p[k] = vertices[i].position[k] - center[k];
+
+            float scale = (float)size / (2.0f * radius);
+            projected[i * 3 + 0] = (p[0] * right[0] + p[1] * right[1] + p[2] * right[2]) * scale + (float)size * 0.5f;
+            projected[i * 3 + 1] = (p[0] * view_up[0] + p[1] * view_up[1] + p[2] * view_up[2]) * scale + (float)size * 0.5f;
+            projected[i * 3 + 2] = (p[0] * forward[0] + p[1] * forward[1] + p[2] * forward[2]);
+        }
+
+        for (auto i = 0; i != size * size; ++i)
+            depth[i] = FLT_MAX;
+
+        for (auto i = 0; i + 2 < num_indices; i += 3)
+        {
+            rasterize_overdraw_triangle(depth,
+                                        &projected[indices[i + 0] * 3],
+                                        &projected[indices[i + 1] * 3],
+                                        &projected[indices[i + 2] * 3],
+                                        &stats.pixels_shaded);
+        }
+
+        for (auto i = 0; i != size * size; ++i)
+            if (depth[i] != FLT_MAX)
+                stats.pixels_covered++;
+    }
+
+    if (stats.pixels_covered)
+        stats.overdraw = (float)stats.pixels_shaded / (float)stats.pixels_covered;
+
+    free(projected);
+    free(depth);
+    return stats;
+}
+
+#endif
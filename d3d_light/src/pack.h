@@ -0,0 +1,292 @@
+#ifndef _PACK_H_
+#define _PACK_H_
+#include "stdafx.h"
+
+#include <ctype.h>
+
+#include "file_map.h"
+
+/// ============ ASSET PACK ============ ///
+// One file holding every asset, mapped once. Lookups hash the asset's path into an open
+//   addressing table, so finding an asset is a hash and usually one probe, and the payload
+//   comes back as a pointer into the mapping: nothing is read or copied until it's touched.
+//
+//   Pack_Header
+//   Pack_Entry[table_size]   (power of two, at most half full, hash == 0 marks a free slot)
+//   names                    (normalized paths, NUL terminated, for listing and collision checks)
+//   payloads, each aligned to PACK_ALIGNMENT
+//
+// Paths are normalized before hashing (lower case, '/' separators), so "data\\remington\\model.mesh"
+//   and "data/Remington/model.mesh" are the same asset.
+// Written by pack_builder.cpp and cook.cpp. Offsets are from the start of the file, everything is little-endian.
+
+#define PACK_MAGIC     0x4B415043 // "CPAK"
+#define PACK_VERSION   1
+#define PACK_ALIGNMENT 64         // cache line, more than any payload needs (mesh blobs want 16)
+#define PACK_MAX_PATH  512
+
+struct Pack_Header
+{
+    uint magic;
+    uint version;
+    uint num_entries;
+    uint table_size;
+    uint64_t table_offset;
+    uint64_t names_offset;
+    uint64_t total_size;
+    uint64_t reserved;
+};
+
+struct Pack_Entry
+{
+    uint64_t hash;
+    uint64_t offset;
+    uint64_t size;
+    uint name_offset;
+    uint name_size; // without the NUL
+};
+
+static_assert(sizeof(Pack_Header) == 48, "Pack_Header layout changed, bump PACK_VERSION.");
+static_assert(sizeof(Pack_Entry) == 32, "Pack_Entry layout changed, bump PACK_VERSION.");
+
+static inline uint64_t align_pack_offset(uint64_t offset)
+{
+    return (offset + (PACK_ALIGNMENT - 1)) & ~(uint64_t)(PACK_ALIGNMENT - 1);
+}
+
+// Writes the normalized path into out and returns its length, or 0 if it doesn't fit.
+static uint normalize_pack_path(const char *path, char *out)
+{
+    uint length = 0;
+    for (; *path; ++path)
+    {
+        if (length + 1 >= PACK_MAX_PATH)
+            return 0;
+        out[length++] = (*path == '\\') ? '/' : (char)tolower(*path);
+    }
+    out[length] = 0;
+    return length;
+}
+
+// FNV-1a, never 0 so 0 can mark free slots.
+static inline uint64_t hash_pack_path(const char *normalized, uint length)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (auto i = 0; i != length; ++i)
+    {
+        hash ^= (uchar)normalized[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash ? hash : 1;
+}
+
+/// ============ WRITING ============ ///
+// Packs the files at paths, each stored under its path, or under names[i] if names is given
+//   (the cook writes outputs to a build directory but the runtime looks them up by their data path).
+//   Duplicates (after normalization) fail.
+bool write_pack(const char *path, const char **paths, uint num_paths, const char **names = NULL)
+{
+    uint table_size = 1;
+    while (table_size < num_paths * 2)
+        table_size *= 2;
+
+    Pack_Entry *table = (Pack_Entry *)calloc(table_size, sizeof(Pack_Entry));
+    Mapped_File *files = (Mapped_File *)calloc(num_paths, sizeof(Mapped_File));
+    char *name_data = (char *)malloc((size_t)num_paths * PACK_MAX_PATH);
+    uint names_size = 0;
+    bool result = true;
+
+    uint64_t names_offset = sizeof(Pack_Header) + (uint64_t)table_size * sizeof(Pack_Entry);
+    uint *slots = (uint *)calloc(num_paths, sizeof(uint));
+
+    for (auto i = 0; i != num_paths && result; ++i)
+    {
+        const char *stored = names ? names[i] : paths[i];
+        char *name = &name_data[names_size];
+        uint length = normalize_pack_path(stored, name);
+        if (!length)
+        {
+            LOGF("Path too long: %s\n", stored);
+            result = false;
+            break;
+        }
+
+        // Empty files are fine, map_file just refuses them.
+        if (!map_file(&files[i], paths[i]))
+        {
+            FILE *test = fopen(paths[i], "rb");
+            if (!test)
+            {
+                LOGF("Failed to open %s\n", paths[i]);
+                result = false;
+                break;
+            }
+            fclose(test);
+        }
+
+        uint64_t hash = hash_pack_path(name, length);
+        uint slot = (uint)hash & (table_size - 1);
+        while (table[slot].hash)
+        {
+            if (table[slot].hash == hash && !strcmp(&name_data[table[slot].name_offset], name))
+            {
+                LOGF("Duplicate asset: %s\n", stored);
+                result = false;
+                break;
+            }
+            slot = (slot + 1) & (table_size - 1);
+        }
+        if (!result)
+            break;
+
+        table[slot].hash = hash;
+        table[slot].name_offset = names_size;
+        table[slot].name_size = length;
+        table[slot].size = files[i].size;
+        slots[i] = slot;
+        names_size += length + 1;
+    }
+
+    FILE *file = NULL;
+    if (result)
+    {
+        uint64_t offset = names_offset + names_size;
+        for (auto i = 0; i != num_paths; ++i)
+        {
+            auto entry = &table[slots[i]];
+            entry->offset = align_pack_offset(offset);
+            entry->name_offset += (uint)names_offset;
+            offset = entry->offset + entry->size;
+        }
+
+        Pack_Header header = {};
+        header.magic = PACK_MAGIC;
+        header.version = PACK_VERSION;
+        header.num_entries = num_paths;
+        header.table_size = table_size;
+        header.table_offset = sizeof(Pack_Header);
+        header.names_offset = names_offset;
+        header.total_size = align_pack_offset(offset);
+
+        file = fopen(path, "wb");
+        if (!file)
+        {
+            LOGF("Failed to open %s for writing.\n", path);
+            result = false;
+        }
+        else
+        {
+            static const uchar padding[PACK_ALIGNMENT] = {};
+            result = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                     fwrite(table, sizeof(Pack_Entry), table_size, file) == table_size &&
+                     fwrite(name_data, 1, names_size, file) == names_size;
+
+            offset = names_offset + names_size;
+            for (auto i = 0; i != num_paths && result; ++i)
+            {
+                auto entry = &table[slots[i]];
+                result = fwrite(padding, 1, entry->offset - offset, file) == entry->offset - offset &&
+                         fwrite(files[i].data, 1, entry->size, file) == entry->size;
+                offset = entry->offset + entry->size;
+            }
+            result = result && fwrite(padding, 1, header.total_size - offset, file) == header.total_size - offset;
+
+            fclose(file);
+            if (!result)
+                LOGF("Failed to write %s.\n", path);
+        }
+    }
+
+    for (auto i = 0; i != num_paths; ++i)
+        unmap_file(&files[i]);
+    free(slots);
+    free(name_data);
+    free(files);
+    free(table);
+    return result;
+}
+
+/// ============ READING ============ ///
+struct Pack_File
+{
+    Mapped_File file;
+    Pack_Header *header;
+    Pack_Entry *table;
+};
+
+bool open_pack(Pack_File *it, const char *path)
+{
+    ZeroThat(it);
+    if (!map_file(&it->file, path))
+        return false;
+
+    auto base = (uchar *)it->file.data;
+    auto header = (Pack_Header *)base;
+
+    if (it->file.size < sizeof(Pack_Header) ||
+        header->magic != PACK_MAGIC ||
+        header->version != PACK_VERSION ||
+        header->total_size != it->file.size ||
+        !header->table_size || (header->table_size & (header->table_size - 1)) ||
+        header->num_entries >= header->table_size ||
+        header->table_offset + (uint64_t)header->table_size * sizeof(Pack_Entry) > it->file.size)
+    {
+        LOGF("Stale or invalid pack: %s\n", path);
+        unmap_file(&it->file);
+        return false;
+    }
+
+    auto table = (Pack_Entry *)(base + header->table_offset);
+    for (auto i = 0; i != header->table_size; ++i)
+    {
+        if (table[i].hash &&
+            (table[i].offset + table[i].size > it->file.size ||
+             (uint64_t)table[i].name_offset + table[i].name_size + 1 > it->file.size))
+        {
+            LOGF("Entry %d is out of bounds: %s\n", i, path);
+            unmap_file(&it->file);
+            return false;
+        }
+    }
+
+    it->header = header;
+    it->table = table;
+    return true;
+}
+
+void close_pack(Pack_File *it)
+{
+    unmap_file(&it->file);
+    ZeroThat(it);
+}
+
+// Zero-copy view of an asset, valid until close_pack. NULL if the pack doesn't have it
+//   (or isn't open, so callers can fall back to loose files either way).
+const void *find_pack_asset(const Pack_File *it, const char *path, size_t *out_size)
+{
+    if (!it->header)
+        return NULL;
+
+    char name[PACK_MAX_PATH];
+    uint length = normalize_pack_path(path, name);
+    if (!length)
+        return NULL;
+
+    auto base = (const uchar *)it->file.data;
+    uint64_t hash = hash_pack_path(name, length);
+    uint mask = it->header->table_size - 1;
+
+    for (uint slot = (uint)hash & mask; it->table[slot].hash; slot = (slot + 1) & mask)
+    {
+        auto entry = &it->table[slot];
+        if (entry->hash == hash && entry->name_size == length && !memcmp(base + entry->name_offset, name, length))
+        {
+            *out_size = (size_t)entry->size;
+            return base + entry->offset;
+        }
+    }
+
+    return NULL;
+}
+
+#endif
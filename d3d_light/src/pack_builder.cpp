@@ -0,0 +1,179 @@
+// Offline pack builder. Puts loose asset files into one .pak (see pack.h) that the runtime
+//   maps once instead of opening every file.
+//
+// Usage: pack_builder <output .pak> <file | name=file>...
+//        pack_builder -benchmark <.pak> <file>...
+//
+// Files are stored under the path they're given as, so run it from the directory the
+//   runtime runs from, e.g. pack_builder data/assets.pak data/remington/model.mesh src/shaders/*.hlsl
+//   or give the name explicitly: src/shaders/lit.hlsl=.build/cook/lit.hlsl
+// -benchmark compares reading the files loose (open, read into a malloc'd buffer, close) against
+//   looking them up in the pack and touching every page, cold and warm. Cold runs evict the
+//   files from the page cache first, which only works on Linux; on Windows the first run is
+//   the cold one only if nothing else has read the files since boot.
+#include "stdafx.h"
+
+#include <chrono>
+
+#include "pack.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static void evict_file_cache(const char *path)
+{
+#ifndef _WIN32
+    int fd = open(path, O_RDONLY);
+    if (fd >= 0)
+    {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+#endif
+}
+
+static double get_ms_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static double read_loose_files(const char **paths, uint num_paths, uint64_t *out_bytes)
+{
+    auto start = std::chrono::steady_clock::now();
+    uint64_t bytes = 0;
+
+    for (auto i = 0; i != num_paths; ++i)
+    {
+        FILE *file = fopen(paths[i], "rb");
+        if (!file)
+            continue;
+
+        fseek(file, 0, SEEK_END);
+        long size = ftell(file);
+        fseek(file, 0, SEEK_SET);
+
+        void *buffer = malloc(size ? size : 1);
+        bytes += fread(buffer, 1, size, file);
+        fclose(file);
+        free(buffer);
+    }
+
+    *out_bytes = bytes;
+    return get_ms_since(start);
+}
+
+static double read_pack_assets(const char *pack_path, const char **paths, uint num_paths, uint64_t *out_bytes)
+{
+    auto start = std::chrono::steady_clock::now();
+    uint64_t bytes = 0;
+    volatile uchar sink = 0;
+
+    Pack_File pack;
+    if (open_pack(&pack, pack_path))
+    {
+        for (auto i = 0; i != num_paths; ++i)
+        {
+            size_t size;
+            auto data = (const uchar *)find_pack_asset(&pack, paths[i], &size);
+            if (!data)
+                continue;
+
+            for (size_t offset = 0; offset < size; offset += 4096)
+                sink += data[offset];
+            bytes += size;
+        }
+        close_pack(&pack);
+    }
+
+    *out_bytes = bytes;
+    return get_ms_since(start);
+}
+
+static void benchmark_pack(const char *pack_path, const char **paths, uint num_paths)
+{
+    const int warm_runs = 5;
+    uint64_t loose_bytes, pack_bytes;
+
+    for (auto i = 0; i != num_paths; ++i)
+        evict_file_cache(paths[i]);
+    evict_file_cache(pack_path);
+
+    double loose_cold = read_loose_files(paths, num_paths, &loose_bytes);
+    double pack_cold = read_pack_assets(pack_path, paths, num_paths, &pack_bytes);
+
+    double loose_warm = 1e30, pack_warm = 1e30;
+    for (auto run = 0; run != warm_runs; ++run)
+    {
+        double ms = read_loose_files(paths, num_paths, &loose_bytes);
+        loose_warm = (ms < loose_warm) ? ms : loose_warm;
+        ms = read_pack_assets(pack_path, paths, num_paths, &pack_bytes);
+        pack_warm = (ms < pack_warm) ? ms : pack_warm;
+    }
+
+    // Lookups alone, the pack stays open.
+    Pack_File pack;
+    double lookup_ns = 0.0;
+    if (open_pack(&pack, pack_path) && num_paths)
+    {
+        const int rounds = 10000;
+        size_t size;
+        uint found = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (auto round = 0; round != rounds; ++round)
+            for (auto i = 0; i != num_paths; ++i)
+                found += find_pack_asset(&pack, paths[i], &size) ? 1 : 0;
+        lookup_ns = get_ms_since(start) * 1e6 / ((double)rounds * num_paths);
+        close_pack(&pack);
+        if (found != rounds * num_paths)
+            LOGF("%u of %u lookups failed, is the pack stale?\n", rounds * num_paths - found, rounds * num_paths);
+    }
+
+    LOGF("%u files, %.2f MB loose, %.2f MB found in the pack\n", num_paths, loose_bytes / (1024.0 * 1024.0), pack_bytes / (1024.0 * 1024.0));
+    LOGF("cold: loose %8.2fms, pack %8.2fms\n", loose_cold, pack_cold);
+    LOGF("warm: loose %8.2fms, pack %8.2fms (best of %d)\n", loose_warm, pack_warm, warm_runs);
+    LOGF("lookup: %.0fns per asset\n", lookup_ns);
+}
+
+int main(int argc, char **argv)
+{
+    bool benchmark = argc > 1 && !strcmp(argv[1], "-benchmark");
+    int arg = benchmark ? 2 : 1;
+
+    if (argc - arg < 2)
+    {
+        printf("Usage: %s <output .pak> <file | name=file>...\n", argv[0]);
+        printf("       %s -benchmark <.pak> <file>...\n", argv[0]);
+        return 1;
+    }
+
+    const char *pack_path = argv[arg];
+    const char **paths = (const char **)&argv[arg + 1];
+    uint num_paths = (uint)(argc - arg - 1);
+
+    if (benchmark)
+    {
+        benchmark_pack(pack_path, paths, num_paths);
+        return 0;
+    }
+
+    // name=file stores file under name, argv is ours to cut up.
+    const char **files = (const char **)malloc(num_paths * sizeof(const char *));
+    for (auto i = 0; i != num_paths; ++i)
+    {
+        char *split = strchr(argv[arg + 1 + i], '=');
+        if (split)
+            *split = 0;
+        files[i] = split ? split + 1 : paths[i];
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    bool result = write_pack(pack_path, files, num_paths, paths);
+    free(files);
+    if (!result)
+        return 1;
+
+    LOGF("Packed %u files into %s in %.2fms\n", num_paths, pack_path, get_ms_since(start));
+    return 0;
+}
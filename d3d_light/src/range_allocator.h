@@ -0,0 +1,141 @@
+#ifndef _RANGE_ALLOCATOR_H_
+#define _RANGE_ALLOCATOR_H_
+#include "stdafx.h"
+
+/// ============ RANGE ALLOCATOR ============ ///
+// Hands out [offset, offset + count) ranges of a fixed capacity, in whatever unit the caller
+//   means (vertices, indices...). Nothing here touches the memory behind the ranges, which is
+//   what lets the mesh arena (see win32_application.h) suballocate GPU buffers with it.
+// The free list is sorted by offset and never holds two touching ranges: release merges a
+//   range into its neighbours. Allocation is first fit, so the low end stays packed and what
+//   gets freed is what gets reused first.
+
+struct Buffer_Range {
+    uint offset;
+    uint count;
+};
+
+struct Range_Allocator {
+    Buffer_Range *free_ranges;
+    uint num_free;
+    uint max_free;
+    uint capacity;
+    uint used;
+};
+
+void init_range_allocator(Range_Allocator *it, uint capacity)
+{
+    ZeroThat(it);
+    it->capacity = capacity;
+    it->max_free = 16;
+    it->free_ranges = (Buffer_Range *)malloc(it->max_free * sizeof(Buffer_Range));
+    if (capacity)
+    {
+        it->free_ranges[0].offset = 0;
+        it->free_ranges[0].count = capacity;
+        it->num_free = 1;
+    }
+}
+
+void free_range_allocator(Range_Allocator *it)
+{
+    free(it->free_ranges);
+    ZeroThat(it);
+}
+
+// Keeps the free list sorted, the caller has checked nothing touches the new range.
+static void insert_free_range(Range_Allocator *it, uint index, uint offset, uint count)
+{
+    if (it->num_free == it->max_free)
+    {
+        it->max_free *= 2;
+        it->free_ranges = (Buffer_Range *)realloc(it->free_ranges, it->max_free * sizeof(Buffer_Range));
+    }
+    memmove(&it->free_ranges[index + 1], &it->free_ranges[index], (it->num_free - index) * sizeof(Buffer_Range));
+    it->free_ranges[index].offset = offset;
+    it->free_ranges[index].count = count;
+    ++it->num_free;
+}
+
+// The offset comes out a multiple of alignment. What alignment skips at the front of a free
+//   range stays free. Returns false when no free range is big enough, even if the free total
+//   would be.
+bool allocate_range(Range_Allocator *it, uint count, uint *out_offset, uint alignment = 1)
+{
+    *out_offset = 0;
+    if (!count)
+        return true;
+    ASSERT(alignment);
+
+    for (auto i = 0; i != it->num_free; ++i)
+    {
+        auto range = &it->free_ranges[i];
+        uint offset = (range->offset + alignment - 1) / alignment * alignment;
+        uint padding = offset - range->offset;
+        if (range->count < padding || range->count - padding < count)
+            continue;
+
+        *out_offset = offset;
+        uint rest = range->count - padding - count;
+        if (padding)
+        {
+            range->count = padding;
+            if (rest)
+                insert_free_range(it, i + 1, offset + count, rest);
+        }
+        else if (rest)
+        {
+            range->offset += count;
+            range->count = rest;
+        }
+        else
+        {
+            memmove(range, range + 1, (it->num_free - i - 1) * sizeof(Buffer_Range));
+            --it->num_free;
+        }
+        it->used += count;
+        return true;
+    }
+    return false;
+}
+
+// offset and count must be exactly what a previous allocate_range handed out.
+void release_range(Range_Allocator *it, uint offset, uint count)
+{
+    if (!count)
+        return;
+    ASSERT(offset + count <= it->capacity && count <= it->used);
+
+    // First free range past this one.
+    uint lo = 0, hi = it->num_free;
+    while (lo < hi)
+    {
+        uint mid = (lo + hi) / 2;
+        if (it->free_ranges[mid].offset < offset)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    it->used -= count;
+    bool merge_prev = lo > 0 && it->free_ranges[lo - 1].offset + it->free_ranges[lo - 1].count == offset;
+    bool merge_next = lo < it->num_free && offset + count == it->free_ranges[lo].offset;
+
+    if (merge_prev && merge_next)
+    {
+        it->free_ranges[lo - 1].count += count + it->free_ranges[lo].count;
+        memmove(&it->free_ranges[lo], &it->free_ranges[lo + 1], (it->num_free - lo - 1) * sizeof(Buffer_Range));
+        --it->num_free;
+    }
+    else if (merge_prev)
+        it->free_ranges[lo - 1].count += count;
+    else if (merge_next)
+    {
+        it->free_ranges[lo].offset = offset;
+        it->free_ranges[lo].count += count;
+    }
+    else
+        insert_free_range(it, lo, offset, count);
+}
+
+#endif
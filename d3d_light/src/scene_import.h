@@ -0,0 +1,73 @@
+#ifndef _SCENE_IMPORT_H_
+#define _SCENE_IMPORT_H_
+#include "stdafx.h"
+
+#include <ctype.h>
+
+#include "mesh_common.h"
+#include "assimp_import.h"
+#include "gltf.h"
+
+/// ============ SCENE IMPORT ============ ///
+// Every mesh of a source scene as Cpu_Meshes, before optimize_cpu_mesh. glTF binaries go
+//   through the native loader (gltf.h), anything else through Assimp with ASSIMP_IMPORT_FLAGS.
+// Shared by the runtime's fallback when there's no usable blob and by the cookers.
+
+static bool is_gltf_binary_path(const char *path)
+{
+    size_t length = strlen(path);
+    return length >= 4 && path[length - 4] == '.' && tolower(path[length - 3]) == 'g' &&
+           tolower(path[length - 2]) == 'l' && tolower(path[length - 1]) == 'b';
+}
+
+// *out_meshes is one allocation, free every mesh and then it.
+bool import_scene_meshes(const char *path, Cpu_Mesh **out_meshes, uint *out_num_meshes)
+{
+    *out_meshes = NULL;
+    *out_num_meshes = 0;
+
+    if (is_gltf_binary_path(path))
+    {
+        Gltf_File gltf;
+        if (!open_gltf(&gltf, path))
+            return false;
+
+        uint num_meshes = count_gltf_primitives(&gltf);
+        Cpu_Mesh *meshes = (Cpu_Mesh *)calloc(num_meshes ? num_meshes : 1, sizeof(Cpu_Mesh));
+        for (auto i = 0; i != num_meshes; ++i)
+        {
+            if (!import_gltf_primitive(&meshes[i], &gltf, i))
+            {
+                for (auto j = 0; j != i; ++j)
+                    free_cpu_mesh(&meshes[j]);
+                free(meshes);
+                close_gltf(&gltf);
+                return false;
+            }
+        }
+
+        close_gltf(&gltf);
+        *out_meshes = meshes;
+        *out_num_meshes = num_meshes;
+        return true;
+    }
+
+    Assimp::Importer importer;
+    const aiScene *scene = importer.ReadFile(path, ASSIMP_IMPORT_FLAGS);
+    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+    {
+        LOGF("Assimp error: %s\n", importer.GetErrorString());
+        return false;
+    }
+
+    uint num_meshes = scene->mNumMeshes;
+    Cpu_Mesh *meshes = (Cpu_Mesh *)calloc(num_meshes ? num_meshes : 1, sizeof(Cpu_Mesh));
+    for (auto i = 0; i != num_meshes; ++i)
+        import_ai_mesh(&meshes[i], scene->mMeshes[i]);
+
+    *out_meshes = meshes;
+    *out_num_meshes = num_meshes;
+    return true;
+}
+
+#endif
@@ -6,11 +6,21 @@ cbuffer cb0 : register(b0) {
     int use_lighting;
 };
 
+// Normal maps only store X and Y (BC5 cooked, RG8 loose, see normal_map.h), Z is what makes
+//   the normal unit length. Tangent space normals never point into the surface.
+//   Not called until meshes know their material and the maps get bound.
+float3 unpack_normal_xy(float2 xy)
+{
+    float2 n = xy * 2 - 1;
+    return float3(n, sqrt(saturate(1 - dot(n, n))));
+}
+
 void main(float4 position      : SV_Position,
           float3 vertex_color  : COLOR0,
           float2 texcoord      : TEXCOORD0,
           float3 normal        : TEXCOORD1,
           float3 pixel_ws      : TEXCOORD2,
+          float4 tangent       : TEXCOORD3,
           out float4 out_pixel : SV_Target)
 {
     if (use_lighting)
@@ -9,11 +9,13 @@ void main(float3 position : POSITION,
           float3 color    : COLOR0,
           float2 texcoord : TEXCOORD0,
           float3 normal   : TEXCOORD1,
+          float4 tangent  : TEXCOORD2,
           out float4 out_position  : SV_Position,
           out float3 out_color     : COLOR0,
           out float2 out_texcoord  : TEXCOORD0,
           out float3 out_normal    : TEXCOORD1,
-          out float3 out_pixel_ws  : TEXCOORD2)
+          out float3 out_pixel_ws  : TEXCOORD2,
+          out float4 out_tangent   : TEXCOORD3)
 {
     //out_position = float4(position, 1);
     out_position = mul(float4(position, 1), mul(world_matrix, mul(view_matrix, proj_matrix)));
@@ -21,4 +23,5 @@ void main(float3 position : POSITION,
     out_texcoord = texcoord;
     out_normal = normal;
     out_pixel_ws = mul(position, (float3x3)world_matrix);
+    out_tangent = tangent;
 }
@@ -0,0 +1,38 @@
+
+// Same as static.hlsl, but for the 16 byte Packed_Vertex from vertex_quant.h.
+cbuffer cb0 : register(b0) {
+    float4x4 world_matrix;
+    float4x4 view_matrix;
+    float4x4 proj_matrix;
+    float3 aabb_min;
+    float3 aabb_extent;
+    float3 base_color;
+};
+
+float3 decode_octahedral(float2 e)
+{
+    float3 n = float3(e, 1 - abs(e.x) - abs(e.y));
+    if (n.z < 0)
+        n.xy = (1 - abs(n.yx)) * (n.xy >= 0 ? 1.0 : -1.0);
+    return normalize(n);
+}
+
+void main(float4 position_unorm : POSITION,
+          float2 texcoord       : TEXCOORD0,
+          float2 normal_oct     : TEXCOORD1,
+          out float4 out_position  : SV_Position,
+          out float3 out_color     : COLOR0,
+          out float2 out_texcoord  : TEXCOORD0,
+          out float3 out_normal    : TEXCOORD1,
+          out float3 out_pixel_ws  : TEXCOORD2,
+          out float4 out_tangent   : TEXCOORD3)
+{
+    float3 position = aabb_min + position_unorm.xyz * aabb_extent;
+
+    out_position = mul(float4(position, 1), mul(world_matrix, mul(view_matrix, proj_matrix)));
+    out_color = base_color;
+    out_texcoord = texcoord;
+    out_normal = decode_octahedral(normal_oct);
+    out_pixel_ws = mul(position, (float3x3)world_matrix);
+    out_tangent = float4(0, 0, 0, 1); // Packed_Vertex has no tangent
+}
@@ -1,10 +1,13 @@
 #ifndef _STDAFX_H_
 #define _STDAFX_H_
+#ifdef _WIN32
 #include <Windows.h>
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdarg.h>
+#include <string.h>
 #include <memory.h>
 
 #define ZeroThat(x) memset(x, 0, sizeof(*x))
@@ -15,6 +18,8 @@
 typedef unsigned int uint;
 typedef unsigned char uchar;
 
+#ifdef _WIN32
+
 static void DebugPrintf(const char *fmt, ...)
 {
     va_list args;
@@ -52,4 +57,21 @@ static void DebugPrintf(const char *fmt, ...)
 #define LOGF(x, ...) DebugPrintf("[%s]: " ## x, __FUNCTION__, __VA_ARGS__)
 #define ASSERT(x) if (!(x)) { LOGF("Assertion Failed: %s\n\tFile: %s\n\tLine: %d\n", #x, __FILE__, __LINE__); __debugbreak(); *(int*)0 = 0; }
 
+#else
+
+// The offline tools (mesh cooker etc.) don't touch D3D and have to run on Linux too.
+static void DebugPrintf(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stdout, fmt, args);
+    va_end(args);
+}
+
+#define LOG(x) DebugPrintf("[%s]: " x, __FUNCTION__)
+#define LOGF(x, ...) DebugPrintf("[%s]: " x, __FUNCTION__, __VA_ARGS__)
+#define ASSERT(x) if (!(x)) { LOGF("Assertion Failed: %s\n\tFile: %s\n\tLine: %d\n", #x, __FILE__, __LINE__); __builtin_trap(); }
+
+#endif
+
 #endif
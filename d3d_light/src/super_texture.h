@@ -0,0 +1,729 @@
+#ifndef _SUPER_TEXTURE_H_
+#define _SUPER_TEXTURE_H_
+#include "stdafx.h"
+
+#include <stddef.h>
+
+#include "texture_format.h"
+#include "bc_compress.h"
+#include "file_map.h"
+#include "huffman.h"
+
+/// ============ SUPER TEXTURES ============ ///
+// One compact file per texture (.stex) that turns into block compressed levels at load time
+//   faster than its JPEG decodes (2x for BC7 and BC5, 4x for BC4 on the Remington maps), and
+//   without the mips and block compression a JPEG would still need.
+// The blocks are the ones the cooker made for the texture's usage (BC1, BC4, BC5 or mode 6
+//   BC7), taken apart into fields and entropy coded:
+//   endpoints  every endpoint field of a block as one byte, minus the same field of the block
+//              to the left (above, in the first column), which smooth textures make mostly 0
+//   selectors  the per-pixel indices, repacked so a byte holds whole indices
+//   p-bits     BC7 only
+// Each stream of a level is one Huffman chunk (see huffman.h), so a level decodes on its own.
+//
+// transcode_super_texture rebuilds the blocks of a level in:
+//   - the format they were cooked in, exactly the blocks the .dds would have had
+//   - BC1, from BC7: endpoints rounded to 565, indices to the nearest of BC1's four weights,
+//     for GPUs without BC7; alpha is lost
+//   - BC4 and BC5, from BC7: the red (and green) endpoints as they are, indices to the nearest
+//     of BC4's eight weights; BC4 from BC5 is its red half
+//   - RGBA8, from anything: what sampling the blocks would return
+// So a BC7 .stex is the one file for every GPU format, within 2-7 dB of cooking that format
+//   directly. Normal maps still get cooked as BC5 and only go on to BC4 or RGBA8: mode 6 fits
+//   all channels to one line, which costs them 8 dB in BC7 already and 10 dB after going to BC5.
+//
+// With SSE2 (see bc_compress.h, bc_disable_sse turns it off the same way) undoing the endpoint
+//   prediction runs 16 bytes at a time and BC7 to RGBA8 builds its palette 8 channels a multiply,
+//   which makes RGBA8 3x faster. The Huffman decode is about half of every other transcode and
+//   stays scalar, the index remapping is one table lookup per two indices.
+//
+//   Stex_Header
+//   per level: uint32 size of each stream's chunk, then the chunks
+
+#define STEX_MAGIC       0x58455453 // "STEX"
+#define STEX_VERSION     1
+#define STEX_MAX_LEVELS  16
+#define STEX_NUM_STREAMS 3
+
+struct Stex_Header
+{
+    uint magic;
+    uint version;
+    uint format; // Texture_Format of the blocks
+    uint width;
+    uint height;
+    uint num_levels;
+    uint level_offsets[STEX_MAX_LEVELS + 1]; // level i is [level_offsets[i], level_offsets[i + 1]) in the file
+};
+
+enum Stex_Stream {
+    STEX_STREAM_ENDPOINTS,
+    STEX_STREAM_SELECTORS,
+    STEX_STREAM_PBITS,
+};
+
+// Bytes every block has in each stream, false for formats this can't store.
+static bool get_stex_stream_bytes(Texture_Format format, uint bytes[STEX_NUM_STREAMS])
+{
+    switch (format)
+    {
+        case TEXTURE_FORMAT_BC1:
+        case TEXTURE_FORMAT_BC1_SRGB: bytes[0] = 6; bytes[1] = 4; bytes[2] = 0; return true;   // 565 565 | 2 bit indices
+        case TEXTURE_FORMAT_BC4:      bytes[0] = 2; bytes[1] = 8; bytes[2] = 0; return true;   // 8 8 | two 3 bit indices a byte
+        case TEXTURE_FORMAT_BC5:      bytes[0] = 4; bytes[1] = 16; bytes[2] = 0; return true;  // BC4 twice
+        case TEXTURE_FORMAT_BC7:
+        case TEXTURE_FORMAT_BC7_SRGB: bytes[0] = 8; bytes[1] = 8; bytes[2] = 1; return true;   // 7 bits RGBA x2 | 4 bit indices | 2 p-bits
+        default:                      return false;
+    }
+}
+
+static inline uint64_t read_stex_u64(const uchar *bytes)
+{
+    uint64_t value;
+    memcpy(&value, bytes, sizeof(value));
+    return value;
+}
+
+static inline void write_stex_u64(uchar *bytes, uint64_t value)
+{
+    memcpy(bytes, &value, sizeof(value));
+}
+
+/// ===== Blocks <-> fields =====
+// BC4 keeps 16 3 bit indices in 48 bits, the stream has them two to a byte.
+static void split_bc4_block(const uchar *block, uchar *endpoints, uchar *selectors)
+{
+    endpoints[0] = block[0];
+    endpoints[1] = block[1];
+    uint64_t indices = read_stex_u64(block) >> 16;
+    for (auto i = 0; i != 8; ++i)
+        selectors[i] = (uchar)((indices >> (i * 6)) & 0x3F);
+}
+
+static void join_bc4_block(const uchar *endpoints, const uchar *selectors, uchar *block)
+{
+    uint64_t indices = 0;
+    for (auto i = 0; i != 8; ++i)
+        indices |= (uint64_t)selectors[i] << (i * 6);
+    write_stex_u64(block, endpoints[0] | ((uint64_t)endpoints[1] << 8) | (indices << 16));
+}
+
+// Mode 6 is 7 mode bits, 8 7 bit endpoint values (R0 R1 G0 G1 B0 B1 A0 A1), 2 p-bits and 16
+//   indices of which the first has 3 bits, which fits two 64 bit halves neatly.
+static bool split_bc7_block(const uchar *block, uchar *endpoints, uchar *selectors, uchar *pbits)
+{
+    uint64_t lo = read_stex_u64(block), hi = read_stex_u64(block + 8);
+    if ((lo & 0x7F) != (1 << 6))
+        return false;
+
+    for (auto f = 0; f != 8; ++f)
+        endpoints[f] = (uchar)((lo >> (7 + f * 7)) & 0x7F);
+    pbits[0] = (uchar)((lo >> 63) | ((hi & 1) << 1));
+
+    // The first index gets a zero top bit, so every index is a nibble.
+    uint64_t indices = hi >> 1;
+    write_stex_u64(selectors, (indices & 7) | ((indices & ~(uint64_t)7) << 1));
+    return true;
+}
+
+static void join_bc7_block(const uchar *endpoints, const uchar *selectors, const uchar *pbits, uchar *block)
+{
+    uint64_t lo = 1 << 6;
+    for (auto f = 0; f != 8; ++f)
+        lo |= (uint64_t)endpoints[f] << (7 + f * 7);
+    lo |= (uint64_t)(pbits[0] & 1) << 63;
+
+    uint64_t nibbles = read_stex_u64(selectors);
+    uint64_t indices = (nibbles & 7) | ((nibbles >> 1) & ~(uint64_t)7);
+    write_stex_u64(block, lo);
+    write_stex_u64(block + 8, ((pbits[0] >> 1) & 1) | (indices << 1));
+}
+
+static bool split_stex_block(Texture_Format format, const uchar *block, uchar *endpoints, uchar *selectors, uchar *pbits)
+{
+    switch (format)
+    {
+        case TEXTURE_FORMAT_BC1:
+        case TEXTURE_FORMAT_BC1_SRGB:
+            for (auto e = 0; e != 2; ++e)
+            {
+                uint color = block[e * 2] | (block[e * 2 + 1] << 8);
+                endpoints[e * 3 + 0] = (uchar)(color >> 11);
+                endpoints[e * 3 + 1] = (uchar)((color >> 5) & 0x3F);
+                endpoints[e * 3 + 2] = (uchar)(color & 0x1F);
+            }
+            memcpy(selectors, block + 4, 4);
+            return true;
+
+        case TEXTURE_FORMAT_BC4:
+            split_bc4_block(block, endpoints, selectors);
+            return true;
+
+        case TEXTURE_FORMAT_BC5:
+            split_bc4_block(block, endpoints, selectors);
+            split_bc4_block(block + 8, endpoints + 2, selectors + 8);
+            return true;
+
+        case TEXTURE_FORMAT_BC7:
+        case TEXTURE_FORMAT_BC7_SRGB:
+            return split_bc7_block(block, endpoints, selectors, pbits);
+
+        default:
+            return false;
+    }
+}
+
+static void join_stex_block(Texture_Format format, const uchar *endpoints, const uchar *selectors, const uchar *pbits, uchar *block)
+{
+    switch (format)
+    {
+        case TEXTURE_FORMAT_BC1:
+        case TEXTURE_FORMAT_BC1_SRGB:
+            for (auto e = 0; e != 2; ++e)
+            {
+                uint color = (endpoints[e * 3] << 11) | (endpoints[e * 3 + 1] << 5) | endpoints[e * 3 + 2];
+                block[e * 2] = (uchar)color;
+                block[e * 2 + 1] = (uchar)(color >> 8);
+            }
+            memcpy(block + 4, selectors, 4);
+            break;
+
+        case TEXTURE_FORMAT_BC4:
+            join_bc4_block(endpoints, selectors, block);
+            break;
+
+        case TEXTURE_FORMAT_BC5:
+            join_bc4_block(endpoints, selectors, block);
+            join_bc4_block(endpoints + 2, selectors + 8, block + 8);
+            break;
+
+        case TEXTURE_FORMAT_BC7:
+        case TEXTURE_FORMAT_BC7_SRGB:
+            join_bc7_block(endpoints, selectors, pbits, block);
+            break;
+
+        default:
+            break;
+    }
+}
+
+/// ===== BC7 -> BC1, BC4, BC5 and RGBA8 =====
+// BC7 index -> BC1 index with the nearest weight (0, 1/3, 2/3, 1 of the way to the second
+//   endpoint are BC1 indices 0, 2, 3, 1), for a byte of two BC7 indices at a time. The second
+//   table is for when the BC1 endpoints had to be swapped to stay in 4 color mode.
+static uchar stex_bc7_to_bc1[2][256];
+// Same for BC4's eight values (0, 1/7 ... 6/7, 1 are indices 0, 2 ... 7, 1), two 3 bit indices a byte.
+static uchar stex_bc7_to_bc4[2][256];
+// Pairs of BC7 weights, each repeated for the four channels, for decode_stex_bc7.
+static int16_t stex_bc7_weight_lanes[8][8];
+
+// Filled once by a local static's initializer, like init_mip_tables, so transcodes on several
+//   threads can all call it.
+static void init_stex_tables()
+{
+    static bool initialized = []() {
+        const uchar nearest[4] = { 0, 2, 3, 1 };
+        for (auto swap = 0; swap != 2; ++swap)
+        {
+            for (auto pair = 0; pair != 256; ++pair)
+            {
+                uchar bc1 = 0, bc4 = 0;
+                for (auto n = 0; n != 2; ++n)
+                {
+                    int weight = bc7_weights4[(pair >> (n * 4)) & 0xF];
+                    int third = (weight * 3 + 32) >> 6;
+                    bc1 |= nearest[swap ? 3 - third : third] << (n * 2);
+
+                    int seventh = (weight * 7 + 32) >> 6;
+                    seventh = swap ? 7 - seventh : seventh;
+                    bc4 |= ((seventh == 0) ? 0 : (seventh == 7) ? 1 : seventh + 1) << (n * 3);
+                }
+                stex_bc7_to_bc1[swap][pair] = bc1;
+                stex_bc7_to_bc4[swap][pair] = bc4;
+            }
+        }
+        for (auto w = 0; w != 16; ++w)
+            for (auto k = 0; k != 4; ++k)
+                stex_bc7_weight_lanes[w / 2][(w & 1) * 4 + k] = (int16_t)bc7_weights4[w];
+        return true;
+    }();
+    (void)initialized;
+}
+
+static inline uint pack_stex_565(const int *color)
+{
+    return (uint)(((color[0] * 31 + 127) / 255) << 11 | ((color[1] * 63 + 127) / 255) << 5 | ((color[2] * 31 + 127) / 255));
+}
+
+static void transcode_bc7_to_bc1(const uchar *endpoints, const uchar *selectors, const uchar *pbits, uchar *block)
+{
+    int c[2][3];
+    for (auto e = 0; e != 2; ++e)
+        for (auto k = 0; k != 3; ++k)
+            c[e][k] = (endpoints[k * 2 + e] << 1) | ((pbits[0] >> e) & 1);
+
+    uint c0 = pack_stex_565(c[0]), c1 = pack_stex_565(c[1]);
+    uint bits = 0;
+    if (c0 != c1)
+    {
+        // BC1 is in 4 color mode only while the first endpoint is the larger one.
+        int swap = c0 < c1;
+        for (auto i = 0; i != 8; ++i)
+            bits |= (uint)stex_bc7_to_bc1[swap][selectors[i]] << (i * 4);
+        if (swap)
+        {
+            uint t = c0;
+            c0 = c1;
+            c1 = t;
+        }
+    }
+
+    block[0] = (uchar)c0;
+    block[1] = (uchar)(c0 >> 8);
+    block[2] = (uchar)c1;
+    block[3] = (uchar)(c1 >> 8);
+    memcpy(block + 4, &bits, 4);
+}
+
+// One channel of the BC7 block as a BC4 block, with the endpoints it had in BC7 (7 bits and the
+//   p-bit). BC4 only has 8 values between them while the first endpoint is the larger one.
+static void transcode_bc7_to_bc4(const uchar *endpoints, const uchar *selectors, const uchar *pbits, uint channel, uchar *block)
+{
+    uint e0 = (endpoints[channel * 2] << 1) | (pbits[0] & 1);
+    uint e1 = (endpoints[channel * 2 + 1] << 1) | ((pbits[0] >> 1) & 1);
+
+    uint64_t indices = 0;
+    if (e0 != e1)
+    {
+        int swap = e0 < e1;
+        for (auto i = 0; i != 8; ++i)
+            indices |= (uint64_t)stex_bc7_to_bc4[swap][selectors[i]] << (i * 6);
+        if (swap)
+        {
+            uint t = e0;
+            e0 = e1;
+            e1 = t;
+        }
+    }
+    write_stex_u64(block, e0 | (e1 << 8) | (indices << 16));
+}
+
+// Same math as decode_bc7_block, straight from the fields. SSE2 works out two palette entries
+//   per multiply, four channels each.
+static void decode_stex_bc7(const uchar *endpoints, const uchar *selectors, const uchar *pbits, uchar *pixels)
+{
+    int c[2][4];
+    for (auto e = 0; e != 2; ++e)
+        for (auto k = 0; k != 4; ++k)
+            c[e][k] = (endpoints[k * 2 + e] << 1) | ((pbits[0] >> e) & 1);
+
+    uint palette[16];
+#if BC_USE_SSE
+    if (!bc_disable_sse)
+    {
+        __m128i c0 = _mm_set_epi16(c[0][3], c[0][2], c[0][1], c[0][0], c[0][3], c[0][2], c[0][1], c[0][0]);
+        __m128i c1 = _mm_set_epi16(c[1][3], c[1][2], c[1][1], c[1][0], c[1][3], c[1][2], c[1][1], c[1][0]);
+        __m128i c1_minus_c0 = _mm_sub_epi16(c1, c0);
+        __m128i c0_scaled = _mm_add_epi16(_mm_slli_epi16(c0, 6), _mm_set1_epi16(32));
+        for (auto w = 0; w != 16; w += 4)
+        {
+            // (64 - w) * c0 + w * c1 + 32 is c0 * 64 + 32 + w * (c1 - c0), which stays in 16 bits.
+            __m128i w01 = _mm_loadu_si128((const __m128i *)stex_bc7_weight_lanes[w / 2]);
+            __m128i w23 = _mm_loadu_si128((const __m128i *)stex_bc7_weight_lanes[w / 2 + 1]);
+            __m128i p01 = _mm_srai_epi16(_mm_add_epi16(c0_scaled, _mm_mullo_epi16(w01, c1_minus_c0)), 6);
+            __m128i p23 = _mm_srai_epi16(_mm_add_epi16(c0_scaled, _mm_mullo_epi16(w23, c1_minus_c0)), 6);
+            _mm_storeu_si128((__m128i *)&palette[w], _mm_packus_epi16(p01, p23));
+        }
+    }
+    else
+#endif
+    {
+        for (auto w = 0; w != 16; ++w)
+        {
+            uchar entry[4];
+            for (auto k = 0; k != 4; ++k)
+                entry[k] = (uchar)(((64 - bc7_weights4[w]) * c[0][k] + bc7_weights4[w] * c[1][k] + 32) >> 6);
+            memcpy(&palette[w], entry, 4);
+        }
+    }
+
+    for (auto i = 0; i != 8; ++i)
+    {
+        memcpy(pixels + i * 8, &palette[selectors[i] & 0xF], 4);
+        memcpy(pixels + i * 8 + 4, &palette[selectors[i] >> 4], 4);
+    }
+}
+
+// row[i] += row[i - n] along a row of endpoint fields, n bytes a block, from the first block on.
+//   With SSE2 and n of 2, 4 or 8, 16 bytes at a time: adding the vector to itself shifted by n,
+//   2n... bytes sums every field over the blocks before it in the vector, and the last block's
+//   sums from the vector before go on top of all of them.
+static void undo_stex_row_prediction(uchar *row, size_t row_bytes, uint n)
+{
+    size_t i = n;
+#if BC_USE_SSE
+    if (!bc_disable_sse && (n == 2 || n == 4 || n == 8))
+    {
+        __m128i carry = _mm_setzero_si128();
+        for (i = 0; i + 16 <= row_bytes; i += 16)
+        {
+            __m128i x = _mm_loadu_si128((const __m128i *)(row + i));
+            switch (n)
+            {
+                case 2: x = _mm_add_epi8(x, _mm_slli_si128(x, 2)); // fall through
+                case 4: x = _mm_add_epi8(x, _mm_slli_si128(x, 4)); // fall through
+                default: x = _mm_add_epi8(x, _mm_slli_si128(x, 8));
+            }
+            x = _mm_add_epi8(x, carry);
+            _mm_storeu_si128((__m128i *)(row + i), x);
+
+            switch (n)
+            {
+                case 2: carry = _mm_shuffle_epi32(_mm_shufflehi_epi16(x, 0xFF), 0xFF); break;
+                case 4: carry = _mm_shuffle_epi32(x, 0xFF); break;
+                default: carry = _mm_unpackhi_epi64(x, x); break;
+            }
+        }
+        i = (i < n) ? n : i;
+    }
+#endif
+    for (; i < row_bytes; ++i)
+        row[i] += row[i - n];
+}
+
+/// ============ WRITING ============ ///
+// Every level's blocks in format, like write_dds takes them. NULL if a block can't be stored
+//   (BC7 other than mode 6, or a format without a layout), otherwise free the result.
+uchar *encode_super_texture(Texture_Format format, uint width, uint height, const void **levels, uint num_levels, size_t *out_size)
+{
+    uint stream_bytes[STEX_NUM_STREAMS];
+    if (!get_stex_stream_bytes(format, stream_bytes) || num_levels > STEX_MAX_LEVELS)
+        return NULL;
+    uint block_bytes = get_texture_format_bytes(format);
+
+    size_t capacity = sizeof(Stex_Header);
+    for (auto l = 0; l != num_levels; ++l)
+    {
+        size_t num_blocks = get_texture_level_size(format, get_mip_dimension(width, l), get_mip_dimension(height, l)) / block_bytes;
+        for (auto s = 0; s != STEX_NUM_STREAMS; ++s)
+            capacity += sizeof(uint) + get_huffman_bound(num_blocks * stream_bytes[s]);
+    }
+
+    uchar *file = (uchar *)malloc(capacity);
+    Stex_Header header = {};
+    header.magic = STEX_MAGIC;
+    header.version = STEX_VERSION;
+    header.format = format;
+    header.width = width;
+    header.height = height;
+    header.num_levels = num_levels;
+
+    size_t offset = sizeof(Stex_Header);
+    bool result = true;
+    for (auto l = 0; l != num_levels && result; ++l)
+    {
+        header.level_offsets[l] = (uint)offset;
+
+        uint blocks_x = (get_mip_dimension(width, l) + 3) / 4;
+        uint blocks_y = (get_mip_dimension(height, l) + 3) / 4;
+        size_t num_blocks = (size_t)blocks_x * blocks_y;
+        uchar *streams[STEX_NUM_STREAMS];
+        for (auto s = 0; s != STEX_NUM_STREAMS; ++s)
+            streams[s] = (uchar *)malloc(num_blocks * stream_bytes[s] + 1);
+
+        for (size_t b = 0; b != num_blocks && result; ++b)
+        {
+            auto block = (const uchar *)levels[l] + b * block_bytes;
+            result = split_stex_block(format, block, streams[0] + b * stream_bytes[0], streams[1] + b * stream_bytes[1], streams[2] + b * stream_bytes[2]);
+        }
+
+        // Endpoints as the difference to their neighbor, backwards so the neighbors are still intact.
+        uint n = stream_bytes[0];
+        for (size_t b = num_blocks - 1; result && b != 0; --b)
+        {
+            size_t neighbor = (b % blocks_x) ? b - 1 : b - blocks_x;
+            for (auto f = 0; f != n; ++f)
+                streams[0][b * n + f] -= streams[0][neighbor * n + f];
+        }
+
+        uint sizes[STEX_NUM_STREAMS];
+        size_t sizes_offset = offset;
+        offset += sizeof(sizes);
+        for (auto s = 0; s != STEX_NUM_STREAMS && result; ++s)
+        {
+            sizes[s] = (uint)encode_huffman(streams[s], num_blocks * stream_bytes[s], file + offset);
+            offset += sizes[s];
+        }
+        memcpy(file + sizes_offset, sizes, sizeof(sizes));
+
+        for (auto s = 0; s != STEX_NUM_STREAMS; ++s)
+            free(streams[s]);
+    }
+    header.level_offsets[num_levels] = (uint)offset;
+    memcpy(file, &header, sizeof(header));
+
+    if (!result)
+    {
+        free(file);
+        return NULL;
+    }
+    *out_size = offset;
+    return file;
+}
+
+bool write_super_texture(const char *path, Texture_Format format, uint width, uint height, const void **levels, uint num_levels)
+{
+    size_t size;
+    uchar *data = encode_super_texture(format, width, height, levels, num_levels, &size);
+    if (!data)
+    {
+        LOGF("%s can't be stored in %s.\n", get_texture_format_name(format), path);
+        return false;
+    }
+
+    FILE *file = fopen(path, "wb");
+    if (!file)
+    {
+        LOGF("Failed to open %s for writing.\n", path);
+        free(data);
+        return false;
+    }
+
+    bool result = fwrite(data, 1, size, file) == size;
+    fclose(file);
+    free(data);
+
+    if (!result)
+        LOGF("Failed to write %s.\n", path);
+    return result;
+}
+
+/// ============ READING ============ ///
+struct Super_Texture
+{
+    Mapped_File file;
+    const uchar *data;
+    size_t size;
+    Texture_Format format;
+    uint width;
+    uint height;
+    uint num_levels;
+};
+
+// Checks the header of a .stex that's already in memory (e.g. a view into a pack, see pack.h).
+//   data has to outlive it. name is only for the log.
+bool open_super_texture_memory(Super_Texture *it, const void *data, size_t size, const char *name)
+{
+    ZeroThat(it);
+
+    Stex_Header header;
+    uint stream_bytes[STEX_NUM_STREAMS];
+    if (size < sizeof(header))
+    {
+        LOGF("Not a super texture: %s\n", name);
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+
+    if (header.magic != STEX_MAGIC || header.version != STEX_VERSION || header.num_levels > STEX_MAX_LEVELS ||
+        !get_stex_stream_bytes((Texture_Format)header.format, stream_bytes))
+    {
+        LOGF("Not a super texture, or an unsupported one: %s\n", name);
+        return false;
+    }
+
+    for (auto l = 0; l != header.num_levels; ++l)
+    {
+        if (header.level_offsets[l] > header.level_offsets[l + 1] || header.level_offsets[l + 1] > size)
+        {
+            LOGF("Mip %d is out of bounds: %s\n", l, name);
+            return false;
+        }
+    }
+
+    it->data = (const uchar *)data;
+    it->size = size;
+    it->format = (Texture_Format)header.format;
+    it->width = header.width;
+    it->height = header.height;
+    it->num_levels = header.num_levels;
+    return true;
+}
+
+// Maps a .stex file until close_super_texture.
+bool open_super_texture(Super_Texture *it, const char *path)
+{
+    Mapped_File file;
+    if (!map_file(&file, path))
+        return false;
+
+    if (!open_super_texture_memory(it, file.data, file.size, path))
+    {
+        unmap_file(&file);
+        return false;
+    }
+
+    it->file = file;
+    return true;
+}
+
+void close_super_texture(Super_Texture *it)
+{
+    unmap_file(&it->file);
+    ZeroThat(it);
+}
+
+static inline Texture_Format get_linear_format(Texture_Format format)
+{
+    switch (format)
+    {
+        case TEXTURE_FORMAT_RGBA8_SRGB: return TEXTURE_FORMAT_RGBA8;
+        case TEXTURE_FORMAT_BC1_SRGB:   return TEXTURE_FORMAT_BC1;
+        case TEXTURE_FORMAT_BC3_SRGB:   return TEXTURE_FORMAT_BC3;
+        case TEXTURE_FORMAT_BC7_SRGB:   return TEXTURE_FORMAT_BC7;
+        default:                        return format;
+    }
+}
+
+// Formats a level can come out in. The sRGB flag is the caller's business, only the layout counts.
+bool can_transcode_super_texture(Texture_Format source, Texture_Format target)
+{
+    source = get_linear_format(source);
+    target = get_linear_format(target);
+    if (target == source || target == TEXTURE_FORMAT_RGBA8)
+        return true;
+    if (source == TEXTURE_FORMAT_BC7)
+        return target == TEXTURE_FORMAT_BC1 || target == TEXTURE_FORMAT_BC4 || target == TEXTURE_FORMAT_BC5;
+    return source == TEXTURE_FORMAT_BC5 && target == TEXTURE_FORMAT_BC4;
+}
+
+// Rebuilds level into out, row_pitch bytes from one row of blocks (or pixels, for RGBA8) to the
+//   next, 0 for tightly packed. Needs get_texture_level_size(target, ...) bytes when packed.
+bool transcode_super_texture(const Super_Texture *it, uint level, Texture_Format target, void *out, size_t row_pitch = 0)
+{
+    if (level >= it->num_levels || !can_transcode_super_texture(it->format, target))
+        return false;
+    init_stex_tables();
+
+    Stex_Header header;
+    memcpy(&header, it->data, sizeof(header));
+    const uchar *chunk = it->data + header.level_offsets[level];
+    const uchar *level_end = it->data + header.level_offsets[level + 1];
+
+    uint level_width = get_mip_dimension(it->width, level), level_height = get_mip_dimension(it->height, level);
+    uint blocks_x = (level_width + 3) / 4, blocks_y = (level_height + 3) / 4;
+    size_t num_blocks = (size_t)blocks_x * blocks_y;
+
+    uint stream_bytes[STEX_NUM_STREAMS];
+    if (!get_stex_stream_bytes(it->format, stream_bytes))
+        return false;
+
+    size_t total = 0;
+    for (auto s = 0; s != STEX_NUM_STREAMS; ++s)
+        total += num_blocks * stream_bytes[s];
+    uchar *streams[STEX_NUM_STREAMS];
+    streams[0] = (uchar *)malloc(total + 1);
+    streams[1] = streams[0] + num_blocks * stream_bytes[0];
+    streams[2] = streams[1] + num_blocks * stream_bytes[1];
+
+    bool result = level_end - chunk >= (ptrdiff_t)(STEX_NUM_STREAMS * sizeof(uint));
+    uint sizes[STEX_NUM_STREAMS] = {};
+    if (result)
+    {
+        memcpy(sizes, chunk, sizeof(sizes));
+        chunk += sizeof(sizes);
+    }
+    for (auto s = 0; s != STEX_NUM_STREAMS && result; ++s)
+    {
+        result = sizes[s] <= level_end - chunk && decode_huffman(chunk, sizes[s], streams[s], num_blocks * stream_bytes[s]);
+        chunk += sizes[s];
+    }
+    if (!result)
+    {
+        free(streams[0]);
+        return false;
+    }
+
+    Texture_Format source = get_linear_format(it->format);
+    target = get_linear_format(target);
+    uint target_bytes = (target == TEXTURE_FORMAT_RGBA8) ? 4 : get_texture_format_bytes(target);
+    if (!row_pitch)
+        row_pitch = (target == TEXTURE_FORMAT_RGBA8) ? (size_t)level_width * 4 : (size_t)blocks_x * target_bytes;
+
+    // Undo the prediction first, one running sum per field along each row, so the loops below
+    //   don't have to care.
+    uint n = stream_bytes[0];
+    size_t row_bytes = (size_t)blocks_x * n;
+    for (uint by = 0; by != blocks_y; ++by)
+    {
+        uchar *row = streams[0] + row_bytes * by;
+        if (by)
+            for (auto f = 0; f != n; ++f)
+                row[f] += row[f - row_bytes];
+        undo_stex_row_prediction(row, row_bytes, n);
+    }
+
+    for (uint by = 0; by != blocks_y; ++by)
+    {
+        size_t first = (size_t)by * blocks_x;
+        const uchar *endpoints = streams[0] + first * n;
+        const uchar *selectors = streams[1] + first * stream_bytes[1];
+        const uchar *pbits = streams[2] + first * stream_bytes[2];
+        uchar *blocks = (uchar *)out + row_pitch * by;
+
+        if (target == source)
+        {
+            for (uint bx = 0; bx != blocks_x; ++bx)
+                join_stex_block(source, endpoints + bx * n, selectors + bx * stream_bytes[1], pbits + bx * stream_bytes[2], blocks + (size_t)bx * target_bytes);
+        }
+        else if (target == TEXTURE_FORMAT_BC1)
+        {
+            for (uint bx = 0; bx != blocks_x; ++bx)
+                transcode_bc7_to_bc1(endpoints + bx * n, selectors + bx * stream_bytes[1], pbits + bx * stream_bytes[2], blocks + (size_t)bx * target_bytes);
+        }
+        else if (target == TEXTURE_FORMAT_BC4 || target == TEXTURE_FORMAT_BC5)
+        {
+            // Red (and green) of BC7, or the red half of BC5.
+            for (uint bx = 0; bx != blocks_x; ++bx)
+            {
+                uchar *block = blocks + (size_t)bx * target_bytes;
+                if (source == TEXTURE_FORMAT_BC5)
+                {
+                    join_bc4_block(endpoints + bx * n, selectors + bx * stream_bytes[1], block);
+                    continue;
+                }
+                for (auto channel = 0; channel != target_bytes / 8; ++channel)
+                    transcode_bc7_to_bc4(endpoints + bx * n, selectors + bx * stream_bytes[1], pbits + bx * stream_bytes[2], channel, block + channel * 8);
+            }
+        }
+        else
+        {
+            for (uint bx = 0; bx != blocks_x; ++bx)
+            {
+                uchar pixels[64];
+                if (source == TEXTURE_FORMAT_BC7)
+                {
+                    decode_stex_bc7(endpoints + bx * n, selectors + bx * stream_bytes[1], pbits + bx * stream_bytes[2], pixels);
+                }
+                else
+                {
+                    uchar block[16];
+                    join_stex_block(source, endpoints + bx * n, selectors + bx * stream_bytes[1], pbits + bx * stream_bytes[2], block);
+                    decode_texture_block(source, block, pixels);
+                }
+
+                // Edge blocks hang over the level, only the pixels inside get written.
+                for (uint y = 0; y != 4 && by * 4 + y < level_height; ++y)
+                {
+                    uint count = (bx * 4 + 4 <= level_width) ? 4 : level_width - bx * 4;
+                    memcpy((uchar *)out + row_pitch * (by * 4 + y) + (size_t)bx * 16, pixels + y * 16, count * 4);
+                }
+            }
+        }
+    }
+
+    free(streams[0]);
+    return true;
+}
+
+#endif
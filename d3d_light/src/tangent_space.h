@@ -0,0 +1,387 @@
+#ifndef _TANGENT_SPACE_H_
+#define _TANGENT_SPACE_H_
+#include "stdafx.h"
+
+#include <math.h>
+#include <atomic>
+#include <thread>
+
+#include "mesh_common.h"
+
+/// ============ TANGENT SPACE ============ ///
+// Per-vertex tangents for normal mapping, following what MikkTSpace (what bakers use) does:
+//   - every triangle's tangent comes from its UV derivatives, and its UV winding says whether
+//     the bitangent is cross(normal, tangent) or the opposite (tangent[3] is +1 or -1)
+//   - every corner projects that tangent onto its vertex normal's plane and weighs it by the
+//     angle of the triangle at that corner
+//   - corners are grouped by the value of their vertex (position, normal and UV), not its index,
+//     so meshes with a vertex per face corner still come out smooth, and by UV winding, so
+//     mirrored UVs don't average into nothing
+//   - a vertex whose triangles disagree on the winding is split in two
+// What's left out of MikkTSpace is splitting groups at sharp tangent discontinuities and
+//   tracking the bitangent's magnitude, neither of which the shader uses.
+//
+// Triangles are spread over threads, each writing only its own corners. Groups then sum their
+//   corners in index order, also spread over threads, so the output is bitwise the same for any
+//   number of threads. Finding the groups is hashing split into fixed partitions for the same reason.
+
+#define TANGENT_JOB_SIZE             4096   // triangles, vertices or groups per job
+#define TANGENT_DEGENERATE_AREA      1e-20f // twice the UV area below which a triangle has no tangent
+#define TANGENT_HASH_PARTITIONS      64     // fixed, so the grouping doesn't depend on the thread count
+#define TANGENT_HASH_PARTITION_SHIFT 26     // 32 - log2(TANGENT_HASH_PARTITIONS)
+
+#define TANGENT_ORIENT_NEGATIVE 0
+#define TANGENT_ORIENT_POSITIVE 1
+#define TANGENT_ORIENT_ANY      2 // degenerate UVs, joins whatever group its vertex is in
+
+static inline float tangent_dot(const float *a, const float *b)
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static inline float tangent_normalize(float *v)
+{
+    float length = sqrtf(tangent_dot(v, v));
+    if (length > 0.0f)
+    {
+        v[0] /= length;
+        v[1] /= length;
+        v[2] /= length;
+    }
+    return length;
+}
+
+// v minus its component along the unit vector n.
+static inline void tangent_project(float *v, const float *n)
+{
+    float d = tangent_dot(v, n);
+    v[0] -= n[0] * d;
+    v[1] -= n[1] * d;
+    v[2] -= n[2] * d;
+}
+
+// Any unit vector perpendicular to n, for groups that got no tangent at all.
+static void get_fallback_tangent(const float *n, float *out)
+{
+    float axis[3] = { 0, 0, 0 };
+    axis[(fabsf(n[0]) < fabsf(n[1])) ? ((fabsf(n[0]) < fabsf(n[2])) ? 0 : 2) : ((fabsf(n[1]) < fabsf(n[2])) ? 1 : 2)] = 1.0f;
+    memcpy(out, axis, sizeof(axis));
+    tangent_project(out, n);
+    if (tangent_normalize(out) == 0.0f)
+    {
+        out[0] = 1.0f;
+        out[1] = out[2] = 0.0f;
+    }
+}
+
+// Runs job(first, end) over [0, count) in TANGENT_JOB_SIZE pieces, the calling thread included.
+template <typename Job>
+static void run_tangent_jobs(uint count, uint num_threads, Job job)
+{
+    uint num_jobs = (count + TANGENT_JOB_SIZE - 1) / TANGENT_JOB_SIZE;
+    if (num_threads > num_jobs)
+        num_threads = num_jobs;
+    if (!num_threads)
+        num_threads = 1;
+
+    std::atomic<uint> next_job(0);
+    auto worker = [&]() {
+        for (uint j; (j = next_job.fetch_add(1)) < num_jobs;)
+        {
+            uint first = j * TANGENT_JOB_SIZE;
+            job(first, (count - first > TANGENT_JOB_SIZE) ? first + TANGENT_JOB_SIZE : count);
+        }
+    };
+
+    std::thread *threads = new std::thread[num_threads - 1];
+    for (auto i = 0; i != num_threads - 1; ++i)
+        threads[i] = std::thread(worker);
+    worker();
+    for (auto i = 0; i != num_threads - 1; ++i)
+        threads[i].join();
+    delete[] threads;
+}
+
+// Angle weighted tangents of the corners of triangles [first, end), projected on the vertex normals.
+static void compute_corner_tangents(const Vertex *vertices, const uint *indices, uint first, uint end, float *tangents, uchar *orients)
+{
+    for (auto t = first; t != end; ++t)
+    {
+        const Vertex *v[3] = { &vertices[indices[t * 3]], &vertices[indices[t * 3 + 1]], &vertices[indices[t * 3 + 2]] };
+
+        float e1[3], e2[3];
+        for (auto k = 0; k != 3; ++k)
+        {
+            e1[k] = v[1]->position[k] - v[0]->position[k];
+            e2[k] = v[2]->position[k] - v[0]->position[k];
+        }
+        float s1[2] = { v[1]->texcoord[0] - v[0]->texcoord[0], v[1]->texcoord[1] - v[0]->texcoord[1] };
+        float s2[2] = { v[2]->texcoord[0] - v[0]->texcoord[0], v[2]->texcoord[1] - v[0]->texcoord[1] };
+
+        // The tangent is along +U, so mirrored triangles flip it, the area's magnitude doesn't matter.
+        float signed_area = s1[0] * s2[1] - s1[1] * s2[0];
+        float sign = (signed_area < 0.0f) ? -1.0f : 1.0f;
+        float face_tangent[3];
+        for (auto k = 0; k != 3; ++k)
+            face_tangent[k] = (e1[k] * s2[1] - e2[k] * s1[1]) * sign;
+
+        uchar orient = (signed_area > 0.0f) ? TANGENT_ORIENT_POSITIVE : TANGENT_ORIENT_NEGATIVE;
+        if (fabsf(signed_area) < TANGENT_DEGENERATE_AREA)
+            orient = TANGENT_ORIENT_ANY;
+
+        for (auto c = 0; c != 3; ++c)
+        {
+            float *out = &tangents[(t * 3 + c) * 3];
+            orients[t * 3 + c] = orient;
+            out[0] = out[1] = out[2] = 0.0f;
+            if (orient == TANGENT_ORIENT_ANY)
+                continue;
+
+            const float *n = v[c]->normal;
+            const float *p = v[c]->position;
+            const float *p_next = v[(c + 1) % 3]->position;
+            const float *p_prev = v[(c + 2) % 3]->position;
+
+            float tangent[3] = { face_tangent[0], face_tangent[1], face_tangent[2] };
+            tangent_project(tangent, n);
+            if (tangent_normalize(tangent) == 0.0f)
+                continue;
+
+            float a[3] = { p_next[0] - p[0], p_next[1] - p[1], p_next[2] - p[2] };
+            float b[3] = { p_prev[0] - p[0], p_prev[1] - p[1], p_prev[2] - p[2] };
+            tangent_project(a, n);
+            tangent_project(b, n);
+            if (tangent_normalize(a) == 0.0f || tangent_normalize(b) == 0.0f)
+                continue;
+
+            float cosine = tangent_dot(a, b);
+            float angle = acosf((cosine > 1.0f) ? 1.0f : (cosine < -1.0f) ? -1.0f : cosine);
+            out[0] = tangent[0] * angle;
+            out[1] = tangent[1] * angle;
+            out[2] = tangent[2] * angle;
+        }
+    }
+}
+
+static inline uint hash_tangent_key(const Vertex *vertex)
+{
+    // Same FNV-1a and avalanche as hash_vertex_weld_key, over position, normal and UV only.
+    uint key[8];
+    memcpy(&key[0], vertex->position, 3 * sizeof(float));
+    memcpy(&key[3], vertex->normal, 3 * sizeof(float));
+    memcpy(&key[6], vertex->texcoord, 2 * sizeof(float));
+
+    uint hash = 2166136261u;
+    for (auto k = 0; k != 8; ++k)
+    {
+        hash ^= key[k];
+        hash *= 16777619u;
+    }
+
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    return hash;
+}
+
+static inline bool is_same_tangent_key(const Vertex *a, const Vertex *b)
+{
+    return !memcmp(a->position, b->position, 3 * sizeof(float)) &&
+           !memcmp(a->normal, b->normal, 3 * sizeof(float)) &&
+           !memcmp(a->texcoord, b->texcoord, 2 * sizeof(float));
+}
+
+// Fills in every vertex's tangent. Vertices whose triangles disagree on the UV winding get a copy
+//   for the negative side, so vertices may be added and indices remapped to them.
+// num_threads == 0 uses one thread per core.
+void generate_tangents(Cpu_Mesh *it, uint num_threads = 0)
+{
+    uint num_vertices = it->num_vertices;
+    uint num_corners = it->num_indices;
+    uint num_triangles = num_corners / 3;
+    if (!num_vertices || !num_triangles)
+        return;
+
+    if (!num_threads)
+        num_threads = std::thread::hardware_concurrency();
+    if (!num_threads) // hardware_concurrency doesn't always know
+        num_threads = 1;
+
+    /// 1. Corners.
+    float *corner_tangents = (float *)malloc((size_t)num_corners * 3 * sizeof(float));
+    uchar *corner_orients = (uchar *)malloc(num_corners);
+    run_tangent_jobs(num_triangles, num_threads, [&](uint first, uint end) {
+        compute_corner_tangents(it->vertices, it->indices, first, end, corner_tangents, corner_orients);
+    });
+
+    /// 2. Classes of vertices with the same position, normal and UV.
+    // The hash range is split into a fixed number of partitions, each with its own table that its
+    //   vertices go into in index order, so every class is its lowest vertex no matter which thread
+    //   did the partition. Classes are then numbered densely in vertex order.
+    uint *hashes = (uint *)malloc(num_vertices * sizeof(uint));
+    run_tangent_jobs(num_vertices, num_threads, [&](uint first, uint end) {
+        for (auto v = first; v != end; ++v)
+            hashes[v] = hash_tangent_key(&it->vertices[v]);
+    });
+
+    uint partition_offsets[TANGENT_HASH_PARTITIONS + 1] = {};
+    for (auto v = 0; v != num_vertices; ++v)
+        ++partition_offsets[(hashes[v] >> TANGENT_HASH_PARTITION_SHIFT) + 1];
+    for (auto p = 0; p != TANGENT_HASH_PARTITIONS; ++p)
+        partition_offsets[p + 1] += partition_offsets[p];
+
+    uint *partition_vertices = (uint *)malloc(num_vertices * sizeof(uint));
+    {
+        uint fill[TANGENT_HASH_PARTITIONS];
+        memcpy(fill, partition_offsets, sizeof(fill));
+        for (auto v = 0; v != num_vertices; ++v)
+            partition_vertices[fill[hashes[v] >> TANGENT_HASH_PARTITION_SHIFT]++] = v;
+    }
+
+    uint *classes = (uint *)malloc(num_vertices * sizeof(uint)); // lowest vertex of the class for now
+    std::atomic<uint> next_partition(0);
+    auto hash_partitions = [&]() {
+        for (uint p; (p = next_partition.fetch_add(1)) < TANGENT_HASH_PARTITIONS;)
+        {
+            uint count = partition_offsets[p + 1] - partition_offsets[p];
+            uint table_size = 1;
+            while (table_size < count * 2)
+                table_size *= 2;
+
+            uint *table = (uint *)calloc(table_size, sizeof(uint)); // vertex + 1, zero means empty
+            for (auto i = partition_offsets[p]; i != partition_offsets[p + 1]; ++i)
+            {
+                uint v = partition_vertices[i];
+                for (uint bucket = hashes[v] & (table_size - 1);; bucket = (bucket + 1) & (table_size - 1))
+                {
+                    if (!table[bucket])
+                    {
+                        table[bucket] = v + 1;
+                        classes[v] = v;
+                        break;
+                    }
+                    if (is_same_tangent_key(&it->vertices[table[bucket] - 1], &it->vertices[v]))
+                    {
+                        classes[v] = table[bucket] - 1;
+                        break;
+                    }
+                }
+            }
+            free(table);
+        }
+    };
+    {
+        uint num_hash_threads = (num_threads < TANGENT_HASH_PARTITIONS) ? num_threads : TANGENT_HASH_PARTITIONS;
+        std::thread *threads = new std::thread[num_hash_threads - 1];
+        for (auto i = 0; i != num_hash_threads - 1; ++i)
+            threads[i] = std::thread(hash_partitions);
+        hash_partitions();
+        for (auto i = 0; i != num_hash_threads - 1; ++i)
+            threads[i].join();
+        delete[] threads;
+    }
+    free(partition_vertices);
+    free(hashes);
+
+    uint num_classes = 0;
+    for (auto v = 0; v != num_vertices; ++v)
+        classes[v] = (classes[v] == v) ? num_classes++ : classes[classes[v]];
+
+    /// 3. Groups are classes times the winding. Their corners, in index order, and which windings
+    //   every vertex is used with (bit per TANGENT_ORIENT_*).
+    uint num_groups = num_classes * 2;
+    uchar *vertex_orients = (uchar *)calloc(num_vertices, 1);
+    uint *group_offsets = (uint *)calloc(num_groups + 1, sizeof(uint));
+    for (auto c = 0; c != num_corners; ++c)
+    {
+        if (corner_orients[c] == TANGENT_ORIENT_ANY)
+            continue;
+        uint v = it->indices[c];
+        vertex_orients[v] |= 1 << corner_orients[c];
+        ++group_offsets[classes[v] * 2 + corner_orients[c] + 1];
+    }
+    for (auto g = 0; g != num_groups; ++g)
+        group_offsets[g + 1] += group_offsets[g];
+
+    uint *group_corners = (uint *)malloc((group_offsets[num_groups] + 1) * sizeof(uint));
+    {
+        uint *fill = (uint *)malloc(num_groups * sizeof(uint));
+        memcpy(fill, group_offsets, num_groups * sizeof(uint));
+        for (auto c = 0; c != num_corners; ++c)
+            if (corner_orients[c] != TANGENT_ORIENT_ANY)
+                group_corners[fill[classes[it->indices[c]] * 2 + corner_orients[c]]++] = c;
+        free(fill);
+    }
+
+    /// 4. Group tangents, zero for groups without any weight.
+    float *group_tangents = (float *)malloc((size_t)num_groups * 3 * sizeof(float));
+    run_tangent_jobs(num_groups, num_threads, [&](uint first, uint end) {
+        for (auto g = first; g != end; ++g)
+        {
+            float *out = &group_tangents[g * 3];
+            out[0] = out[1] = out[2] = 0.0f;
+            for (auto i = group_offsets[g]; i != group_offsets[g + 1]; ++i)
+            {
+                const float *corner = &corner_tangents[group_corners[i] * 3];
+                out[0] += corner[0];
+                out[1] += corner[1];
+                out[2] += corner[2];
+            }
+            tangent_normalize(out);
+        }
+    });
+
+    /// 5. Vertices get their positive group if they have one. The ones used with both windings
+    //   get a copy for the negative side.
+    auto set_vertex_tangent = [&](Vertex *vertex, uint group) {
+        const float *tangent = &group_tangents[group * 3];
+        if (tangent[0] == 0.0f && tangent[1] == 0.0f && tangent[2] == 0.0f)
+            get_fallback_tangent(vertex->normal, vertex->tangent);
+        else
+            memcpy(vertex->tangent, tangent, 3 * sizeof(float));
+        vertex->tangent[3] = (group & 1) ? 1.0f : -1.0f;
+    };
+    run_tangent_jobs(num_vertices, num_threads, [&](uint first, uint end) {
+        for (auto v = first; v != end; ++v)
+        {
+            uint orient = (vertex_orients[v] == (1 << TANGENT_ORIENT_NEGATIVE)) ? TANGENT_ORIENT_NEGATIVE : TANGENT_ORIENT_POSITIVE;
+            set_vertex_tangent(&it->vertices[v], classes[v] * 2 + orient);
+        }
+    });
+
+    uint num_split = 0;
+    for (auto v = 0; v != num_vertices; ++v)
+        num_split += (vertex_orients[v] == 3);
+
+    if (num_split)
+    {
+        uint *splits = (uint *)malloc(num_vertices * sizeof(uint));
+        it->vertices = (Vertex *)realloc(it->vertices, (num_vertices + num_split) * sizeof(Vertex));
+        it->num_vertices = num_vertices;
+        for (auto v = 0; v != num_vertices; ++v)
+        {
+            splits[v] = v;
+            if (vertex_orients[v] != 3)
+                continue;
+
+            splits[v] = it->num_vertices++;
+            it->vertices[splits[v]] = it->vertices[v];
+            set_vertex_tangent(&it->vertices[splits[v]], classes[v] * 2 + TANGENT_ORIENT_NEGATIVE);
+        }
+
+        for (auto c = 0; c != num_corners; ++c)
+            if (corner_orients[c] == TANGENT_ORIENT_NEGATIVE)
+                it->indices[c] = splits[it->indices[c]];
+        free(splits);
+    }
+
+    free(group_tangents);
+    free(group_corners);
+    free(group_offsets);
+    free(vertex_orients);
+    free(classes);
+    free(corner_orients);
+    free(corner_tangents);
+}
+
+#endif
@@ -0,0 +1,145 @@
+#ifndef _TEXTURE_COOK_H_
+#define _TEXTURE_COOK_H_
+#include "stdafx.h"
+
+#include <time.h>
+
+#include "image_decode.h"
+#include "mip_chain.h"
+#include "bc_compress.h"
+#include "dds.h"
+#include "super_texture.h"
+#include "material.h"
+#include "normal_map.h"
+
+/// ============ TEXTURE COOKING ============ ///
+// One image to one .dds: mips (mip_chain.h), block compression (bc_compress.h) in the format
+//   its usage asks for, and a PSNR check of level 0, an angular one for normal maps, which only
+//   keep X and Y (see normal_map.h). Shared by texture_cooker.cpp and cook.cpp.
+// An output ending in .stex gets the same blocks as a super texture (see super_texture.h) instead.
+
+#define TEXTURE_COOK_VERSION 2 // bump when the output of cook_texture changes for the same input
+
+// Channels that survive the format, for PSNR.
+static uint get_format_channel_mask(Texture_Format format)
+{
+    switch (format)
+    {
+        case TEXTURE_FORMAT_BC4: return 0x1;
+        case TEXTURE_FORMAT_BC5: return 0x3;
+        case TEXTURE_FORMAT_BC1:
+        case TEXTURE_FORMAT_BC1_SRGB: return 0x7;
+        default: return 0xF;
+    }
+}
+
+// rgba is width x height RGBA8, name is only for the log. channel_psnr gets the PSNR of each channel
+//   of level 0 on its own, for textures whose channels are separate maps.
+bool cook_texture(const uchar *rgba, uint width, uint height, Texture_Usage usage, Mip_Filter filter, const char *output, const char *name,
+                  float channel_psnr[4] = NULL)
+{
+    Texture_Format format = get_usage_format(usage);
+    clock_t clock1 = clock();
+
+    Mip_Chain chain;
+    if (!generate_mip_chain(&chain, rgba, width, height, usage, filter))
+    {
+        LOGF("Out of memory building the mips of %s\n", name);
+        return false;
+    }
+
+    const void *levels[MIP_MAX_LEVELS];
+    size_t size = 0;
+    for (auto l = 0; l != chain.num_levels; ++l)
+        size += get_texture_level_size(format, get_mip_dimension(width, l), get_mip_dimension(height, l));
+
+    uchar *blocks = (uchar *)malloc(size);
+    size_t offset = 0;
+    for (auto l = 0; l != chain.num_levels; ++l)
+    {
+        uint level_width = get_mip_dimension(width, l), level_height = get_mip_dimension(height, l);
+        compress_texture(format, get_mip_level(&chain, l), level_width, level_height, blocks + offset);
+        levels[l] = blocks + offset;
+        offset += get_texture_level_size(format, level_width, level_height);
+    }
+
+    float seconds = (float)(clock() - clock1) / (float)CLOCKS_PER_SEC;
+
+    uchar *decoded = (uchar *)malloc((size_t)width * height * 4);
+    decompress_texture(format, blocks, width, height, decoded);
+    float psnr = compute_texture_psnr(rgba, decoded, width, height, get_format_channel_mask(format));
+    if (channel_psnr)
+        for (auto c = 0; c != 4; ++c)
+            channel_psnr[c] = compute_texture_psnr(rgba, decoded, width, height, 1u << c);
+    Normal_Error normal_error = {};
+    if (usage == TEXTURE_USAGE_NORMAL)
+        normal_error = measure_normal_error(rgba, decoded, (size_t)width * height);
+    free(decoded);
+
+    const char *extension = strrchr(output, '.');
+    bool result = (extension && !strcmp(extension, ".stex")) ? write_super_texture(output, format, width, height, levels, chain.num_levels)
+                                                             : write_dds(output, format, width, height, levels, chain.num_levels);
+
+    LOGF("%s -> %s: %s, %u mips (%s), %.2f MB, %.2f dB PSNR, %.2fs CPU\n", name, output, get_texture_format_name(format),
+         chain.num_levels, get_mip_filter_name(filter), (float)size / (1024.0f * 1024.0f), psnr, seconds);
+    if (usage == TEXTURE_USAGE_NORMAL)
+        LOGF("  %.2f degrees mean, %.2f max off the source normals\n", normal_error.mean_degrees, normal_error.max_degrees);
+
+    free(blocks);
+    free_mip_chain(&chain);
+    return result;
+}
+
+// Decodes input and cooks it with the usage its name suggests.
+bool cook_texture_file(const char *input, const char *output, Mip_Filter filter = MIP_FILTER_KAISER)
+{
+    Decoded_Image image;
+    load_images(&input, 1, &image, 4, 1);
+    if (!image.pixels)
+        return false;
+
+    bool result = cook_texture(image.pixels, (uint)image.width, (uint)image.height, guess_texture_usage(input), filter, output, input);
+    stbi_image_free(image.pixels);
+    return result;
+}
+
+// Packs the AO, roughness and metallic images (in Material_Channel order) into one ORM texture
+//   laid out as ORM_DEFAULT_CHANNELS. The maps are decoded as one channel each, which for the
+//   grey JPGs they come as skips upsampling and converting the chroma planes, and every map's
+//   error after compression is logged against its own decode.
+bool cook_orm_texture_files(const char *const inputs[MATERIAL_CHANNEL_COUNT], const char *output, Mip_Filter filter = MIP_FILTER_KAISER)
+{
+    Decoded_Image images[MATERIAL_CHANNEL_COUNT];
+    load_images((const char **)inputs, MATERIAL_CHANNEL_COUNT, images, 1);
+
+    bool result = true;
+    for (auto c = 0; c != MATERIAL_CHANNEL_COUNT && result; ++c)
+    {
+        result = images[c].pixels && images[c].width == images[0].width && images[c].height == images[0].height;
+        if (!result)
+            LOGF("%s is missing or not the size of %s\n", inputs[c], inputs[0]);
+    }
+
+    if (result)
+    {
+        uint width = (uint)images[0].width, height = (uint)images[0].height;
+        const uchar *maps[MATERIAL_CHANNEL_COUNT];
+        for (auto c = 0; c != MATERIAL_CHANNEL_COUNT; ++c)
+            maps[c] = images[c].pixels;
+
+        uchar *rgba = (uchar *)malloc((size_t)width * height * 4);
+        pack_orm_texture(rgba, maps, (size_t)width * height);
+
+        float channel_psnr[4];
+        result = cook_texture(rgba, width, height, TEXTURE_USAGE_ORM, filter, output, output, channel_psnr);
+        for (auto c = 0; c != MATERIAL_CHANNEL_COUNT; ++c)
+            LOGF("  %s (%s): %.2f dB PSNR\n", get_material_channel_name((Material_Channel)c), inputs[c], channel_psnr[ORM_DEFAULT_CHANNELS[c]]);
+        free(rgba);
+    }
+
+    for (auto c = 0; c != MATERIAL_CHANNEL_COUNT; ++c)
+        stbi_image_free(images[c].pixels);
+    return result;
+}
+
+#endif
@@ -0,0 +1,356 @@
+// Offline texture cooker. Block compresses images into .dds files (see dds.h) that the
+//   runtime uploads without decoding anything.
+//
+// Usage: texture_cooker [-filter box|kaiser|lanczos] [-stex] <output directory> <image>...
+//        texture_cooker -benchmark <image>...
+//
+// The format follows from the file name: *normal* -> BC5, roughness/metallic/AO -> BC4,
+//   anything else is color -> BC7 sRGB. The output is <output directory>/<image name>.dds
+//   with a full mip chain (see mip_chain.h), or .stex with -stex (see super_texture.h).
+// -benchmark only builds the mip chains of the images with every filter and logs the throughput,
+//   times block compressing level 0 of each image on one thread with the SSE2 loops against the
+//   scalar ones (see bc_compress.h), times decoding each image alone on 1, 2, 4... threads (see jpeg_decode.h) against stbi, and
+//   times transcoding each image's super texture to every format against decoding its JPEG.
+#include "stdafx.h"
+
+#include <time.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "texture_cook.h"
+
+// <directory>/<file name without extension><extension>
+static void get_output_path(char *out, size_t size, const char *directory, const char *path, const char *output_extension)
+{
+    const char *name = path;
+    for (auto c = path; *c; ++c)
+        if (*c == '/' || *c == '\\')
+            name = c + 1;
+
+    const char *extension = strrchr(name, '.');
+    int length = extension ? (int)(extension - name) : (int)strlen(name);
+    snprintf(out, size, "%s/%.*s%s", directory, length, name, output_extension);
+}
+
+static void benchmark_mip_filters(const char **paths, const Decoded_Image *images, uint num_images)
+{
+    const Mip_Filter filters[] = { MIP_FILTER_BOX, MIP_FILTER_KAISER, MIP_FILTER_LANCZOS };
+
+    for (auto f = 0; f != sizeof(filters) / sizeof(filters[0]); ++f)
+    {
+        double megapixels = 0.0;
+        clock_t clock1 = clock();
+
+        for (auto i = 0; i != num_images; ++i)
+        {
+            if (!images[i].pixels)
+                continue;
+
+            Mip_Chain chain;
+            generate_mip_chain(&chain, images[i].pixels, images[i].width, images[i].height, guess_texture_usage(paths[i]), filters[f]);
+            free_mip_chain(&chain);
+            megapixels += (double)images[i].width * images[i].height / 1e6;
+        }
+
+        float seconds = (float)(clock() - clock1) / (float)CLOCKS_PER_SEC;
+        LOGF("%-8s %.2fs for %.1f MPix of level 0 (%.1f MPix/s)\n", get_mip_filter_name(filters[f]), seconds,
+             megapixels, megapixels / seconds);
+    }
+}
+
+// Level 0 in the format the cook picks, on one thread so it's the loops being timed and not the
+//   threading. Best of a few runs each, blocks that differ between the two are an error.
+static void benchmark_block_compression(const char **paths, const Decoded_Image *images, uint num_images)
+{
+    const int runs = 3;
+
+    for (auto i = 0; i != num_images; ++i)
+    {
+        if (!images[i].pixels)
+            continue;
+
+        uint width = (uint)images[i].width, height = (uint)images[i].height;
+        Texture_Format format = get_usage_format(guess_texture_usage(paths[i]));
+        if (!is_block_compressed(format))
+            continue;
+
+        size_t size = get_texture_level_size(format, width, height);
+        uchar *blocks[2] = { (uchar *)malloc(size), (uchar *)malloc(size) };
+        double best_ms[2] = { 1e30, 1e30 }; // SSE2, scalar
+        for (auto run = 0; run != runs; ++run)
+        {
+            for (auto scalar = 0; scalar != 2; ++scalar)
+            {
+                bc_disable_sse = scalar != 0;
+                auto start = std::chrono::steady_clock::now();
+                compress_texture(format, images[i].pixels, width, height, blocks[scalar], 1);
+                double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                best_ms[scalar] = (ms < best_ms[scalar]) ? ms : best_ms[scalar];
+            }
+        }
+        bc_disable_sse = false;
+
+        uchar *decoded = (uchar *)malloc((size_t)width * height * 4);
+        decompress_texture(format, blocks[0], width, height, decoded);
+        float psnr = compute_texture_psnr(images[i].pixels, decoded, width, height, get_format_channel_mask(format));
+        double megapixels = (double)width * height / 1e6;
+
+        LOGF("%-40s %-8s %.2f dB: SSE2 %8.2fms (%.1f MPix/s), scalar %8.2fms (%.1f MPix/s), %.2fx%s\n", paths[i],
+             get_texture_format_name(format), psnr, best_ms[0], megapixels / (best_ms[0] / 1000.0), best_ms[1],
+             megapixels / (best_ms[1] / 1000.0), best_ms[1] / best_ms[0], memcmp(blocks[0], blocks[1], size) ? " DIFFERS FROM SCALAR" : "");
+
+        free(decoded);
+        free(blocks[0]);
+        free(blocks[1]);
+    }
+}
+
+// Every image on its own with 1, 2, 4... up to one thread per core, best of a few runs each.
+//   Any output that differs from stbi_load_from_memory is an error.
+static void benchmark_jpeg_decode(const char **paths, uint num_images)
+{
+    const int runs = 3;
+    uint num_cores = std::thread::hardware_concurrency();
+    num_cores = num_cores ? num_cores : 1;
+
+    for (auto i = 0; i != num_images; ++i)
+    {
+        Mapped_File file;
+        if (!map_file(&file, paths[i]))
+            continue;
+
+        int width, height, channels;
+        stbi_uc *reference = stbi_load_from_memory((const stbi_uc *)file.data, (int)file.size, &width, &height, &channels, 4);
+        if (!reference)
+        {
+            unmap_file(&file);
+            continue;
+        }
+
+        double single_ms = 0.0;
+        for (uint num_threads = 1;; num_threads = (num_threads * 2 > num_cores && num_threads < num_cores) ? num_cores : num_threads * 2)
+        {
+            double best_ms = 1e30;
+            bool identical = true;
+            for (auto run = 0; run != runs; ++run)
+            {
+                auto start = std::chrono::steady_clock::now();
+                stbi_uc *pixels = decode_jpeg_parallel(file.data, file.size, &width, &height, &channels, 4, num_threads);
+                double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+                best_ms = (ms < best_ms) ? ms : best_ms;
+                identical = identical && pixels && !memcmp(pixels, reference, (size_t)width * height * 4);
+                stbi_image_free(pixels);
+            }
+            single_ms = (num_threads == 1) ? best_ms : single_ms;
+
+            LOGF("%-40s %2u threads %8.2fms %5.2fx%s\n", paths[i], num_threads, best_ms, single_ms / best_ms,
+                 identical ? "" : " DIFFERS FROM STBI");
+            if (num_threads >= num_cores)
+                break;
+        }
+
+        stbi_image_free(reference);
+        unmap_file(&file);
+    }
+}
+
+// Cooks every image into a super texture in memory, then times turning it back into the blocks the
+//   .dds would have (level 0 and the whole chain) against a single threaded stbi decode of the
+//   source, best of a few runs each. Sizes are for the whole chain. Then level 0 goes to every
+//   format it can, SSE2 against scalar, with the PSNR of the result against the source.
+static void benchmark_super_textures(const char **paths, const Decoded_Image *images, uint num_images)
+{
+    const int runs = 5;
+
+    for (auto i = 0; i != num_images; ++i)
+    {
+        Mapped_File file;
+        if (!images[i].pixels || !map_file(&file, paths[i]))
+            continue;
+
+        uint width = (uint)images[i].width, height = (uint)images[i].height;
+        Texture_Usage usage = guess_texture_usage(paths[i]);
+        Texture_Format format = get_usage_format(usage);
+
+        Mip_Chain chain;
+        generate_mip_chain(&chain, images[i].pixels, width, height, usage, MIP_FILTER_BOX);
+
+        const void *levels[MIP_MAX_LEVELS];
+        size_t level_offsets[MIP_MAX_LEVELS + 1] = {};
+        for (auto l = 0; l != chain.num_levels; ++l)
+            level_offsets[l + 1] = level_offsets[l] + get_texture_level_size(format, get_mip_dimension(width, l), get_mip_dimension(height, l));
+        uchar *blocks = (uchar *)malloc(level_offsets[chain.num_levels]);
+        for (auto l = 0; l != chain.num_levels; ++l)
+        {
+            compress_texture(format, get_mip_level(&chain, l), get_mip_dimension(width, l), get_mip_dimension(height, l), blocks + level_offsets[l]);
+            levels[l] = blocks + level_offsets[l];
+        }
+
+        size_t stex_size;
+        uchar *stex = encode_super_texture(format, width, height, levels, chain.num_levels, &stex_size);
+        Super_Texture texture;
+        if (!stex || !open_super_texture_memory(&texture, stex, stex_size, paths[i]))
+        {
+            LOGF("%s can't be a super texture\n", paths[i]);
+            free(stex);
+            free(blocks);
+            free_mip_chain(&chain);
+            unmap_file(&file);
+            continue;
+        }
+
+        uchar *out = (uchar *)malloc(level_offsets[chain.num_levels] + (size_t)width * height * 4);
+        double best_ms[3] = { 1e30, 1e30, 1e30 }; // JPEG, level 0, chain
+        bool identical = true;
+        for (auto run = 0; run != runs; ++run)
+        {
+            double ms[3];
+            auto start = std::chrono::steady_clock::now();
+            int decoded_width, decoded_height, channels;
+            stbi_image_free(stbi_load_from_memory((const stbi_uc *)file.data, (int)file.size, &decoded_width, &decoded_height, &channels, 4));
+            auto decoded = std::chrono::steady_clock::now();
+            transcode_super_texture(&texture, 0, format, out);
+            auto level0 = std::chrono::steady_clock::now();
+            for (auto l = 0; l != chain.num_levels; ++l)
+                transcode_super_texture(&texture, l, format, out + level_offsets[l]);
+            auto end = std::chrono::steady_clock::now();
+            identical = identical && !memcmp(out, blocks, level_offsets[chain.num_levels]);
+
+            ms[0] = std::chrono::duration<double, std::milli>(decoded - start).count();
+            ms[1] = std::chrono::duration<double, std::milli>(level0 - decoded).count();
+            ms[2] = std::chrono::duration<double, std::milli>(end - level0).count();
+            for (auto k = 0; k != 3; ++k)
+                best_ms[k] = (ms[k] < best_ms[k]) ? ms[k] : best_ms[k];
+        }
+
+        LOGF("%-40s %s: jpg %zu KB, dds %zu KB, stex %zu KB\n", paths[i], get_texture_format_name(format), file.size / 1024,
+             level_offsets[chain.num_levels] / 1024, stex_size / 1024);
+        LOGF("%-40s jpg %.2fms, stex level 0 %.2fms (%.2fx), all levels %.2fms%s\n", "", best_ms[0], best_ms[1],
+             best_ms[0] / best_ms[1], best_ms[2], identical ? "" : " DIFFERS FROM THE BLOCKS");
+
+        // Level 0 in every format it transcodes to, with the SSE2 loops and the scalar ones.
+        const Texture_Format targets[] = { TEXTURE_FORMAT_BC1, TEXTURE_FORMAT_BC4, TEXTURE_FORMAT_BC5, TEXTURE_FORMAT_BC7, TEXTURE_FORMAT_RGBA8 };
+        uchar *scalar_out = (uchar *)malloc((size_t)width * height * 4);
+        uchar *decoded = (uchar *)malloc((size_t)width * height * 4);
+        for (auto t = 0; t != sizeof(targets) / sizeof(targets[0]); ++t)
+        {
+            if (!can_transcode_super_texture(format, targets[t]))
+                continue;
+
+            size_t size = (targets[t] == TEXTURE_FORMAT_RGBA8) ? (size_t)width * height * 4 : get_texture_level_size(targets[t], width, height);
+            double target_ms[2] = { 1e30, 1e30 }; // SSE2, scalar
+            for (auto run = 0; run != runs; ++run)
+            {
+                for (auto scalar = 0; scalar != 2; ++scalar)
+                {
+                    bc_disable_sse = scalar != 0;
+                    auto start = std::chrono::steady_clock::now();
+                    transcode_super_texture(&texture, 0, targets[t], scalar ? scalar_out : out);
+                    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                    target_ms[scalar] = (ms < target_ms[scalar]) ? ms : target_ms[scalar];
+                }
+            }
+            bc_disable_sse = false;
+
+            if (targets[t] == TEXTURE_FORMAT_RGBA8)
+                memcpy(decoded, out, size);
+            else
+                decompress_texture(targets[t], out, width, height, decoded);
+            // RGBA8 only has the channels the stored blocks had.
+            Texture_Format channels = (targets[t] == TEXTURE_FORMAT_RGBA8) ? format : targets[t];
+            float psnr = compute_texture_psnr(images[i].pixels, decoded, width, height, get_format_channel_mask(channels));
+
+            LOGF("%-40s to %-5s %.2f dB: SSE2 %.2fms (%.2fx jpg), scalar %.2fms, %.2fx%s\n", "", get_texture_format_name(targets[t]), psnr,
+                 target_ms[0], best_ms[0] / target_ms[0], target_ms[1], target_ms[1] / target_ms[0],
+                 memcmp(out, scalar_out, size) ? " DIFFERS FROM SCALAR" : "");
+        }
+
+        free(decoded);
+        free(scalar_out);
+        free(out);
+        free(stex);
+        free(blocks);
+        free_mip_chain(&chain);
+        unmap_file(&file);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Mip_Filter filter = MIP_FILTER_KAISER;
+    bool benchmark = false;
+    const char *output_extension = ".dds";
+    bool bad_arguments = false;
+
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-' && !bad_arguments; ++arg)
+    {
+        if (!strcmp(argv[arg], "-benchmark"))
+            benchmark = true;
+        else if (!strcmp(argv[arg], "-stex"))
+            output_extension = ".stex";
+        else if (!strcmp(argv[arg], "-filter") && arg + 1 < argc)
+        {
+            ++arg;
+            if (!strcmp(argv[arg], "box"))
+                filter = MIP_FILTER_BOX;
+            else if (!strcmp(argv[arg], "kaiser"))
+                filter = MIP_FILTER_KAISER;
+            else if (!strcmp(argv[arg], "lanczos"))
+                filter = MIP_FILTER_LANCZOS;
+            else
+                bad_arguments = true;
+        }
+        else
+            bad_arguments = true;
+    }
+
+    if (bad_arguments || argc - arg < (benchmark ? 1 : 2))
+    {
+        printf("Usage: %s [-filter box|kaiser|lanczos] [-stex] <output directory> <image>...\n", argv[0]);
+        printf("       %s -benchmark <image>...\n", argv[0]);
+        return 1;
+    }
+
+    const char *directory = benchmark ? NULL : argv[arg++];
+    const char **paths = (const char **)&argv[arg];
+    uint num_images = (uint)(argc - arg);
+
+    Decoded_Image *images = (Decoded_Image *)calloc(num_images, sizeof(Decoded_Image));
+    Image_Decode_Stats decode_stats = load_images(paths, num_images, images);
+    log_image_decode_stats(paths, images, num_images, &decode_stats);
+
+    if (benchmark)
+    {
+        benchmark_mip_filters(paths, images, num_images);
+        benchmark_block_compression(paths, images, num_images);
+        benchmark_jpeg_decode(paths, num_images);
+        benchmark_super_textures(paths, images, num_images);
+        for (auto i = 0; i != num_images; ++i)
+            stbi_image_free(images[i].pixels);
+        free(images);
+        return 0;
+    }
+
+    int result = 0;
+    for (auto i = 0; i != num_images; ++i)
+    {
+        if (!images[i].pixels)
+        {
+            result = 1;
+            continue;
+        }
+
+        char output[1024];
+        get_output_path(output, sizeof(output), directory, paths[i], output_extension);
+
+        if (!cook_texture(images[i].pixels, (uint)images[i].width, (uint)images[i].height, guess_texture_usage(paths[i]),
+                          filter, output, paths[i]))
+            result = 1;
+
+        stbi_image_free(images[i].pixels);
+    }
+
+    free(images);
+    return result;
+}
@@ -0,0 +1,158 @@
+#ifndef _TEXTURE_FORMAT_H_
+#define _TEXTURE_FORMAT_H_
+#include "stdafx.h"
+
+#include <ctype.h>
+
+/// ============ TEXTURE FORMATS ============ ///
+// The formats the texture tools know about. The values are the matching DXGI_FORMAT ones,
+//   so DDS files can store them as they are and the runtime can cast them straight to
+//   DXGI_FORMAT, while the tools still build on Linux without the D3D headers.
+enum Texture_Format {
+    TEXTURE_FORMAT_UNKNOWN    = 0,
+    TEXTURE_FORMAT_RG8        = 49, // DXGI_FORMAT_R8G8_UNORM, normal maps loaded loose (see normal_map.h)
+    TEXTURE_FORMAT_RGBA8      = 28, // DXGI_FORMAT_R8G8B8A8_UNORM
+    TEXTURE_FORMAT_RGBA8_SRGB = 29, // DXGI_FORMAT_R8G8B8A8_UNORM_SRGB
+    TEXTURE_FORMAT_BC1        = 71, // DXGI_FORMAT_BC1_UNORM
+    TEXTURE_FORMAT_BC1_SRGB   = 72, // DXGI_FORMAT_BC1_UNORM_SRGB
+    TEXTURE_FORMAT_BC3        = 77, // DXGI_FORMAT_BC3_UNORM
+    TEXTURE_FORMAT_BC3_SRGB   = 78, // DXGI_FORMAT_BC3_UNORM_SRGB
+    TEXTURE_FORMAT_BC4        = 80, // DXGI_FORMAT_BC4_UNORM
+    TEXTURE_FORMAT_BC5        = 83, // DXGI_FORMAT_BC5_UNORM
+    TEXTURE_FORMAT_BC7        = 98, // DXGI_FORMAT_BC7_UNORM
+    TEXTURE_FORMAT_BC7_SRGB   = 99, // DXGI_FORMAT_BC7_UNORM_SRGB
+};
+
+#ifdef _WIN32
+#include <dxgiformat.h>
+static_assert(TEXTURE_FORMAT_RG8 == DXGI_FORMAT_R8G8_UNORM, "Texture_Format must match DXGI_FORMAT.");
+static_assert(TEXTURE_FORMAT_RGBA8_SRGB == DXGI_FORMAT_R8G8B8A8_UNORM_SRGB, "Texture_Format must match DXGI_FORMAT.");
+static_assert(TEXTURE_FORMAT_BC5 == DXGI_FORMAT_BC5_UNORM, "Texture_Format must match DXGI_FORMAT.");
+static_assert(TEXTURE_FORMAT_BC7_SRGB == DXGI_FORMAT_BC7_UNORM_SRGB, "Texture_Format must match DXGI_FORMAT.");
+#endif
+
+// What a texture is used for, which decides how it gets compressed.
+enum Texture_Usage {
+    TEXTURE_USAGE_COLOR,  // albedo & co: BC7, sRGB
+    TEXTURE_USAGE_NORMAL, // tangent space normals: BC5, X and Y only
+    TEXTURE_USAGE_MASK,   // single channel (roughness, metallic, AO): BC4
+    TEXTURE_USAGE_ORM,    // AO, roughness and metallic packed together (see material.h): BC7, linear
+};
+
+static inline bool contains_nocase(const char *string, const char *pattern)
+{
+    for (; *string; ++string)
+    {
+        auto a = string;
+        auto b = pattern;
+        while (*a && *b && tolower(*a) == tolower(*b))
+            ++a, ++b;
+        if (!*b)
+            return true;
+    }
+    return false;
+}
+
+// Guess from the file name: *normal* -> normal map, *_orm* -> packed ORM, roughness/metallic/AO -> mask,
+//   anything else is color.
+static inline Texture_Usage guess_texture_usage(const char *path)
+{
+    if (contains_nocase(path, "normal"))
+        return TEXTURE_USAGE_NORMAL;
+    if (contains_nocase(path, "_orm"))
+        return TEXTURE_USAGE_ORM;
+    if (contains_nocase(path, "rough") || contains_nocase(path, "metal") ||
+        contains_nocase(path, "_ao") || contains_nocase(path, "occlusion"))
+        return TEXTURE_USAGE_MASK;
+    return TEXTURE_USAGE_COLOR;
+}
+
+static inline Texture_Format get_usage_format(Texture_Usage usage)
+{
+    switch (usage)
+    {
+        case TEXTURE_USAGE_NORMAL: return TEXTURE_FORMAT_BC5;
+        case TEXTURE_USAGE_MASK:   return TEXTURE_FORMAT_BC4;
+        case TEXTURE_USAGE_ORM:    return TEXTURE_FORMAT_BC7;
+        default:                   return TEXTURE_FORMAT_BC7_SRGB;
+    }
+}
+
+static inline bool is_block_compressed(Texture_Format format)
+{
+    return format != TEXTURE_FORMAT_UNKNOWN && format != TEXTURE_FORMAT_RG8 && format != TEXTURE_FORMAT_RGBA8 && format != TEXTURE_FORMAT_RGBA8_SRGB;
+}
+
+static inline bool is_srgb_format(Texture_Format format)
+{
+    return format == TEXTURE_FORMAT_RGBA8_SRGB || format == TEXTURE_FORMAT_BC1_SRGB ||
+           format == TEXTURE_FORMAT_BC3_SRGB || format == TEXTURE_FORMAT_BC7_SRGB;
+}
+
+// Bytes per 4x4 block, or per pixel for uncompressed formats.
+static inline uint get_texture_format_bytes(Texture_Format format)
+{
+    switch (format)
+    {
+        case TEXTURE_FORMAT_BC1:
+        case TEXTURE_FORMAT_BC1_SRGB:
+        case TEXTURE_FORMAT_BC4:
+            return 8;
+        case TEXTURE_FORMAT_BC3:
+        case TEXTURE_FORMAT_BC3_SRGB:
+        case TEXTURE_FORMAT_BC5:
+        case TEXTURE_FORMAT_BC7:
+        case TEXTURE_FORMAT_BC7_SRGB:
+            return 16;
+        case TEXTURE_FORMAT_RGBA8:
+        case TEXTURE_FORMAT_RGBA8_SRGB:
+            return 4;
+        case TEXTURE_FORMAT_RG8:
+            return 2;
+        default:
+            return 0;
+    }
+}
+
+// Bytes per row of pixels, or per row of blocks for compressed formats. This is what
+//   D3D11_SUBRESOURCE_DATA::SysMemPitch wants.
+static inline uint get_texture_row_pitch(Texture_Format format, uint width)
+{
+    if (is_block_compressed(format))
+        return ((width + 3) / 4) * get_texture_format_bytes(format);
+    return width * get_texture_format_bytes(format);
+}
+
+static inline size_t get_texture_level_size(Texture_Format format, uint width, uint height)
+{
+    uint rows = is_block_compressed(format) ? (height + 3) / 4 : height;
+    return (size_t)get_texture_row_pitch(format, width) * rows;
+}
+
+// Width or height of a mip level.
+static inline uint get_mip_dimension(uint size, uint level)
+{
+    size >>= level;
+    return size ? size : 1;
+}
+
+static inline const char *get_texture_format_name(Texture_Format format)
+{
+    switch (format)
+    {
+        case TEXTURE_FORMAT_RG8:        return "RG8";
+        case TEXTURE_FORMAT_RGBA8:      return "RGBA8";
+        case TEXTURE_FORMAT_RGBA8_SRGB: return "RGBA8_SRGB";
+        case TEXTURE_FORMAT_BC1:        return "BC1";
+        case TEXTURE_FORMAT_BC1_SRGB:   return "BC1_SRGB";
+        case TEXTURE_FORMAT_BC3:        return "BC3";
+        case TEXTURE_FORMAT_BC3_SRGB:   return "BC3_SRGB";
+        case TEXTURE_FORMAT_BC4:        return "BC4";
+        case TEXTURE_FORMAT_BC5:        return "BC5";
+        case TEXTURE_FORMAT_BC7:        return "BC7";
+        case TEXTURE_FORMAT_BC7_SRGB:   return "BC7_SRGB";
+        default:                        return "UNKNOWN";
+    }
+}
+
+#endif
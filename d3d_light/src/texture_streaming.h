@@ -0,0 +1,392 @@
+#ifndef _TEXTURE_STREAMING_H_
+#define _TEXTURE_STREAMING_H_
+#include "stdafx.h"
+
+#include <math.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "texture_format.h"
+
+/// ============ TEXTURE STREAMING ============ ///
+// Textures become usable as soon as they're added: the mip tail (every level no larger than
+//   STREAM_TAIL_DIMENSION) goes up right away, the finer levels stream in afterwards, one
+//   level at a time, finest-needed-first for whatever is biggest on screen.
+//
+// Every update:
+//   1. levels the loader finished are handed to the sink, if they're still wanted
+//   2. every texture gets the level its on-screen size asks for
+//   3. the budget goes to the textures in order of on-screen size, the rest get coarser levels
+//   4. textures above their budgeted level are evicted down to it
+//   5. the most important textures below their budgeted level get their next level queued
+//
+// The loader thread only pulls the level's bytes into memory (the sources are meant to be
+//   mapped files, see dds.h), so the main thread never stalls on a page fault. The actual
+//   upload is the sink's job and happens on the thread calling update_texture_streaming,
+//   which for D3D11 is the one owning the immediate context.
+// Nothing in here touches the GPU, so the scheduling runs anywhere with a fake sink.
+
+#define STREAM_MAX_LEVELS       16
+#define STREAM_TAIL_DIMENSION   64
+#define STREAM_MAX_IN_FLIGHT    2
+#define STREAM_NO_LEVEL         (~0u)
+
+struct Streamed_Texture
+{
+    Texture_Format format;
+    uint width;
+    uint height;
+    uint num_levels;
+    const uchar *levels[STREAM_MAX_LEVELS]; // source of every level, must outlive the streamer
+
+    uint tail_level;     // first level of the mip tail, always resident
+    uint resident_level; // finest level the sink has, everything coarser is resident too
+    uint allowed_level;  // finest level the budget gave it on the last update
+    uint pending_level;  // level the loader is working on, STREAM_NO_LEVEL if none
+    float screen_size;   // largest size on screen in pixels requested since the last update
+};
+
+// Makes levels [first_level, num_levels) of texture resident, dropping anything finer.
+// Called for uploads and evictions alike; the level bytes are in texture->levels.
+struct Texture_Stream_Sink
+{
+    void *user;
+    bool (*set_resident_levels)(void *user, uint index, const Streamed_Texture *texture, uint first_level);
+};
+
+struct Stream_Request
+{
+    uint texture;
+    uint level;
+};
+
+struct Stream_Loader
+{
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool quit;
+
+    Stream_Request queue[STREAM_MAX_IN_FLIGHT];
+    uint num_queued;
+    Stream_Request done[STREAM_MAX_IN_FLIGHT];
+    uint num_done;
+};
+
+struct Texture_Streamer
+{
+    Streamed_Texture *textures;
+    uint num_textures;
+    uint max_textures;
+
+    Texture_Stream_Sink sink;
+    size_t budget;
+    size_t eviction_cap; // SIZE_MAX: none, else what evict_streamed_texture left resident
+    size_t resident_bytes;
+    uint num_in_flight;
+
+    Stream_Loader *loader; // NULL: levels are loaded inside update_texture_streaming
+};
+
+/// -- Helpers
+// Bytes of levels [first_level, num_levels).
+static size_t get_streamed_bytes(const Streamed_Texture *it, uint first_level)
+{
+    size_t bytes = 0;
+    for (auto l = first_level; l < it->num_levels; ++l)
+        bytes += get_texture_level_size(it->format, get_mip_dimension(it->width, l), get_mip_dimension(it->height, l));
+    return bytes;
+}
+
+// Touches every page of a level so the loads from the mapped file happen on this thread.
+static void prefetch_streamed_level(const Streamed_Texture *it, uint level)
+{
+    size_t size = get_texture_level_size(it->format, get_mip_dimension(it->width, level), get_mip_dimension(it->height, level));
+    volatile uchar sink = 0;
+    for (size_t i = 0; i < size; i += 4096)
+        sink += it->levels[level][i];
+    sink += it->levels[level][size - 1];
+}
+
+// Diameter in pixels of a bounding sphere, for request_texture_screen_size.
+float compute_screen_size(const float *center, float radius, const float *camera_position, float fov_y, float viewport_height)
+{
+    float d[3] = { center[0] - camera_position[0], center[1] - camera_position[1], center[2] - camera_position[2] };
+    float distance = sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+
+    // Inside the sphere it covers the whole screen.
+    if (distance <= radius)
+        return viewport_height;
+
+    return (2.0f * radius) * viewport_height / (2.0f * tanf(fov_y * 0.5f) * distance);
+}
+
+// Level whose texels are about one pixel when the texture covers screen_size pixels.
+static uint get_wanted_level(const Streamed_Texture *it, float screen_size)
+{
+    if (screen_size <= 0.0f)
+        return it->tail_level;
+
+    float texels = (float)((it->width > it->height) ? it->width : it->height);
+    if (screen_size >= texels)
+        return 0;
+
+    uint level = (uint)floorf(log2f(texels / screen_size));
+    return (level < it->tail_level) ? level : it->tail_level;
+}
+
+/// -- Loader
+static void run_stream_loader(Texture_Streamer *streamer)
+{
+    auto loader = streamer->loader;
+    std::unique_lock<std::mutex> lock(loader->mutex);
+
+    for (;;)
+    {
+        loader->wake.wait(lock, [loader] { return loader->quit || loader->num_queued; });
+        if (loader->quit)
+            return;
+
+        // The queue is filled in priority order.
+        Stream_Request request = loader->queue[0];
+        memmove(&loader->queue[0], &loader->queue[1], (--loader->num_queued) * sizeof(Stream_Request));
+
+        lock.unlock();
+        prefetch_streamed_level(&streamer->textures[request.texture], request.level);
+        lock.lock();
+
+        loader->done[loader->num_done++] = request;
+    }
+}
+
+/// -- Streamer
+// threaded == false loads levels inside update_texture_streaming, which keeps tests deterministic.
+void init_texture_streamer(Texture_Streamer *it, Texture_Stream_Sink sink, size_t budget, uint max_textures, bool threaded = true)
+{
+    ZeroThat(it);
+    it->sink = sink;
+    it->budget = budget;
+    it->eviction_cap = SIZE_MAX;
+    it->max_textures = max_textures;
+    it->textures = (Streamed_Texture *)calloc(max_textures, sizeof(Streamed_Texture));
+
+    if (threaded)
+    {
+        it->loader = new Stream_Loader();
+        it->loader->thread = std::thread(run_stream_loader, it);
+    }
+}
+
+void shutdown_texture_streamer(Texture_Streamer *it)
+{
+    if (it->loader)
+    {
+        {
+            std::lock_guard<std::mutex> lock(it->loader->mutex);
+            it->loader->quit = true;
+        }
+        it->loader->wake.notify_one();
+        it->loader->thread.join();
+        delete it->loader;
+    }
+
+    free(it->textures);
+    ZeroThat(it);
+}
+
+// levels[i] is level i in format, they have to stay valid until shutdown_texture_streamer.
+// Uploads the mip tail right away. Returns the texture's index or STREAM_NO_LEVEL when full.
+uint add_streamed_texture(Texture_Streamer *it, Texture_Format format, uint width, uint height, const uchar **levels, uint num_levels)
+{
+    if (it->num_textures == it->max_textures || !num_levels)
+        return STREAM_NO_LEVEL;
+
+    uint index = it->num_textures++;
+    auto texture = &it->textures[index];
+    ZeroThat(texture);
+
+    texture->format = format;
+    texture->width = width;
+    texture->height = height;
+    texture->num_levels = (num_levels < STREAM_MAX_LEVELS) ? num_levels : STREAM_MAX_LEVELS;
+    memcpy(texture->levels, levels, texture->num_levels * sizeof(levels[0]));
+
+    texture->tail_level = texture->num_levels - 1;
+    while (texture->tail_level && get_mip_dimension(width, texture->tail_level - 1) <= STREAM_TAIL_DIMENSION &&
+           get_mip_dimension(height, texture->tail_level - 1) <= STREAM_TAIL_DIMENSION)
+        --texture->tail_level;
+
+    texture->allowed_level = texture->tail_level;
+    texture->pending_level = STREAM_NO_LEVEL;
+    texture->resident_level = texture->num_levels;
+
+    if (it->sink.set_resident_levels(it->sink.user, index, texture, texture->tail_level))
+    {
+        texture->resident_level = texture->tail_level;
+        it->resident_bytes += get_streamed_bytes(texture, texture->tail_level);
+    }
+
+    return index;
+}
+
+// Call for every object using the texture, every frame it's visible; the largest size wins.
+void request_texture_screen_size(Texture_Streamer *it, uint index, float screen_size)
+{
+    auto texture = &it->textures[index];
+    if (screen_size > texture->screen_size)
+        texture->screen_size = screen_size;
+}
+
+static void set_resident_level(Texture_Streamer *it, uint index, uint level)
+{
+    auto texture = &it->textures[index];
+    if (!it->sink.set_resident_levels(it->sink.user, index, texture, level))
+        return;
+
+    it->resident_bytes -= get_streamed_bytes(texture, texture->resident_level);
+    it->resident_bytes += get_streamed_bytes(texture, level);
+    texture->resident_level = level;
+}
+
+static Texture_Streamer *sort_streamer;
+static int compare_stream_priority(const void *a, const void *b)
+{
+    float pa = sort_streamer->textures[*(const uint *)a].screen_size;
+    float pb = sort_streamer->textures[*(const uint *)b].screen_size;
+    return (pa < pb) ? 1 : (pa > pb) ? -1 : (int)(*(const uint *)a) - (int)(*(const uint *)b);
+}
+
+void update_texture_streaming(Texture_Streamer *it)
+{
+    if (!it->num_textures)
+        return;
+
+    // 1. Finished loads.
+    Stream_Request done[STREAM_MAX_IN_FLIGHT];
+    uint num_done = 0;
+    if (it->loader)
+    {
+        std::lock_guard<std::mutex> lock(it->loader->mutex);
+        num_done = it->loader->num_done;
+        memcpy(done, it->loader->done, num_done * sizeof(Stream_Request));
+        it->loader->num_done = 0;
+    }
+
+    for (auto i = 0; i != num_done; ++i)
+    {
+        auto texture = &it->textures[done[i].texture];
+        texture->pending_level = STREAM_NO_LEVEL;
+        --it->num_in_flight;
+
+        if (done[i].level < texture->resident_level && done[i].level >= texture->allowed_level)
+            set_resident_level(it, done[i].texture, done[i].level);
+    }
+
+    // 2. & 3. Hand out the budget, biggest on screen first. Tails are always resident.
+    uint *order = (uint *)malloc(it->num_textures * sizeof(uint));
+    size_t remaining = (it->eviction_cap < it->budget) ? it->eviction_cap : it->budget;
+    for (auto i = 0; i != it->num_textures; ++i)
+    {
+        order[i] = i;
+        size_t tail = get_streamed_bytes(&it->textures[i], it->textures[i].tail_level);
+        remaining = (remaining > tail) ? remaining - tail : 0;
+    }
+
+    sort_streamer = it;
+    qsort(order, it->num_textures, sizeof(uint), compare_stream_priority);
+
+    for (auto i = 0; i != it->num_textures; ++i)
+    {
+        auto texture = &it->textures[order[i]];
+        size_t tail = get_streamed_bytes(texture, texture->tail_level);
+
+        uint level = get_wanted_level(texture, texture->screen_size);
+        while (level < texture->tail_level && get_streamed_bytes(texture, level) - tail > remaining)
+            ++level;
+
+        remaining -= get_streamed_bytes(texture, level) - tail;
+        texture->allowed_level = level;
+    }
+
+    // 4. Evictions first, so the loads below fit.
+    for (auto i = 0; i != it->num_textures; ++i)
+        if (it->textures[i].resident_level < it->textures[i].allowed_level)
+            set_resident_level(it, i, it->textures[i].allowed_level);
+
+    // 5. Next level of the most important textures that want more.
+    Stream_Request requests[STREAM_MAX_IN_FLIGHT];
+    uint num_requests = 0;
+    for (auto i = 0; i != it->num_textures && it->num_in_flight + num_requests < STREAM_MAX_IN_FLIGHT; ++i)
+    {
+        auto texture = &it->textures[order[i]];
+        if (texture->pending_level != STREAM_NO_LEVEL || texture->resident_level <= texture->allowed_level)
+            continue;
+
+        texture->pending_level = texture->resident_level - 1;
+        requests[num_requests].texture = order[i];
+        requests[num_requests].level = texture->pending_level;
+        ++num_requests;
+    }
+
+    if (it->loader && num_requests)
+    {
+        {
+            std::lock_guard<std::mutex> lock(it->loader->mutex);
+            memcpy(&it->loader->queue[it->loader->num_queued], requests, num_requests * sizeof(Stream_Request));
+            it->loader->num_queued += num_requests;
+        }
+        it->num_in_flight += num_requests;
+        it->loader->wake.notify_one();
+    }
+    else
+    {
+        for (auto i = 0; i != num_requests; ++i)
+        {
+            auto texture = &it->textures[requests[i].texture];
+            prefetch_streamed_level(texture, requests[i].level);
+            texture->pending_level = STREAM_NO_LEVEL;
+            set_resident_level(it, requests[i].texture, requests[i].level);
+        }
+    }
+
+    for (auto i = 0; i != it->num_textures; ++i)
+        it->textures[i].screen_size = 0.0f;
+
+    free(order);
+}
+
+// Drops the texture to its mip tail from outside the update, e.g. under memory pressure (see
+//   gpu_budget.h), and caps the next updates at what's left resident so they don't stream it
+//   straight back in. The budget itself stays, relax_texture_eviction_cap lifts the cap again.
+//   Returns the bytes freed.
+size_t evict_streamed_texture(Texture_Streamer *it, uint index)
+{
+    auto texture = &it->textures[index];
+    if (texture->resident_level >= texture->tail_level)
+        return 0;
+
+    size_t resident_bytes = it->resident_bytes;
+    set_resident_level(it, index, texture->tail_level);
+
+    texture->allowed_level = texture->resident_level;
+    if (it->eviction_cap > it->resident_bytes)
+        it->eviction_cap = it->resident_bytes;
+    return resident_bytes - it->resident_bytes;
+}
+
+// Once the memory pressure is gone: lets the cap grow by up to headroom bytes past what's resident,
+//   and drops it altogether once it no longer holds the budget back.
+void relax_texture_eviction_cap(Texture_Streamer *it, size_t headroom)
+{
+    if (it->eviction_cap == SIZE_MAX)
+        return;
+
+    if (it->resident_bytes >= it->budget || headroom >= it->budget - it->resident_bytes)
+        it->eviction_cap = SIZE_MAX;
+    else if (it->resident_bytes + headroom > it->eviction_cap)
+        it->eviction_cap = it->resident_bytes + headroom;
+}
+
+#endif
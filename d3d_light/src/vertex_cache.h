@@ -0,0 +1,219 @@
+#ifndef _VERTEX_CACHE_H_
+#define _VERTEX_CACHE_H_
+#include "stdafx.h"
+
+#include <math.h>
+
+/// ============ POST-TRANSFORM VERTEX CACHE ============ ///
+// Triangle reordering after Tom Forsyth's "Linear-Speed Vertex Cache Optimisation".
+// Every vertex gets a score from its position in a simulated LRU cache plus a bonus for
+//   how few triangles still use it, and we greedily emit the triangle with the best sum.
+
+#define VERTEX_CACHE_SCORE_SIZE 32   // LRU size the scoring assumes.
+#define VERTEX_CACHE_FIFO_SIZE  16   // FIFO size the statistics assume (conservative for D3D11 hardware).
+
+struct Vertex_Cache_Stats
+{
+    uint transforms; // cache misses, i.e. vertex shader invocations
+    float acmr;      // average cache miss ratio: transforms per triangle, 0.5 is optimal, 3 is worst
+    float atvr;      // average transform to vertex ratio: transforms per referenced vertex, 1 is optimal
+};
+
+// Simulates a FIFO post-transform cache of cache_size entries over the index buffer.
+Vertex_Cache_Stats analyze_vertex_cache(const uint *indices, uint num_indices, uint num_vertices, uint cache_size = VERTEX_CACHE_FIFO_SIZE)
+{
+    Vertex_Cache_Stats stats = {};
+
+    // A vertex is in the cache if it was inserted less than cache_size insertions ago.
+    uint *timestamps = (uint *)calloc(num_vertices, sizeof(uint));
+    uint timestamp = cache_size + 1;
+    uint referenced = 0;
+
+    for (auto i = 0; i != num_indices; ++i)
+    {
+        auto index = indices[i];
+        if (!timestamps[index])
+            ++referenced;
+
+        if (timestamp - timestamps[index] > cache_size)
+        {
+            timestamps[index] = timestamp++;
+            ++stats.transforms;
+        }
+    }
+
+    if (num_indices)
+        stats.acmr = (float)stats.transforms / (float)(num_indices / 3);
+    if (referenced)
+        stats.atvr = (float)stats.transforms / (float)referenced;
+
+    free(timestamps);
+    return stats;
+}
+
+static inline float vertex_cache_score(int cache_position, uint remaining_valence)
+{
+    // No triangles left, the vertex can never be picked again.
+    if (!remaining_valence)
+        return -1.0f;
+
+    float score = 0.0f;
+    if (cache_position >= 0)
+    {
+        // The three vertices of the last triangle get a fixed score, so we don't
+        //   prefer strips over fans just because of the order inside a triangle.
+        if (cache_position < 3)
+            score = 0.75f;
+        else
+            score = powf(1.0f - (float)(cache_position - 3) / (float)(VERTEX_CACHE_SCORE_SIZE - 3), 1.5f);
+    }
+
+    // Prefer finishing off vertices with few triangles left, so they don't linger as lone stragglers.
+    return score + (2.0f / sqrtf((float)remaining_valence));
+}
+
+// Writes the reordered index buffer into dst. dst and indices may be the same buffer.
+void optimize_vertex_cache(uint *dst, const uint *indices, uint num_indices, uint num_vertices)
+{
+    uint num_triangles = num_indices / 3;
+    if (!num_triangles)
+        return;
+
+    /// -- Vertex -> triangle adjacency.
+    uint *valence = (uint *)calloc(num_vertices, sizeof(uint));
+    uint *adjacency_offsets = (uint *)malloc((num_vertices + 1) * sizeof(uint));
+    uint *adjacency = (uint *)malloc(num_indices * sizeof(uint));
+
+    for (auto i = 0; i != num_indices; ++i)
+        valence[indices[i]]++;
+
+    adjacency_offsets[0] = 0;
+    for (auto i = 0; i != num_vertices; ++i)
+        adjacency_offsets[i + 1] = adjacency_offsets[i] + valence[i];
+
+    // valence is reused as a fill cursor, and ends up as the remaining valence again.
+    memset(valence, 0, num_vertices * sizeof(uint));
+    for (auto i = 0; i != num_indices; ++i)
+    {
+        auto index = indices[i];
+        adjacency[adjacency_offsets[index] + valence[index]++] = i / 3;
+    }
+
+    /// -- Scores.
+    float *vertex_scores = (float *)malloc(num_vertices * sizeof(float));
+    float *triangle_scores = (float *)malloc(num_triangles * sizeof(float));
+    bool *emitted = (bool *)calloc(num_triangles, sizeof(bool));
+
+    for (auto i = 0; i != num_vertices; ++i)
+        vertex_scores[i] = vertex_cache_score(-1, valence[i]);
+
+    for (auto i = 0; i != num_triangles; ++i)
+        triangle_scores[i] = vertex_scores[indices[i * 3 + 0]] + vertex_scores[indices[i * 3 + 1]] + vertex_scores[indices[i * 3 + 2]];
+
+    // Keep our own copy, dst is allowed to alias indices.
+    uint *source = (uint *)malloc(num_indices * sizeof(uint));
+    memcpy(source, indices, num_indices * sizeof(uint));
+
+    uint cache[VERTEX_CACHE_SCORE_SIZE + 3];
+    uint cache_count = 0;
+    uint next_unemitted = 0;
+
+    for (auto emitted_count = 0; emitted_count != num_triangles; ++emitted_count)
+    {
+        /// -- Pick the best triangle touching the cache, or fall back to the next one in input order.
+        int best_triangle = -1;
+        float best_score = -1.0f;
+
+        for (auto i = 0; i != cache_count; ++i)
+        {
+            auto vertex = cache[i];
+            for (auto j = adjacency_offsets[vertex]; j != adjacency_offsets[vertex] + valence[vertex]; ++j)
+            {
+                auto triangle = adjacency[j];
+                if (triangle_scores[triangle] > best_score)
+                {
+                    best_score = triangle_scores[triangle];
+                    best_triangle = triangle;
+                }
+            }
+        }
+
+        if (best_triangle < 0)
+        {
+            while (emitted[next_unemitted])
+                ++next_unemitted;
+            best_triangle = next_unemitted;
+        }
+
+        /// -- Emit it.
+        auto tri = &source[best_triangle * 3];
+        memcpy(&dst[emitted_count * 3], tri, 3 * sizeof(uint));
+        emitted[best_triangle] = true;
+
+        // Remove the triangle from its vertices' live adjacency lists.
+        for (auto k = 0; k != 3; ++k)
+        {
+            auto vertex = tri[k];
+            auto list = &adjacency[adjacency_offsets[vertex]];
+            for (auto j = 0; j != valence[vertex]; ++j)
+            {
+                if (list[j] == best_triangle)
+                {
+                    list[j] = list[valence[vertex] - 1];
+                    break;
+                }
+            }
+            valence[vertex]--;
+        }
+
+        /// -- Move its vertices to the front of the LRU cache.
+        uint new_cache[VERTEX_CACHE_SCORE_SIZE + 3];
+        uint new_cache_count = 0;
+
+        new_cache[new_cache_count++] = tri[0];
+        if (tri[1] != tri[0])
+            new_cache[new_cache_count++] = tri[1];
+        if (tri[2] != tri[0] && tri[2] != tri[1])
+            new_cache[new_cache_count++] = tri[2];
+
+        for (auto i = 0; i != cache_count; ++i)
+        {
+            auto vertex = cache[i];
+            if (vertex != tri[0] && vertex != tri[1] && vertex != tri[2])
+                new_cache[new_cache_count++] = vertex;
+        }
+
+        // Whatever fell off the end is no longer cached.
+        for (auto i = VERTEX_CACHE_SCORE_SIZE; i < new_cache_count; ++i)
+            vertex_scores[new_cache[i]] = vertex_cache_score(-1, valence[new_cache[i]]);
+
+        for (auto i = 0; i != new_cache_count && i != VERTEX_CACHE_SCORE_SIZE; ++i)
+            vertex_scores[new_cache[i]] = vertex_cache_score(i, valence[new_cache[i]]);
+
+        /// -- Rescore the triangles around everything that moved, including the evicted vertices.
+        for (auto i = 0; i != new_cache_count; ++i)
+        {
+            auto vertex = new_cache[i];
+            for (auto j = adjacency_offsets[vertex]; j != adjacency_offsets[vertex] + valence[vertex]; ++j)
+            {
+                auto triangle = adjacency[j];
+                triangle_scores[triangle] = vertex_scores[source[triangle * 3 + 0]] +
+                                            vertex_scores[source[triangle * 3 + 1]] +
+                                            vertex_scores[source[triangle * 3 + 2]];
+            }
+        }
+
+        cache_count = (new_cache_count < VERTEX_CACHE_SCORE_SIZE) ? new_cache_count : VERTEX_CACHE_SCORE_SIZE;
+        memcpy(cache, new_cache, cache_count * sizeof(uint));
+    }
+
+    free(source);
+    free(emitted);
+    free(triangle_scores);
+    free(vertex_scores);
+    free(adjacency);
+    free(adjacency_offsets);
+    free(valence);
+}
+
+#endif
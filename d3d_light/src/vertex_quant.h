@@ -0,0 +1,257 @@
+#ifndef _VERTEX_QUANT_H_
+#define _VERTEX_QUANT_H_
+#include "stdafx.h"
+
+#include <math.h>
+#include <float.h>
+
+#include "mesh_common.h"
+
+/// ============ QUANTIZED VERTICES ============ ///
+// 16 byte alternative to the 60 byte Vertex:
+//   position: unorm16 x4, relative to the mesh AABB (w is padding)   -> DXGI_FORMAT_R16G16B16A16_UNORM
+//   normal:   octahedral encoded, snorm16 x2                         -> DXGI_FORMAT_R16G16_SNORM
+//   texcoord: half x2                                                -> DXGI_FORMAT_R16G16_FLOAT
+// The vertex color is constant per mesh anyway, so it moves to the shader constants
+//   along with the AABB (see shaders/static_packed.hlsl). Tangents aren't kept, so normal maps
+//   need the full Vertex.
+struct Packed_Vertex {
+    uint16_t position[4];
+    int16_t  normal[2];
+    uint16_t texcoord[2];
+};
+
+static_assert(sizeof(Packed_Vertex) == 16, "Packed_Vertex must stay 16 bytes, the input layout depends on it.");
+
+#ifdef _WIN32
+#include <d3d11.h>
+
+// Reflection only sees the float types static_packed.hlsl reads, not the packed formats
+//   behind them, so this gets passed to create_gpu_shader as an explicit layout.
+static D3D11_INPUT_ELEMENT_DESC packed_vertex_layout[] = {
+    { "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, 0,  D3D11_INPUT_PER_VERTEX_DATA, 0 },
+    { "TEXCOORD", 1, DXGI_FORMAT_R16G16_SNORM,       0, 8,  D3D11_INPUT_PER_VERTEX_DATA, 0 },
+    { "TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT,       0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+};
+#endif
+
+struct Vertex_Quant_Params {
+    float aabb_min[3];
+    float aabb_extent[3];
+};
+
+struct Vertex_Quant_Error {
+    float max_position_error;   // world units
+    float max_normal_degrees;
+    float max_texcoord_error;
+};
+
+/// -- Half floats.
+static inline uint16_t float_to_half(float f)
+{
+    uint x;
+    memcpy(&x, &f, sizeof(x));
+
+    uint sign = (x >> 16) & 0x8000;
+    uint exponent = (x >> 23) & 0xFF;
+    uint mantissa = x & 0x7FFFFF;
+    int half_exponent = (int)exponent - 127 + 15;
+
+    if (exponent == 0xFF)
+        return (uint16_t)(sign | 0x7C00 | (mantissa ? 0x200 : 0));
+    if (half_exponent >= 31)
+        return (uint16_t)(sign | 0x7C00);
+
+    if (half_exponent <= 0)
+    {
+        // Denormal or zero.
+        if (half_exponent < -10)
+            return (uint16_t)sign;
+
+        mantissa |= 0x800000;
+        uint shift = (uint)(14 - half_exponent);
+        uint h = mantissa >> shift;
+        uint remainder = mantissa & ((1u << shift) - 1);
+        uint halfway = 1u << (shift - 1);
+        if (remainder > halfway || (remainder == halfway && (h & 1)))
+            ++h;
+        return (uint16_t)(sign | h);
+    }
+
+    // Round to nearest even. A carry out of the mantissa correctly bumps the exponent.
+    uint h = ((uint)half_exponent << 10) | (mantissa >> 13);
+    uint remainder = mantissa & 0x1FFF;
+    if (remainder > 0x1000 || (remainder == 0x1000 && (h & 1)))
+        ++h;
+    return (uint16_t)(sign | h);
+}
+
+static inline float half_to_float(uint16_t h)
+{
+    uint sign = (uint)(h & 0x8000) << 16;
+    uint exponent = (h >> 10) & 0x1F;
+    uint mantissa = h & 0x3FF;
+    uint x;
+
+    if (exponent == 0x1F)
+    {
+        x = sign | 0x7F800000 | (mantissa << 13);
+    }
+    else if (exponent == 0)
+    {
+        float f = ldexpf((float)mantissa, -24);
+        return sign ? -f : f;
+    }
+    else
+    {
+        x = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+    }
+
+    float f;
+    memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+/// -- Octahedral normals.
+static inline float oct_sign(float v)
+{
+    return (v >= 0.0f) ? 1.0f : -1.0f;
+}
+
+static inline void encode_octahedral(const float *normal, int16_t *out)
+{
+    float l1 = fabsf(normal[0]) + fabsf(normal[1]) + fabsf(normal[2]);
+    float x = 0.0f, y = 0.0f;
+
+    if (l1 > 0.0f)
+    {
+        x = normal[0] / l1;
+        y = normal[1] / l1;
+
+        // Fold the lower hemisphere over the diagonals.
+        if (normal[2] < 0.0f)
+        {
+            float fx = (1.0f - fabsf(y)) * oct_sign(x);
+            float fy = (1.0f - fabsf(x)) * oct_sign(y);
+            x = fx;
+            y = fy;
+        }
+    }
+
+    out[0] = (int16_t)lrintf(fminf(fmaxf(x, -1.0f), 1.0f) * 32767.0f);
+    out[1] = (int16_t)lrintf(fminf(fmaxf(y, -1.0f), 1.0f) * 32767.0f);
+}
+
+static inline void decode_octahedral(const int16_t *encoded, float *out)
+{
+    float x = fmaxf((float)encoded[0] / 32767.0f, -1.0f);
+    float y = fmaxf((float)encoded[1] / 32767.0f, -1.0f);
+    float z = 1.0f - fabsf(x) - fabsf(y);
+
+    if (z < 0.0f)
+    {
+        float fx = (1.0f - fabsf(y)) * oct_sign(x);
+        float fy = (1.0f - fabsf(x)) * oct_sign(y);
+        x = fx;
+        y = fy;
+    }
+
+    float length = sqrtf(x * x + y * y + z * z);
+    out[0] = x / length;
+    out[1] = y / length;
+    out[2] = z / length;
+}
+
+/// -- Encode / decode.
+void compute_vertex_quant_params(const Vertex *vertices, uint num_vertices, Vertex_Quant_Params *out)
+{
+    float aabb_max[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for (auto k = 0; k != 3; ++k)
+        out->aabb_min[k] = FLT_MAX;
+
+    for (auto i = 0; i != num_vertices; ++i)
+    {
+        for (auto k = 0; k != 3; ++k)
+        {
+            out->aabb_min[k] = fminf(out->aabb_min[k], vertices[i].position[k]);
+            aabb_max[k] = fmaxf(aabb_max[k], vertices[i].position[k]);
+        }
+    }
+
+    for (auto k = 0; k != 3; ++k)
+    {
+        if (!num_vertices)
+            out->aabb_min[k] = aabb_max[k] = 0.0f;
+        out->aabb_extent[k] = aabb_max[k] - out->aabb_min[k];
+    }
+}
+
+void encode_packed_vertices(Packed_Vertex *dst, const Vertex *src, uint num_vertices, const Vertex_Quant_Params *params)
+{
+    for (auto i = 0; i != num_vertices; ++i)
+    {
+        for (auto k = 0; k != 3; ++k)
+        {
+            float t = 0.0f;
+            if (params->aabb_extent[k] > 0.0f)
+                t = (src[i].position[k] - params->aabb_min[k]) / params->aabb_extent[k];
+            dst[i].position[k] = (uint16_t)lrintf(fminf(fmaxf(t, 0.0f), 1.0f) * 65535.0f);
+        }
+        dst[i].position[3] = 0;
+
+        encode_octahedral(src[i].normal, dst[i].normal);
+
+        dst[i].texcoord[0] = float_to_half(src[i].texcoord[0]);
+        dst[i].texcoord[1] = float_to_half(src[i].texcoord[1]);
+    }
+}
+
+// CPU reference of what static_packed.hlsl does, used to measure the quantization error.
+void decode_packed_vertex(Vertex *dst, const Packed_Vertex *src, const Vertex_Quant_Params *params, const float *color)
+{
+    for (auto k = 0; k != 3; ++k)
+    {
+        dst->position[k] = params->aabb_min[k] + ((float)src->position[k] / 65535.0f) * params->aabb_extent[k];
+        dst->color[k] = color[k];
+    }
+
+    decode_octahedral(src->normal, dst->normal);
+
+    dst->texcoord[0] = half_to_float(src->texcoord[0]);
+    dst->texcoord[1] = half_to_float(src->texcoord[1]);
+}
+
+Vertex_Quant_Error measure_vertex_quant_error(const Vertex *original, const Packed_Vertex *packed, uint num_vertices, const Vertex_Quant_Params *params)
+{
+    Vertex_Quant_Error error = {};
+
+    for (auto i = 0; i != num_vertices; ++i)
+    {
+        Vertex decoded;
+        decode_packed_vertex(&decoded, &packed[i], params, original[i].color);
+
+        float position_error = 0.0f;
+        for (auto k = 0; k != 3; ++k)
+        {
+            float d = decoded.position[k] - original[i].position[k];
+            position_error += d * d;
+        }
+        error.max_position_error = fmaxf(error.max_position_error, sqrtf(position_error));
+
+        auto n = original[i].normal;
+        float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (length > 0.0f)
+        {
+            float cosine = (n[0] * decoded.normal[0] + n[1] * decoded.normal[1] + n[2] * decoded.normal[2]) / length;
+            float degrees = acosf(fminf(fmaxf(cosine, -1.0f), 1.0f)) * (180.0f / 3.14159265f);
+            error.max_normal_degrees = fmaxf(error.max_normal_degrees, degrees);
+        }
+
+        for (auto k = 0; k != 2; ++k)
+            error.max_texcoord_error = fmaxf(error.max_texcoord_error, fabsf(decoded.texcoord[k] - original[i].texcoord[k]));
+    }
+
+    return error;
+}
+
+#endif
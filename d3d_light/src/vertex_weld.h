@@ -0,0 +1,140 @@
+#ifndef _VERTEX_WELD_H_
+#define _VERTEX_WELD_H_
+#include "stdafx.h"
+
+#include <math.h>
+
+#include "mesh_common.h"
+
+/// ============ VERTEX WELDING ============ ///
+// Assimp hands us one vertex per face corner in plenty of cases, so identical vertices
+//   are merged through an open addressing hash table keyed on the vertex contents.
+//
+// With epsilon == 0 vertices have to be bit-identical. Otherwise every float is snapped
+//   to a grid of epsilon-sized cells first, and vertices landing in the same cells merge.
+//   Two values just either side of a cell border won't merge, which is fine for cleaning
+//   up exporter noise but not a substitute for a proper spatial weld.
+
+#define VERTEX_WELD_FLOATS (sizeof(Vertex) / sizeof(float))
+
+static inline void get_vertex_weld_key(const Vertex *vertex, float epsilon, uint *out_key)
+{
+    auto floats = (const float *)vertex;
+
+    if (epsilon > 0.0f)
+    {
+        for (auto k = 0; k != VERTEX_WELD_FLOATS; ++k)
+            out_key[k] = (uint)(int)floorf(floats[k] / epsilon + 0.5f);
+    }
+    else
+    {
+        memcpy(out_key, floats, sizeof(Vertex));
+    }
+}
+
+static inline uint hash_vertex_weld_key(const uint *key)
+{
+    // FNV-1a over the words, with a final avalanche so the low bits are usable as a bucket index.
+    uint hash = 2166136261u;
+    for (auto k = 0; k != VERTEX_WELD_FLOATS; ++k)
+    {
+        hash ^= key[k];
+        hash *= 16777619u;
+    }
+
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    return hash;
+}
+
+// Merges duplicate vertices in place, keeping the first occurrence of each, and remaps
+//   the index buffer. Returns the number of vertices removed.
+uint weld_vertices(Cpu_Mesh *it, float epsilon = 0.0f)
+{
+    uint num_vertices = it->num_vertices;
+    if (!num_vertices)
+        return 0;
+
+    uint table_size = 1;
+    while (table_size < num_vertices * 2)
+        table_size *= 2;
+
+    // Buckets hold the new index + 1, so zero means empty.
+    uint *table = (uint *)calloc(table_size, sizeof(uint));
+    uint *keys = (uint *)malloc(num_vertices * VERTEX_WELD_FLOATS * sizeof(uint));
+    uint *remap = (uint *)malloc(num_vertices * sizeof(uint));
+    uint num_unique = 0;
+
+    for (auto i = 0; i != num_vertices; ++i)
+    {
+        uint *key = &keys[num_unique * VERTEX_WELD_FLOATS];
+        get_vertex_weld_key(&it->vertices[i], epsilon, key);
+
+        uint bucket = hash_vertex_weld_key(key) & (table_size - 1);
+        for (;;)
+        {
+            if (!table[bucket])
+            {
+                table[bucket] = num_unique + 1;
+                remap[i] = num_unique;
+                it->vertices[num_unique] = it->vertices[i];
+                ++num_unique;
+                break;
+            }
+
+            uint existing = table[bucket] - 1;
+            if (!memcmp(&keys[existing * VERTEX_WELD_FLOATS], key, VERTEX_WELD_FLOATS * sizeof(uint)))
+            {
+                remap[i] = existing;
+                break;
+            }
+
+            bucket = (bucket + 1) & (table_size - 1);
+        }
+    }
+
+    for (auto i = 0; i != it->num_indices; ++i)
+        it->indices[i] = remap[it->indices[i]];
+
+    it->num_vertices = num_unique;
+
+    free(remap);
+    free(keys);
+    free(table);
+    return num_vertices - num_unique;
+}
+
+/// ============ VERTEX FETCH ORDER ============ ///
+// Reorders the vertex buffer so vertices appear in the order the index buffer first
+//   references them, which turns vertex fetches into a mostly linear walk. Vertices that
+//   no triangle references are dropped. Run this last, after every pass that reorders triangles.
+void optimize_vertex_fetch(Cpu_Mesh *it)
+{
+    uint *remap = (uint *)malloc(it->num_vertices * sizeof(uint));
+    memset(remap, 0xFF, it->num_vertices * sizeof(uint));
+
+    Vertex *vertices = (Vertex *)malloc(it->num_vertices * sizeof(Vertex));
+    uint num_used = 0;
+
+    for (auto i = 0; i != it->num_indices; ++i)
+    {
+        auto index = it->indices[i];
+        if (remap[index] == ~0u)
+        {
+            remap[index] = num_used;
+            vertices[num_used] = it->vertices[index];
+            ++num_used;
+        }
+
+        it->indices[i] = remap[index];
+    }
+
+    memcpy(it->vertices, vertices, num_used * sizeof(Vertex));
+    it->num_vertices = num_used;
+
+    free(vertices);
+    free(remap);
+}
+
+#endif
@@ -148,6 +148,10 @@ static inline int64_t get_clock() {
 #include <d3d11shader.h>
 #include <d3dcompiler.h>
 
+#include "texture_format.h"
+#include "gpu_budget.h"
+#include "range_allocator.h"
+
 struct D3D_State {
     IDXGIFactory2 *factory;
     IDXGIAdapter1 *adapter;
@@ -162,12 +166,15 @@ struct D3D_State {
     ID3D11Texture2D *depthbuffer;
     ID3D11RenderTargetView *backbuffer_view;
     ID3D11DepthStencilView *depthbuffer_view;
+
+    Gpu_Budget budget; // every create_gpu_* reports into it, see gpu_budget.h
 };
 
 static D3D_State d3d = {};
 
 int initialize_d3d() {
     CreateDXGIFactory1(IID_PPV_ARGS(&d3d.factory));
+    init_gpu_budget(&d3d.budget);
 
     ///
     IDXGIAdapter1 *adapter = nullptr;
@@ -223,6 +230,7 @@ int initialize_d3d() {
     ASSERT(!FAILED(d3d.factory->CreateSwapChainForHwnd(d3d.device, win32.hwnd, &sc_desc, NULL, NULL, &d3d.swapchain)));
     d3d.swapchain->GetBuffer(0, IID_PPV_ARGS(&d3d.backbuffer));
     d3d.device->CreateRenderTargetView(d3d.backbuffer, NULL, &d3d.backbuffer_view);
+    track_gpu_resource(&d3d.budget, d3d.backbuffer, GPU_RESOURCE_RENDER_TARGET, (size_t)sc_desc.Width * sc_desc.Height * 4, "backbuffer");
 
     ///
     D3D11_RASTERIZER_DESC rz_desc = {};
@@ -243,6 +251,7 @@ int initialize_d3d() {
     texture_desc.MipLevels = 1;
     texture_desc.SampleDesc.Count = 1;
     ASSERT(!FAILED(d3d.device->CreateTexture2D(&texture_desc, NULL, &d3d.depthbuffer)));
+    track_gpu_resource(&d3d.budget, d3d.depthbuffer, GPU_RESOURCE_DEPTH_STENCIL, (size_t)texture_desc.Width * texture_desc.Height * 4, "depthbuffer");
 
     D3D11_DEPTH_STENCIL_VIEW_DESC dsv_desc = {};
     dsv_desc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
@@ -255,6 +264,8 @@ int initialize_d3d() {
 }
 
 void release_d3d() {
+    untrack_gpu_resource(&d3d.budget, d3d.depthbuffer);
+    untrack_gpu_resource(&d3d.budget, d3d.backbuffer);
     d3d.depthbuffer_view->Release();
     d3d.depthbuffer->Release();
     d3d.backbuffer_view->Release();
@@ -271,6 +282,9 @@ void release_d3d() {
     d3d.factory->Release();
 
     // Debug
+    dump_gpu_budget(&d3d.budget);
+    free_gpu_budget(&d3d.budget);
+
     IDXGIDebug1 *dxgi_debug;
     DXGIGetDebugInterface1(0, IID_PPV_ARGS(&dxgi_debug));
     dxgi_debug->ReportLiveObjects(DXGI_DEBUG_ALL, DXGI_DEBUG_RLO_ALL);
@@ -286,9 +300,20 @@ struct Gpu_Buffer
     unsigned int element_stride;
     unsigned int element_offset;
     int type;
+    DXGI_FORMAT index_format;
 };
 
-bool create_gpu_buffer(Gpu_Buffer *it, void *data, uint element_count, uint element_stride, int type)
+static Gpu_Resource_Kind get_gpu_buffer_kind(int type)
+{
+    switch (type) {
+        case D3D11_BIND_INDEX_BUFFER:    return GPU_RESOURCE_INDEX_BUFFER;
+        case D3D11_BIND_CONSTANT_BUFFER: return GPU_RESOURCE_CONSTANT_BUFFER;
+        default:                         return GPU_RESOURCE_VERTEX_BUFFER;
+    }
+}
+
+// asset names what the buffer belongs to in d3d.budget.
+bool create_gpu_buffer(Gpu_Buffer *it, void *data, uint element_count, uint element_stride, int type, const char *asset = NULL)
 {
     D3D11_BUFFER_DESC buffer_desc = {};
     D3D11_SUBRESOURCE_DATA buffer_data = {};
@@ -301,21 +326,30 @@ bool create_gpu_buffer(Gpu_Buffer *it, void *data, uint element_count, uint elem
     if (!data)
         data_ptr = NULL;
 
+    if (!reserve_gpu_memory(&d3d.budget, buffer_desc.ByteWidth))
+        return false;
+
     if (FAILED(d3d.device->CreateBuffer(&buffer_desc, data_ptr, &it->handle))) {
         LOGF("Failed: %p, %dx%d, %d\n", data, element_count, element_stride, type);
         return false;
     }
+    track_gpu_resource(&d3d.budget, it->handle, get_gpu_buffer_kind(type), buffer_desc.ByteWidth, asset);
 
     it->element_count  = element_count;
     it->element_stride = element_stride;
     it->element_offset = 0;
     it->type           = type;
+    it->index_format   = DXGI_FORMAT_UNKNOWN;
+
+    if (type == D3D11_BIND_INDEX_BUFFER)
+        it->index_format = (element_stride == sizeof(uint16_t)) ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
     
     return true;
 }
 
 void release_gpu_buffer(Gpu_Buffer *it)
 {
+    untrack_gpu_resource(&d3d.budget, it->handle);
     it->handle->Release();
     ZeroThat(it);
 }
@@ -347,7 +381,115 @@ void bind_gpu_buffer(Gpu_Buffer *it)
     if (it->type == D3D11_BIND_VERTEX_BUFFER)
         d3d.context->IASetVertexBuffers(0, 1, &it->handle, &it->element_stride, &it->element_offset);
     else
-        d3d.context->IASetIndexBuffer(it->handle, DXGI_FORMAT_R32_UINT, 0);
+        d3d.context->IASetIndexBuffer(it->handle, it->index_format, 0);
+}
+
+/// ============ GPU MESH ARENA ============ ///
+// One vertex buffer and one index buffer that static meshes of the same vertex and index
+//   stride are suballocated from (see range_allocator.h), so a whole model draws with a single
+//   bind and a DrawIndexed per part: first_index and base_vertex get the mesh's offsets added.
+// Meshes are written in with UpdateSubresource as they come in, and their ranges go back to the
+//   free list when they're unloaded for the next ones to reuse. Both buffers count as one
+//   resource each in d3d.budget, at their full size.
+
+struct Gpu_Mesh_Arena
+{
+    Gpu_Buffer vertices;
+    Gpu_Buffer indices;
+    Range_Allocator vertex_ranges;
+    Range_Allocator index_ranges;
+};
+
+// Where a mesh lives in the arena, in vertices and indices.
+struct Gpu_Mesh_Range
+{
+    uint first_vertex;
+    uint num_vertices;
+    uint first_index;
+    uint num_indices;
+};
+
+bool create_gpu_mesh_arena(Gpu_Mesh_Arena *it, uint max_vertices, uint vertex_stride, uint max_indices, uint index_stride, const char *asset = NULL)
+{
+    ZeroThat(it);
+    if (!create_gpu_buffer(&it->vertices, NULL, max_vertices ? max_vertices : 1, vertex_stride, D3D11_BIND_VERTEX_BUFFER, asset))
+        return false;
+    if (!create_gpu_buffer(&it->indices, NULL, max_indices ? max_indices : 1, index_stride, D3D11_BIND_INDEX_BUFFER, asset))
+    {
+        release_gpu_buffer(&it->vertices);
+        return false;
+    }
+
+    init_range_allocator(&it->vertex_ranges, max_vertices);
+    init_range_allocator(&it->index_ranges, max_indices);
+    return true;
+}
+
+void release_gpu_mesh_arena(Gpu_Mesh_Arena *it)
+{
+    if (it->vertices.handle)
+        release_gpu_buffer(&it->vertices);
+    if (it->indices.handle)
+        release_gpu_buffer(&it->indices);
+    free_range_allocator(&it->vertex_ranges);
+    free_range_allocator(&it->index_ranges);
+    ZeroThat(it);
+}
+
+// Fails when the strides don't match the arena's or there's no room left.
+bool upload_gpu_mesh(Gpu_Mesh_Arena *it, Gpu_Mesh_Range *range, const void *vertices, uint num_vertices, uint vertex_stride,
+                     const void *indices, uint num_indices, uint index_stride)
+{
+    ZeroThat(range);
+    if (vertex_stride != it->vertices.element_stride || index_stride != it->indices.element_stride)
+    {
+        LOGF("Mesh doesn't fit the arena: %u byte vertices, %u byte indices\n", vertex_stride, index_stride);
+        return false;
+    }
+
+    if (!allocate_range(&it->vertex_ranges, num_vertices, &range->first_vertex))
+    {
+        LOGF("Mesh arena is out of vertices: %u wanted, %u of %u used\n", num_vertices, it->vertex_ranges.used, it->vertex_ranges.capacity);
+        return false;
+    }
+    if (!allocate_range(&it->index_ranges, num_indices, &range->first_index))
+    {
+        LOGF("Mesh arena is out of indices: %u wanted, %u of %u used\n", num_indices, it->index_ranges.used, it->index_ranges.capacity);
+        release_range(&it->vertex_ranges, range->first_vertex, num_vertices);
+        return false;
+    }
+    range->num_vertices = num_vertices;
+    range->num_indices = num_indices;
+
+    D3D11_BOX box = {};
+    box.bottom = box.back = 1;
+    if (num_vertices)
+    {
+        box.left = range->first_vertex * vertex_stride;
+        box.right = box.left + num_vertices * vertex_stride;
+        d3d.context->UpdateSubresource(it->vertices.handle, 0, &box, vertices, 0, 0);
+    }
+    if (num_indices)
+    {
+        box.left = range->first_index * index_stride;
+        box.right = box.left + num_indices * index_stride;
+        d3d.context->UpdateSubresource(it->indices.handle, 0, &box, indices, 0, 0);
+    }
+    return true;
+}
+
+// The range's contents stay in the buffers until something else gets uploaded over them.
+void unload_gpu_mesh(Gpu_Mesh_Arena *it, Gpu_Mesh_Range *range)
+{
+    release_range(&it->vertex_ranges, range->first_vertex, range->num_vertices);
+    release_range(&it->index_ranges, range->first_index, range->num_indices);
+    ZeroThat(range);
+}
+
+void bind_gpu_mesh_arena(Gpu_Mesh_Arena *it)
+{
+    bind_gpu_buffer(&it->vertices);
+    bind_gpu_buffer(&it->indices);
 }
 
 /// ============ GPU IMAGE ============ ///
@@ -357,29 +499,48 @@ struct Gpu_Image
     uint size[2];
 };
 
-bool create_gpu_image(Gpu_Image *it, void *data, uint width, uint height)
+// data holds num_levels mips back to back, largest first, the way a DDS file stores them.
+// Compressed textures can't be render targets, so they're only bound as shader resources.
+// asset names what the image belongs to in d3d.budget, evictable ones are handed to its evictor.
+bool create_gpu_image(Gpu_Image *it, void *data, uint width, uint height, Texture_Format format = TEXTURE_FORMAT_RGBA8, uint num_levels = 1,
+                      const char *asset = NULL, bool evictable = false)
 {
     D3D11_TEXTURE2D_DESC texture_desc;
-    D3D11_SUBRESOURCE_DATA texture_data;
-    auto data_ptr = &texture_data;
+    D3D11_SUBRESOURCE_DATA texture_data[16];
+    auto data_ptr = texture_data;
+    ZeroThat(&texture_desc);
+    ZeroThat(&texture_data);
+    ASSERT(num_levels && num_levels <= ARRAYSIZE(texture_data));
 
-    texture_desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+    texture_desc.Format = (DXGI_FORMAT)format;
     texture_desc.Width = width;
     texture_desc.Height = height;
     texture_desc.ArraySize = 1;
-    texture_desc.MipLevels = 1;
-    texture_desc.BindFlags = D3D11_BIND_RENDER_TARGET|D3D11_BIND_SHADER_RESOURCE;
+    texture_desc.MipLevels = num_levels;
+    texture_desc.BindFlags = is_block_compressed(format) ? D3D11_BIND_SHADER_RESOURCE : D3D11_BIND_RENDER_TARGET|D3D11_BIND_SHADER_RESOURCE;
     texture_desc.SampleDesc.Count = 1;
     
-    texture_data.pSysMem = data;
-    texture_data.SysMemPitch = (4 * width);
+    auto level_data = (uchar *)data;
+    size_t bytes = 0;
+    for (auto i = 0; i != num_levels; ++i)
+    {
+        uint level_width = get_mip_dimension(width, i);
+        uint level_height = get_mip_dimension(height, i);
+        texture_data[i].pSysMem = level_data + bytes;
+        texture_data[i].SysMemPitch = get_texture_row_pitch(format, level_width);
+        bytes += get_texture_level_size(format, level_width, level_height);
+    }
     if (!data)
         data_ptr = NULL;
 
+    if (!reserve_gpu_memory(&d3d.budget, bytes))
+        return false;
+
     if (FAILED(d3d.device->CreateTexture2D(&texture_desc, data_ptr, &it->handle))) {
-        LOGF("Failed: %p, %dx%d\n", data, width, height);
+        LOGF("Failed: %p, %dx%d %s\n", data, width, height, get_texture_format_name(format));
         return false;
     }
+    track_gpu_resource(&d3d.budget, it->handle, GPU_RESOURCE_TEXTURE, bytes, asset, evictable);
 
     it->size[0] = width;
     it->size[1] = height;
@@ -389,6 +550,7 @@ bool create_gpu_image(Gpu_Image *it, void *data, uint width, uint height)
 
 void release_gpu_image(Gpu_Image *it)
 {
+    untrack_gpu_resource(&d3d.budget, it->handle);
     it->handle->Release();
     ZeroThat(it);
 }
@@ -425,7 +587,10 @@ struct Gpu_Shader
     int type;
 };
 
-bool create_gpu_shader(Gpu_Shader *it, void *bytecode, size_t bytecode_size)
+// layout overrides the input layout that would otherwise be built from reflection,
+//   which can only guess 32-bit formats. asset names the shader's cbuffers in d3d.budget.
+bool create_gpu_shader(Gpu_Shader *it, void *bytecode, size_t bytecode_size, const D3D11_INPUT_ELEMENT_DESC *layout = NULL, uint num_layout_elements = 0,
+                       const char *asset = NULL)
 {
     ID3D11ShaderReflection *reflector;
     if (FAILED(D3DReflect(bytecode, bytecode_size, IID_PPV_ARGS(&reflector))))
@@ -491,7 +656,10 @@ bool create_gpu_shader(Gpu_Shader *it, void *bytecode, size_t bytecode_size)
             }
         }
 
-        d3d.device->CreateInputLayout(input_elements, shader_desc.InputParameters, bytecode, bytecode_size, &it->vs.layout);
+        if (layout)
+            d3d.device->CreateInputLayout(layout, num_layout_elements, bytecode, bytecode_size, &it->vs.layout);
+        else
+            d3d.device->CreateInputLayout(input_elements, shader_desc.InputParameters, bytecode, bytecode_size, &it->vs.layout);
         it->type = D3D11_SHVER_VERTEX_SHADER;
         
     } else
@@ -527,6 +695,7 @@ bool create_gpu_shader(Gpu_Shader *it, void *bytecode, size_t bytecode_size)
             buffer_desc.Usage = D3D11_USAGE_DYNAMIC;
             buffer_desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
             d3d.device->CreateBuffer(&buffer_desc, NULL, &it->cbuffers.handles[i]);
+            track_gpu_resource(&d3d.budget, it->cbuffers.handles[i], GPU_RESOURCE_CONSTANT_BUFFER, buffer_desc.ByteWidth, asset);
         }
     }
 
@@ -535,36 +704,18 @@ bool create_gpu_shader(Gpu_Shader *it, void *bytecode, size_t bytecode_size)
     return true;
 }
 
-bool compile_gpu_shader(Gpu_Shader *it, char *path, int type)
+// source doesn't need to be NUL terminated, name is only for the compiler's messages.
+bool compile_gpu_shader_source(Gpu_Shader *it, const char *source, size_t source_size, const char *name, int type, const D3D11_INPUT_ELEMENT_DESC *layout = NULL, uint num_layout_elements = 0)
 {
-    char *buffer = NULL;
-    LARGE_INTEGER li;
-    HANDLE file;
-
-    file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ|FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 128, NULL);
-    if (file == (HANDLE)-1)
-    {
-        LOGF("Failed: %s\n", path);
-        return false;
-    }
-
-    GetFileSizeEx(file, &li);
-    buffer = (char *)malloc(li.QuadPart + 1);
-    buffer[li.QuadPart] = 0;
-    
-    ReadFile(file, buffer, li.LowPart, NULL, NULL);
-    CloseHandle(file);
-
-    ///
     ID3DBlob *source_blob, *error_blob;
     const char *model = "vs_5_0";
     if (type == D3D11_SHVER_PIXEL_SHADER)
         model = "ps_5_0";
     
     if (FAILED(D3DCompile(
-                   buffer,
-                   li.QuadPart,
-                   NULL,
+                   source,
+                   source_size,
+                   name,
                    NULL,
                    D3D_COMPILE_STANDARD_FILE_INCLUDE,
                    "main",
@@ -577,13 +728,36 @@ bool compile_gpu_shader(Gpu_Shader *it, char *path, int type)
         char *error_message = (char *)error_blob->GetBufferPointer();
         printf(error_message);
         error_blob->Release();
-        free(buffer);
         return false;
     }
 
-    bool result = create_gpu_shader(it, source_blob->GetBufferPointer(), source_blob->GetBufferSize());
+    bool result = create_gpu_shader(it, source_blob->GetBufferPointer(), source_blob->GetBufferSize(), layout, num_layout_elements, name);
     
     source_blob->Release();
+    return result;
+}
+
+bool compile_gpu_shader(Gpu_Shader *it, char *path, int type, const D3D11_INPUT_ELEMENT_DESC *layout = NULL, uint num_layout_elements = 0)
+{
+    char *buffer = NULL;
+    LARGE_INTEGER li;
+    HANDLE file;
+
+    file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ|FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 128, NULL);
+    if (file == (HANDLE)-1)
+    {
+        LOGF("Failed: %s\n", path);
+        return false;
+    }
+
+    GetFileSizeEx(file, &li);
+    buffer = (char *)malloc(li.QuadPart + 1);
+    buffer[li.QuadPart] = 0;
+    
+    ReadFile(file, buffer, li.LowPart, NULL, NULL);
+    CloseHandle(file);
+
+    bool result = compile_gpu_shader_source(it, buffer, li.QuadPart, path, type, layout, num_layout_elements);
     free(buffer);
     return result;
 }
@@ -605,6 +779,7 @@ void release_gpu_shader(Gpu_Shader *it)
         for (auto i = 0; i != it->cbuffers.count; ++i)
         {
             free(it->cbuffers.data[i].data);
+            untrack_gpu_resource(&d3d.budget, it->cbuffers.handles[i]);
             it->cbuffers.handles[i]->Release();
         }
         free(it->cbuffers.data);
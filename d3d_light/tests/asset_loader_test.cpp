@@ -0,0 +1,218 @@
+// Load and complete ordering of the asset loader (see asset_loader.h).
+#include "test_common.h"
+
+#include <atomic>
+
+#include "asset_loader.h"
+
+// One request's worth of state. load waits for its gate, so the test decides the finish order.
+struct Test_Load
+{
+    Asset_Loader *loader;
+    std::atomic<bool> gate;
+    bool fail;
+    uint num_children; // requests complete issues
+
+    uint children[4];
+    uint num_completes;
+    uint completed_as; // position among all completes, from 1
+    bool completed_loaded;
+};
+
+static uint test_completes;
+
+static void init_test_load(Test_Load *it, Asset_Loader *loader, bool gate = true)
+{
+    it->loader = loader;
+    it->gate = gate;
+    it->fail = false;
+    it->num_children = 0;
+    it->num_completes = 0;
+    it->completed_as = 0;
+    it->completed_loaded = false;
+}
+
+static bool load_test_asset(void *user)
+{
+    auto it = (Test_Load *)user;
+    while (!it->gate)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    return !it->fail;
+}
+
+static bool complete_test_asset(void *user, bool loaded)
+{
+    auto it = (Test_Load *)user;
+    ++it->num_completes;
+    it->completed_as = ++test_completes;
+    it->completed_loaded = loaded;
+
+    // Children only come from a load that worked, same as a scene's meshes.
+    for (auto i = 0; i != it->num_children && loaded; ++i)
+    {
+        auto child = new Test_Load();
+        init_test_load(child, it->loader);
+        it->children[i] = request_asset_load(it->loader, load_test_asset, complete_test_asset, child);
+    }
+    return loaded;
+}
+
+// Polls until count loads finished, like the main loop would every frame.
+static bool wait_for_loads(Asset_Loader *it, uint count)
+{
+    for (auto i = 0; i != 2000; ++i)
+    {
+        {
+            std::lock_guard<std::mutex> lock(it->pool->mutex);
+            if (it->pool->num_done >= count)
+                return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return false;
+}
+
+// Completes go in the order loads finished, not the order they were requested.
+static void test_finish_order()
+{
+    Asset_Loader loader;
+    init_asset_loader(&loader, 16, 3);
+    test_completes = 0;
+
+    Test_Load loads[3];
+    uint requests[3];
+    for (auto i = 0; i != 3; ++i)
+    {
+        init_test_load(&loads[i], &loader, false);
+        requests[i] = request_asset_load(&loader, load_test_asset, complete_test_asset, &loads[i]);
+    }
+    CHECK(get_asset_state(&loader, requests[0]) == ASSET_PENDING);
+
+    // Finish 2, then 0, then 1.
+    const uint finish[3] = { 2, 0, 1 };
+    for (auto i = 0; i != 3; ++i)
+    {
+        loads[finish[i]].gate = true;
+        CHECK(wait_for_loads(&loader, i + 1));
+    }
+    complete_asset_loads(&loader, 1000.0f);
+
+    CHECK(loads[2].completed_as == 1);
+    CHECK(loads[0].completed_as == 2);
+    CHECK(loads[1].completed_as == 3);
+    for (auto i = 0; i != 3; ++i)
+        CHECK(get_asset_state(&loader, requests[i]) == ASSET_READY);
+    CHECK(are_asset_loads_done(&loader));
+
+    shutdown_asset_loader(&loader);
+}
+
+// A budget that's already spent still completes one load per call, the rest wait as loaded.
+static void test_budget()
+{
+    Asset_Loader loader;
+    init_asset_loader(&loader, 16, 2);
+    test_completes = 0;
+
+    Test_Load loads[3];
+    uint requests[3];
+    for (auto i = 0; i != 3; ++i)
+    {
+        init_test_load(&loads[i], &loader);
+        loads[i].fail = (i == 1);
+        requests[i] = request_asset_load(&loader, load_test_asset, complete_test_asset, &loads[i]);
+    }
+    CHECK(wait_for_loads(&loader, 3));
+
+    for (auto call = 0; call != 3; ++call)
+    {
+        complete_asset_loads(&loader, 0.0f);
+        CHECK(test_completes == call + 1);
+
+        uint num_loaded = 0;
+        for (auto i = 0; i != 3; ++i)
+            num_loaded += (get_asset_state(&loader, requests[i]) == ASSET_LOADED);
+        CHECK(num_loaded == 2 - call);
+    }
+
+    // The failed load still gets its complete, told it failed.
+    CHECK(get_asset_state(&loader, requests[1]) == ASSET_FAILED);
+    CHECK(loads[1].num_completes == 1 && !loads[1].completed_loaded);
+    CHECK(get_asset_state(&loader, requests[0]) == ASSET_READY);
+    CHECK(get_asset_state(&loader, ASSET_NO_REQUEST) == ASSET_FAILED);
+
+    shutdown_asset_loader(&loader);
+}
+
+// Requests made from a complete step get loaded and completed on later calls.
+static void test_requests_from_complete()
+{
+    Asset_Loader loader;
+    init_asset_loader(&loader, 16, 2);
+    test_completes = 0;
+
+    Test_Load parent;
+    init_test_load(&parent, &loader);
+    parent.num_children = 3;
+    uint request = request_asset_load(&loader, load_test_asset, complete_test_asset, &parent);
+    CHECK(wait_for_loads(&loader, 1));
+    complete_asset_loads(&loader, 1000.0f);
+    CHECK(get_asset_state(&loader, request) == ASSET_READY);
+    CHECK(loader.num_requests == 4);
+    CHECK(!are_asset_loads_done(&loader));
+
+    CHECK(wait_for_loads(&loader, 4));
+    complete_asset_loads(&loader, 1000.0f);
+    CHECK(are_asset_loads_done(&loader));
+
+    bool children_ready = true;
+    for (auto i = 0; i != parent.num_children; ++i)
+    {
+        auto child = (Test_Load *)loader.requests[parent.children[i]].user;
+        children_ready = children_ready && get_asset_state(&loader, parent.children[i]) == ASSET_READY && child->num_completes == 1;
+        delete child;
+    }
+    CHECK(children_ready);
+
+    shutdown_asset_loader(&loader);
+}
+
+// Shutdown completes what finished but wasn't completed with loaded == false, and nothing twice.
+static void test_shutdown()
+{
+    Asset_Loader loader;
+    init_asset_loader(&loader, 16, 2);
+    test_completes = 0;
+
+    Test_Load loads[3];
+    for (auto i = 0; i != 3; ++i)
+    {
+        init_test_load(&loads[i], &loader);
+        request_asset_load(&loader, load_test_asset, complete_test_asset, &loads[i]);
+    }
+    CHECK(wait_for_loads(&loader, 3));
+    complete_asset_loads(&loader, 0.0f);
+    CHECK(test_completes == 1);
+
+    shutdown_asset_loader(&loader);
+    CHECK(test_completes == 3);
+
+    bool once_each = true;
+    uint num_unloaded = 0;
+    for (auto i = 0; i != 3; ++i)
+    {
+        once_each = once_each && loads[i].num_completes == 1;
+        num_unloaded += !loads[i].completed_loaded;
+    }
+    CHECK(once_each);
+    CHECK(num_unloaded == 2);
+}
+
+int main()
+{
+    test_finish_order();
+    test_budget();
+    test_requests_from_complete();
+    test_shutdown();
+    return finish_tests("asset_loader_test");
+}
@@ -0,0 +1,244 @@
+// Block encoders and decoders (see bc_compress.h).
+#include "test_common.h"
+
+#include "bc_compress.h"
+
+// Smooth gradients with some noise on top, like a photographed texture would have.
+static uchar *make_test_image(uint width, uint height)
+{
+    uchar *rgba = (uchar *)malloc((size_t)width * height * 4);
+    uint seed = 17;
+    for (auto y = 0; y != height; ++y)
+    {
+        for (auto x = 0; x != width; ++x)
+        {
+            uchar *pixel = &rgba[(y * width + x) * 4];
+            int noise = (int)(test_random(&seed) % 9) - 4;
+            pixel[0] = (uchar)bc_clamp(x * 255 / width + noise, 0, 255);
+            pixel[1] = (uchar)bc_clamp(y * 255 / height - noise, 0, 255);
+            pixel[2] = (uchar)bc_clamp(128 + (int)(100.0f * sinf((float)(x + y) * 0.05f)) + noise, 0, 255);
+            pixel[3] = (uchar)bc_clamp(255 - x * 2 + noise, 0, 255);
+        }
+    }
+    return rgba;
+}
+
+// Every format decodes back close to the source, and the SSE2 and scalar paths write the same blocks.
+static void test_round_trip()
+{
+    const uint width = 61, height = 37; // partial blocks on both edges
+    uchar *rgba = make_test_image(width, height);
+
+    struct {
+        Texture_Format format;
+        uint channel_mask;
+        float min_psnr;
+    } cases[] = {
+        { TEXTURE_FORMAT_BC1, 0x7, 30.0f },
+        { TEXTURE_FORMAT_BC3, 0xF, 30.0f },
+        { TEXTURE_FORMAT_BC4, 0x1, 40.0f },
+        { TEXTURE_FORMAT_BC5, 0x3, 40.0f },
+        { TEXTURE_FORMAT_BC7, 0xF, 35.0f },
+    };
+
+    for (auto c = 0; c != sizeof(cases) / sizeof(cases[0]); ++c)
+    {
+        size_t size = get_texture_level_size(cases[c].format, width, height);
+        uchar *blocks = (uchar *)malloc(size);
+        uchar *scalar_blocks = (uchar *)malloc(size);
+        uchar *decoded = (uchar *)malloc(width * height * 4);
+
+        compress_texture(cases[c].format, rgba, width, height, blocks, 2);
+        bc_disable_sse = true;
+        compress_texture(cases[c].format, rgba, width, height, scalar_blocks, 1);
+        bc_disable_sse = false;
+        CHECK(!memcmp(blocks, scalar_blocks, size));
+
+        CHECK(decompress_texture(cases[c].format, blocks, width, height, decoded));
+        float psnr = compute_texture_psnr(rgba, decoded, width, height, cases[c].channel_mask);
+        if (psnr < cases[c].min_psnr)
+            LOGF("%s: %.2f dB\n", get_texture_format_name(cases[c].format), psnr);
+        CHECK(psnr >= cases[c].min_psnr);
+
+        free(decoded);
+        free(scalar_blocks);
+        free(blocks);
+    }
+    free(rgba);
+}
+
+// Flat blocks come back exactly from BC4, and within 1 from BC7 mode 6, whose p-bit is shared by
+//   all channels of an endpoint.
+static void test_flat_blocks()
+{
+    uchar pixels[64], decoded[64], block[16];
+    uint seed = 5;
+    bool exact = true, close = true;
+    for (auto run = 0; run != 64; ++run)
+    {
+        uint color = test_random(&seed);
+        for (auto i = 0; i != 16; ++i)
+            memcpy(&pixels[i * 4], &color, 4);
+
+        encode_bc7_block(pixels, block);
+        close = close && decode_bc7_block(block, decoded);
+        for (auto i = 0; i != 64; ++i)
+            close = close && abs((int)pixels[i] - (int)decoded[i]) <= 1;
+
+        uchar values[16], decoded_values[16];
+        memset(values, pixels[0], sizeof(values));
+        encode_bc4_block(values, block);
+        decode_bc4_block(block, decoded_values);
+        exact = exact && !memcmp(values, decoded_values, 16);
+    }
+    CHECK(close);
+    CHECK(exact);
+}
+
+static int expand_bc7_test_endpoint(int value, uint bits)
+{
+    return (value << (8 - bits)) | (value >> (2 * bits - 8));
+}
+
+// Builds a block of the given mode field by field: the anchors get index 0 and everything else
+//   index, so each pixel has to come out as its own subset's endpoints mixed by that index. That
+//   pins down the field layout, the partition tables and the anchors together.
+static bool check_bc7_mode(uint mode, uint partition, uint rotation, uint selection, uint index)
+{
+    auto info = &bc7_modes[mode];
+    uchar block[16] = {};
+    uint position = 0;
+    put_bc7_bits(block, &position, 1u << mode, mode + 1);
+    put_bc7_bits(block, &position, partition, info->partition_bits);
+    put_bc7_bits(block, &position, rotation, info->rotation_bits);
+    put_bc7_bits(block, &position, selection, info->selection_bits);
+
+    int endpoints[3][2][4];
+    uint num_endpoints = info->subsets * 2;
+    for (auto k = 0; k != 4; ++k)
+    {
+        uint bits = (k == 3) ? info->alpha_bits : info->color_bits;
+        for (auto e = 0; e != num_endpoints; ++e)
+        {
+            int value = (int)(((e * 7 + k * 5 + 3) * 37) & ((1u << bits) - 1));
+            endpoints[e / 2][e % 2][k] = bits ? value : 255;
+            put_bc7_bits(block, &position, value, bits);
+        }
+    }
+
+    uint color_bits = info->color_bits, alpha_bits = info->alpha_bits;
+    if (info->endpoint_pbits || info->shared_pbits)
+    {
+        for (auto e = 0; e != num_endpoints; ++e)
+        {
+            int pbit = info->endpoint_pbits ? (e & 1) : ((e / 2) & 1);
+            if (info->endpoint_pbits || !(e & 1))
+                put_bc7_bits(block, &position, pbit, 1);
+            for (auto k = 0; k != (alpha_bits ? 4 : 3); ++k)
+                endpoints[e / 2][e % 2][k] = (endpoints[e / 2][e % 2][k] << 1) | pbit;
+        }
+        ++color_bits;
+        alpha_bits += alpha_bits ? 1 : 0;
+    }
+    for (auto e = 0; e != num_endpoints; ++e)
+        for (auto k = 0; k != 4; ++k)
+            if ((k == 3) ? alpha_bits : color_bits)
+                endpoints[e / 2][e % 2][k] = expand_bc7_test_endpoint(endpoints[e / 2][e % 2][k], (k == 3) ? alpha_bits : color_bits);
+
+    for (auto i = 0; i != 16; ++i)
+    {
+        bool anchor = is_bc7_anchor(info->subsets, partition, i);
+        put_bc7_bits(block, &position, anchor ? 0 : index, info->index_bits - (anchor ? 1 : 0));
+    }
+    if (info->index_bits2)
+        for (auto i = 0; i != 16; ++i)
+            put_bc7_bits(block, &position, i ? index : 0, info->index_bits2 - (i ? 0 : 1));
+    if (position != 128)
+        return false;
+
+    uchar pixels[64];
+    if (!decode_bc7_block(block, pixels))
+        return false;
+
+    for (auto i = 0; i != 16; ++i)
+    {
+        auto e = endpoints[get_bc7_subset(info->subsets, partition, i)];
+        bool anchor = is_bc7_anchor(info->subsets, partition, i);
+        int color_weight = anchor ? 0 : get_bc7_weight(info->index_bits, index);
+        int alpha_weight = color_weight;
+        if (info->index_bits2)
+        {
+            int weight2 = i ? get_bc7_weight(info->index_bits2, index) : 0;
+            int weight1 = color_weight;
+            color_weight = selection ? weight2 : weight1;
+            alpha_weight = selection ? weight1 : weight2;
+        }
+
+        uchar expected[4];
+        for (auto k = 0; k != 4; ++k)
+        {
+            int w = (k == 3) ? alpha_weight : color_weight;
+            expected[k] = (uchar)(((64 - w) * e[0][k] + w * e[1][k] + 32) >> 6);
+        }
+        if (rotation)
+        {
+            uchar t = expected[3];
+            expected[3] = expected[rotation - 1];
+            expected[rotation - 1] = t;
+        }
+        if (memcmp(expected, &pixels[i * 4], 4))
+            return false;
+    }
+    return true;
+}
+
+static void test_bc7_modes()
+{
+    for (auto mode = 0; mode != 8; ++mode)
+    {
+        auto info = &bc7_modes[mode];
+        bool all_pass = true;
+        for (auto partition = 0; partition != (1u << info->partition_bits); ++partition)
+        {
+            for (auto rotation = 0; rotation != (1u << info->rotation_bits); ++rotation)
+            {
+                for (auto selection = 0; selection != (1u << info->selection_bits); ++selection)
+                {
+                    // The top index (only non-anchors can have it) and 1, which blends.
+                    uint top = (1u << info->index_bits) - 1;
+                    all_pass = all_pass && check_bc7_mode(mode, partition, rotation, selection, top);
+                    all_pass = all_pass && check_bc7_mode(mode, partition, rotation, selection, 1);
+                }
+            }
+        }
+        if (!all_pass)
+            LOGF("BC7 mode %d\n", mode);
+        CHECK(all_pass);
+    }
+
+    // A zero first byte is no mode at all.
+    uchar block[16] = {}, pixels[64];
+    CHECK(!decode_bc7_block(block, pixels));
+}
+
+// Every anchor is in the subset it anchors, which is what lets the index drop a bit there.
+static void test_bc7_tables()
+{
+    bool consistent = true;
+    for (auto p = 0; p != 64; ++p)
+    {
+        consistent = consistent && get_bc7_subset(2, p, 0) == 0 && get_bc7_subset(2, p, bc7_anchors2[p]) == 1;
+        consistent = consistent && get_bc7_subset(3, p, 0) == 0 && get_bc7_subset(3, p, bc7_anchors3[0][p]) == 1 &&
+                     get_bc7_subset(3, p, bc7_anchors3[1][p]) == 2;
+    }
+    CHECK(consistent);
+}
+
+int main()
+{
+    test_round_trip();
+    test_flat_blocks();
+    test_bc7_tables();
+    test_bc7_modes();
+    return finish_tests("bc_compress_test");
+}
@@ -0,0 +1,155 @@
+// Keys of shaders and their #include chains (see cook_cache.h).
+#include "test_common.h"
+
+#include "cook_cache.h"
+
+#define TEST_DIRECTORY "cook_cache_test_files"
+
+static void write_test_file(const char *name, const char *text)
+{
+    char path[COOK_MAX_PATH];
+    snprintf(path, sizeof(path), TEST_DIRECTORY "/%s", name);
+    FILE *file = fopen(path, "wb");
+    if (file)
+    {
+        fputs(text, file);
+        fclose(file);
+    }
+}
+
+static void remove_test_file(const char *name)
+{
+    char path[COOK_MAX_PATH];
+    snprintf(path, sizeof(path), TEST_DIRECTORY "/%s", name);
+    remove(path);
+}
+
+// Key of a shader rule, the way cook.cpp makes it: the source, then everything it includes.
+static uint64_t get_shader_key(const char *name, bool *out_result)
+{
+    char path[COOK_MAX_PATH];
+    snprintf(path, sizeof(path), TEST_DIRECTORY "/%s", name);
+    uint64_t hash = 0, key = mix_cook_key(0, path);
+    *out_result = hash_cook_file(path, &hash) && mix_cook_includes(&key, path);
+    return mix_cook_key(key, hash);
+}
+
+// Touching the end of a -> b -> c changes a's key and only a's.
+static void test_include_chain()
+{
+    write_test_file("a.hlsl", "#include \"b.hlsl\"\nfloat4 a() { return b(); }\n");
+    write_test_file("b.hlsl", "  #  include \"c.hlsl\"\nfloat4 b() { return c(); }\n");
+    write_test_file("c.hlsl", "float4 c() { return 0; }\n");
+    write_test_file("d.hlsl", "#include \"e.hlsl\"\nfloat4 d() { return e(); }\n");
+    write_test_file("e.hlsl", "float4 e() { return 1; }\n");
+
+    auto seen = (Cook_Path_List *)calloc(1, sizeof(Cook_Path_List));
+    CHECK(flatten_hlsl_file(TEST_DIRECTORY "/a.hlsl", seen));
+    CHECK(seen->count == 3 && !strcmp(seen->paths[2], TEST_DIRECTORY "/c.hlsl"));
+    free(seen);
+
+    bool a_result, d_result;
+    uint64_t a_key = get_shader_key("a.hlsl", &a_result);
+    uint64_t d_key = get_shader_key("d.hlsl", &d_result);
+    CHECK(a_result && d_result && a_key != d_key);
+
+    // Same files, same keys.
+    CHECK(get_shader_key("a.hlsl", &a_result) == a_key && get_shader_key("d.hlsl", &d_result) == d_key);
+
+    write_test_file("c.hlsl", "float4 c() { return 2; }\n");
+    uint64_t touched_a_key = get_shader_key("a.hlsl", &a_result);
+    uint64_t touched_d_key = get_shader_key("d.hlsl", &d_result);
+    CHECK(a_result && touched_a_key != a_key);
+    CHECK(d_result && touched_d_key == d_key);
+
+    // A missing include fails the key instead of leaving it out.
+    remove_test_file("c.hlsl");
+    get_shader_key("a.hlsl", &a_result);
+    CHECK(!a_result);
+
+    const char *names[] = { "a.hlsl", "b.hlsl", "d.hlsl", "e.hlsl" };
+    for (auto i = 0; i != 4; ++i)
+        remove_test_file(names[i]);
+}
+
+// x -> y -> x ends, and the flattened source has each of them once.
+static void test_include_cycle()
+{
+    write_test_file("x.hlsl", "#include \"y.hlsl\"\nfloat4 x() { return 0; }\n");
+    write_test_file("y.hlsl", "#include \"x.hlsl\"\nfloat4 y() { return 1; }\n");
+
+    const char *flat_path = TEST_DIRECTORY "/flat.hlsl";
+    FILE *flat = fopen(flat_path, "wb");
+    auto seen = (Cook_Path_List *)calloc(1, sizeof(Cook_Path_List));
+    CHECK(flat && flatten_hlsl_file(TEST_DIRECTORY "/x.hlsl", seen, flat));
+    if (flat)
+        fclose(flat);
+    CHECK(seen->count == 2);
+    free(seen);
+
+    char text[1024] = {};
+    flat = fopen(flat_path, "rb");
+    if (flat)
+    {
+        fread(text, 1, sizeof(text) - 1, flat);
+        fclose(flat);
+    }
+    auto x = strstr(text, "float4 x()"), y = strstr(text, "float4 y()");
+    CHECK(x && y && y < x && !strstr(x + 1, "float4 x()") && !strstr(y + 1, "float4 y()"));
+    CHECK(!strstr(text, "#include"));
+
+    bool result;
+    get_shader_key("x.hlsl", &result);
+    CHECK(result);
+
+    remove(flat_path);
+    remove_test_file("x.hlsl");
+    remove_test_file("y.hlsl");
+}
+
+// One include past COOK_MAX_INCLUDES fails the flatten and the key.
+static void test_too_many_includes()
+{
+    char name[32], source[COOK_MAX_INCLUDES * 32] = {};
+    for (auto i = 0; i != COOK_MAX_INCLUDES; ++i)
+    {
+        snprintf(name, sizeof(name), "many_%d.hlsl", i);
+        write_test_file(name, "\n");
+        snprintf(source + strlen(source), sizeof(source) - strlen(source), "#include \"%s\"\n", name);
+    }
+    write_test_file("many.hlsl", source);
+
+    // The source and all but one include fit.
+    auto seen = (Cook_Path_List *)calloc(1, sizeof(Cook_Path_List));
+    CHECK(!flatten_hlsl_file(TEST_DIRECTORY "/many.hlsl", seen));
+    CHECK(seen->full && seen->count == COOK_MAX_INCLUDES);
+    free(seen);
+
+    bool result;
+    get_shader_key("many.hlsl", &result);
+    CHECK(!result);
+
+    // One fewer fits exactly.
+    snprintf(name, sizeof(name), "#include \"many_%d.hlsl\"\n", COOK_MAX_INCLUDES - 1);
+    *strstr(source, name) = 0;
+    write_test_file("many.hlsl", source);
+    get_shader_key("many.hlsl", &result);
+    CHECK(result);
+
+    for (auto i = 0; i != COOK_MAX_INCLUDES; ++i)
+    {
+        snprintf(name, sizeof(name), "many_%d.hlsl", i);
+        remove_test_file(name);
+    }
+    remove_test_file("many.hlsl");
+}
+
+int main()
+{
+    make_cook_parent_directories(TEST_DIRECTORY "/");
+    test_include_chain();
+    test_include_cycle();
+    test_too_many_includes();
+    remove(TEST_DIRECTORY);
+    return finish_tests("cook_cache_test");
+}
@@ -0,0 +1,144 @@
+// Native .glb loading (see gltf.h).
+#include "test_common.h"
+
+#include "gltf.h"
+
+// A quad: positions and normals, its indices as UNSIGNED_SHORT and as an UNSIGNED_BYTE strip,
+//   plus index accessors glTF doesn't allow (FLOAT, SHORT, VEC2) over the same bytes.
+static const char test_json[] =
+    "{\"asset\":{\"version\":\"2.0\"},"
+    "\"buffers\":[{\"byteLength\":140}],"
+    "\"bufferViews\":["
+        "{\"buffer\":0,\"byteOffset\":0,\"byteLength\":48},"
+        "{\"buffer\":0,\"byteOffset\":48,\"byteLength\":48},"
+        "{\"buffer\":0,\"byteOffset\":96,\"byteLength\":12},"
+        "{\"buffer\":0,\"byteOffset\":108,\"byteLength\":4},"
+        "{\"buffer\":0,\"byteOffset\":116,\"byteLength\":24}],"
+    "\"accessors\":["
+        "{\"bufferView\":0,\"componentType\":5126,\"count\":4,\"type\":\"VEC3\"},"
+        "{\"bufferView\":1,\"componentType\":5126,\"count\":4,\"type\":\"VEC3\"},"
+        "{\"bufferView\":2,\"componentType\":5123,\"count\":6,\"type\":\"SCALAR\"},"
+        "{\"bufferView\":3,\"componentType\":5121,\"count\":4,\"type\":\"SCALAR\"},"
+        "{\"bufferView\":4,\"componentType\":5126,\"count\":6,\"type\":\"SCALAR\"},"
+        "{\"bufferView\":2,\"componentType\":5122,\"count\":6,\"type\":\"SCALAR\"},"
+        "{\"bufferView\":2,\"componentType\":5123,\"count\":3,\"type\":\"VEC2\"}],"
+    "\"meshes\":[{\"primitives\":["
+        "{\"attributes\":{\"POSITION\":0,\"NORMAL\":1},\"indices\":2},"
+        "{\"attributes\":{\"POSITION\":0},\"indices\":3,\"mode\":5},"
+        "{\"attributes\":{\"POSITION\":0},\"mode\":0},"
+        "{\"attributes\":{\"POSITION\":0},\"indices\":4},"
+        "{\"attributes\":{\"POSITION\":0},\"indices\":5},"
+        "{\"attributes\":{\"POSITION\":0},\"indices\":6}]}]}";
+
+#define TEST_BIN_SIZE 140
+
+static void put_test_uint(uchar *out, uint value)
+{
+    memcpy(out, &value, 4);
+}
+
+// Header, the JSON chunk padded with spaces, then the BIN chunk.
+static uchar *make_test_glb(size_t *out_size)
+{
+    uchar bin[TEST_BIN_SIZE] = {};
+    const float positions[12] = { 0, 0, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0 };
+    const float normals[12] = { 0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 1 };
+    const uint16_t indices[6] = { 0, 1, 2, 0, 2, 3 };
+    const uchar strip[4] = { 0, 1, 3, 2 };
+    const float float_indices[6] = { 0, 1, 2, 0, 2, 3 };
+    memcpy(bin, positions, 48);
+    memcpy(bin + 48, normals, 48);
+    memcpy(bin + 96, indices, 12);
+    memcpy(bin + 108, strip, 4);
+    memcpy(bin + 116, float_indices, 24);
+
+    uint json_size = (uint)strlen(test_json);
+    uint json_chunk = (json_size + 3) & ~3u;
+    size_t size = 12 + 8 + json_chunk + 8 + TEST_BIN_SIZE;
+
+    uchar *glb = (uchar *)malloc(size);
+    put_test_uint(glb, GLB_MAGIC);
+    put_test_uint(glb + 4, GLB_VERSION);
+    put_test_uint(glb + 8, (uint)size);
+    put_test_uint(glb + 12, json_chunk);
+    put_test_uint(glb + 16, GLB_CHUNK_JSON);
+    memset(glb + 20, ' ', json_chunk);
+    memcpy(glb + 20, test_json, json_size);
+    put_test_uint(glb + 20 + json_chunk, TEST_BIN_SIZE);
+    put_test_uint(glb + 24 + json_chunk, GLB_CHUNK_BIN);
+    memcpy(glb + 28 + json_chunk, bin, TEST_BIN_SIZE);
+
+    *out_size = size;
+    return glb;
+}
+
+// Indexed triangles come through as they are, strips become lists with flat normals.
+static void test_import(const Gltf_File *file)
+{
+    CHECK(count_gltf_primitives(file) == 5);
+
+    Cpu_Mesh mesh;
+    CHECK(import_gltf_primitive(&mesh, file, 0));
+    CHECK(mesh.num_vertices == 4 && mesh.num_indices == 6);
+    const uint quad[6] = { 0, 1, 2, 0, 2, 3 };
+    CHECK(mesh.indices && !memcmp(mesh.indices, quad, sizeof(quad)));
+    CHECK(mesh.vertices && mesh.vertices[2].position[0] == 1.0f && mesh.vertices[2].position[1] == 1.0f);
+    CHECK(mesh.vertices && mesh.vertices[3].normal[2] == 1.0f);
+    free_cpu_mesh(&mesh);
+
+    CHECK(import_gltf_primitive(&mesh, file, 1));
+    CHECK(mesh.num_vertices == 6 && mesh.num_indices == 6);
+    bool flat = true;
+    for (auto v = 0; v != mesh.num_vertices; ++v)
+        flat = flat && fabsf(fabsf(mesh.vertices[v].normal[2]) - 1.0f) < 1e-6f;
+    CHECK(flat);
+    free_cpu_mesh(&mesh);
+}
+
+// FLOAT, SHORT and VEC2 indices are turned away instead of read as 4 byte unsigned ones.
+static void test_index_types(const Gltf_File *file)
+{
+    Cpu_Mesh mesh;
+    for (auto i = 2; i != 5; ++i)
+    {
+        CHECK(!import_gltf_primitive(&mesh, file, i));
+        free_cpu_mesh(&mesh);
+    }
+
+    Gltf_Accessor accessor;
+    CHECK(get_gltf_accessor(file, 2, &accessor) && is_gltf_index_accessor(&accessor));
+    CHECK(get_gltf_accessor(file, 3, &accessor) && is_gltf_index_accessor(&accessor));
+    CHECK(get_gltf_accessor(file, 4, &accessor) && !is_gltf_index_accessor(&accessor));
+    CHECK(get_gltf_accessor(file, 5, &accessor) && !is_gltf_index_accessor(&accessor));
+    CHECK(get_gltf_accessor(file, 6, &accessor) && !is_gltf_index_accessor(&accessor));
+}
+
+// Anything that isn't a whole glTF 2.0 binary doesn't open.
+static void test_broken_files(const uchar *glb, size_t size)
+{
+    Gltf_File file;
+    CHECK(!open_gltf_memory(&file, glb, 11, "test"));
+    CHECK(!open_gltf_memory(&file, glb, size - 4, "test"));
+
+    uchar *copy = (uchar *)malloc(size);
+    memcpy(copy, glb, size);
+    put_test_uint(copy, 0);
+    CHECK(!open_gltf_memory(&file, copy, size, "test"));
+    free(copy);
+}
+
+int main()
+{
+    size_t size;
+    uchar *glb = make_test_glb(&size);
+
+    Gltf_File file;
+    CHECK(open_gltf_memory(&file, glb, size, "test"));
+    test_import(&file);
+    test_index_types(&file);
+    close_gltf(&file);
+
+    test_broken_files(glb, size);
+    free(glb);
+    return finish_tests("gltf_test");
+}
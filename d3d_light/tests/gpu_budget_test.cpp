@@ -0,0 +1,252 @@
+// GPU memory accounting, limits and eviction against a stand-in device (see gpu_budget.h), and
+//   the texture streamer giving way to it (see texture_streaming.h).
+#include "test_common.h"
+
+#include "gpu_budget.h"
+#include "texture_streaming.h"
+
+/// ============ STAND-IN DEVICE ============ ///
+// Resources are slots that only know their size. Creates go through reserve_gpu_memory and
+//   track_gpu_resource like the D3D11 ones do, releases through untrack_gpu_resource.
+
+#define TEST_MAX_RESOURCES 16
+
+struct Test_Device
+{
+    Gpu_Budget budget;
+    size_t bytes[TEST_MAX_RESOURCES];
+    bool alive[TEST_MAX_RESOURCES];
+    uint num_resources;
+
+    // Filled by the evict callback, in the order it was called.
+    const void *evicted[TEST_MAX_RESOURCES];
+    uint num_evicted;
+};
+
+static const void *create_test_resource(Test_Device *it, size_t bytes, bool evictable)
+{
+    if (!reserve_gpu_memory(&it->budget, bytes))
+        return NULL;
+
+    uint slot = it->num_resources++;
+    it->bytes[slot] = bytes;
+    it->alive[slot] = true;
+    track_gpu_resource(&it->budget, &it->alive[slot], GPU_RESOURCE_TEXTURE, bytes, "test", evictable);
+    return &it->alive[slot];
+}
+
+static void release_test_resource(Test_Device *it, const void *handle)
+{
+    untrack_gpu_resource(&it->budget, handle);
+    *(bool *)handle = false;
+}
+
+static bool evict_test_resource(void *user, const void *handle)
+{
+    auto it = (Test_Device *)user;
+    it->evicted[it->num_evicted++] = handle;
+    release_test_resource(it, handle);
+    return true;
+}
+
+static void init_test_device(Test_Device *it, size_t soft_limit, size_t hard_limit)
+{
+    ZeroThat(it);
+    init_gpu_budget(&it->budget, soft_limit, hard_limit);
+    set_gpu_budget_evictor(&it->budget, evict_test_resource, it);
+}
+
+/// ============ BUDGET ============ ///
+
+// The soft limit may be crossed and every crossing is counted, the hard one turns creates away.
+static void test_limits()
+{
+    Test_Device device;
+    init_test_device(&device, 1000, 2000);
+
+    CHECK(create_test_resource(&device, 600, false));
+    CHECK(create_test_resource(&device, 300, true));
+    CHECK(!device.budget.over_soft);
+    CHECK(get_gpu_soft_headroom(&device.budget) == 100);
+
+    auto crossing = create_test_resource(&device, 200, true);
+    CHECK(crossing);
+    CHECK(device.budget.over_soft);
+    CHECK(device.budget.num_soft_overruns == 1);
+    CHECK(get_gpu_soft_headroom(&device.budget) == 0);
+
+    // Evicting everything evictable wouldn't make room either, so nothing goes.
+    CHECK(!create_test_resource(&device, 1500, false));
+    CHECK(device.budget.num_refused == 1);
+    CHECK(device.num_evicted == 0);
+    CHECK(device.budget.total_bytes == 1100);
+
+    release_test_resource(&device, crossing);
+    CHECK(!device.budget.over_soft);
+    CHECK(get_gpu_kind_bytes(&device.budget, GPU_RESOURCE_TEXTURE) == 900);
+    CHECK(get_gpu_asset_bytes(&device.budget, "test") == 900);
+
+    free_gpu_budget(&device.budget);
+
+    // No soft limit, no end to the headroom.
+    init_test_device(&device, 0, 0);
+    CHECK(get_gpu_soft_headroom(&device.budget) == SIZE_MAX);
+    free_gpu_budget(&device.budget);
+}
+
+// Least recently used goes first, the biggest of those first, and only as much as is needed.
+static void test_eviction_order()
+{
+    Test_Device device;
+    init_test_device(&device, 0, 1000);
+
+    auto small = create_test_resource(&device, 100, true);
+    auto used = create_test_resource(&device, 300, true);
+    auto big = create_test_resource(&device, 200, true);
+    CHECK(create_test_resource(&device, 50, false));
+    update_gpu_budget(&device.budget);
+    mark_gpu_resource_used(&device.budget, used);
+
+    const void *plan[4];
+    CHECK(plan_gpu_eviction(&device.budget, 250, plan, 4) == 2);
+    CHECK(plan[0] == big && plan[1] == small);
+
+    // 650 + 600 needs 250 freed: big, then small.
+    CHECK(create_test_resource(&device, 600, false));
+    CHECK(device.num_evicted == 2);
+    CHECK(device.evicted[0] == big && device.evicted[1] == small);
+    CHECK(*(bool *)used);
+    CHECK(device.budget.total_bytes == 950);
+    CHECK(device.budget.num_evicted == 2);
+
+    // Back under a soft limit once a frame, with whatever is left to evict.
+    set_gpu_budget_limits(&device.budget, 700, 1000);
+    update_gpu_budget(&device.budget);
+    CHECK(device.num_evicted == 3 && device.evicted[2] == used);
+    CHECK(device.budget.total_bytes == 650);
+
+    free_gpu_budget(&device.budget);
+}
+
+/// ============ STREAMING UNDER PRESSURE ============ ///
+// Each streamed texture is one resource, recreated at its new size whenever its resident levels
+//   change, like the D3D11 sink in WinMain.cpp does.
+
+#define TEST_SIZE   1024
+#define TEST_LEVELS 11
+#define TEST_TAIL   4
+
+struct Test_Stream_Target
+{
+    Test_Device *device;
+    Texture_Streamer *streamer;
+    uchar handles[4];
+};
+
+static bool set_test_resident_levels(void *user, uint index, const Streamed_Texture *texture, uint first_level)
+{
+    auto it = (Test_Stream_Target *)user;
+    size_t bytes = get_streamed_bytes(texture, first_level);
+    untrack_gpu_resource(&it->device->budget, &it->handles[index]);
+    if (!reserve_gpu_memory(&it->device->budget, bytes))
+        return false;
+    track_gpu_resource(&it->device->budget, &it->handles[index], GPU_RESOURCE_TEXTURE, bytes, "streamed", true);
+    return true;
+}
+
+static bool evict_test_texture(void *user, const void *handle)
+{
+    auto it = (Test_Stream_Target *)user;
+    for (auto i = 0; i != it->streamer->num_textures; ++i)
+        if (&it->handles[i] == handle)
+            return evict_streamed_texture(it->streamer, i) != 0;
+    return false;
+}
+
+// One frame the way WinMain.cpp runs it.
+static void run_test_frame(Test_Device *device, Texture_Streamer *streamer)
+{
+    request_texture_screen_size(streamer, 0, 2000.0f);
+    mark_gpu_resource_used(&device->budget, &((Test_Stream_Target *)streamer->sink.user)->handles[0]);
+    if (!device->budget.over_soft)
+        relax_texture_eviction_cap(streamer, get_gpu_soft_headroom(&device->budget));
+    update_texture_streaming(streamer);
+    update_gpu_budget(&device->budget);
+}
+
+// Evicting caps the streamer without touching its budget, the cap follows the room under the soft
+//   limit and goes once the pressure is gone.
+static void test_streaming_eviction()
+{
+    uchar *data = (uchar *)calloc(1, 2 * get_texture_level_size(TEXTURE_FORMAT_BC1, TEST_SIZE, TEST_SIZE));
+    const uchar *levels[TEST_LEVELS];
+    size_t offset = 0;
+    for (auto l = 0; l != TEST_LEVELS; ++l)
+    {
+        levels[l] = data + offset;
+        offset += get_texture_level_size(TEXTURE_FORMAT_BC1, get_mip_dimension(TEST_SIZE, l), get_mip_dimension(TEST_SIZE, l));
+    }
+
+    Test_Device device;
+    Texture_Streamer streamer;
+    Test_Stream_Target target = { &device, &streamer };
+    init_test_device(&device, 0, 0);
+    set_gpu_budget_evictor(&device.budget, evict_test_texture, &target);
+    init_texture_streamer(&streamer, { &target, set_test_resident_levels }, 0, 1, false);
+    add_streamed_texture(&streamer, TEXTURE_FORMAT_BC1, TEST_SIZE, TEST_SIZE, levels, TEST_LEVELS);
+
+    // Just room for all of it.
+    auto texture = &streamer.textures[0];
+    const size_t budget = get_streamed_bytes(texture, 0);
+    streamer.budget = budget;
+    size_t tail = get_streamed_bytes(texture, TEST_TAIL);
+    size_t level3 = get_streamed_bytes(texture, 3);
+    size_t level2 = get_streamed_bytes(texture, 2);
+
+    for (auto frame = 0; frame != 20; ++frame)
+        run_test_frame(&device, &streamer);
+    CHECK(texture->resident_level == 0);
+
+    // Something else needs the memory: room left under the soft limit for level 3, not for 2.
+    const size_t other_bytes = 1u << 20;
+    set_gpu_budget_limits(&device.budget, other_bytes + (level3 + level2) / 2, 0);
+    auto other = create_test_resource(&device, other_bytes, false);
+    CHECK(device.budget.over_soft);
+
+    run_test_frame(&device, &streamer);
+    CHECK(texture->resident_level == TEST_TAIL);
+    CHECK(streamer.resident_bytes == tail);
+    CHECK(streamer.budget == budget);
+    CHECK(streamer.eviction_cap == tail);
+
+    bool under_soft = true;
+    for (auto frame = 0; frame != 20; ++frame)
+    {
+        run_test_frame(&device, &streamer);
+        under_soft = under_soft && !device.budget.over_soft;
+    }
+    CHECK(under_soft);
+    CHECK(texture->resident_level == 3);
+    CHECK(streamer.eviction_cap != SIZE_MAX);
+    CHECK(streamer.budget == budget);
+
+    // Pressure gone: the cap lifts and the texture streams back in.
+    release_test_resource(&device, other);
+    for (auto frame = 0; frame != 20; ++frame)
+        run_test_frame(&device, &streamer);
+    CHECK(streamer.eviction_cap == SIZE_MAX);
+    CHECK(texture->resident_level == 0);
+    CHECK(device.budget.total_bytes == get_streamed_bytes(texture, 0));
+
+    shutdown_texture_streamer(&streamer);
+    free_gpu_budget(&device.budget);
+    free(data);
+}
+
+int main()
+{
+    test_limits();
+    test_eviction_order();
+    test_streaming_eviction();
+    return finish_tests("gpu_budget_test");
+}
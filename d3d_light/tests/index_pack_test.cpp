@@ -0,0 +1,132 @@
+// split_mesh_parts and pack_mesh_indices (see index_pack.h).
+#include "test_common.h"
+
+#include "index_pack.h"
+
+// Every part's triangles, read back through the packed 16-bit indices and the part's base
+//   vertex, have to land on the same positions as the original triangle at the same place.
+static void check_mesh_parts(const Cpu_Mesh *it, const Cpu_Mesh *original)
+{
+    CHECK(it->index_stride == sizeof(uint16_t));
+    CHECK(it->num_indices == original->num_indices);
+
+    uint16_t *packed = (uint16_t *)malloc(it->num_indices * sizeof(uint16_t));
+    pack_mesh_indices(it, packed);
+
+    uint *stamp = (uint *)calloc(it->num_vertices, sizeof(uint));
+    uint next_index = 0;
+    bool in_range = true;
+    bool same_triangles = true;
+    for (auto p = 0; p != it->num_parts; ++p)
+    {
+        auto part = &it->parts[p];
+        CHECK(part->first_index == next_index);
+        CHECK(part->index_count % 3 == 0);
+        next_index = part->first_index + part->index_count;
+
+        uint unique_vertices = 0;
+        for (auto i = part->first_index; i != part->first_index + part->index_count; ++i)
+        {
+            int vertex = (int)packed[i] + part->base_vertex;
+            in_range = in_range && packed[i] < INDEX_PACK_MAX_VERTICES && vertex >= 0 && vertex < (int)it->num_vertices;
+            if (!in_range)
+                break;
+            if (stamp[vertex] != p + 1)
+            {
+                stamp[vertex] = p + 1;
+                ++unique_vertices;
+            }
+
+            auto position = it->vertices[vertex].position;
+            auto expected = original->vertices[original->indices[i]].position;
+            same_triangles = same_triangles && !memcmp(position, expected, 3 * sizeof(float));
+        }
+        CHECK(unique_vertices < 65536);
+    }
+    CHECK(next_index == it->num_indices);
+    CHECK(in_range);
+    CHECK(same_triangles);
+
+    free(stamp);
+    free(packed);
+}
+
+static void test_small_mesh_is_one_part()
+{
+    Cpu_Mesh original, mesh;
+    make_test_grid(&original, 20, 20);
+    copy_test_mesh(&mesh, &original);
+
+    split_mesh_parts(&mesh);
+    CHECK(mesh.num_parts == 1);
+    CHECK(mesh.parts[0].base_vertex == 0);
+    CHECK(mesh.num_vertices == original.num_vertices);
+    check_mesh_parts(&mesh, &original);
+
+    free_cpu_mesh(&mesh);
+    free_cpu_mesh(&original);
+}
+
+// 301 * 301 vertices, in random triangle order so a lot of them straddle the cuts.
+static void test_large_mesh_is_split()
+{
+    Cpu_Mesh original, mesh;
+    make_test_grid(&original, 300, 300, 1234);
+    CHECK(original.num_vertices > 65536);
+    copy_test_mesh(&mesh, &original);
+
+    split_mesh_parts(&mesh);
+    CHECK(mesh.num_parts >= 2);
+    CHECK(mesh.num_vertices >= original.num_vertices);
+    check_mesh_parts(&mesh, &original);
+
+    free_cpu_mesh(&mesh);
+    free_cpu_mesh(&original);
+}
+
+// Two LODs: the whole grid, then its first half again. Every LOD has to start a new part.
+static void test_parts_follow_lods()
+{
+    Cpu_Mesh grid, original, mesh;
+    make_test_grid(&grid, 300, 300, 99);
+
+    uint lod1_indices = (grid.num_indices / 6) * 3;
+    copy_test_mesh(&original, &grid);
+    original.num_indices = grid.num_indices + lod1_indices;
+    original.indices = (uint *)realloc(original.indices, original.num_indices * sizeof(uint));
+    memcpy(&original.indices[grid.num_indices], grid.indices, lod1_indices * sizeof(uint));
+    copy_test_mesh(&mesh, &original);
+
+    mesh.num_lods = 2;
+    mesh.lods = (Mesh_Lod *)calloc(2, sizeof(Mesh_Lod));
+    mesh.lods[0].index_count = grid.num_indices;
+    mesh.lods[1].first_index = grid.num_indices;
+    mesh.lods[1].index_count = lod1_indices;
+
+    split_mesh_parts(&mesh);
+    check_mesh_parts(&mesh, &original);
+
+    CHECK(mesh.lods[0].first_part == 0);
+    CHECK(mesh.lods[1].first_part == mesh.lods[0].num_parts);
+    CHECK(mesh.lods[1].first_part + mesh.lods[1].num_parts == mesh.num_parts);
+    for (auto l = 0; l != 2; ++l)
+    {
+        auto lod = &mesh.lods[l];
+        CHECK(lod->num_parts >= 1);
+        CHECK(mesh.parts[lod->first_part].first_index == lod->first_index);
+        auto last = &mesh.parts[lod->first_part + lod->num_parts - 1];
+        CHECK(last->first_index + last->index_count == lod->first_index + lod->index_count);
+    }
+
+    free_cpu_mesh(&mesh);
+    free_cpu_mesh(&original);
+    free_cpu_mesh(&grid);
+}
+
+int main()
+{
+    test_small_mesh_is_one_part();
+    test_large_mesh_is_split();
+    test_parts_follow_lods();
+    return finish_tests("index_pack_test");
+}
@@ -0,0 +1,65 @@
+// ORM packing (see material.h).
+#include "test_common.h"
+
+#include "material.h"
+
+#define TEST_WIDTH  37
+#define TEST_HEIGHT 23
+#define TEST_COUNT  (TEST_WIDTH * TEST_HEIGHT)
+
+// Every channel holds exactly its map, the one no map lands in is 255.
+static bool check_orm_texture(const uchar *rgba, const uchar *const maps[MATERIAL_CHANNEL_COUNT], const uchar channels[MATERIAL_CHANNEL_COUNT])
+{
+    int sources[4] = { -1, -1, -1, -1 };
+    for (auto c = 0; c != MATERIAL_CHANNEL_COUNT; ++c)
+        sources[channels[c]] = c;
+
+    for (auto k = 0; k != 4; ++k)
+    {
+        for (auto i = 0; i != TEST_COUNT; ++i)
+        {
+            uchar expected = (sources[k] < 0) ? 255 : maps[sources[k]][i];
+            if (rgba[i * 4 + k] != expected)
+            {
+                LOGF("Channel %d, pixel %d: %u instead of %u\n", k, i, rgba[i * 4 + k], expected);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void test_pack_orm()
+{
+    // Three different images, none of them constant and none equal to 255 everywhere.
+    uchar *maps[MATERIAL_CHANNEL_COUNT];
+    uint seed = 29;
+    for (auto c = 0; c != MATERIAL_CHANNEL_COUNT; ++c)
+    {
+        maps[c] = (uchar *)malloc(TEST_COUNT);
+        for (auto i = 0; i != TEST_COUNT; ++i)
+            maps[c][i] = (uchar)(test_random(&seed) % 255);
+    }
+    CHECK(memcmp(maps[0], maps[1], TEST_COUNT) && memcmp(maps[1], maps[2], TEST_COUNT));
+
+    uchar *rgba = (uchar *)malloc(TEST_COUNT * 4);
+    memset(rgba, 0, TEST_COUNT * 4);
+    pack_orm_texture(rgba, maps, TEST_COUNT);
+    CHECK(check_orm_texture(rgba, maps, ORM_DEFAULT_CHANNELS));
+
+    // AO in alpha, roughness in red, metallic in green: blue is the one left over.
+    const uchar channels[MATERIAL_CHANNEL_COUNT] = { 3, 0, 1 };
+    memset(rgba, 0, TEST_COUNT * 4);
+    pack_orm_texture(rgba, maps, TEST_COUNT, channels);
+    CHECK(check_orm_texture(rgba, maps, channels));
+
+    free(rgba);
+    for (auto c = 0; c != MATERIAL_CHANNEL_COUNT; ++c)
+        free(maps[c]);
+}
+
+int main()
+{
+    test_pack_orm();
+    return finish_tests("material_test");
+}
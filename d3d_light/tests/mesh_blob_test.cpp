@@ -0,0 +1,134 @@
+// Writing and reading back cooked .mesh blobs (see mesh_blob.h).
+#include "test_common.h"
+
+#include "mesh_blob.h"
+#include "mesh_optimize.h"
+
+#define TEST_BLOB_PATH "mesh_blob_test.mesh"
+
+// A small bumpy grid, which gets LODs, and one with more vertices than 16-bit indices reach,
+//   which gets several parts. Both cooked the way mesh_cook.h cooks.
+static void make_test_meshes(Cpu_Mesh *meshes)
+{
+    const uint cells[2] = { 40, 260 };
+    for (auto m = 0; m != 2; ++m)
+    {
+        make_test_grid(&meshes[m], cells[m], cells[m], m + 1);
+        for (auto v = 0; v != meshes[m].num_vertices; ++v)
+        {
+            auto vertex = &meshes[m].vertices[v];
+            vertex->position[2] = sinf(vertex->position[0] * 0.4f) * cosf(vertex->position[1] * 0.3f);
+        }
+        optimize_cpu_mesh(&meshes[m], m);
+    }
+}
+
+static uchar *read_test_file(const char *path, size_t *out_size)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return NULL;
+    fseek(file, 0, SEEK_END);
+    *out_size = (size_t)ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uchar *data = (uchar *)malloc(*out_size);
+    if (fread(data, 1, *out_size, file) != *out_size)
+        *out_size = 0;
+    fclose(file);
+    return data;
+}
+
+// Everything comes back exactly as it went in, indices packed the way pack_mesh_indices packs them.
+static void test_round_trip(const Cpu_Mesh *meshes)
+{
+    Mesh_Blob blob;
+    CHECK(open_mesh_blob(&blob, TEST_BLOB_PATH));
+    if (!blob.header)
+        return;
+    CHECK(blob.header->num_meshes == 2);
+
+    for (auto m = 0; m != 2; ++m)
+    {
+        auto mesh = &meshes[m];
+        auto entry = &blob.entries[m];
+        CHECK(entry->vertex_count == mesh->num_vertices);
+        CHECK(entry->index_count == mesh->num_indices);
+        CHECK(entry->index_stride == mesh->index_stride);
+        CHECK(entry->num_parts == mesh->num_parts);
+        CHECK(entry->num_meshlets == mesh->num_meshlets);
+        CHECK(entry->num_lods == mesh->num_lods);
+        CHECK(!memcmp(&entry->bounds, &mesh->bounds, sizeof(Mesh_Bounds)));
+
+        bool aligned = !(entry->vertex_offset % MESH_BLOB_ALIGNMENT) && !(entry->index_offset % MESH_BLOB_ALIGNMENT) &&
+                       !(entry->part_offset % MESH_BLOB_ALIGNMENT) && !(entry->meshlet_offset % MESH_BLOB_ALIGNMENT) &&
+                       !(entry->lod_offset % MESH_BLOB_ALIGNMENT);
+        CHECK(aligned);
+
+        CHECK(!memcmp(get_blob_vertices(&blob, m), mesh->vertices, mesh->num_vertices * sizeof(Vertex)));
+        void *packed = malloc((size_t)mesh->num_indices * mesh->index_stride);
+        pack_mesh_indices(mesh, packed);
+        CHECK(!memcmp(get_blob_indices(&blob, m), packed, (size_t)mesh->num_indices * mesh->index_stride));
+        free(packed);
+        CHECK(!memcmp(get_blob_parts(&blob, m), mesh->parts, mesh->num_parts * sizeof(Mesh_Part)));
+        CHECK(!memcmp(get_blob_meshlets(&blob, m), mesh->meshlets, mesh->num_meshlets * sizeof(Meshlet)));
+        CHECK(!memcmp(get_blob_lods(&blob, m), mesh->lods, mesh->num_lods * sizeof(Mesh_Lod)));
+    }
+
+    // What the test meshes are there for.
+    CHECK(meshes[0].num_lods > 1);
+    CHECK(meshes[1].num_parts > 1 && meshes[1].index_stride == sizeof(uint16_t));
+
+    close_mesh_blob(&blob);
+}
+
+// Cut short, another version or an entry pointing past the end: not opened.
+static void test_broken_blobs()
+{
+    size_t size;
+    uchar *data = read_test_file(TEST_BLOB_PATH, &size);
+    CHECK(data && size);
+    if (!data)
+        return;
+
+    Mesh_Blob blob;
+    CHECK(open_mesh_blob_memory(&blob, data, size, "test"));
+    CHECK(!open_mesh_blob_memory(&blob, data, size - MESH_BLOB_ALIGNMENT, "test"));
+    CHECK(!open_mesh_blob_memory(&blob, data, sizeof(Mesh_Blob_Header) - 1, "test"));
+
+    uchar *copy = (uchar *)malloc(size);
+    memcpy(copy, data, size);
+    ((Mesh_Blob_Header *)copy)->version = MESH_BLOB_VERSION - 1;
+    CHECK(!open_mesh_blob_memory(&blob, copy, size, "test"));
+
+    // Still truncated when the header agrees with the size.
+    memcpy(copy, data, size);
+    ((Mesh_Blob_Header *)copy)->total_size = size - MESH_BLOB_ALIGNMENT;
+    CHECK(!open_mesh_blob_memory(&blob, copy, size - MESH_BLOB_ALIGNMENT, "test"));
+
+    memcpy(copy, data, size);
+    auto entries = (Mesh_Blob_Entry *)(copy + sizeof(Mesh_Blob_Header));
+    entries[0].meshlet_offset = size;
+    CHECK(!open_mesh_blob_memory(&blob, copy, size, "test"));
+
+    memcpy(copy, data, size);
+    entries[1].index_offset = size - 1;
+    CHECK(!open_mesh_blob_memory(&blob, copy, size, "test"));
+
+    free(copy);
+    free(data);
+}
+
+int main()
+{
+    Cpu_Mesh meshes[2];
+    make_test_meshes(meshes);
+    CHECK(write_mesh_blob(TEST_BLOB_PATH, meshes, 2));
+
+    test_round_trip(meshes);
+    test_broken_blobs();
+
+    remove(TEST_BLOB_PATH);
+    for (auto m = 0; m != 2; ++m)
+        free_cpu_mesh(&meshes[m]);
+    return finish_tests("mesh_blob_test");
+}
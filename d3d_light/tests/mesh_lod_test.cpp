@@ -0,0 +1,145 @@
+// Simplification and LOD chains (see mesh_simplify.h and mesh_lod.h).
+#include "test_common.h"
+
+#include "mesh_lod.h"
+
+#define TEST_CELLS 48
+#define TEST_SEAM  (TEST_CELLS / 2) // column the UVs are cut along
+
+// A bumpy grid cut in two along a column: the right half gets its own copies of the seam
+//   vertices, with other UVs, the way a UV island border comes out of an exporter.
+// Returns the first seam copy, copies of seam vertex y are at that plus y.
+static uint make_seamed_grid(Cpu_Mesh *it)
+{
+    make_test_grid(it, TEST_CELLS, TEST_CELLS, 5);
+    uint row = TEST_CELLS + 1;
+    uint first_copy = it->num_vertices;
+    it->vertices = (Vertex *)realloc(it->vertices, (it->num_vertices + row) * sizeof(Vertex));
+    for (auto y = 0; y != row; ++y)
+    {
+        it->vertices[first_copy + y] = it->vertices[y * row + TEST_SEAM];
+        it->vertices[first_copy + y].texcoord[0] += 0.5f;
+    }
+    it->num_vertices += row;
+
+    for (auto v = 0; v != it->num_vertices; ++v)
+    {
+        auto vertex = &it->vertices[v];
+        vertex->position[2] = 2.0f * sinf(vertex->position[0] * 0.35f) * cosf(vertex->position[1] * 0.25f);
+    }
+
+    // Triangles right of the seam use the copies.
+    for (auto t = 0; t != it->num_indices / 3; ++t)
+    {
+        uint *triangle = &it->indices[t * 3];
+        bool right = false;
+        for (auto c = 0; c != 3; ++c)
+            right = right || (triangle[c] % row) > TEST_SEAM;
+        for (auto c = 0; c != 3 && right; ++c)
+            if ((triangle[c] % row) == TEST_SEAM && triangle[c] < first_copy)
+                triangle[c] = first_copy + triangle[c] / row;
+    }
+    return first_copy;
+}
+
+// Both copies of every seam vertex are still used, and no triangle mixes a side's vertices
+//   with the other side's copies, so the UV layout is intact.
+static bool is_seam_intact(const Cpu_Mesh *it, const uint *indices, uint count, uint first_copy)
+{
+    uint row = TEST_CELLS + 1;
+    uchar *used = (uchar *)calloc(it->num_vertices, 1);
+    bool intact = true;
+    for (auto t = 0; t != count / 3; ++t)
+    {
+        bool left = false, right = false;
+        for (auto c = 0; c != 3; ++c)
+        {
+            uint v = indices[t * 3 + c];
+            used[v] = 1;
+            left = left || (v < first_copy && (v % row) <= TEST_SEAM);
+            right = right || v >= first_copy || (v % row) > TEST_SEAM;
+        }
+        intact = intact && !(left && right);
+    }
+    for (auto y = 0; y != row; ++y)
+        intact = intact && used[y * row + TEST_SEAM] && used[first_copy + y];
+    free(used);
+    return intact;
+}
+
+static void test_lod_chain()
+{
+    Cpu_Mesh mesh;
+    uint first_copy = make_seamed_grid(&mesh);
+    CHECK(is_seam_intact(&mesh, mesh.indices, mesh.num_indices, first_copy));
+
+    build_mesh_lods(&mesh);
+    CHECK(mesh.num_lods >= 3);
+    CHECK(mesh.lods[0].first_index == 0 && mesh.lods[0].error == 0.0f);
+
+    bool decreasing = true, increasing = true, seams = true, contiguous = true;
+    for (auto l = 1; l != mesh.num_lods; ++l)
+    {
+        auto lod = &mesh.lods[l];
+        auto previous = &mesh.lods[l - 1];
+        decreasing = decreasing && lod->index_count < previous->index_count && lod->index_count % 3 == 0;
+        increasing = increasing && lod->error > previous->error;
+        contiguous = contiguous && lod->first_index == previous->first_index + previous->index_count;
+        seams = seams && is_seam_intact(&mesh, &mesh.indices[lod->first_index], lod->index_count, first_copy);
+    }
+    CHECK(decreasing);
+    CHECK(increasing);
+    CHECK(contiguous);
+    CHECK(seams);
+    CHECK(mesh.lods[mesh.num_lods - 1].first_index + mesh.lods[mesh.num_lods - 1].index_count == mesh.num_indices);
+
+    /// -- select_mesh_lod: LOD l is fine from the distance its error shrinks to a pixel.
+    const float fov_y = 1.0f, viewport_height = 1000.0f, near_plane = 0.1f, error_scale = 2.0f;
+    float projection = viewport_height / (2.0f * tanf(fov_y * 0.5f));
+    auto switch_distance = [&](uint l) { return mesh.lods[l].error * error_scale * projection; };
+
+    uint last = mesh.num_lods - 1;
+    CHECK(select_mesh_lod(mesh.lods, mesh.num_lods, error_scale, 0.0f, near_plane, fov_y, viewport_height) == 0);
+    CHECK(select_mesh_lod(mesh.lods, mesh.num_lods, error_scale, switch_distance(1) * 0.9f, near_plane, fov_y, viewport_height) == 0);
+    CHECK(select_mesh_lod(mesh.lods, mesh.num_lods, error_scale, (switch_distance(1) + switch_distance(2)) * 0.5f, near_plane, fov_y,
+                          viewport_height) == 1);
+    CHECK(select_mesh_lod(mesh.lods, mesh.num_lods, error_scale, switch_distance(last) * 1.1f, near_plane, fov_y, viewport_height) == last);
+
+    // Twice the pixels allowed: half the distance does.
+    CHECK(select_mesh_lod(mesh.lods, mesh.num_lods, error_scale, switch_distance(last) * 0.55f, near_plane, fov_y, viewport_height,
+                          2.0f) == last);
+
+    free_cpu_mesh(&mesh);
+}
+
+// A target error stops the simplifier before the target count, and the error it reports
+//   stays under it.
+static void test_target_error()
+{
+    Cpu_Mesh mesh;
+    make_seamed_grid(&mesh);
+    uint *dst = (uint *)malloc(mesh.num_indices * sizeof(uint));
+
+    float full_error;
+    uint full_count = simplify_mesh(dst, mesh.indices, mesh.num_indices, mesh.vertices, mesh.num_vertices, 0, FLT_MAX, &full_error);
+    CHECK(full_count < mesh.num_indices / 4);
+
+    float error;
+    uint count = simplify_mesh(dst, mesh.indices, mesh.num_indices, mesh.vertices, mesh.num_vertices, 0, full_error * 0.1f, &error);
+    CHECK(count > full_count);
+    CHECK(error <= full_error * 0.1f);
+
+    // Nothing to do: the indices come back as they are.
+    count = simplify_mesh(dst, mesh.indices, mesh.num_indices, mesh.vertices, mesh.num_vertices, mesh.num_indices, FLT_MAX, &error);
+    CHECK(count == mesh.num_indices && error == 0.0f && !memcmp(dst, mesh.indices, count * sizeof(uint)));
+
+    free(dst);
+    free_cpu_mesh(&mesh);
+}
+
+int main()
+{
+    test_lod_chain();
+    test_target_error();
+    return finish_tests("mesh_lod_test");
+}
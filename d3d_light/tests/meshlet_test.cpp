@@ -0,0 +1,199 @@
+// build_meshlets and meshlet culling (see meshlet.h).
+#include "test_common.h"
+
+#define HANDMADE_MATH_USE_RADIANS
+#include "HandmadeMath.h"
+
+#include "index_pack.h"
+#include "meshlet.h"
+
+// Meshlets come out of split_mesh_parts' output, same as in optimize_cpu_mesh.
+static void make_meshlet_mesh(Cpu_Mesh *it, Cpu_Mesh *original, uint cells, uint seed)
+{
+    make_test_grid(original, cells, cells, seed);
+    copy_test_mesh(it, original);
+    split_mesh_parts(it);
+    build_meshlets(it);
+}
+
+static void check_meshlets(const Cpu_Mesh *it, const Cpu_Mesh *original)
+{
+    CHECK(it->num_meshlets > 0);
+
+    uint16_t *packed = (uint16_t *)malloc(it->num_indices * sizeof(uint16_t));
+    pack_mesh_indices(it, packed);
+
+    // Triangle order survives both passes, so triangle t of the mesh is triangle t of the original.
+    uint num_triangles = original->num_indices / 3;
+    uint *seen = (uint *)calloc(num_triangles, sizeof(uint));
+    uint *stamp = (uint *)calloc(it->num_vertices, sizeof(uint));
+    bool within_limits = true;
+    bool same_vertices = true;
+    uint part = 0;
+
+    for (auto m = 0; m != it->num_meshlets; ++m)
+    {
+        auto meshlet = &it->meshlets[m];
+        CHECK(meshlet->index_count % 3 == 0);
+
+        // Meshlets never straddle parts, and use their part's base vertex.
+        while (part + 1 < it->num_parts && meshlet->first_index >= it->parts[part + 1].first_index)
+            ++part;
+        auto owner = &it->parts[part];
+        CHECK(meshlet->base_vertex == owner->base_vertex);
+        CHECK(meshlet->first_index + meshlet->index_count <= owner->first_index + owner->index_count);
+
+        uint num_vertices = 0;
+        for (auto i = meshlet->first_index; i != meshlet->first_index + meshlet->index_count; ++i)
+        {
+            int vertex = (int)packed[i] + meshlet->base_vertex;
+            if (stamp[vertex] != m + 1)
+            {
+                stamp[vertex] = m + 1;
+                ++num_vertices;
+            }
+            auto expected = original->vertices[original->indices[i]].position;
+            same_vertices = same_vertices && !memcmp(it->vertices[vertex].position, expected, 3 * sizeof(float));
+        }
+        within_limits = within_limits && num_vertices <= MESHLET_MAX_VERTICES && meshlet->index_count / 3 <= MESHLET_MAX_TRIANGLES;
+
+        for (auto t = meshlet->first_index / 3; t != (meshlet->first_index + meshlet->index_count) / 3; ++t)
+            ++seen[t];
+    }
+
+    bool each_once = true;
+    for (auto t = 0; t != num_triangles; ++t)
+        each_once = each_once && seen[t] == 1;
+
+    CHECK(within_limits);
+    CHECK(each_once);
+    CHECK(same_vertices);
+
+    free(stamp);
+    free(seen);
+    free(packed);
+}
+
+static void test_meshlet_partition()
+{
+    // In order, in random order, and big enough for several parts.
+    uint cells[] = { 1, 40, 40, 300 };
+    uint seeds[] = { 0, 0, 7, 7 };
+    for (auto i = 0; i != sizeof(cells) / sizeof(cells[0]); ++i)
+    {
+        Cpu_Mesh original, mesh;
+        make_meshlet_mesh(&mesh, &original, cells[i], seeds[i]);
+        if (cells[i] == 300)
+            CHECK(mesh.num_parts > 1);
+        check_meshlets(&mesh, &original);
+        free_cpu_mesh(&mesh);
+        free_cpu_mesh(&original);
+    }
+}
+
+// Every corner inside the sphere.
+static void test_meshlet_spheres()
+{
+    Cpu_Mesh original, mesh;
+    make_meshlet_mesh(&mesh, &original, 40, 3);
+
+    bool inside = true;
+    for (auto m = 0; m != mesh.num_meshlets; ++m)
+    {
+        auto meshlet = &mesh.meshlets[m];
+        for (auto i = meshlet->first_index; i != meshlet->first_index + meshlet->index_count; ++i)
+        {
+            auto p = mesh.vertices[mesh.indices[i]].position;
+            float d[3] = { p[0] - meshlet->center[0], p[1] - meshlet->center[1], p[2] - meshlet->center[2] };
+            inside = inside && sqrtf(meshlet_dot(d, d)) <= meshlet->radius * 1.0001f;
+        }
+    }
+    CHECK(inside);
+
+    free_cpu_mesh(&mesh);
+    free_cpu_mesh(&original);
+}
+
+static uint count_visible(const Cpu_Mesh *mesh, HMM_Vec3 eye, HMM_Vec3 target, bool cull_backfaces)
+{
+    HMM_Mat4 view = HMM_LookAt_RH(eye, target, HMM_V3(0, 1, 0));
+    HMM_Mat4 proj = HMM_Perspective_RH_ZO(HMM_AngleDeg(60.0f), 1.0f, 0.1f, 100.0f);
+    HMM_Mat4 model_view_proj = HMM_MulM4(proj, view);
+
+    Meshlet_Cull_Params params;
+    setup_meshlet_culling(&params, &model_view_proj.Elements[0][0], eye.Elements, cull_backfaces);
+
+    Mesh_Part *ranges = (Mesh_Part *)malloc(mesh->num_meshlets * sizeof(Mesh_Part));
+    uint num_ranges = cull_meshlets(mesh->meshlets, mesh->num_meshlets, &params, ranges);
+
+    uint visible = 0;
+    for (auto m = 0; m != mesh->num_meshlets; ++m)
+        visible += is_meshlet_visible(&mesh->meshlets[m], &params) ? 1 : 0;
+
+    // The ranges are the visible meshlets, merged.
+    uint index_count = 0;
+    for (auto r = 0; r != num_ranges; ++r)
+        index_count += ranges[r].index_count;
+    uint visible_index_count = 0;
+    for (auto m = 0; m != mesh->num_meshlets; ++m)
+        if (is_meshlet_visible(&mesh->meshlets[m], &params))
+            visible_index_count += mesh->meshlets[m].index_count;
+    CHECK(index_count == visible_index_count);
+    CHECK(num_ranges <= visible);
+
+    free(ranges);
+    return visible;
+}
+
+// A flat 6x6 grid facing +z: its one meshlet has a tight cone along +z.
+static void test_meshlet_culling()
+{
+    Cpu_Mesh original, mesh;
+    make_meshlet_mesh(&mesh, &original, 6, 0);
+    CHECK(mesh.num_meshlets == 1);
+    CHECK(mesh.meshlets[0].cone_cutoff <= 1.0f);
+    CHECK(mesh.meshlets[0].cone_axis[2] > 0.99f);
+
+    HMM_Vec3 center = HMM_V3(3, 3, 0);
+
+    // Seen from the front.
+    CHECK(count_visible(&mesh, HMM_V3(3, 3, 10), center, true) == 1);
+    CHECK(count_visible(&mesh, HMM_V3(5, 1, 3), center, true) == 1);
+
+    // Seen from behind: the cone rejects it, unless backface culling is off.
+    CHECK(count_visible(&mesh, HMM_V3(3, 3, -10), center, true) == 0);
+    CHECK(count_visible(&mesh, HMM_V3(1, 5, -3), center, true) == 0);
+    CHECK(count_visible(&mesh, HMM_V3(3, 3, -10), center, false) == 1);
+
+    // In front but outside the frustum: looking away, off to the side, past the far plane.
+    CHECK(count_visible(&mesh, HMM_V3(3, 3, 10), HMM_V3(3, 3, 20), false) == 0);
+    CHECK(count_visible(&mesh, HMM_V3(40, 3, 10), HMM_V3(40, 3, 0), false) == 0);
+    CHECK(count_visible(&mesh, HMM_V3(3, 3, 200), center, false) == 0);
+
+    free_cpu_mesh(&mesh);
+    free_cpu_mesh(&original);
+}
+
+// Part of a bigger grid in view: only some meshlets pass.
+static void test_meshlet_culling_partial()
+{
+    Cpu_Mesh original, mesh;
+    make_meshlet_mesh(&mesh, &original, 64, 0);
+    CHECK(mesh.num_meshlets > 4);
+
+    uint visible = count_visible(&mesh, HMM_V3(8, 8, 4), HMM_V3(8, 8, 0), true);
+    CHECK(visible > 0 && visible < mesh.num_meshlets);
+    CHECK(count_visible(&mesh, HMM_V3(32, 32, 60), HMM_V3(32, 32, 0), true) == mesh.num_meshlets);
+
+    free_cpu_mesh(&mesh);
+    free_cpu_mesh(&original);
+}
+
+int main()
+{
+    test_meshlet_partition();
+    test_meshlet_spheres();
+    test_meshlet_culling();
+    test_meshlet_culling_partial();
+    return finish_tests("meshlet_test");
+}
@@ -0,0 +1,214 @@
+// Range allocation, release and merging (see range_allocator.h).
+#include "test_common.h"
+
+#include "range_allocator.h"
+
+// Sorted by offset, nothing touching or overlapping, and free plus used is the capacity.
+static bool is_free_list_valid(const Range_Allocator *it)
+{
+    size_t free_count = 0;
+    for (auto i = 0; i != it->num_free; ++i)
+    {
+        auto range = &it->free_ranges[i];
+        if (!range->count || range->offset + range->count > it->capacity)
+            return false;
+        if (i && it->free_ranges[i - 1].offset + it->free_ranges[i - 1].count >= range->offset)
+            return false;
+        free_count += range->count;
+    }
+    return free_count + it->used == it->capacity;
+}
+
+// Ranges go out from the low end, the first free one that's big enough wins.
+static void test_first_fit()
+{
+    Range_Allocator ranges;
+    init_range_allocator(&ranges, 100);
+
+    uint a, b, c, d;
+    CHECK(allocate_range(&ranges, 10, &a) && a == 0);
+    CHECK(allocate_range(&ranges, 20, &b) && b == 10);
+    CHECK(allocate_range(&ranges, 30, &c) && c == 30);
+    CHECK(ranges.used == 60);
+
+    // Holes of 10 and 30 at 0 and 30: 15 skips the first for the second, 5 takes the first.
+    release_range(&ranges, a, 10);
+    release_range(&ranges, c, 30);
+    CHECK(ranges.num_free == 2);
+    CHECK(allocate_range(&ranges, 15, &c) && c == 30);
+    CHECK(allocate_range(&ranges, 5, &d) && d == 0);
+    CHECK(is_free_list_valid(&ranges));
+
+    // Empty ranges take nothing.
+    uint before = ranges.used;
+    CHECK(allocate_range(&ranges, 0, &d) && d == 0);
+    CHECK(ranges.used == before);
+
+    free_range_allocator(&ranges);
+}
+
+// Aligned offsets leave what they skip free, for whatever comes next to fit into.
+static void test_alignment()
+{
+    Range_Allocator ranges;
+    init_range_allocator(&ranges, 64);
+
+    uint a, b, c, d;
+    CHECK(allocate_range(&ranges, 3, &a) && a == 0);
+    CHECK(allocate_range(&ranges, 8, &b, 16) && b == 16);
+    CHECK(ranges.num_free == 2);
+    CHECK(ranges.free_ranges[0].offset == 3 && ranges.free_ranges[0].count == 13);
+    CHECK(ranges.free_ranges[1].offset == 24 && ranges.free_ranges[1].count == 40);
+
+    // Fits the skipped part, aligned or not.
+    CHECK(allocate_range(&ranges, 4, &c, 4) && c == 4);
+    CHECK(allocate_range(&ranges, 1, &d) && d == 3);
+    CHECK(is_free_list_valid(&ranges));
+
+    // Ends exactly at the end of a free range: nothing left behind it.
+    uint e;
+    CHECK(allocate_range(&ranges, 8, &e, 8) && e == 8);
+    CHECK(ranges.free_ranges[0].offset == 24);
+
+    // Not enough left once aligned, even though the range itself is big enough.
+    uint f;
+    CHECK(!allocate_range(&ranges, 40, &f, 32));
+    CHECK(allocate_range(&ranges, 32, &f, 32) && f == 32);
+    CHECK(is_free_list_valid(&ranges));
+
+    free_range_allocator(&ranges);
+}
+
+// A released range merges with the free one before it, the one after it, or both.
+static void test_merging()
+{
+    Range_Allocator ranges;
+    init_range_allocator(&ranges, 50);
+
+    uint offsets[5];
+    for (auto i = 0; i != 5; ++i)
+        CHECK(allocate_range(&ranges, 10, &offsets[i]) && offsets[i] == i * 10);
+    CHECK(ranges.num_free == 0);
+
+    // Nothing free around it.
+    release_range(&ranges, offsets[1], 10);
+    CHECK(ranges.num_free == 1);
+
+    // Free before it.
+    release_range(&ranges, offsets[2], 10);
+    CHECK(ranges.num_free == 1);
+    CHECK(ranges.free_ranges[0].offset == 10 && ranges.free_ranges[0].count == 20);
+
+    // Free after it.
+    release_range(&ranges, offsets[0], 10);
+    CHECK(ranges.num_free == 1);
+    CHECK(ranges.free_ranges[0].offset == 0 && ranges.free_ranges[0].count == 30);
+
+    // Free on both sides.
+    release_range(&ranges, offsets[4], 10);
+    CHECK(ranges.num_free == 2);
+    release_range(&ranges, offsets[3], 10);
+    CHECK(ranges.num_free == 1);
+    CHECK(ranges.free_ranges[0].offset == 0 && ranges.free_ranges[0].count == 50);
+    CHECK(ranges.used == 0);
+
+    free_range_allocator(&ranges);
+}
+
+// Full is full, however it's asked, and releasing makes the room usable again.
+static void test_exhaustion()
+{
+    Range_Allocator ranges;
+    init_range_allocator(&ranges, 30);
+
+    uint a, b, c;
+    CHECK(allocate_range(&ranges, 30, &a) && a == 0);
+    CHECK(ranges.num_free == 0);
+    CHECK(!allocate_range(&ranges, 1, &b));
+
+    // 20 free in total, but not in one piece.
+    release_range(&ranges, 0, 30);
+    CHECK(allocate_range(&ranges, 10, &a));
+    CHECK(allocate_range(&ranges, 10, &b));
+    CHECK(allocate_range(&ranges, 10, &c));
+    release_range(&ranges, a, 10);
+    release_range(&ranges, c, 10);
+    CHECK(!allocate_range(&ranges, 20, &a));
+    CHECK(ranges.used == 10);
+
+    free_range_allocator(&ranges);
+
+    // No capacity at all.
+    init_range_allocator(&ranges, 0);
+    CHECK(!allocate_range(&ranges, 1, &a));
+    free_range_allocator(&ranges);
+}
+
+// Random allocations and releases, checked against a map of what's taken, until everything is
+//   released back into the one range it started as.
+static void test_random_use()
+{
+    const uint capacity = 4096;
+    Range_Allocator ranges;
+    init_range_allocator(&ranges, capacity);
+
+    uchar taken[capacity] = {};
+    Buffer_Range live[256];
+    uint num_live = 0;
+    uint seed = 11;
+    bool valid = true, no_overlap = true, aligned = true;
+
+    for (auto step = 0; step != 20000; ++step)
+    {
+        if (num_live != 256 && (test_random(&seed) % 3))
+        {
+            uint count = 1 + test_random(&seed) % 64;
+            uint alignment = 1u << (test_random(&seed) % 4);
+            uint offset;
+            if (!allocate_range(&ranges, count, &offset, alignment))
+                continue;
+
+            aligned = aligned && !(offset % alignment);
+            for (auto i = offset; i != offset + count; ++i)
+            {
+                no_overlap = no_overlap && !taken[i];
+                taken[i] = 1;
+            }
+            live[num_live].offset = offset;
+            live[num_live].count = count;
+            ++num_live;
+        }
+        else if (num_live)
+        {
+            uint index = test_random(&seed) % num_live;
+            memset(&taken[live[index].offset], 0, live[index].count);
+            release_range(&ranges, live[index].offset, live[index].count);
+            live[index] = live[--num_live];
+        }
+        valid = valid && is_free_list_valid(&ranges);
+    }
+    CHECK(valid);
+    CHECK(no_overlap);
+    CHECK(aligned);
+
+    while (num_live)
+    {
+        --num_live;
+        release_range(&ranges, live[num_live].offset, live[num_live].count);
+    }
+    CHECK(ranges.used == 0);
+    CHECK(ranges.num_free == 1);
+    CHECK(ranges.free_ranges[0].offset == 0 && ranges.free_ranges[0].count == capacity);
+
+    free_range_allocator(&ranges);
+}
+
+int main()
+{
+    test_first_fit();
+    test_alignment();
+    test_merging();
+    test_exhaustion();
+    test_random_use();
+    return finish_tests("range_allocator_test");
+}
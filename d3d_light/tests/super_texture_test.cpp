@@ -0,0 +1,211 @@
+// Super texture encoding and transcoding (see super_texture.h).
+#include "test_common.h"
+
+#include "super_texture.h"
+
+#define TEST_WIDTH  70
+#define TEST_HEIGHT 45
+
+static uchar *make_test_image()
+{
+    uchar *rgba = (uchar *)malloc(TEST_WIDTH * TEST_HEIGHT * 4);
+    uint seed = 3;
+    for (auto i = 0; i != TEST_WIDTH * TEST_HEIGHT; ++i)
+    {
+        uint x = i % TEST_WIDTH, y = i / TEST_WIDTH;
+        int noise = (int)(test_random(&seed) % 7) - 3;
+        rgba[i * 4 + 0] = (uchar)bc_clamp((int)(x * 3) + noise, 0, 255);
+        rgba[i * 4 + 1] = (uchar)bc_clamp((int)(y * 5) - noise, 0, 255);
+        rgba[i * 4 + 2] = (uchar)bc_clamp((int)((x + y) * 2) + noise, 0, 255);
+        rgba[i * 4 + 3] = 255;
+    }
+    return rgba;
+}
+
+// Level 0 and one mip of the image, in format.
+struct Test_Stex
+{
+    uchar *blocks[2];
+    uchar *file;
+    size_t size;
+    Super_Texture texture;
+};
+
+static bool init_test_stex(Test_Stex *it, Texture_Format format, const uchar *rgba)
+{
+    ZeroThat(it);
+    uchar *mip = (uchar *)malloc(TEST_WIDTH * TEST_HEIGHT * 4);
+    uint mip_width = get_mip_dimension(TEST_WIDTH, 1), mip_height = get_mip_dimension(TEST_HEIGHT, 1);
+    for (auto y = 0; y != mip_height; ++y)
+        for (auto x = 0; x != mip_width; ++x)
+            memcpy(&mip[(y * mip_width + x) * 4], &rgba[(y * 2 * TEST_WIDTH + x * 2) * 4], 4);
+
+    it->blocks[0] = (uchar *)malloc(get_texture_level_size(format, TEST_WIDTH, TEST_HEIGHT));
+    it->blocks[1] = (uchar *)malloc(get_texture_level_size(format, mip_width, mip_height));
+    compress_texture(format, rgba, TEST_WIDTH, TEST_HEIGHT, it->blocks[0], 1);
+    compress_texture(format, mip, mip_width, mip_height, it->blocks[1], 1);
+    free(mip);
+
+    const void *levels[2] = { it->blocks[0], it->blocks[1] };
+    it->file = encode_super_texture(format, TEST_WIDTH, TEST_HEIGHT, levels, 2, &it->size);
+    return it->file && open_super_texture_memory(&it->texture, it->file, it->size, "test");
+}
+
+static void free_test_stex(Test_Stex *it)
+{
+    free(it->file);
+    free(it->blocks[0]);
+    free(it->blocks[1]);
+}
+
+// Every format comes back as exactly the blocks that went in, SSE2 or not.
+static void test_round_trip(const uchar *rgba)
+{
+    const Texture_Format formats[] = { TEXTURE_FORMAT_BC1, TEXTURE_FORMAT_BC4, TEXTURE_FORMAT_BC5, TEXTURE_FORMAT_BC7 };
+    for (auto f = 0; f != sizeof(formats) / sizeof(formats[0]); ++f)
+    {
+        Test_Stex stex;
+        CHECK(init_test_stex(&stex, formats[f], rgba));
+        for (auto l = 0; l != 2; ++l)
+        {
+            uint width = get_mip_dimension(TEST_WIDTH, l), height = get_mip_dimension(TEST_HEIGHT, l);
+            size_t size = get_texture_level_size(formats[f], width, height);
+            uchar *out = (uchar *)malloc(size);
+            for (auto scalar = 0; scalar != 2; ++scalar)
+            {
+                bc_disable_sse = scalar != 0;
+                memset(out, 0, size);
+                CHECK(transcode_super_texture(&stex.texture, l, formats[f], out));
+                CHECK(!memcmp(out, stex.blocks[l], size));
+            }
+            bc_disable_sse = false;
+            free(out);
+        }
+        free_test_stex(&stex);
+    }
+}
+
+// From BC7 to the other formats: each has to decode to about what the BC7 blocks decode to, in
+//   the channels it has. RGBA8 has to be exactly that.
+static void test_transcode_targets(const uchar *rgba)
+{
+    Test_Stex stex;
+    CHECK(init_test_stex(&stex, TEXTURE_FORMAT_BC7, rgba));
+
+    uchar *reference = (uchar *)malloc(TEST_WIDTH * TEST_HEIGHT * 4);
+    decompress_texture(TEXTURE_FORMAT_BC7, stex.blocks[0], TEST_WIDTH, TEST_HEIGHT, reference);
+
+    uchar *out = (uchar *)malloc(TEST_WIDTH * TEST_HEIGHT * 4);
+    uchar *decoded = (uchar *)malloc(TEST_WIDTH * TEST_HEIGHT * 4);
+    for (auto scalar = 0; scalar != 2; ++scalar)
+    {
+        bc_disable_sse = scalar != 0;
+        CHECK(transcode_super_texture(&stex.texture, 0, TEXTURE_FORMAT_RGBA8, out));
+        CHECK(!memcmp(out, reference, TEST_WIDTH * TEST_HEIGHT * 4));
+    }
+    bc_disable_sse = false;
+
+    struct {
+        Texture_Format format;
+        uint channel_mask;
+        int max_error;
+    } targets[] = {
+        { TEXTURE_FORMAT_BC1, 0x7, 12 },
+        { TEXTURE_FORMAT_BC4, 0x1, 4 },
+        { TEXTURE_FORMAT_BC5, 0x3, 4 },
+    };
+    for (auto t = 0; t != sizeof(targets) / sizeof(targets[0]); ++t)
+    {
+        CHECK(can_transcode_super_texture(TEXTURE_FORMAT_BC7_SRGB, targets[t].format));
+        CHECK(transcode_super_texture(&stex.texture, 0, targets[t].format, out));
+        decompress_texture(targets[t].format, out, TEST_WIDTH, TEST_HEIGHT, decoded);
+
+        int max_error = 0;
+        for (auto i = 0; i != TEST_WIDTH * TEST_HEIGHT * 4; ++i)
+        {
+            int error = abs((int)decoded[i] - (int)reference[i]);
+            if ((targets[t].channel_mask >> (i & 3)) & 1)
+                max_error = (error > max_error) ? error : max_error;
+        }
+        if (max_error > targets[t].max_error)
+            LOGF("%s: %d off\n", get_texture_format_name(targets[t].format), max_error);
+        CHECK(max_error <= targets[t].max_error);
+    }
+
+    free(decoded);
+    free(out);
+    free(reference);
+    free_test_stex(&stex);
+}
+
+// BC5 only goes to its red half, RGBA8 and itself.
+static void test_bc5_targets(const uchar *rgba)
+{
+    Test_Stex stex;
+    CHECK(init_test_stex(&stex, TEXTURE_FORMAT_BC5, rgba));
+    CHECK(!can_transcode_super_texture(TEXTURE_FORMAT_BC5, TEXTURE_FORMAT_BC1));
+    CHECK(!can_transcode_super_texture(TEXTURE_FORMAT_BC5, TEXTURE_FORMAT_BC7));
+    CHECK(!can_transcode_super_texture(TEXTURE_FORMAT_BC4, TEXTURE_FORMAT_BC5));
+
+    size_t size = get_texture_level_size(TEXTURE_FORMAT_BC4, TEST_WIDTH, TEST_HEIGHT);
+    uchar *out = (uchar *)malloc(size);
+    CHECK(transcode_super_texture(&stex.texture, 0, TEXTURE_FORMAT_BC4, out));
+    bool red_halves = true;
+    for (size_t b = 0; b != size / 8; ++b)
+        red_halves = red_halves && !memcmp(out + b * 8, stex.blocks[0] + b * 16, 8);
+    CHECK(red_halves);
+
+    free(out);
+    free_test_stex(&stex);
+}
+
+// Broken files get turned away, not read.
+static void test_broken_files(const uchar *rgba)
+{
+    Test_Stex stex;
+    CHECK(init_test_stex(&stex, TEXTURE_FORMAT_BC4, rgba));
+    uchar *out = (uchar *)malloc(get_texture_level_size(TEXTURE_FORMAT_BC4, TEST_WIDTH, TEST_HEIGHT) * 4);
+
+    Super_Texture texture;
+    CHECK(!open_super_texture_memory(&texture, stex.file, sizeof(Stex_Header) - 1, "test"));
+
+    Stex_Header header;
+    memcpy(&header, stex.file, sizeof(header));
+    uchar *copy = (uchar *)malloc(stex.size);
+    memcpy(copy, stex.file, stex.size);
+
+    ((Stex_Header *)copy)->format = TEXTURE_FORMAT_BC3;
+    CHECK(!open_super_texture_memory(&texture, copy, stex.size, "test"));
+
+    memcpy(copy, &header, sizeof(header));
+    ((Stex_Header *)copy)->level_offsets[2] = (uint)stex.size + 1;
+    CHECK(!open_super_texture_memory(&texture, copy, stex.size, "test"));
+
+    // A level cut short decodes to nothing.
+    memcpy(copy, &header, sizeof(header));
+    CHECK(!open_super_texture_memory(&texture, copy, header.level_offsets[1] - 4, "test"));
+    ((Stex_Header *)copy)->level_offsets[1] = header.level_offsets[0] + 8;
+    CHECK(open_super_texture_memory(&texture, copy, stex.size, "test"));
+    CHECK(!transcode_super_texture(&texture, 0, TEXTURE_FORMAT_BC4, out));
+
+    // A format that got past opening (or a zeroed texture) can't be transcoded either.
+    texture = stex.texture;
+    texture.format = TEXTURE_FORMAT_BC3;
+    CHECK(!transcode_super_texture(&texture, 0, TEXTURE_FORMAT_RGBA8, out));
+    CHECK(!transcode_super_texture(&stex.texture, 2, TEXTURE_FORMAT_BC4, out));
+
+    free(copy);
+    free(out);
+    free_test_stex(&stex);
+}
+
+int main()
+{
+    uchar *rgba = make_test_image();
+    test_round_trip(rgba);
+    test_transcode_targets(rgba);
+    test_bc5_targets(rgba);
+    test_broken_files(rgba);
+    free(rgba);
+    return finish_tests("super_texture_test");
+}
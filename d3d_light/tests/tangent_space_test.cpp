@@ -0,0 +1,140 @@
+// Tangent generation (see tangent_space.h).
+#include "test_common.h"
+
+#include "tangent_space.h"
+
+#define TEST_CELLS 100 // 20000 triangles, a few jobs' worth
+
+// A bumpy grid whose U mirrors at its middle column, and whose bottom rows all share one UV so
+//   their triangles have none to speak of.
+static void make_test_mesh(Cpu_Mesh *it)
+{
+    make_test_grid(it, TEST_CELLS, TEST_CELLS, 7);
+    for (auto v = 0; v != it->num_vertices; ++v)
+    {
+        auto vertex = &it->vertices[v];
+        float x = vertex->position[0], y = vertex->position[1];
+        vertex->position[2] = sinf(x * 0.3f) * cosf(y * 0.2f);
+        vertex->texcoord[0] = fabsf(x - TEST_CELLS / 2) / (TEST_CELLS / 2);
+        if (y <= 5.0f)
+            vertex->texcoord[0] = vertex->texcoord[1] = 0.5f;
+        memset(vertex->tangent, 0, sizeof(vertex->tangent));
+    }
+}
+
+// The UV winding of triangle t, TANGENT_ORIENT_*, the way generate_tangents works it out.
+static uint get_test_orient(const Cpu_Mesh *it, uint t)
+{
+    const Vertex *v[3] = { &it->vertices[it->indices[t * 3]], &it->vertices[it->indices[t * 3 + 1]], &it->vertices[it->indices[t * 3 + 2]] };
+    float s1[2] = { v[1]->texcoord[0] - v[0]->texcoord[0], v[1]->texcoord[1] - v[0]->texcoord[1] };
+    float s2[2] = { v[2]->texcoord[0] - v[0]->texcoord[0], v[2]->texcoord[1] - v[0]->texcoord[1] };
+    float signed_area = s1[0] * s2[1] - s1[1] * s2[0];
+    if (fabsf(signed_area) < TANGENT_DEGENERATE_AREA)
+        return TANGENT_ORIENT_ANY;
+    return (signed_area > 0.0f) ? TANGENT_ORIENT_POSITIVE : TANGENT_ORIENT_NEGATIVE;
+}
+
+// Any number of threads writes exactly what one does.
+static void test_thread_counts(const Cpu_Mesh *source)
+{
+    Cpu_Mesh reference;
+    copy_test_mesh(&reference, source);
+    generate_tangents(&reference, 1);
+
+    const uint thread_counts[] = { 2, 3, 8 };
+    for (auto i = 0; i != sizeof(thread_counts) / sizeof(thread_counts[0]); ++i)
+    {
+        Cpu_Mesh mesh;
+        copy_test_mesh(&mesh, source);
+        generate_tangents(&mesh, thread_counts[i]);
+
+        bool same = mesh.num_vertices == reference.num_vertices && mesh.num_indices == reference.num_indices &&
+                    !memcmp(mesh.vertices, reference.vertices, mesh.num_vertices * sizeof(Vertex)) &&
+                    !memcmp(mesh.indices, reference.indices, mesh.num_indices * sizeof(uint));
+        if (!same)
+            LOGF("%u threads differ\n", thread_counts[i]);
+        CHECK(same);
+        free_cpu_mesh(&mesh);
+    }
+    free_cpu_mesh(&reference);
+}
+
+// Vertices used with both windings get a copy, after which every triangle with UVs has corners
+//   whose sign matches its winding. Every sign is +1 or -1 and every tangent is a unit vector
+//   in the normal's plane.
+static void test_mirroring(const Cpu_Mesh *source)
+{
+    uchar *orients = (uchar *)calloc(source->num_vertices, 1);
+    for (auto t = 0; t != source->num_indices / 3; ++t)
+    {
+        uint orient = get_test_orient(source, t);
+        for (auto c = 0; c != 3 && orient != TANGENT_ORIENT_ANY; ++c)
+            orients[source->indices[t * 3 + c]] |= 1 << orient;
+    }
+    uint num_split = 0;
+    for (auto v = 0; v != source->num_vertices; ++v)
+        num_split += (orients[v] == 3);
+    free(orients);
+
+    Cpu_Mesh mesh;
+    copy_test_mesh(&mesh, source);
+    generate_tangents(&mesh, 2);
+    CHECK(num_split >= TEST_CELLS / 2);
+    CHECK(mesh.num_vertices == source->num_vertices + num_split);
+
+    bool signs_match = true, degenerate_seen = false;
+    for (auto t = 0; t != mesh.num_indices / 3; ++t)
+    {
+        uint orient = get_test_orient(&mesh, t);
+        degenerate_seen = degenerate_seen || orient == TANGENT_ORIENT_ANY;
+        for (auto c = 0; c != 3 && orient != TANGENT_ORIENT_ANY; ++c)
+            signs_match = signs_match && mesh.vertices[mesh.indices[t * 3 + c]].tangent[3] == ((orient == TANGENT_ORIENT_POSITIVE) ? 1.0f : -1.0f);
+    }
+    CHECK(signs_match);
+    CHECK(degenerate_seen);
+
+    bool valid = true;
+    for (auto v = 0; v != mesh.num_vertices; ++v)
+    {
+        auto vertex = &mesh.vertices[v];
+        valid = valid && (vertex->tangent[3] == 1.0f || vertex->tangent[3] == -1.0f);
+        valid = valid && fabsf(tangent_dot(vertex->tangent, vertex->tangent) - 1.0f) < 1e-4f;
+        valid = valid && fabsf(tangent_dot(vertex->tangent, vertex->normal)) < 1e-4f;
+    }
+    CHECK(valid);
+
+    // The copies are the vertices they were split from, but for the tangent.
+    bool copies = true;
+    for (auto v = source->num_vertices; v != mesh.num_vertices; ++v)
+        copies = copies && mesh.vertices[v].tangent[3] == -1.0f;
+    CHECK(copies);
+
+    free_cpu_mesh(&mesh);
+}
+
+// A UV layout without any mirroring doesn't split anything.
+static void test_no_mirroring()
+{
+    Cpu_Mesh mesh;
+    make_test_grid(&mesh, 10, 10);
+    uint num_vertices = mesh.num_vertices;
+    generate_tangents(&mesh, 3);
+    CHECK(mesh.num_vertices == num_vertices);
+
+    bool along_u = true;
+    for (auto v = 0; v != mesh.num_vertices; ++v)
+        along_u = along_u && fabsf(mesh.vertices[v].tangent[0] - 1.0f) < 1e-5f && mesh.vertices[v].tangent[3] == 1.0f;
+    CHECK(along_u);
+    free_cpu_mesh(&mesh);
+}
+
+int main()
+{
+    Cpu_Mesh source;
+    make_test_mesh(&source);
+    test_thread_counts(&source);
+    test_mirroring(&source);
+    test_no_mirroring();
+    free_cpu_mesh(&source);
+    return finish_tests("tangent_space_test");
+}
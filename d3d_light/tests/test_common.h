@@ -0,0 +1,108 @@
+#ifndef _TEST_COMMON_H_
+#define _TEST_COMMON_H_
+#include "stdafx.h"
+
+#include <math.h>
+
+#include "mesh_common.h"
+
+/// ============ TESTS ============ ///
+// Every *_test.cpp here is its own program, built and run on Linux by build_tests.sh. They only
+//   include the headers they test, nothing that needs D3D, Assimp or data files.
+// CHECK logs a failure and carries on, so one run shows everything that's broken. main ends
+//   with return finish_tests(), which is non-zero when anything failed.
+
+static uint test_checks;
+static uint test_failures;
+
+#define CHECK(x) do { ++test_checks; if (!(x)) { ++test_failures; LOGF("Check failed: %s\n\tFile: %s\n\tLine: %d\n", #x, __FILE__, __LINE__); } } while (0)
+
+static int finish_tests(const char *name)
+{
+    printf("%s: %u checks, %u failed\n", name, test_checks, test_failures);
+    return test_failures ? 1 : 0;
+}
+
+// xorshift32, so runs are the same everywhere. state must not be 0.
+static uint test_random(uint *state)
+{
+    uint x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+/// ============ TEST MESHES ============ ///
+
+// Grid of cells_x * cells_y quads in the z = 0 plane, from (0, 0) to (cells_x, cells_y), normals
+//   along +z and counter-clockwise seen from there. With seed, triangles come in random order.
+static void make_test_grid(Cpu_Mesh *it, uint cells_x, uint cells_y, uint seed = 0)
+{
+    ZeroThat(it);
+    uint row = cells_x + 1;
+    it->num_vertices = row * (cells_y + 1);
+    it->num_indices = cells_x * cells_y * 6;
+    it->vertices = (Vertex *)calloc(it->num_vertices, sizeof(Vertex));
+    it->indices = (uint *)malloc(it->num_indices * sizeof(uint));
+
+    for (auto y = 0; y != cells_y + 1; ++y)
+    {
+        for (auto x = 0; x != row; ++x)
+        {
+            auto vertex = &it->vertices[y * row + x];
+            vertex->position[0] = (float)x;
+            vertex->position[1] = (float)y;
+            vertex->texcoord[0] = (float)x / (float)cells_x;
+            vertex->texcoord[1] = (float)y / (float)cells_y;
+            vertex->normal[2] = 1.0f;
+            vertex->tangent[0] = vertex->tangent[3] = 1.0f;
+        }
+    }
+
+    uint num_triangles = it->num_indices / 3;
+    uint *order = (uint *)malloc(num_triangles * sizeof(uint));
+    for (auto t = 0; t != num_triangles; ++t)
+        order[t] = t;
+    if (seed)
+    {
+        for (auto t = num_triangles - 1; t > 0; --t)
+        {
+            uint other = test_random(&seed) % (t + 1);
+            uint swap = order[t];
+            order[t] = order[other];
+            order[other] = swap;
+        }
+    }
+
+    for (auto t = 0; t != num_triangles; ++t)
+    {
+        uint cell = order[t] / 2;
+        uint a = (cell / cells_x) * row + cell % cells_x;
+        uint b = a + 1, c = a + row, d = c + 1;
+        uint *tri = &it->indices[t * 3];
+        if (order[t] & 1)
+        {
+            tri[0] = a; tri[1] = b; tri[2] = d;
+        }
+        else
+        {
+            tri[0] = a; tri[1] = d; tri[2] = c;
+        }
+    }
+    free(order);
+}
+
+static void copy_test_mesh(Cpu_Mesh *it, const Cpu_Mesh *source)
+{
+    ZeroThat(it);
+    it->num_vertices = source->num_vertices;
+    it->num_indices = source->num_indices;
+    it->vertices = (Vertex *)malloc(it->num_vertices * sizeof(Vertex));
+    it->indices = (uint *)malloc(it->num_indices * sizeof(uint));
+    memcpy(it->vertices, source->vertices, it->num_vertices * sizeof(Vertex));
+    memcpy(it->indices, source->indices, it->num_indices * sizeof(uint));
+}
+
+#endif
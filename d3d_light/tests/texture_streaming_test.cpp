@@ -0,0 +1,230 @@
+// Texture streaming scheduling against a fake sink (see texture_streaming.h).
+#include "test_common.h"
+
+#include <chrono>
+
+#include "texture_streaming.h"
+
+// 1024 x 1024 BC1: 11 levels, level 4 (64 x 64) starts the tail.
+#define TEST_SIZE       1024
+#define TEST_LEVELS     11
+#define TEST_TAIL       4
+
+// Records every call, in order. fail makes it refuse them, like a failed upload would.
+struct Fake_Sink
+{
+    uint num_calls;
+    uint textures[256];
+    uint levels[256];
+    bool fail;
+};
+
+static bool fake_set_resident_levels(void *user, uint index, const Streamed_Texture *texture, uint first_level)
+{
+    auto it = (Fake_Sink *)user;
+    if (it->fail)
+        return false;
+    if (it->num_calls < 256)
+    {
+        it->textures[it->num_calls] = index;
+        it->levels[it->num_calls] = first_level;
+    }
+    ++it->num_calls;
+    return true;
+}
+
+struct Test_Texture
+{
+    uchar *data;
+    const uchar *levels[TEST_LEVELS];
+};
+
+static void init_test_texture(Test_Texture *it)
+{
+    it->data = (uchar *)calloc(1, 2 * get_texture_level_size(TEXTURE_FORMAT_BC1, TEST_SIZE, TEST_SIZE));
+    size_t offset = 0;
+    for (auto l = 0; l != TEST_LEVELS; ++l)
+    {
+        it->levels[l] = it->data + offset;
+        offset += get_texture_level_size(TEXTURE_FORMAT_BC1, get_mip_dimension(TEST_SIZE, l), get_mip_dimension(TEST_SIZE, l));
+    }
+}
+
+static void init_test_streamer(Texture_Streamer *it, Fake_Sink *sink, size_t budget, Test_Texture *textures, uint num_textures, bool threaded)
+{
+    ZeroThat(sink);
+    Texture_Stream_Sink stream_sink = { sink, fake_set_resident_levels };
+    init_texture_streamer(it, stream_sink, budget, num_textures, threaded);
+    for (auto i = 0; i != num_textures; ++i)
+        add_streamed_texture(it, TEXTURE_FORMAT_BC1, TEST_SIZE, TEST_SIZE, textures[i].levels, TEST_LEVELS);
+}
+
+// Only the tail goes up on add.
+static void test_tail_on_add(Test_Texture *textures)
+{
+    Texture_Streamer streamer;
+    Fake_Sink sink;
+    init_test_streamer(&streamer, &sink, 64u << 20, textures, 1, false);
+
+    auto texture = &streamer.textures[0];
+    CHECK(texture->tail_level == TEST_TAIL);
+    CHECK(texture->resident_level == TEST_TAIL);
+    CHECK(sink.num_calls == 1 && sink.levels[0] == TEST_TAIL);
+    CHECK(streamer.resident_bytes == get_streamed_bytes(texture, TEST_TAIL));
+
+    // Not on screen: nothing past the tail.
+    update_texture_streaming(&streamer);
+    CHECK(sink.num_calls == 1);
+
+    shutdown_texture_streamer(&streamer);
+}
+
+// One level per update, coarse to fine, and the texture biggest on screen goes first.
+static void test_request_order(Test_Texture *textures)
+{
+    Texture_Streamer streamer;
+    Fake_Sink sink;
+    init_test_streamer(&streamer, &sink, 64u << 20, textures, 3, false);
+    uint first_call = sink.num_calls;
+
+    for (auto frame = 0; frame != 20; ++frame)
+    {
+        request_texture_screen_size(&streamer, 0, 100.0f);
+        request_texture_screen_size(&streamer, 1, 2000.0f);
+        request_texture_screen_size(&streamer, 2, 300.0f);
+        update_texture_streaming(&streamer);
+    }
+
+    // Wanted levels: 1024 / 100 -> 3, everything -> 0, 1024 / 300 -> 1.
+    CHECK(streamer.textures[0].resident_level == 3);
+    CHECK(streamer.textures[1].resident_level == 0);
+    CHECK(streamer.textures[2].resident_level == 1);
+
+    uint next_level[3] = { TEST_TAIL - 1, TEST_TAIL - 1, TEST_TAIL - 1 };
+    bool coarse_to_fine = true;
+    for (auto c = first_call; c != sink.num_calls; ++c)
+    {
+        coarse_to_fine = coarse_to_fine && sink.levels[c] == next_level[sink.textures[c]];
+        --next_level[sink.textures[c]];
+    }
+    CHECK(coarse_to_fine);
+
+    // STREAM_MAX_IN_FLIGHT loads per update, handed out by screen size: 1 then 2, then 0.
+    CHECK(sink.textures[first_call] == 1);
+    CHECK(sink.textures[first_call + 1] == 2);
+    CHECK(sink.textures[first_call + 2] == 1);
+    CHECK(sink.textures[first_call + 3] == 2);
+    CHECK(sink.textures[first_call + 4] == 1);
+    CHECK(sink.textures[first_call + 5] == 2);
+    CHECK(sink.textures[first_call + 6] == 1);
+    CHECK(sink.textures[first_call + 7] == 0);
+
+    shutdown_texture_streamer(&streamer);
+}
+
+// The budget goes biggest-first and resident bytes never go past it, also when sizes change.
+static void test_budget_cap(Test_Texture *textures)
+{
+    Texture_Streamer streamer;
+    Fake_Sink sink;
+    init_test_streamer(&streamer, &sink, 0, textures, 2, false);
+
+    // Room for both tails plus levels 1 - 3 of one texture, not for level 0 or a second one.
+    size_t tail = get_streamed_bytes(&streamer.textures[0], TEST_TAIL);
+    size_t level1 = get_streamed_bytes(&streamer.textures[0], 1) - tail;
+    streamer.budget = 2 * tail + level1 + 1000;
+
+    bool within_budget = true;
+    for (auto frame = 0; frame != 20; ++frame)
+    {
+        request_texture_screen_size(&streamer, 0, 600.0f);
+        request_texture_screen_size(&streamer, 1, 2000.0f);
+        update_texture_streaming(&streamer);
+        within_budget = within_budget && streamer.resident_bytes <= streamer.budget;
+    }
+    CHECK(within_budget);
+    CHECK(streamer.textures[1].allowed_level == 1);
+    CHECK(streamer.textures[1].resident_level == 1);
+    CHECK(streamer.textures[0].resident_level == TEST_TAIL);
+
+    // Swap sizes: 1 gets evicted before 0 streams in.
+    for (auto frame = 0; frame != 20; ++frame)
+    {
+        request_texture_screen_size(&streamer, 0, 2000.0f);
+        request_texture_screen_size(&streamer, 1, 600.0f);
+        update_texture_streaming(&streamer);
+        within_budget = within_budget && streamer.resident_bytes <= streamer.budget;
+    }
+    CHECK(within_budget);
+    CHECK(streamer.textures[0].resident_level == 1);
+    CHECK(streamer.textures[1].resident_level == TEST_TAIL);
+    CHECK(streamer.resident_bytes == 2 * tail + level1);
+
+    shutdown_texture_streamer(&streamer);
+}
+
+// With the loader thread, a level becomes resident on the update after its load finished, and
+//   only if the sink took it.
+static void test_residency_after_upload(Test_Texture *textures)
+{
+    Texture_Streamer streamer;
+    Fake_Sink sink;
+    init_test_streamer(&streamer, &sink, 64u << 20, textures, 1, true);
+    auto texture = &streamer.textures[0];
+    size_t tail_bytes = streamer.resident_bytes;
+
+    request_texture_screen_size(&streamer, 0, 2000.0f);
+    update_texture_streaming(&streamer);
+    CHECK(texture->pending_level == TEST_TAIL - 1);
+    CHECK(texture->resident_level == TEST_TAIL);
+    CHECK(streamer.resident_bytes == tail_bytes);
+    CHECK(sink.num_calls == 1);
+
+    auto wait_for_load = [&streamer]() {
+        for (auto i = 0; i != 1000; ++i)
+        {
+            {
+                std::lock_guard<std::mutex> lock(streamer.loader->mutex);
+                if (streamer.loader->num_done)
+                    return true;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return false;
+    };
+
+    // Upload refused: still at the tail, and the level gets asked for again.
+    CHECK(wait_for_load());
+    sink.fail = true;
+    request_texture_screen_size(&streamer, 0, 2000.0f);
+    update_texture_streaming(&streamer);
+    CHECK(texture->resident_level == TEST_TAIL);
+    CHECK(streamer.resident_bytes == tail_bytes);
+    CHECK(texture->pending_level == TEST_TAIL - 1);
+
+    CHECK(wait_for_load());
+    sink.fail = false;
+    request_texture_screen_size(&streamer, 0, 2000.0f);
+    update_texture_streaming(&streamer);
+    CHECK(texture->resident_level == TEST_TAIL - 1);
+    CHECK(streamer.resident_bytes == get_streamed_bytes(texture, TEST_TAIL - 1));
+    CHECK(sink.num_calls == 2 && sink.levels[1] == TEST_TAIL - 1);
+
+    shutdown_texture_streamer(&streamer);
+}
+
+int main()
+{
+    Test_Texture textures[3];
+    for (auto i = 0; i != 3; ++i)
+        init_test_texture(&textures[i]);
+
+    test_tail_on_add(textures);
+    test_request_order(textures);
+    test_budget_cap(textures);
+    test_residency_after_upload(textures);
+
+    for (auto i = 0; i != 3; ++i)
+        free(textures[i].data);
+    return finish_tests("texture_streaming_test");
+}
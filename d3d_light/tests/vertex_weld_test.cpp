@@ -0,0 +1,120 @@
+// Vertex welding and the vertex fetch order (see vertex_weld.h).
+#include "test_common.h"
+
+#include "vertex_weld.h"
+
+#define TEST_CELLS 20
+
+// A vertex per triangle corner, the way Assimp hands some meshes over. noise moves every
+//   position and texcoord by up to that much.
+static void make_corner_mesh(Cpu_Mesh *it, const Cpu_Mesh *source, float noise)
+{
+    ZeroThat(it);
+    it->num_vertices = it->num_indices = source->num_indices;
+    it->vertices = (Vertex *)malloc(it->num_vertices * sizeof(Vertex));
+    it->indices = (uint *)malloc(it->num_indices * sizeof(uint));
+
+    uint seed = 13;
+    for (auto i = 0; i != source->num_indices; ++i)
+    {
+        it->vertices[i] = source->vertices[source->indices[i]];
+        it->indices[i] = i;
+        float *floats[5] = { &it->vertices[i].position[0], &it->vertices[i].position[1], &it->vertices[i].position[2],
+                             &it->vertices[i].texcoord[0], &it->vertices[i].texcoord[1] };
+        for (auto k = 0; k != 5; ++k)
+            *floats[k] += noise * ((float)(test_random(&seed) % 2001) / 1000.0f - 1.0f);
+    }
+}
+
+// Every triangle lands on the same positions as in the source, give or take tolerance.
+static bool has_same_triangles(const Cpu_Mesh *it, const Cpu_Mesh *source, float tolerance)
+{
+    if (it->num_indices != source->num_indices)
+        return false;
+    for (auto i = 0; i != it->num_indices; ++i)
+    {
+        if (it->indices[i] >= it->num_vertices)
+            return false;
+        auto a = it->vertices[it->indices[i]].position;
+        auto b = source->vertices[source->indices[i]].position;
+        for (auto k = 0; k != 3; ++k)
+            if (fabsf(a[k] - b[k]) > tolerance)
+                return false;
+    }
+    return true;
+}
+
+// Vertices are numbered in the order the indices first use them.
+static bool is_first_use_order(const Cpu_Mesh *it)
+{
+    uint next = 0;
+    for (auto i = 0; i != it->num_indices; ++i)
+    {
+        if (it->indices[i] > next)
+            return false;
+        if (it->indices[i] == next)
+            ++next;
+    }
+    return next == it->num_vertices;
+}
+
+static void test_exact_weld(const Cpu_Mesh *grid)
+{
+    Cpu_Mesh mesh;
+    make_corner_mesh(&mesh, grid, 0.0f);
+    uint removed = weld_vertices(&mesh);
+    CHECK(mesh.num_vertices == grid->num_vertices);
+    CHECK(removed == grid->num_indices - grid->num_vertices);
+    CHECK(has_same_triangles(&mesh, grid, 0.0f));
+    CHECK(is_first_use_order(&mesh));
+
+    // Welding again finds nothing.
+    CHECK(weld_vertices(&mesh) == 0);
+    free_cpu_mesh(&mesh);
+
+    // Bit-exact means noise keeps everything apart.
+    make_corner_mesh(&mesh, grid, 1e-4f);
+    CHECK(weld_vertices(&mesh) == 0);
+    free_cpu_mesh(&mesh);
+}
+
+// Noise well inside a cell welds away, the triangles move by at most that noise.
+static void test_epsilon_weld(const Cpu_Mesh *grid)
+{
+    const float epsilon = 1e-3f, noise = 2e-4f;
+    Cpu_Mesh mesh;
+    make_corner_mesh(&mesh, grid, noise);
+    weld_vertices(&mesh, epsilon);
+    CHECK(mesh.num_vertices == grid->num_vertices);
+    CHECK(has_same_triangles(&mesh, grid, 2.0f * noise));
+    CHECK(is_first_use_order(&mesh));
+    free_cpu_mesh(&mesh);
+}
+
+// Reordering for fetch keeps the triangles, numbers vertices by first use and drops unused ones.
+static void test_fetch_order(const Cpu_Mesh *grid)
+{
+    Cpu_Mesh mesh;
+    copy_test_mesh(&mesh, grid);
+    mesh.vertices = (Vertex *)realloc(mesh.vertices, (mesh.num_vertices + 1) * sizeof(Vertex));
+    ZeroThat(&mesh.vertices[mesh.num_vertices]);
+    ++mesh.num_vertices;
+    CHECK(!is_first_use_order(&mesh));
+
+    optimize_vertex_fetch(&mesh);
+    CHECK(mesh.num_vertices == grid->num_vertices);
+    CHECK(has_same_triangles(&mesh, grid, 0.0f));
+    CHECK(is_first_use_order(&mesh));
+    free_cpu_mesh(&mesh);
+}
+
+int main()
+{
+    Cpu_Mesh grid;
+    make_test_grid(&grid, TEST_CELLS, TEST_CELLS, 3);
+    test_exact_weld(&grid);
+    test_epsilon_weld(&grid);
+    test_fetch_order(&grid);
+    free_cpu_mesh(&grid);
+    return finish_tests("vertex_weld_test");
+}
@@ -74,8 +74,8 @@ void Application::Run()
     auto vs = pipeline.vs_storage.Append();
     auto ps = pipeline.ps_storage.Append();
     auto material = pipeline.material_storage.Append();
-    vbo->Create(dx_device, vertices, sizeof(Vertex), 24);
-    ibo->Create(dx_device, indices, 36);
+    vbo->Create(dx_device, vertices, sizeof(Vertex), 24, "cube");
+    ibo->CreateCompact(dx_device, indices, 36, 24, "cube");
     vs->Compile(dx_device, "src\\shaders\\static.hlsl");
     ps->Compile(dx_device, "src\\shaders\\lit.hlsl");
     material->ps = ps;
@@ -227,6 +227,7 @@ Application::Application()
     /// D3D
     auto feature_level = D3D_FEATURE_LEVEL_11_0;
     ASSERT(!FAILED(D3D11CreateDevice(dx_adapter, D3D_DRIVER_TYPE_UNKNOWN, nullptr, D3D11_CREATE_DEVICE_DEBUG, &feature_level, 1, D3D11_SDK_VERSION, &dx_device, nullptr, &dx_con)));
+    init_gpu_budget(&gpu_budget);
     
     DXGI_SWAP_CHAIN_DESC1 sc_desc;
     ZeroThat(&sc_desc);
@@ -279,6 +280,9 @@ Application::~Application()
     dx_adapter->Release();
     dx_factory->Release();
 
+    dump_gpu_budget(&gpu_budget);
+    free_gpu_budget(&gpu_budget);
+
     IDXGIDebug1 *dxgi_debug;
     DXGIGetDebugInterface1(0, IID_PPV_ARGS(&dxgi_debug));
     dxgi_debug->ReportLiveObjects(DXGI_DEBUG_ALL, DXGI_DEBUG_RLO_ALL);
@@ -3,8 +3,10 @@
 #include <d3dcompiler.h>
 #include <d3d11shader.h>
 
+Gpu_Budget gpu_budget;
+
 ////////////////////////////////////////////////
-bool DxVertexBuffer::Create(ID3D11Device *device, void *data, uint element_stride, uint num_elements)
+bool DxVertexBuffer::Create(ID3D11Device *device, void *data, uint element_stride, uint num_elements, const char *asset)
 {
     D3D11_BUFFER_DESC bd;
     D3D11_SUBRESOURCE_DATA sd;
@@ -15,10 +17,14 @@ bool DxVertexBuffer::Create(ID3D11Device *device, void *data, uint element_strid
     bd.ByteWidth = element_stride * num_elements;
     sd.pSysMem = data;
 
+    if (!reserve_gpu_memory(&gpu_budget, bd.ByteWidth))
+        return false;
+
     if (FAILED(device->CreateBuffer(&bd, &sd, &m_handle))) {
         LOGF("Failed: %p, %d, %d\n", data, element_stride, num_elements);
         return false;
     }
+    track_gpu_resource(&gpu_budget, m_handle, GPU_RESOURCE_VERTEX_BUFFER, bd.ByteWidth, asset);
 
     m_element_stride = element_stride;
     m_num_elements = num_elements;
@@ -29,36 +35,60 @@ bool DxVertexBuffer::Create(ID3D11Device *device, void *data, uint element_strid
 void DxVertexBuffer::Release()
 {
     if (m_handle) {
+        untrack_gpu_resource(&gpu_budget, m_handle);
         m_handle->Release();
         ZeroThat(this);
     }
 }
 
 
-bool DxIndexBuffer::Create(ID3D11Device *device, void *data, uint num_elements)
+bool DxIndexBuffer::Create(ID3D11Device *device, void *data, uint num_elements, uint element_stride, const char *asset)
 {
     D3D11_BUFFER_DESC bd;
     D3D11_SUBRESOURCE_DATA sd;
     ZeroThat(&bd);
     ZeroThat(&sd);
 
+    ASSERT(element_stride == sizeof(uint16_t) || element_stride == sizeof(uint));
+
     bd.BindFlags = D3D11_BIND_INDEX_BUFFER;
-    bd.ByteWidth = sizeof(uint) * num_elements;
+    bd.ByteWidth = element_stride * num_elements;
     sd.pSysMem = data;
 
+    if (!reserve_gpu_memory(&gpu_budget, bd.ByteWidth))
+        return false;
+
     if (FAILED(device->CreateBuffer(&bd, &sd, &m_handle))) {
-        LOGF("Failed: %p, %d\n", data, num_elements);
+        LOGF("Failed: %p, %d, %d\n", data, num_elements, element_stride);
         return false;
     }
+    track_gpu_resource(&gpu_budget, m_handle, GPU_RESOURCE_INDEX_BUFFER, bd.ByteWidth, asset);
 
     m_num_elements = num_elements;
+    m_format = (element_stride == sizeof(uint16_t)) ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
 
     return true;
 }
 
+bool DxIndexBuffer::CreateCompact(ID3D11Device *device, uint *indices, uint num_elements, uint num_vertices, const char *asset)
+{
+    // 0xFFFF stays unused so it can never be read as a strip cut.
+    if (num_vertices > 0xFFFF)
+        return Create(device, indices, num_elements, sizeof(uint), asset);
+
+    auto narrow = (uint16_t *)malloc(num_elements * sizeof(uint16_t));
+    for (auto i = 0; i != num_elements; ++i)
+        narrow[i] = (uint16_t)indices[i];
+
+    auto result = Create(device, narrow, num_elements, sizeof(uint16_t), asset);
+    free(narrow);
+    return result;
+}
+
 void DxIndexBuffer::Release()
 {
     if (m_handle) {
+        untrack_gpu_resource(&gpu_budget, m_handle);
         m_handle->Release();
         ZeroThat(this);
     }
@@ -79,8 +109,10 @@ DxVertexShader::~DxVertexShader()
 
         if (m_num_cbuffers)
         {
-            for (auto i = 0; i != m_num_cbuffers; ++i)
+            for (auto i = 0; i != m_num_cbuffers; ++i) {
+                untrack_gpu_resource(&gpu_budget, m_cbuffer_handles[i]);
                 m_cbuffer_handles[i]->Release();
+            }
             free(m_cbuffer_handles);
         }
 
@@ -88,7 +120,7 @@ DxVertexShader::~DxVertexShader()
     }
 }
 
-bool DxVertexShader::Create(ID3D11Device *device, void *bc, size_t bc_size)
+bool DxVertexShader::Create(ID3D11Device *device, void *bc, size_t bc_size, const char *asset)
 {
     ID3D11ShaderReflection *reflector;
     D3D11_SHADER_DESC sd;
@@ -185,6 +217,7 @@ bool DxVertexShader::Create(ID3D11Device *device, void *bc, size_t bc_size)
             bd.Usage = D3D11_USAGE_DYNAMIC;
 
             device->CreateBuffer(&bd, nullptr, &m_cbuffer_handles[i]);
+            track_gpu_resource(&gpu_budget, m_cbuffer_handles[i], GPU_RESOURCE_CONSTANT_BUFFER, bd.ByteWidth, asset);
             m_cbuffers[i].size = cbuffer_desc[i].Size;
             m_cbuffers[i].data = temp;
             memset(m_cbuffers[i].data, 0, m_cbuffers[i].size);
@@ -226,7 +259,7 @@ bool DxVertexShader::Compile(ID3D11Device *device, char *path)
     }
 
     free(buffer);
-    auto result = this->Create(device, source_blob->GetBufferPointer(), source_blob->GetBufferSize());
+    auto result = this->Create(device, source_blob->GetBufferPointer(), source_blob->GetBufferSize(), path);
     source_blob->Release();
 
     return result;
@@ -244,8 +277,10 @@ DxPixelShader::~DxPixelShader() {
         m_handle->Release();
 
         if (m_num_cbuffers) {
-            for (auto i = 0; i != m_num_cbuffers; ++i)
+            for (auto i = 0; i != m_num_cbuffers; ++i) {
+                untrack_gpu_resource(&gpu_budget, m_cbuffer_handles[i]);
                 m_cbuffer_handles[i]->Release();
+            }
             free(m_cbuffer_handles);
         }
 
@@ -253,7 +288,7 @@ DxPixelShader::~DxPixelShader() {
     }
 }
 
-bool DxPixelShader::Create(ID3D11Device *device, void *bc, size_t bc_size)
+bool DxPixelShader::Create(ID3D11Device *device, void *bc, size_t bc_size, const char *asset)
 {
     ID3D11ShaderReflection *reflector;
     D3D11_SHADER_DESC sd;
@@ -292,6 +327,7 @@ bool DxPixelShader::Create(ID3D11Device *device, void *bc, size_t bc_size)
             bd.Usage = D3D11_USAGE_DYNAMIC;
 
             device->CreateBuffer(&bd, nullptr, &m_cbuffer_handles[i]);
+            track_gpu_resource(&gpu_budget, m_cbuffer_handles[i], GPU_RESOURCE_CONSTANT_BUFFER, bd.ByteWidth, asset);
             m_cbuffers[i].size = cbuffer_desc[i].Size;
             m_cbuffers[i].data = temp;
             memset(m_cbuffers[i].data, 0, m_cbuffers[i].size);
@@ -333,7 +369,7 @@ bool DxPixelShader::Compile(ID3D11Device *device, char *path)
     }
 
     free(buffer);
-    auto result = this->Create(device, source_blob->GetBufferPointer(), source_blob->GetBufferSize());
+    auto result = this->Create(device, source_blob->GetBufferPointer(), source_blob->GetBufferSize(), path);
     source_blob->Release();
 
     return result;
@@ -346,6 +382,7 @@ void DxPixelShader::Release()
 
         if (m_num_cbuffers) {
             for (auto i = 0; i != m_num_cbuffers; ++i) {
+                untrack_gpu_resource(&gpu_budget, m_cbuffer_handles[i]);
                 m_cbuffer_handles[i]->Release();
             }
             free(m_cbuffer_handles);
@@ -356,13 +393,39 @@ void DxPixelShader::Release()
 }
 
 ////////////////////////////////////////////////
-bool DxImage::Create(ID3D11Device *device, void *data, uint width, uint height, DxImageType type)
+static bool IsBlockCompressed(DXGI_FORMAT format)
+{
+    return (format >= DXGI_FORMAT_BC1_TYPELESS && format <= DXGI_FORMAT_BC5_SNORM) ||
+           (format >= DXGI_FORMAT_BC6H_TYPELESS && format <= DXGI_FORMAT_BC7_UNORM_SRGB);
+}
+
+// Bytes per row of pixels, or per row of 4x4 blocks for BC formats.
+static uint GetImageRowPitch(DXGI_FORMAT format, uint width)
+{
+    switch (format) {
+        case DXGI_FORMAT_BC1_UNORM:
+        case DXGI_FORMAT_BC1_UNORM_SRGB:
+        case DXGI_FORMAT_BC4_UNORM:
+            return ((width + 3) / 4) * 8;
+        case DXGI_FORMAT_BC3_UNORM:
+        case DXGI_FORMAT_BC3_UNORM_SRGB:
+        case DXGI_FORMAT_BC5_UNORM:
+        case DXGI_FORMAT_BC7_UNORM:
+        case DXGI_FORMAT_BC7_UNORM_SRGB:
+            return ((width + 3) / 4) * 16;
+        default:
+            return 4 * width;
+    }
+}
+
+bool DxImage::Create(ID3D11Device *device, void *data, uint width, uint height, DxImageType type, DXGI_FORMAT format, uint num_levels, const char *asset)
 {
     D3D11_TEXTURE2D_DESC td;
-    D3D11_SUBRESOURCE_DATA sd;
-    D3D11_SUBRESOURCE_DATA *psd = &sd;
+    D3D11_SUBRESOURCE_DATA sd[16];
+    D3D11_SUBRESOURCE_DATA *psd = sd;
     ZeroThat(&td);
     ZeroThat(&sd);
+    ASSERT(num_levels && num_levels <= ARRAYSIZE(sd));
 
     switch (type) {
         case DxImageType_ShaderResource: 
@@ -379,22 +442,43 @@ bool DxImage::Create(ID3D11Device *device, void *data, uint width, uint height,
             break;
     }
 
+    if (format != DXGI_FORMAT_UNKNOWN)
+        td.Format = format;
+
     td.ArraySize = 1;
-    td.MipLevels = 1;
+    td.MipLevels = num_levels;
     td.SampleDesc.Count = 1;
     td.Width = width;
     td.Height = height;
     
-    sd.pSysMem = data;
-    sd.SysMemPitch = sizeof(float) * width;
+    uchar *level_data = (uchar *)data;
+    size_t bytes = 0;
+    for (uint i = 0; i != num_levels; ++i) {
+        uint level_width = (width >> i) ? (width >> i) : 1;
+        uint level_height = (height >> i) ? (height >> i) : 1;
+        uint level_rows = IsBlockCompressed(td.Format) ? (level_height + 3) / 4 : level_height;
+        sd[i].pSysMem = level_data + bytes;
+        sd[i].SysMemPitch = GetImageRowPitch(td.Format, level_width);
+        bytes += (size_t)sd[i].SysMemPitch * level_rows;
+    }
     if (!data)
         psd = nullptr;
 
+    if (!reserve_gpu_memory(&gpu_budget, bytes))
+        return false;
+
     if (FAILED(device->CreateTexture2D(&td, psd, &m_handle))) {
         LOGF("Failed: %p, %dx%d, %d\n", data, width, height, type);
         return false;
     }
 
+    Gpu_Resource_Kind kind = GPU_RESOURCE_TEXTURE;
+    if (type == DxImageType_RenderTarget)
+        kind = GPU_RESOURCE_RENDER_TARGET;
+    else if (type == DxImageType_DepthStencil)
+        kind = GPU_RESOURCE_DEPTH_STENCIL;
+    track_gpu_resource(&gpu_budget, m_handle, kind, bytes, asset);
+
     m_size[0] = width;
     m_size[1] = height;
     m_type = type;
@@ -437,6 +521,7 @@ void *DxImage::CreateView(ID3D11Device *device, DxImageType type)
 void DxImage::Release()
 {
     if (m_handle) {
+        untrack_gpu_resource(&gpu_budget, m_handle);
         m_handle->Release();
         ZeroThat(this);
     }
@@ -2,6 +2,12 @@
 #define _DX_TYPES_H_
 #include "pch.h"
 #include <d3d11.h>
+#include "../../d3d_light/src/gpu_budget.h"
+
+////////////////// MEMORY //////////////////
+// Every Create below reports what it allocates into this, under asset, and its Release takes it
+//   back out. Application sets it up with the device and dumps it at shutdown.
+extern Gpu_Budget gpu_budget;
 
 ////////////////// BUFFERS //////////////////
 struct DxVertexBuffer 
@@ -14,7 +20,7 @@ struct DxVertexBuffer
     DxVertexBuffer() { ZeroThat(this); }
     ~DxVertexBuffer() { Release(); }
 
-    bool Create(ID3D11Device *device, void *data, uint element_stride, uint num_elements);
+    bool Create(ID3D11Device *device, void *data, uint element_stride, uint num_elements, const char *asset = nullptr);
     void Release();
 
     __forceinline DxVertexBuffer *Bind(ID3D11DeviceContext *con) {
@@ -27,15 +33,18 @@ struct DxIndexBuffer
 {
     ID3D11Buffer *m_handle;
     uint m_num_elements;
+    DXGI_FORMAT m_format;
 
     DxIndexBuffer() { ZeroThat(this); }
     ~DxIndexBuffer() { Release(); }
 
-    bool Create(ID3D11Device *device, void *data, uint num_elements);
+    bool Create(ID3D11Device *device, void *data, uint num_elements, uint element_stride = sizeof(uint), const char *asset = nullptr);
+    // Narrows 32-bit indices to 16-bit when num_vertices allows it.
+    bool CreateCompact(ID3D11Device *device, uint *indices, uint num_elements, uint num_vertices, const char *asset = nullptr);
     void Release();
 
     __forceinline DxIndexBuffer *Bind(ID3D11DeviceContext *con) {
-        con->IASetIndexBuffer(m_handle, DXGI_FORMAT_R32_UINT, 0);
+        con->IASetIndexBuffer(m_handle, m_format, 0);
         return this;
     }
 };
@@ -58,7 +67,7 @@ struct DxVertexShader
     DxVertexShader();
     ~DxVertexShader();
 
-    bool Create(ID3D11Device *device, void *bc, size_t bc_size);
+    bool Create(ID3D11Device *device, void *bc, size_t bc_size, const char *asset = nullptr);
     bool Compile(ID3D11Device *device, char *path);
 
     __forceinline DxVertexShader *UpdateAllCBuffers(ID3D11DeviceContext *con) {   
@@ -94,7 +103,7 @@ struct DxPixelShader
     DxPixelShader();
     ~DxPixelShader();
 
-    bool Create(ID3D11Device *device, void *bc, size_t bc_size);
+    bool Create(ID3D11Device *device, void *bc, size_t bc_size, const char *asset = nullptr);
     bool Compile(ID3D11Device *device, char *path);
     void Release();
 
@@ -139,7 +148,9 @@ struct DxImage
     DxImage() { ZeroThat(this); }
     ~DxImage() { Release(); }
 
-    bool Create(ID3D11Device *device, void *data, uint width, uint height, DxImageType type);
+    // format overrides the type's default one, block compressed formats are only valid as shader resources.
+    // data holds num_levels mips back to back, largest first.
+    bool Create(ID3D11Device *device, void *data, uint width, uint height, DxImageType type, DXGI_FORMAT format = DXGI_FORMAT_UNKNOWN, uint num_levels = 1, const char *asset = nullptr);
     void *CreateView(ID3D11Device *device, DxImageType type);
     void Release();
 };